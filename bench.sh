@@ -0,0 +1,77 @@
+#!/bin/sh
+# Boot an image built with -DBOOT_BENCHMARK headless, from floppy and from
+# hard disk, and report min/median/p99 boot latency over a number of runs.
+# Usage: bench.sh IMAGE [RUNS] [extra qemu arguments]
+
+IMAGE=${1:?usage: bench.sh IMAGE [RUNS] [qemu arguments]}
+RUNS=${2:-20}
+shift
+[ $# -gt 0 ] && shift
+
+# The kernel writes BOOT_EXIT_SUCCESS (0x10) to isa-debug-exit
+EXIT_SUCCESS=33
+TIMEOUT=60
+
+RESULTS=$(mktemp -d)
+trap 'rm -rf "$RESULTS"' EXIT
+
+now_us() {
+    echo $(($(date +%s%N) / 1000))
+}
+
+# min/median/p99 of the numbers in a file
+summarize() {
+    sort -n "$1" | awk -v name="$2" '
+        { values[NR] = $1 }
+        END {
+            if (NR == 0) exit
+            median = values[int((NR + 1) / 2)]
+            p99 = int(NR * 0.99 + 0.999)
+            printf "  %-14s min %9d  median %9d  p99 %9d us\n",
+                   name, values[1], median, values[p99]
+        }'
+}
+
+bench_media() {
+    label=$1
+    shift
+    dir=$RESULTS/$label
+    mkdir -p "$dir"
+    failures=0
+
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        start=$(now_us)
+        timeout $TIMEOUT qemu-system-i386 -display none -serial stdio \
+            -no-reboot -device isa-debug-exit,iobase=0xf4,iosize=0x04 \
+            "$@" $QEMU_EXTRA_ARGS > "$dir/log" 2>&1
+        status=$?
+        end=$(now_us)
+
+        if [ $status -ne $EXIT_SUCCESS ]; then
+            failures=$((failures + 1))
+        else
+            echo $((end - start)) >> "$dir/wall"
+            tr -d '\r' < "$dir/log" | awk -v dir="$dir" \
+                '$1 == "boot:" && $4 == "us" { print $3 >> (dir "/" $2) }'
+        fi
+        i=$((i + 1))
+    done
+
+    echo "$label: $RUNS runs, $failures failed"
+    summarize "$dir/wall" "qemu-wall"
+    for phase in stage2-entry stage2-image stage2-disk kernel-loaded \
+                 kernel-entry interrupts smp devices done; do
+        [ -f "$dir/$phase" ] && summarize "$dir/$phase" "$phase"
+    done
+
+    [ $failures -eq 0 ]
+}
+
+QEMU_EXTRA_ARGS="$*"
+status=0
+bench_media floppy -drive file="$IMAGE",if=floppy,format=raw,snapshot=on \
+    || status=1
+bench_media hdd -drive file="$IMAGE",if=ide,format=raw,snapshot=on -boot c \
+    || status=1
+exit $status
@@ -0,0 +1,116 @@
+// Pack files into a boot module archive, see src/libs/boot/archive.h.
+//
+//   mkarchive OUTPUT FILE...
+//
+// Modules are named after the last path component of FILE.
+#include <boot/archive.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t Align(uint32_t value) {
+  return (value + BOOT_ARCHIVE_ALIGNMENT - 1) &
+         ~(uint32_t)(BOOT_ARCHIVE_ALIGNMENT - 1);
+}
+
+static uint8_t *ReadFile(const char *path, uint32_t *size_out) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "mkarchive: cannot open %s\n", path);
+    return NULL;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  uint8_t *data = malloc(size > 0 ? size : 1);
+  if (data == NULL || fread(data, 1, size, file) != (size_t)size) {
+    fprintf(stderr, "mkarchive: cannot read %s\n", path);
+    free(data);
+    fclose(file);
+    return NULL;
+  }
+
+  fclose(file);
+  *size_out = size;
+  return data;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s OUTPUT FILE...\n", argv[0]);
+    return 2;
+  }
+
+  uint32_t count = argc - 2;
+  BootArchiveEntry *entries = calloc(count + 1, sizeof(BootArchiveEntry));
+  uint8_t **contents = calloc(count + 1, sizeof(uint8_t *));
+  uint32_t offset = Align(sizeof(BootArchiveHeader) +
+                          count * sizeof(BootArchiveEntry));
+  int status = 0;
+
+  for (uint32_t i = 0; i < count && status == 0; i++) {
+    const char *path = argv[i + 2];
+    const char *name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    if (strlen(name) >= BOOT_ARCHIVE_NAME_SIZE) {
+      fprintf(stderr, "mkarchive: name too long: %s\n", name);
+      status = 1;
+      break;
+    }
+
+    contents[i] = ReadFile(path, &entries[i].size);
+    if (contents[i] == NULL) {
+      status = 1;
+      break;
+    }
+
+    strcpy(entries[i].name, name);
+    entries[i].offset = offset;
+    offset = Align(offset + entries[i].size);
+  }
+
+  BootArchiveHeader header = {
+      .magic = BOOT_ARCHIVE_MAGIC,
+      .version = BOOT_ARCHIVE_VERSION,
+      .entry_count = count,
+      .size = sizeof(BootArchiveHeader),
+  };
+
+  // The last module is not padded, the archive ends with its data
+  if (count > 0) {
+    header.size = entries[count - 1].offset + entries[count - 1].size;
+  }
+
+  FILE *output = status == 0 ? fopen(argv[1], "wb") : NULL;
+  if (status == 0 && output == NULL) {
+    fprintf(stderr, "mkarchive: cannot create %s\n", argv[1]);
+    status = 1;
+  }
+
+  if (status == 0) {
+    static const uint8_t kPadding[BOOT_ARCHIVE_ALIGNMENT];
+    uint32_t position = sizeof(header) + count * sizeof(BootArchiveEntry);
+    fwrite(&header, sizeof(header), 1, output);
+    fwrite(entries, sizeof(BootArchiveEntry), count, output);
+
+    for (uint32_t i = 0; i < count; i++) {
+      fwrite(kPadding, 1, entries[i].offset - position, output);
+      fwrite(contents[i], 1, entries[i].size, output);
+      position = entries[i].offset + entries[i].size;
+    }
+
+    if (fclose(output) != 0) {
+      fprintf(stderr, "mkarchive: cannot write %s\n", argv[1]);
+      status = 1;
+    }
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    free(contents[i]);
+  }
+  free(contents);
+  free(entries);
+  return status;
+}
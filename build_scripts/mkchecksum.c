@@ -0,0 +1,67 @@
+// Append a CRC32C trailer to a file stage2 loads, see
+// src/libs/boot/checksum.h.
+//
+//   mkchecksum INPUT OUTPUT
+#include <boot/checksum.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Bit at a time, nothing shared with the stage2 implementation it checks
+static uint32_t CRC32C(const uint8_t *data, long size) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (long i = 0; i < size; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
+    }
+  }
+  return ~crc;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s INPUT OUTPUT\n", argv[0]);
+    return 2;
+  }
+
+  FILE *input = fopen(argv[1], "rb");
+  if (input == NULL) {
+    fprintf(stderr, "mkchecksum: cannot open %s\n", argv[1]);
+    return 1;
+  }
+  fseek(input, 0, SEEK_END);
+  long size = ftell(input);
+  fseek(input, 0, SEEK_SET);
+
+  uint8_t *data = malloc(size > 0 ? size : 1);
+  if (data == NULL || fread(data, 1, size, input) != (size_t)size) {
+    fprintf(stderr, "mkchecksum: cannot read %s\n", argv[1]);
+    free(data);
+    fclose(input);
+    return 1;
+  }
+  fclose(input);
+
+  BootChecksum trailer = {
+      .magic = BOOT_CHECKSUM_MAGIC,
+      .crc32c = CRC32C(data, size),
+  };
+
+  int status = 0;
+  FILE *output = fopen(argv[2], "wb");
+  if (output == NULL) {
+    fprintf(stderr, "mkchecksum: cannot create %s\n", argv[2]);
+    status = 1;
+  } else {
+    fwrite(data, 1, size, output);
+    fwrite(&trailer, sizeof(trailer), 1, output);
+    if (fclose(output) != 0) {
+      fprintf(stderr, "mkchecksum: cannot write %s\n", argv[2]);
+      status = 1;
+    }
+  }
+
+  free(data);
+  return status;
+}
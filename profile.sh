@@ -0,0 +1,140 @@
+#!/bin/sh
+# Symbolize the samples a kernel built with -DPROFILE dumps on the serial port
+# and print them as folded stacks, one "outer;...;inner count" line per
+# distinct stack, ready for flamegraph.pl.
+# Usage: profile.sh MAP [LOG]
+#
+# MAP is the kernel.map written by the kernel link, LOG the serial output
+# (standard input if omitted). The kernel is compiled with -ffunction-sections,
+# so static functions show up in the map as .text.<name> input sections.
+
+MAP=${1:?usage: profile.sh MAP [LOG]}
+LOG=${2:-/dev/stdin}
+
+SYMBOLS=$(mktemp)
+trap 'rm -f "$SYMBOLS"' EXIT
+
+# "address size name" for every function section and global code symbol,
+# addresses in decimal so sort -n can order them
+awk '
+function hex(s,    i, v) {
+    s = tolower(s)
+    sub(/^0x/, "", s)
+    v = 0
+    for (i = 1; i <= length(s); i++) {
+        v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+    }
+    return v
+}
+
+function section(name, address, size) {
+    if (size == 0) {
+        return
+    }
+    in_code = 1
+    end = address + size
+    if (name ~ /^\.text\./) {
+        sub(/^\.text\.(unlikely\.|startup\.|hot\.)?/, "", name)
+        print address, size, name
+    }
+}
+
+/^Linker script and memory map/ { started = 1; next }
+!started { next }
+
+# Section name on its own line when it is too long, the numbers follow
+pending != "" {
+    if ($1 ~ /^0x/) {
+        section(pending, hex($1), hex($2))
+    }
+    pending = ""
+    next
+}
+
+/^ \.(text|entry)/ {
+    if (NF == 1) {
+        pending = $1
+    } else {
+        section($1, hex($2), hex($3))
+    }
+    next
+}
+
+/^ \./ { in_code = 0; next }
+
+# Global symbols, including the assembly ones, inside a code section
+in_code && NF == 2 && $1 ~ /^0x/ && $2 ~ /^[A-Za-z_][A-Za-z0-9_.]*$/ {
+    address = hex($1)
+    if (address < end) {
+        print address, 0, $2
+    }
+}
+' "$MAP" | sort -n -k1,1 -k2,2r > "$SYMBOLS"
+
+tr -d '\r' < "$LOG" | awk -v symbols="$SYMBOLS" '
+function hex(s,    i, v) {
+    s = tolower(s)
+    v = 0
+    for (i = 1; i <= length(s); i++) {
+        v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+    }
+    return v
+}
+
+# Innermost symbol starting at or below the address. A function section
+# and a global symbol at the same address name the same function.
+function lookup(address,    low, high, mid) {
+    if (count == 0 || address < addresses[1] || address >= limit) {
+        return "[unknown]"
+    }
+    low = 1
+    high = count
+    while (low < high) {
+        mid = int((low + high + 1) / 2)
+        if (addresses[mid] <= address) {
+            low = mid
+        } else {
+            high = mid - 1
+        }
+    }
+    return names[low]
+}
+
+BEGIN {
+    while ((getline line < symbols) > 0) {
+        split(line, fields, " ")
+        if (count > 0 && addresses[count] == fields[1]) {
+            continue
+        }
+        count++
+        addresses[count] = fields[1] + 0
+        names[count] = fields[3]
+        if (fields[1] + fields[2] > limit) {
+            limit = fields[1] + fields[2]
+        }
+    }
+}
+
+$1 == "profile:" && $2 == "begin" { inside = 1; next }
+$1 == "profile:" && $2 == "end" { inside = 0; next }
+
+inside && $1 == "sample" {
+    # Return addresses point past the call, step back into it
+    stack = lookup(hex($3))
+    for (i = 4; i <= NF; i++) {
+        stack = lookup(hex($i) - 1) ";" stack
+    }
+    stacks[stack]++
+    total++
+}
+
+END {
+    for (stack in stacks) {
+        print stack, stacks[stack]
+    }
+    if (total == 0) {
+        print "profile.sh: no samples found" > "/dev/stderr"
+        exit 1
+    }
+}
+' | sort
@@ -69,7 +69,7 @@ ebr_system_id:              db 'FAT12   '           ; 8 bytes with padding
 
 start:
     ; Data segments
-    mov ax, 0
+    xor ax, ax
     mov ds, ax
     mov es, ax
 
@@ -85,10 +85,6 @@ start:
 
     mov [ebr_drive_number], dl
 
-    ; Print string to terminal
-    mov si, msg_loading
-    call puts
-
     ; Read drive parameters
     push es
     mov ah, 08h
@@ -111,21 +107,17 @@ start:
     add ax, [bdb_reserved_sectors]
     push ax
 
+    ; Root directory sectors, rounded up (16 entries per 512 byte sector)
     mov ax, [bdb_dir_entries_count]
-    shl ax, 5
-    xor dx, dx
-    div word [bdb_bytes_per_sector]
-
-    test dx, dx
-    jz .root_dir_after
-    inc ax
-
-.root_dir_after:
+    add ax, 15
+    shr ax, 4
 
-    ; Read root dir
+    ; Read root dir, the data region starts right after it
     mov cl, al
     pop ax
-    mov dl, [ebr_drive_number]
+    mov di, ax
+    add di, cx
+    mov [data_start], di
     mov bx, buffer
     call disk_read
 
@@ -151,59 +143,62 @@ start:
 
 .found_stage2:
 
-    mov ax, [di + 26]
-    mov [stage2_cluster], ax
+    ; First cluster of stage2
+    push word [di + 26]
 
     ; Load FAT from disk into memory
     mov ax, [bdb_reserved_sectors]
     mov bx, buffer
     mov cl, [bdb_sectors_per_fat]
-    mov dl, [ebr_drive_number]
     call disk_read
 
-    ; Read stage2 and process FAT chain
+    ; Read stage2 and process FAT chain. Runs of contiguous clusters are
+    ; merged into as few reads as the track and DMA boundaries allow.
     mov bx, STAGE2_LOAD_SEGMENT
     mov es, bx
-    mov bx, STAGE2_LOAD_OFFSET
-
-.load_stage2_loop:
-
-    ; Read next cluster
-    mov ax, [stage2_cluster]
-    add ax, 31
-    mov cl, 1
-    mov dl, [ebr_drive_number]
-    call disk_read
+    pop ax
 
-    add bx, [bdb_bytes_per_sector]
+.next_run:
 
-    ; Compute location of next cluster
-    mov ax, [stage2_cluster]
-    mov cx, 3
-    mul cx
-    mov cx, 2
-    div cx
+    ; Extend the run from si for as long as the chain stays contiguous
+    mov si, ax
+    xor cx, cx
 
-    mov si, buffer
-    add si, ax
-    mov ax, [ds:si]
+.extend_run:
+    inc cx
 
-    or dx, dx
+    ; Next cluster = FAT[cluster * 3 / 2], low or high 12 bits
+    mov bx, ax
+    shr bx, 1
+    add bx, ax
+    mov bx, [buffer + bx]
+    test al, 1
     jz .even
-
-.odd:
-    shr ax, 4
-    jmp .next_cluster_after
+    shr bx, 4
 
 .even:
-    and ax, 0x0FFF
+    and bx, 0x0FFF
+    mov ax, bx
 
-.next_cluster_after:
-    cmp ax, 0x0FF8
-    jae .read_finish
+    mov di, si
+    add di, cx
+    cmp ax, di
+    je .extend_run
 
-    mov [stage2_cluster], ax
-    jmp .load_stage2_loop
+    ; LBA = data start + (first cluster - 2) * sectors per cluster
+    push ax
+    movzx di, byte [bdb_sectors_per_cluter]
+    lea ax, [si - 2]
+    mul di
+    add ax, [data_start]
+    xchg ax, cx
+    mul di
+    xchg ax, cx
+    call read_run
+    pop ax
+
+    cmp ax, 0x0FF8
+    jb .next_run
 
 .read_finish:
 
@@ -216,35 +211,25 @@ start:
 
     jmp STAGE2_LOAD_SEGMENT:STAGE2_LOAD_OFFSET
 
-    jmp wait_key_and_reboot
-
-
-    cli
-    hlt
-
 ; ==============
 ; Error handling
 ; ==============
 
+stage2_not_found_error:
+    mov si, msg_stage2_not_found
+    jmp error
+
 floppy_error:
     mov si, message_read_fail
-    call puts
-    jmp wait_key_and_reboot
 
-stage2_not_found_error:
-    mov si, msg_stage2_not_found
+error:
     call puts
-    jmp wait_key_and_reboot
 
 wait_key_and_reboot:
     mov ah, 0
     int 16h                                 ; Interrupt code for waiting for user keypress
     jmp 0FFFFh:0                            ; This jumps to the beginning of the BIOS to initiate reboot
 
-.halt:
-    cli
-    hlt
-
 ;
 ; Prints a string to terminal
 ; Params:
@@ -315,15 +300,11 @@ lba_to_chs:
 ; Parameters:
 ;   - ax: LBA address
 ;   - cl: Number of sectors to read
-;   - dl: Drive number
 ;   - es:bx: Memory address where the data will be stored
 ;
 disk_read:
-    push ax
-    push bx
-    push cx
-    push dx
-    push di
+    pusha
+    mov dl, [ebr_drive_number]
 
     push cx                             ; temporarily save cl
     call lba_to_chs                     ; compute CHS position
@@ -338,12 +319,12 @@ disk_read:
     int 13h                             ; carry flag cleared indicates success
     jnc .done
 
-    ; Execute this if read fails
+    ; Reset the disk controller and try again
+    xor ah, ah
+    int 13h
     popa
-    call disk_reset
 
     dec di
-    test di, di
     jnz .retry
 
 .fail:
@@ -353,36 +334,70 @@ disk_read:
 
 .done:
     popa
-
-    pop di
-    pop dx
-    pop cx
-    pop bx
-    pop ax
+    popa
     ret
 
 ;
-; Reset the disk controller
+; Read consecutive sectors to es:0 and advance es past them, splitting the
+; read at track ends and 64 KiB DMA boundaries
 ; Parameters:
-;   - dl: Drive number
+;   - ax: LBA address
+;   - cx: Number of sectors to read
+;   - es: Segment to read to, must be sector aligned
 ;
-disk_reset:
-    pusha
-    mov ah, 0
-    stc
-    int 13h
-    jc floppy_error
-    popa
+read_run:
+
+    ; Sectors left on this track
+    push ax
+    xor dx, dx
+    div word [bdb_sectors_per_track]
+    mov di, [bdb_sectors_per_track]
+    sub di, dx
+
+    ; Sectors left before the next 64 KiB boundary, none if es is on one
+    mov dx, es
+    neg dx
+    and dx, 0x0FFF
+    shr dx, 5
+    jz .track_limit
+
+    cmp di, dx
+    jbe .track_limit
+    mov di, dx
+
+.track_limit:
+    cmp di, cx
+    jbe .count_limit
+    mov di, cx
+
+.count_limit:
+    pop ax
+
+    push cx
+    mov cx, di
+    xor bx, bx
+    call disk_read
+    pop cx
+
+    add ax, di
+    sub cx, di
+    shl di, 5
+    mov dx, es
+    add dx, di
+    mov es, dx
+
+    test cx, cx
+    jnz read_run
     ret
 
-msg_loading:                db 'Loading...', ENDL, 0
-message_read_fail:          db 'Read from disk failed!', ENDL, 0
-msg_stage2_not_found:       db 'STAGE2.BIN file not found!', ENDL, 0
+message_read_fail:          db 'Disk error', 0
+msg_stage2_not_found:       db 'STAGE2.BIN not found', 0
 file_stage2_bin:            db 'STAGE2  BIN'
-stage2_cluster:             dw 0
+data_start:                 dw 0
 
-STAGE2_LOAD_SEGMENT         equ 0x0
-STAGE2_LOAD_OFFSET          equ 0x500
+; Must match the link address in stage2/linker.ld
+STAGE2_LOAD_SEGMENT         equ 0x1000
+STAGE2_LOAD_OFFSET          equ 0x0
 
 
 times 510-($-$$) db 0
@@ -0,0 +1,68 @@
+#include "bios.h"
+#include "memory.h"
+#include "x86.h"
+
+// The trampoline addresses the queue with ds = 0
+#ifndef BIOS_QUEUE_LIMIT
+#define BIOS_QUEUE_LIMIT 0x00010000 // NOLINT
+#endif
+
+void BIOSRequestInitialize(BIOSRequest *request, uint8_t interrupt) {
+  memset(request, 0, sizeof(BIOSRequest));
+  request->interrupt = interrupt;
+}
+
+// Point es:bx at a buffer below 1 MiB
+void BIOSSetBuffer(BIOSRequest *request, void *buffer) {
+  uintptr_t linear = (uintptr_t)buffer;
+  request->in.es = (uint16_t)(linear >> 4);
+  request->in.ebx = linear & 0xF;
+}
+
+// Point es:di at a buffer below 1 MiB, for the services that take it there
+void BIOSSetBufferDI(BIOSRequest *request, void *buffer) {
+  uintptr_t linear = (uintptr_t)buffer;
+  request->in.es = (uint16_t)(linear >> 4);
+  request->in.edi = linear & 0xF;
+}
+
+// Segment in the high word, offset in the low word, as the BIOS stores them
+void *BIOSFarPointer(uint32_t far_pointer) {
+  return (void *)(uintptr_t)(((far_pointer >> 16) << 4) +
+                             (far_pointer & 0xFFFF));
+}
+
+bool BIOSRequestSucceeded(const BIOSRequest *request) {
+  return (request->out.eflags & kBIOSFlagCarry) == 0;
+}
+
+// Run every request in a single trip to real mode. Each request gets its
+// output registers, and the bounce buffers of the successful ones are
+// copied out afterwards. True if all of them succeeded.
+bool BIOSCallBatch(BIOSRequest *requests, int count) {
+  if (count <= 0) {
+    return true;
+  }
+
+  if ((uintptr_t)(requests + count) > BIOS_QUEUE_LIMIT) {
+    return false;
+  }
+
+  x86_BIOSCallBatch(requests, count);
+
+  bool all_succeeded = true;
+  for (int i = 0; i < count; i++) {
+    BIOSRequest *request = &requests[i];
+    if (!BIOSRequestSucceeded(request)) {
+      all_succeeded = false;
+      continue;
+    }
+
+    if (request->bounce.size > 0) {
+      memcpy(request->bounce.destination, request->bounce.low,
+             request->bounce.size);
+    }
+  }
+
+  return all_succeeded;
+}
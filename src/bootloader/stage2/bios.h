@@ -0,0 +1,52 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#pragma pack(push, 1)
+
+// Register image for a real mode BIOS call. eflags is only meaningful on
+// the way out, the call is always made with the carry flag set.
+typedef struct {
+  uint32_t eax;
+  uint32_t ebx;
+  uint32_t ecx;
+  uint32_t edx;
+  uint32_t esi;
+  uint32_t edi;
+  uint32_t ebp;
+  uint16_t ds;
+  uint16_t es;
+  uint32_t eflags;
+} BIOSRegisters;
+
+// Data the BIOS leaves in a low memory buffer that has to be copied to its
+// final place once back in protected mode. Unused when size is 0.
+typedef struct {
+  void *low;
+  void *destination;
+  uint32_t size;
+} BIOSBounce;
+
+// Layout shared with x86_BIOSCallBatch in x86.asm
+typedef struct {
+  uint8_t interrupt;
+  uint8_t _reserved[3];
+  BIOSRegisters in;
+  BIOSRegisters out;
+  BIOSBounce bounce;
+} BIOSRequest;
+
+#pragma pack(pop)
+
+enum BIOSFlags {
+  kBIOSFlagCarry = 0x0001,
+};
+
+#define BIOS_MAX_BATCH 16 // NOLINT
+
+void BIOSRequestInitialize(BIOSRequest *request, uint8_t interrupt);
+void BIOSSetBuffer(BIOSRequest *request, void *buffer);
+void BIOSSetBufferDI(BIOSRequest *request, void *buffer);
+void *BIOSFarPointer(uint32_t far_pointer);
+bool BIOSRequestSucceeded(const BIOSRequest *request);
+bool BIOSCallBatch(BIOSRequest *requests, int count);
@@ -0,0 +1,96 @@
+#include "crc32c.h"
+#include "x86.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CRC32C_POLYNOMIAL 0x82F63B78 // NOLINT, reflected
+#define CRC32C_SLICES 8              // NOLINT
+
+enum CRC32CCPUIDBits {
+  kCPUIDFeatureSSE42 = 1u << 20,
+};
+
+// tables_[k][b] is the CRC of byte b followed by k zero bytes
+static uint32_t tables_[CRC32C_SLICES][256];
+static bool hardware_;
+
+void CRC32CInitialize() {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+    }
+    tables_[0][i] = crc;
+  }
+  for (uint32_t i = 0; i < 256; i++) {
+    for (int k = 1; k < CRC32C_SLICES; k++) {
+      uint32_t previous = tables_[k - 1][i];
+      tables_[k][i] = (previous >> 8) ^ tables_[0][previous & 0xFF];
+    }
+  }
+
+  x86_CPUIDResult features;
+  x86_CPUID(1, &features);
+  hardware_ = (features.ecx & kCPUIDFeatureSSE42) != 0;
+}
+
+static inline uint32_t CRC32CByte(uint32_t crc, uint8_t byte) {
+  return (crc >> 8) ^ tables_[0][(crc ^ byte) & 0xFF];
+}
+
+uint32_t CRC32CUpdateTable(uint32_t crc, const void *data, uint32_t size) {
+  const uint8_t *bytes = data;
+  crc = ~crc;
+
+  // Line up for whole word loads
+  while (size > 0 && ((uintptr_t)bytes & 3) != 0) {
+    crc = CRC32CByte(crc, *bytes++);
+    size--;
+  }
+
+  const uint32_t *words = (const uint32_t *)bytes;
+  for (; size >= 8; size -= 8) {
+    uint32_t one = *words++ ^ crc;
+    uint32_t two = *words++;
+    crc = tables_[7][one & 0xFF] ^ tables_[6][(one >> 8) & 0xFF] ^
+          tables_[5][(one >> 16) & 0xFF] ^ tables_[4][one >> 24] ^
+          tables_[3][two & 0xFF] ^ tables_[2][(two >> 8) & 0xFF] ^
+          tables_[1][(two >> 16) & 0xFF] ^ tables_[0][two >> 24];
+  }
+
+  bytes = (const uint8_t *)words;
+  while (size-- > 0) {
+    crc = CRC32CByte(crc, *bytes++);
+  }
+  return ~crc;
+}
+
+static uint32_t CRC32CUpdateHardware(uint32_t crc, const void *data,
+                                     uint32_t size) {
+  const uint8_t *bytes = data;
+  crc = ~crc;
+
+  while (size > 0 && ((uintptr_t)bytes & 3) != 0) {
+    __asm__("crc32b %1, %0" : "+r"(crc) : "rm"(*bytes));
+    bytes++;
+    size--;
+  }
+
+  const uint32_t *words = (const uint32_t *)bytes;
+  for (; size >= 4; size -= 4) {
+    __asm__("crc32l %1, %0" : "+r"(crc) : "rm"(*words));
+    words++;
+  }
+
+  bytes = (const uint8_t *)words;
+  for (; size > 0; size--) {
+    __asm__("crc32b %1, %0" : "+r"(crc) : "rm"(*bytes));
+    bytes++;
+  }
+  return ~crc;
+}
+
+uint32_t CRC32CUpdate(uint32_t crc, const void *data, uint32_t size) {
+  return hardware_ ? CRC32CUpdateHardware(crc, data, size)
+                   : CRC32CUpdateTable(crc, data, size);
+}
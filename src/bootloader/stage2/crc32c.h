@@ -0,0 +1,15 @@
+#pragma once
+#include <stdint.h>
+
+// CRC32C (Castagnoli), the checksum boot/checksum.h trailers carry
+
+// Fill the lookup tables and pick the SSE4.2 crc32 instruction if the CPU
+// has it
+void CRC32CInitialize();
+
+// Continue crc over size more bytes, start with 0. Runs on the crc32
+// instruction when it is there, on the tables otherwise.
+uint32_t CRC32CUpdate(uint32_t crc, const void *data, uint32_t size);
+
+// Slicing-by-8 over the tables, eight bytes per step
+uint32_t CRC32CUpdateTable(uint32_t crc, const void *data, uint32_t size);
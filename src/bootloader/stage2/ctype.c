@@ -7,3 +7,7 @@ bool islower(char chr) {
 char toupper(char chr) {
     return islower(chr) ? (chr - 'a' + 'A') : chr;
 }
+
+char tolower(char chr) {
+    return (chr >= 'A' && chr <= 'Z') ? (chr - 'A' + 'a') : chr;
+}
@@ -5,3 +5,4 @@
 
 bool islower(char chr);
 char toupper(char chr);
+char tolower(char chr);
@@ -1,20 +1,49 @@
 #include "disk.h"
-#include "stdio.h"
-#include "x86.h"
+#include "bios.h"
+#include "fdc.h"
+#include "memdefs.h"
+#include "memory.h"
+#include "minmax.h"
+#include <stddef.h>
+
+#define SECTOR_SIZE 512                  // NOLINT
+#define DISK_RETRIES 3                   // NOLINT
+#define DISK_INTERRUPT 0x13              // NOLINT
+#define DISK_REAL_MODE_LIMIT 0x00100000  // NOLINT
+#define DISK_DMA_BOUNDARY 0x00010000     // NOLINT
+#define DISK_FIRST_HARD_DISK 0x80        // NOLINT
+#define DISK_MAX_READ 255                // NOLINT
+#define DISK_COPY_SECTORS 64             // NOLINT, memcpy takes 16-bit sizes
+
+enum DISKFunctions {
+  kDISKFunctionReset = 0x00,
+  kDISKFunctionRead = 0x02,
+  kDISKFunctionGetParameters = 0x08,
+};
 
 bool DISKInitialize(DISK *disk, uint8_t drive_number) {
-  uint8_t drive_type;
-  uint16_t cylinders, sectors, heads;
+  BIOSRequest request;
+  BIOSRequestInitialize(&request, DISK_INTERRUPT);
+  request.in.eax = kDISKFunctionGetParameters << 8;
+  request.in.edx = drive_number;
 
-  if (!x86_Disk_GetDriveParams(disk->id, &drive_type, &cylinders, &sectors,
-                               &heads)) {
+  if (!BIOSCallBatch(&request, 1)) {
     return false;
   }
 
+  // ch holds the low cylinder bits, cl the top two above the sector count,
+  // and both the cylinder and head are the highest index rather than a count
+  uint8_t ch = (request.out.ecx >> 8) & 0xFF;
+  uint8_t cl = request.out.ecx & 0xFF;
   disk->id = drive_number;
-  disk->cylinders = cylinders;
-  disk->sectors = sectors;
-  disk->heads = heads;
+  disk->cylinders = (ch | ((cl & 0xC0) << 2)) + 1;
+  disk->sectors = cl & 0x3F;
+  disk->heads = ((request.out.edx >> 8) & 0xFF) + 1;
+
+  disk->image = NULL;
+
+  // Floppies are read directly from the controller when there is one
+  disk->fdc = drive_number < DISK_FIRST_HARD_DISK && FDCInitialize(disk);
 
   return true;
 }
@@ -32,21 +61,163 @@ void DISK_LBA2CHS(DISK *disk, uint32_t lba, uint16_t *cylinders_out,
   *heads_out = (lba / disk->sectors) % disk->heads;
 }
 
-bool DISKReadSectors(DISK *disk, uint32_t lba, uint8_t sectors,
-                     void *data_out) {
+static void DISKPrepareReset(DISK *disk, BIOSRequest *request) {
+  BIOSRequestInitialize(request, DISK_INTERRUPT);
+  request->in.eax = kDISKFunctionReset << 8;
+  request->in.edx = disk->id;
+}
+
+static void DISKPrepareRead(DISK *disk, BIOSRequest *request, uint32_t lba,
+                            uint8_t sectors, void *buffer) {
   uint16_t cylinder;
   uint16_t sector;
   uint16_t head;
 
   DISK_LBA2CHS(disk, lba, &cylinder, &sector, &head);
 
-  for (int i = 0; i < 3; i++) {
-    if (x86_Disk_Read(disk->id, cylinder, sector, head, sectors, data_out)) {
+  BIOSRequestInitialize(request, DISK_INTERRUPT);
+  request->in.eax = (kDISKFunctionRead << 8) | sectors;
+  request->in.ecx =
+      ((cylinder & 0xFF) << 8) | ((cylinder >> 2) & 0xC0) | (sector & 0x3F);
+  request->in.edx = (head << 8) | disk->id;
+  BIOSSetBuffer(request, buffer);
+}
+
+// Submit a batch of reads, then retry the ones that failed after a reset
+static bool DISKSubmit(DISK *disk, BIOSRequest *requests, int count) {
+  if (BIOSCallBatch(requests, count)) {
+    return true;
+  }
+
+  for (int i = 0; i < count; i++) {
+    for (int retry = 0; !BIOSRequestSucceeded(&requests[i]); retry++) {
+      if (retry == DISK_RETRIES) {
+        return false;
+      }
+
+      BIOSRequest retry_requests[2];
+      DISKPrepareReset(disk, &retry_requests[0]);
+      retry_requests[1] = requests[i];
+      BIOSCallBatch(retry_requests, 2);
+      requests[i] = retry_requests[1];
+    }
+  }
+
+  return true;
+}
+
+// Reads are split so that no request crosses a track or makes the DMA cross
+// a 64 KiB boundary. Destinations the BIOS cannot reach go through the bounce
+// buffer. All requests are queued and run in as few trips to real mode as
+// possible.
+bool DISKReadSectors(DISK *disk, uint32_t lba, uint8_t sectors,
+                     void *data_out) {
+  if (disk->image != NULL) {
+    if (lba + sectors > DISKSize(disk) / SECTOR_SIZE) {
+      return false;
+    }
+
+    uint8_t *u8_data_out = (uint8_t *)data_out;
+    while (sectors > 0) {
+      uint8_t chunk = min(sectors, DISK_COPY_SECTORS);
+      memcpy(u8_data_out, disk->image + lba * SECTOR_SIZE, chunk * SECTOR_SIZE);
+      lba += chunk;
+      sectors -= chunk;
+      u8_data_out += chunk * SECTOR_SIZE;
+    }
+    return true;
+  }
+
+  if (disk->fdc) {
+    if (FDCReadSectors(disk, lba, sectors, data_out)) {
       return true;
     }
 
-    x86_Disk_Reset(disk->id);
+    // The controller and the BIOS share the bounce buffer, so stay with the
+    // BIOS from here on
+    FDCStop(disk);
+    disk->fdc = false;
+  }
+
+  BIOSRequest requests[BIOS_MAX_BATCH];
+  int count = 0;
+  uint8_t *bounce = (uint8_t *)MEMORY_DISK_BOUNCE;
+  uint32_t bounce_used = 0;
+  uint8_t *u8_data_out = (uint8_t *)data_out;
+
+  while (sectors > 0) {
+    // A chunk is at most a track, make sure one more of those fits
+    if (count == BIOS_MAX_BATCH ||
+        bounce_used + disk->sectors * SECTOR_SIZE > MEMORY_DISK_BOUNCE_SIZE) {
+      if (!DISKSubmit(disk, requests, count)) {
+        return false;
+      }
+      count = 0;
+      bounce_used = 0;
+    }
+
+    uint32_t chunk = min(disk->sectors - lba % disk->sectors, sectors);
+    uintptr_t linear = (uintptr_t)u8_data_out;
+    bool direct = linear + chunk * SECTOR_SIZE <= DISK_REAL_MODE_LIMIT;
+    if (direct) {
+      uint32_t to_boundary =
+          (DISK_DMA_BOUNDARY - (linear & (DISK_DMA_BOUNDARY - 1))) /
+          SECTOR_SIZE;
+      direct = to_boundary > 0;
+      chunk = direct ? min(chunk, to_boundary) : chunk;
+    }
+
+    BIOSRequest *request = &requests[count++];
+    if (direct) {
+      DISKPrepareRead(disk, request, lba, chunk, u8_data_out);
+    } else {
+      DISKPrepareRead(disk, request, lba, chunk, bounce + bounce_used);
+      request->bounce.low = bounce + bounce_used;
+      request->bounce.destination = u8_data_out;
+      request->bounce.size = chunk * SECTOR_SIZE;
+      bounce_used += chunk * SECTOR_SIZE;
+    }
+
+    lba += chunk;
+    sectors -= chunk;
+    u8_data_out += chunk * SECTOR_SIZE;
+  }
+
+  return DISKSubmit(disk, requests, count);
+}
+
+uint32_t DISKSize(DISK *disk) {
+  return (uint32_t)disk->cylinders * disk->heads * disk->sectors * SECTOR_SIZE;
+}
+
+// Reads are whole cylinders, as many as a single request takes, so the
+// controller or the BIOS only ever moves forward
+bool DISKLoadImage(DISK *disk, void *address, uint32_t size_limit) {
+  uint32_t size = DISKSize(disk);
+  uint32_t cylinder_sectors = disk->heads * disk->sectors;
+  if (disk->image != NULL || size == 0 || size > size_limit ||
+      cylinder_sectors > DISK_MAX_READ) {
+    return false;
+  }
+
+  uint32_t total = size / SECTOR_SIZE;
+  uint32_t step = DISK_MAX_READ / cylinder_sectors * cylinder_sectors;
+  uint8_t *u8_address = (uint8_t *)address;
+  for (uint32_t lba = 0; lba < total; lba += step) {
+    uint8_t sectors = min(step, total - lba);
+    if (!DISKReadSectors(disk, lba, sectors, u8_address + lba * SECTOR_SIZE)) {
+      return false;
+    }
   }
 
-  return false;
+  DISKRelease(disk);
+  disk->image = u8_address;
+  return true;
+}
+
+void DISKRelease(DISK *disk) {
+  if (disk->fdc) {
+    FDCStop(disk);
+    disk->fdc = false;
+  }
 }
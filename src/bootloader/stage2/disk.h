@@ -8,7 +8,17 @@ typedef struct {
   uint16_t cylinders;
   uint16_t sectors;
   uint16_t heads;
+  bool fdc;      // Reads go to the floppy controller instead of the BIOS
+  uint8_t *image; // Reads are served from memory once the disk is loaded
 } DISK;
 
 bool DISKInitialize(DISK *disk, uint8_t drive_number);
 bool DISKReadSectors(DISK *disk, uint32_t lba, uint8_t sectors, void *data_out);
+
+// Read the whole disk into memory in large sequential reads, later reads are
+// copies from there. Fails without changing anything if it does not fit.
+bool DISKLoadImage(DISK *disk, void *address, uint32_t size_limit);
+uint32_t DISKSize(DISK *disk);
+
+// Leave the drive as the kernel expects to find it
+void DISKRelease(DISK *disk);
@@ -1,5 +1,7 @@
 bits 16
 
+%include "realmode.inc"
+
 section .entry
 
 extern __bss_start
@@ -11,14 +13,14 @@ global entry
 entry:
     cli
 
-    ; Save boot drive
-    mov [boot_drive_], dl
+    ; Save boot drive, stage1 left ds = STAGE2_SEGMENT
+    mov [REAL(boot_drive_)], dl
 
     ; Set up stack
-    mov ax, ds
+    xor ax, ax
     mov ss, ax
-    mov sp, 0xFFF0
-    mov bp, sp
+    mov esp, STAGE2_STACK
+    mov ebp, esp
 
     ; Switch to protected mode
     call EnableA20
@@ -39,6 +41,7 @@ entry:
     ; 6 - Set up segment registers
     mov ax, 0x10
     mov ds, ax
+    mov es, ax
     mov ss, ax
 
     ; Clear bss
@@ -113,7 +116,7 @@ A20WaitOutput:
 
 LoadGDT:
     [bits 16]
-    lgdt [gdt_desc_]
+    lgdt [REAL(gdt_desc_)]
     ret
 
 KbdControllerDataPort               equ 0x60
@@ -144,10 +147,10 @@ gdt_:
                 db 11001111b                ; granularity (4k pages, 32-bit pmode) + limit (bits 16-19)
                 db 0                        ; base high
 
-                ; 16-bit code segment
+                ; 16-bit code segment, based at the load address like real mode cs
                 dw 0FFFFh                   ; limit (bits 0-15) = 0xFFFFF
                 dw 0                        ; base (bits 0-15) = 0x0
-                db 0                        ; base (bits 16-23)
+                db STAGE2_BASE >> 16        ; base (bits 16-23)
                 db 10011010b                ; access (present, ring 0, code segment, executable, direction 0, readable)
                 db 00001111b                ; granularity (1b pages, 16-bit pmode) + limit (bits 16-19)
                 db 0                        ; base high
@@ -11,6 +11,15 @@
 #define MAX_PATH_SIZE 256        // NOLINT
 #define MAX_FILE_HANDLES 10      // NOLINT
 #define ROOT_DIRECTORY_HANDLE -1 // NOLINT
+#define FAT_END_OF_CHAIN 0xFF8   // NOLINT
+#define FAT_MAX_DIRECT_READ 255  // NOLINT, sectors per DISKReadSectors
+#define FAT_DELETED 0xE5         // NOLINT, first name byte of a free entry
+#define FAT_LFN_LAST 0x40        // NOLINT, order flag of the first LFN entry
+#define FAT_LFN_SEQUENCE 0x1F    // NOLINT
+#define FAT_LFN_CHARS 13         // NOLINT, UCS-2 characters per LFN entry
+#define FAT_LFN_MAX_ENTRIES 20   // NOLINT
+#define FAT_CASE_LOWER_BASE 0x08 // NOLINT
+#define FAT_CASE_LOWER_EXT 0x10  // NOLINT
 
 #pragma pack(push, 1)
 
@@ -40,8 +49,34 @@ typedef struct {
   uint8_t system_id[8];
 } FAT_BootSector;
 
+// Long names are stored backwards in entries ahead of the short entry, 13
+// characters each
+typedef struct {
+  uint8_t order;
+  uint16_t name1[5];
+  uint8_t attributes;
+  uint8_t type;
+  uint8_t checksum; // Of the short name the entries belong to
+  uint16_t name2[6];
+  uint16_t first_cluster;
+  uint16_t name3[2];
+} FATLongNameEntry;
+
 #pragma pack(pop)
 
+// A long name being put together while its entries go by
+typedef struct {
+  char name[FAT_NAME_MAX + 1];
+  uint8_t checksum;
+  uint8_t next; // Sequence number expected next, 0 once complete
+  bool valid;
+} FATLongName;
+
+// Called for every short entry of a directory scan, with the long name that
+// belongs to it if there is one. Returns false to stop after the entry.
+typedef bool (*FATEntryVisitor)(void *context, const FATDirectoryEntry *entry,
+                                const char *long_name);
+
 typedef struct {
   uint8_t buffer[SECTOR_SIZE];
   FATFile public;
@@ -158,7 +193,7 @@ FATFile *FATOpenEntry(DISK *disk, FATDirectoryEntry *entry) {
   // Out of handles
   if (handle < 0) {
     printf("FAT: out of file handles\r\n");
-    return false;
+    return NULL;
   }
 
   // Set up vars
@@ -172,10 +207,12 @@ FATFile *FATOpenEntry(DISK *disk, FATDirectoryEntry *entry) {
   fd->current_cluster = fd->first_cluster;
   fd->current_sector_in_cluster = 0;
 
-  if (!DISKReadSectors(disk, FATClusterToLba(fd->current_cluster), 1,
+  // Empty files have no cluster to read
+  if (fd->first_cluster >= 2 &&
+      !DISKReadSectors(disk, FATClusterToLba(fd->current_cluster), 1,
                        fd->buffer)) {
     printf("FAT: read error\r\n");
-    return false;
+    return NULL;
   }
 
   fd->opened = true;
@@ -191,12 +228,71 @@ uint32_t FATNextCluster(uint32_t current_cluster) {
   }
 }
 
+// Step to the next sector of a file, false once its chain has ended
+static bool FATNextSector(FATFileData *fd) {
+  if (++fd->current_sector_in_cluster >=
+      data_->boot_sector_data.boot_sector.sectors_per_cluster) {
+    fd->current_sector_in_cluster = 0;
+    fd->current_cluster = FATNextCluster(fd->current_cluster);
+  }
+
+  return fd->current_cluster < FAT_END_OF_CHAIN;
+}
+
+// Read whole sectors straight into the caller's buffer, one disk read per run
+// of clusters that follow each other on disk
+static bool FATReadDirect(DISK *disk, FATFileData *fd, uint32_t sectors,
+                          uint8_t *data_out, uint32_t *read_out) {
+  *read_out = 0;
+  while (sectors > 0 && fd->current_cluster < FAT_END_OF_CHAIN) {
+    uint32_t lba =
+        FATClusterToLba(fd->current_cluster) + fd->current_sector_in_cluster;
+    uint32_t run = 0;
+    bool contiguous = true;
+    while (contiguous && run < sectors && run < FAT_MAX_DIRECT_READ) {
+      uint32_t cluster = fd->current_cluster;
+      run++;
+      FATNextSector(fd);
+      contiguous = fd->current_sector_in_cluster != 0 ||
+                   fd->current_cluster == cluster + 1;
+    }
+
+    if (!DISKReadSectors(disk, lba, run, data_out + *read_out)) {
+      return false;
+    }
+
+    *read_out += run * SECTOR_SIZE;
+    sectors -= run;
+  }
+
+  return true;
+}
+
+static FATFileData *FATFileDataOf(FATFile *file) {
+  return (file->handle == ROOT_DIRECTORY_HANDLE)
+             ? &data_->root_directory
+             : &data_->opened_files[file->handle];
+}
+
+// FATClose rewinds the root directory without a disk to reload from, so
+// bring the buffer back in line with the position before using it
+static bool FATSyncRootBuffer(DISK *disk, FATFileData *fd) {
+  if (fd->public.handle != ROOT_DIRECTORY_HANDLE ||
+      fd->public.position >= fd->public.size) {
+    return true;
+  }
+
+  uint32_t lba = fd->first_cluster + fd->public.position / SECTOR_SIZE;
+  if (fd->current_cluster == lba) {
+    return true;
+  }
+  fd->current_cluster = lba;
+  return DISKReadSectors(disk, lba, 1, fd->buffer);
+}
+
 uint32_t FATRead(DISK *disk, FATFile *file, uint32_t byte_count,
                  void *data_out) {
-  // Get file data
-  FATFileData *fd = (file->handle == ROOT_DIRECTORY_HANDLE)
-                        ? &data_->root_directory
-                        : &data_->opened_files[file->handle];
+  FATFileData *fd = FATFileDataOf(file);
 
   uint8_t *u8_data_out = (uint8_t *)data_out;
 
@@ -206,6 +302,11 @@ uint32_t FATRead(DISK *disk, FATFile *file, uint32_t byte_count,
     byte_count = min(byte_count, fd->public.size - fd->public.position);
   }
 
+  if (byte_count > 0 && !FATSyncRootBuffer(disk, fd)) {
+    printf("FAT: Read error!\r\n");
+    return 0;
+  }
+
   while (byte_count > 0) {
     uint32_t left_in_buffer = SECTOR_SIZE - (fd->public.position % SECTOR_SIZE);
     uint32_t take = min(byte_count, left_in_buffer);
@@ -215,8 +316,11 @@ uint32_t FATRead(DISK *disk, FATFile *file, uint32_t byte_count,
     fd->public.position += take;
     byte_count -= take;
 
-    // See if we need to read more data
-    if (left_in_buffer == take) {
+    // See if we need to read more data. Nothing past the last sector of a
+    // file is ever needed, directories without a size end with their chain.
+    bool at_end = fd->public.position >= fd->public.size &&
+                  !(fd->public.is_directory && fd->public.size == 0);
+    if (left_in_buffer == take && !at_end) {
       // Special handling for the root directory
       if (fd->public.handle == ROOT_DIRECTORY_HANDLE) {
         ++fd->current_cluster;
@@ -226,19 +330,35 @@ uint32_t FATRead(DISK *disk, FATFile *file, uint32_t byte_count,
           break;
         }
       } else {
-        // Read next sector
-        if (++fd->current_sector_in_cluster >=
-            data_->boot_sector_data.boot_sector.sectors_per_cluster) {
-          fd->current_sector_in_cluster = 0;
-          fd->current_cluster = FATNextCluster(fd->current_cluster);
-        }
-
-        if (fd->current_cluster >= 0xFF8) {
+        if (!FATNextSector(fd)) {
           // Mark the end of the file
           fd->public.size = fd->public.position;
           break;
         }
 
+        // Whole sectors skip the handle buffer
+        if (!fd->public.is_directory && byte_count >= SECTOR_SIZE) {
+          uint32_t read;
+          bool ok = FATReadDirect(disk, fd, byte_count / SECTOR_SIZE,
+                                  u8_data_out, &read);
+          u8_data_out += read;
+          fd->public.position += read;
+          byte_count -= read;
+          if (!ok) {
+            printf("FAT: Read error!\r\n");
+            break;
+          }
+
+          if (fd->public.position >= fd->public.size) {
+            break;
+          }
+
+          if (fd->current_cluster >= FAT_END_OF_CHAIN) {
+            fd->public.size = fd->public.position;
+            break;
+          }
+        }
+
         // Read next sector
         if (!DISKReadSectors(disk,
                              FATClusterToLba(fd->current_cluster) +
@@ -261,45 +381,269 @@ bool FATReadEntry(DISK *disk, FATFile *file, FATDirectoryEntry *dir_entry) {
 
 void FATClose(FATFile *file) {
   if (file->handle == ROOT_DIRECTORY_HANDLE) {
+    // The buffer is reloaded by the next FATRead if it is stale
     file->position = 0;
-    data_->root_directory.current_cluster = data_->root_directory.first_cluster;
   } else {
     data_->opened_files[file->handle].opened = false;
   }
 }
 
-bool FATFindFile(DISK *disk, FATFile *file, const char *name,
-                 FATDirectoryEntry *entry_out) {
-  char fat_name[12];
-  FATDirectoryEntry entry;
+static uint8_t FATShortNameChecksum(const uint8_t *name) {
+  uint8_t sum = 0;
+  for (int i = 0; i < 11; i++) {
+    sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + name[i]);
+  }
+  return sum;
+}
 
-  // Convert from name to FAT name
-  memset(fat_name, ' ', sizeof(fat_name));
-  fat_name[11] = '\0';
+// Only ASCII survives the trip from UCS-2, the rest becomes '?'
+static void FATLongNamePut(FATLongName *long_name, int offset, uint16_t chr) {
+  if (offset < FAT_NAME_MAX) {
+    long_name->name[offset] =
+        (chr == 0x0000 || chr == 0xFFFF) ? '\0' : (chr < 0x80 ? chr : '?');
+  }
+}
 
-  const char *ext = strchr(name, '.');
-  if (ext == NULL) {
-    ext = name + 11;
+static void FATLongNameAdd(FATLongName *long_name,
+                           const FATDirectoryEntry *raw) {
+  const FATLongNameEntry *entry = (const FATLongNameEntry *)raw;
+  uint8_t sequence = entry->order & FAT_LFN_SEQUENCE;
+
+  // The entry with the last part comes first and starts a new name
+  if (entry->order & FAT_LFN_LAST) {
+    long_name->valid = sequence >= 1 && sequence <= FAT_LFN_MAX_ENTRIES;
+    long_name->checksum = entry->checksum;
+    long_name->next = sequence;
+    long_name->name[min(sequence * FAT_LFN_CHARS, FAT_NAME_MAX)] = '\0';
+  }
+  if (!long_name->valid || sequence != long_name->next ||
+      entry->checksum != long_name->checksum) {
+    long_name->valid = false;
+    return;
+  }
+
+  int offset = (sequence - 1) * FAT_LFN_CHARS;
+  for (int i = 0; i < 5; i++) {
+    FATLongNamePut(long_name, offset++, entry->name1[i]);
+  }
+  for (int i = 0; i < 6; i++) {
+    FATLongNamePut(long_name, offset++, entry->name2[i]);
   }
+  for (int i = 0; i < 2; i++) {
+    FATLongNamePut(long_name, offset++, entry->name3[i]);
+  }
+  long_name->next--;
+}
 
-  for (int i = 0; i < 8 && name[i] && name + i < ext; i++) {
-    fat_name[i] = toupper(name[i]);
+// A long name only counts when every part was seen and it was written for
+// this short entry, anything else was left behind by a driver without LFN
+static const char *FATLongNameFor(const FATLongName *long_name,
+                                  const FATDirectoryEntry *entry) {
+  if (!long_name->valid || long_name->next != 0 ||
+      long_name->checksum != FATShortNameChecksum(entry->name)) {
+    return NULL;
   }
+  return long_name->name;
+}
 
-  if (ext != NULL) {
-    for (int i = 0; i < 3 && ext[i + 1]; i++) {
-      fat_name[i + 8] = toupper(ext[i + 1]);
+// Load the sector the position moved into. Returns false at the end of the
+// directory, and on read errors with *error set.
+static bool FATNextDirectorySector(DISK *disk, FATFileData *fd, bool *error) {
+  if (fd->public.handle == ROOT_DIRECTORY_HANDLE) {
+    if (fd->public.position >= fd->public.size) {
+      return false;
     }
+    ++fd->current_cluster;
+    *error = !DISKReadSectors(disk, fd->current_cluster, 1, fd->buffer);
+    return !*error;
+  }
+
+  if (!FATNextSector(fd)) {
+    // Mark the end of the directory
+    fd->public.size = fd->public.position;
+    return false;
+  }
+  *error = !DISKReadSectors(
+      disk, FATClusterToLba(fd->current_cluster) + fd->current_sector_in_cluster,
+      1, fd->buffer);
+  return !*error;
+}
+
+// Walk the entries of a directory from its position, straight out of the
+// handle's sector buffer. The position ends up after the last entry visited.
+static bool FATScanDirectory(DISK *disk, FATFile *directory,
+                             FATEntryVisitor visit, void *context) {
+  FATFileData *fd = FATFileDataOf(directory);
+  FATLongName long_name;
+  long_name.valid = false;
+
+  if (!FATSyncRootBuffer(disk, fd)) {
+    return false;
   }
 
-  while (FATReadEntry(disk, file, &entry)) {
-    if (memcmp(fat_name, entry.name, 11) == 0) {
-      *entry_out = entry;
+  bool more = true;
+  while (more) {
+    // Subdirectories get a size once their chain has run out
+    if (fd->public.size != 0 && fd->public.position >= fd->public.size) {
+      return true;
+    }
+
+    const FATDirectoryEntry *entry =
+        (const FATDirectoryEntry *)(fd->buffer +
+                                    fd->public.position % SECTOR_SIZE);
+
+    // A never used entry marks the end of the directory
+    if (entry->name[0] == 0x00) {
       return true;
     }
+
+    if (entry->name[0] == FAT_DELETED) {
+      long_name.valid = false;
+    } else if ((entry->attributes & kFatAttributeLFN) == kFatAttributeLFN) {
+      FATLongNameAdd(&long_name, entry);
+    } else {
+      if ((entry->attributes & kFatAttributeVolumeId) == 0) {
+        more = visit(context, entry, FATLongNameFor(&long_name, entry));
+      }
+      long_name.valid = false;
+    }
+
+    fd->public.position += sizeof(FATDirectoryEntry);
+    bool error = false;
+    if (fd->public.position % SECTOR_SIZE == 0 &&
+        !FATNextDirectorySector(disk, fd, &error)) {
+      return !error;
+    }
   }
 
-  return false;
+  return true;
+}
+
+// The 8.3 name as it is shown, with the case Windows NT keeps in case_flags
+static void FATFormatShortName(const FATDirectoryEntry *entry, char *name_out) {
+  bool lower_base = (entry->case_flags & FAT_CASE_LOWER_BASE) != 0;
+  bool lower_ext = (entry->case_flags & FAT_CASE_LOWER_EXT) != 0;
+  int length = 0;
+
+  for (int i = 0; i < 8 && entry->name[i] != ' '; i++) {
+    name_out[length++] = lower_base ? tolower(entry->name[i]) : entry->name[i];
+  }
+  // 0x05 stands in for a name starting with 0xE5
+  if (length > 0 && (uint8_t)name_out[0] == 0x05) {
+    name_out[0] = (char)FAT_DELETED;
+  }
+
+  if (entry->name[8] != ' ') {
+    name_out[length++] = '.';
+    for (int i = 8; i < 11 && entry->name[i] != ' '; i++) {
+      name_out[length++] = lower_ext ? tolower(entry->name[i]) : entry->name[i];
+    }
+  }
+  name_out[length] = '\0';
+}
+
+typedef struct {
+  FATEntry *entries;
+  int count;
+  int filled;
+} FATReadDirState;
+
+static bool FATReadDirVisit(void *context, const FATDirectoryEntry *entry,
+                            const char *long_name) {
+  FATReadDirState *state = context;
+  if (entry->name[0] == '.') {
+    return true;
+  }
+
+  FATEntry *out = &state->entries[state->filled++];
+  if (long_name != NULL) {
+    strcpy(out->name, long_name);
+  } else {
+    FATFormatShortName(entry, out->name);
+  }
+  out->attributes = entry->attributes;
+  out->first_cluster =
+      entry->first_cluster_low + ((uint32_t)entry->first_cluster_high << 16);
+  out->size = entry->size;
+  return state->filled < state->count;
+}
+
+int FATReadDir(DISK *disk, FATFile *directory, FATEntry *entries, int count) {
+  if (!directory->is_directory) {
+    return -1;
+  }
+  if (count <= 0) {
+    return 0;
+  }
+
+  FATReadDirState state = {entries, count, 0};
+  if (!FATScanDirectory(disk, directory, FATReadDirVisit, &state) &&
+      state.filled == 0) {
+    printf("FAT: Read error!\r\n");
+    return -1;
+  }
+  return state.filled;
+}
+
+typedef struct {
+  const char *name;
+  bool has_short_name; // Whether name is a valid 8.3 name at all
+  char short_name[11];
+  FATDirectoryEntry *entry_out;
+  bool found;
+} FATFindState;
+
+static bool FATNameEquals(const char *a, const char *b) {
+  while (*a != '\0' && toupper(*a) == toupper(*b)) {
+    a++;
+    b++;
+  }
+  return *a == '\0' && *b == '\0';
+}
+
+static bool FATFindVisit(void *context, const FATDirectoryEntry *entry,
+                         const char *long_name) {
+  FATFindState *state = context;
+  if ((long_name != NULL && FATNameEquals(long_name, state->name)) ||
+      (state->has_short_name &&
+       memcmp(entry->name, state->short_name, 11) == 0)) {
+    *state->entry_out = *entry;
+    state->found = true;
+    return false;
+  }
+  return true;
+}
+
+bool FATFindFile(DISK *disk, FATFile *file, const char *name,
+                 FATDirectoryEntry *entry_out) {
+  FATFindState state;
+  state.name = name;
+  state.entry_out = entry_out;
+  state.found = false;
+
+  // Convert from name to FAT name, names that don't fit can only match a
+  // long name
+  memset(state.short_name, ' ', sizeof(state.short_name));
+  const char *ext = strchr(name, '.');
+  const char *name_end = (ext != NULL) ? ext : name + strlen(name);
+  state.has_short_name = name_end > name && name_end - name <= 8 &&
+                         (ext == NULL || (strlen(ext + 1) <= 3 &&
+                                          strchr(ext + 1, '.') == NULL));
+
+  for (int i = 0; i < 8 && name + i < name_end; i++) {
+    state.short_name[i] = toupper(name[i]);
+  }
+
+  if (ext != NULL) {
+    for (int i = 0; i < 3 && ext[i + 1]; i++) {
+      state.short_name[i + 8] = toupper(ext[i + 1]);
+    }
+  }
+
+  if (!FATScanDirectory(disk, file, FATFindVisit, &state)) {
+    printf("FAT: Read error!\r\n");
+  }
+  return state.found;
 }
 
 FATFile *FATOpen(DISK *disk, const char *path) {
@@ -318,12 +662,12 @@ FATFile *FATOpen(DISK *disk, const char *path) {
     const char *delim = strchr(path, '/');
     if (delim != NULL) {
       memcpy(name, path, delim - path);
-      name[delim - path + 1] = '\0';
+      name[delim - path] = '\0';
       path = delim + 1;
     } else {
       unsigned len = strlen(path);
       memcpy(name, path, len);
-      name[len + 1] = '\0';
+      name[len] = '\0';
       path += len;
       is_last = true;
     }
@@ -334,7 +678,7 @@ FATFile *FATOpen(DISK *disk, const char *path) {
       FATClose(current);
 
       // Check if directory
-      if (!is_last && entry.attributes & kFatAttributeDirectory == 0) {
+      if (!is_last && (entry.attributes & kFatAttributeDirectory) == 0) {
         printf("FAT: %s is not a directory\r\n", name);
         return NULL;
       }
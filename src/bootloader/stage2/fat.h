@@ -2,12 +2,14 @@
 #include "disk.h"
 #include <stdint.h>
 
+#define FAT_NAME_MAX 255 // NOLINT
+
 #pragma pack(push, 1)
 
 typedef struct {
   uint8_t name[11];
   uint8_t attributes;
-  uint8_t _reserved;
+  uint8_t case_flags; // Windows NT: lower case base name and extension
   uint8_t created_time_tenths;
   uint16_t created_time;
   uint16_t created_date;
@@ -28,6 +30,14 @@ typedef struct {
   uint32_t size;
 } FATFile;
 
+// A decoded directory entry
+typedef struct {
+  char name[FAT_NAME_MAX + 1]; // The long name if it has a valid one
+  uint8_t attributes;
+  uint32_t first_cluster;
+  uint32_t size;
+} FATEntry;
+
 enum FATAttributes {
   kFatAttributeReadOnly = 0x01,
   kFatAttributeHidden = 0x02,
@@ -36,8 +46,7 @@ enum FATAttributes {
   kFatAttributeDirectory = 0x10,
   kFatAttributeArchive = 0x20,
   kFatAttributeLFN = kFatAttributeReadOnly | kFatAttributeHidden |
-                     kFatAttributeSystem | kFatAttributeVolumeId |
-                     kFatAttributeDirectory | kFatAttributeArchive
+                     kFatAttributeSystem | kFatAttributeVolumeId
 };
 
 bool FATInitialize(DISK *disk);
@@ -45,4 +54,10 @@ FATFile *FATOpen(DISK *disk, const char *path);
 uint32_t FATRead(DISK *disk, FATFile *file, uint32_t byte_count,
                  void *data_out);
 bool FATReadEntry(DISK *disk, FATFile *file, FATDirectoryEntry *dir_entry);
+
+// Decode up to count entries from the directory's position, with long names
+// put together and checked against their short entry. Free entries, volume
+// labels, "." and ".." are skipped. Returns how many were filled, 0 at the
+// end of the directory and -1 on read errors.
+int FATReadDir(DISK *disk, FATFile *directory, FATEntry *entries, int count);
 void FATClose(FATFile *file);
@@ -0,0 +1,375 @@
+#include "fdc.h"
+#include "memdefs.h"
+#include "memory.h"
+#include "minmax.h"
+#include "x86.h"
+
+#define SECTOR_SIZE 512            // NOLINT
+#define FDC_RETRIES 3              // NOLINT
+#define FDC_VERSION_82077AA 0x90   // NOLINT
+#define FDC_RESET_SENSES 4         // NOLINT
+#define FDC_SECTOR_SIZE_CODE 2     // NOLINT
+#define FDC_GAP_LENGTH 0x1B        // NOLINT
+#define FDC_DMA_LIMIT 0x01000000   // NOLINT
+#define FDC_DMA_BOUNDARY 0x00010000 // NOLINT
+
+// Stage2 runs with interrupts off and the PIC still set up for the BIOS, so
+// IRQ6 is never taken. Completion is polled in the main status register and
+// with sense interrupt, bounded by a number of port reads (about 1 us each).
+#define FDC_TIMEOUT 1000000        // NOLINT
+#define FDC_SPIN_UP_DELAY 300000   // NOLINT
+#define FDC_DELAY_PORT 0x80        // NOLINT
+
+enum FDCPorts {
+  kFDCPortDigitalOutput = 0x3F2,
+  kFDCPortMainStatus = 0x3F4,
+  kFDCPortFIFO = 0x3F5,
+  kFDCPortConfigurationControl = 0x3F7,
+};
+
+enum FDCDigitalOutput {
+  kFDCDigitalOutputNotReset = 0x04,
+  kFDCDigitalOutputDMA = 0x08,
+  kFDCDigitalOutputMotor = 0x10, // Shifted left by the drive number
+};
+
+enum FDCMainStatus {
+  kFDCMainStatusDataIn = 0x40,
+  kFDCMainStatusReady = 0x80,
+};
+
+enum FDCCommands {
+  kFDCCommandSpecify = 0x03,
+  kFDCCommandReadData = 0x06,
+  kFDCCommandRecalibrate = 0x07,
+  kFDCCommandSenseInterrupt = 0x08,
+  kFDCCommandSeek = 0x0F,
+  kFDCCommandVersion = 0x10,
+  kFDCCommandConfigure = 0x13,
+};
+
+enum FDCCommandFlags {
+  kFDCFlagSkipDeleted = 0x20,
+  kFDCFlagMFM = 0x40,
+  kFDCFlagMultiTrack = 0x80,
+};
+
+enum FDCStatus0 {
+  kFDCStatus0SeekEnd = 0x20,
+  kFDCStatus0InterruptCode = 0xC0,
+  kFDCStatus0InvalidCommand = 0x80,
+};
+
+enum FDCDataRates {
+  kFDCDataRate500K = 0,
+  kFDCDataRate300K = 1,
+  kFDCDataRate250K = 2,
+  kFDCDataRate1M = 3,
+};
+
+enum DMAPorts {
+  kDMAPortChannel2Address = 0x04,
+  kDMAPortChannel2Count = 0x05,
+  kDMAPortSingleMask = 0x0A,
+  kDMAPortMode = 0x0B,
+  kDMAPortFlipFlop = 0x0C,
+  kDMAPortChannel2Page = 0x81,
+};
+
+enum DMAFlags {
+  kDMAChannelFloppy = 2,
+  kDMAMaskSet = 0x04,
+  kDMAModeSingleWrite = 0x44, // Single transfer, device to memory
+};
+
+static uint8_t *buffer_ = (uint8_t *)MEMORY_DISK_BOUNCE;
+static uint8_t digital_output_;
+static uint8_t data_rate_;
+
+// Cylinder whose sectors are in buffer_, and the one the heads are on or
+// moving to. -1 when unknown.
+static int32_t buffered_cylinder_ = -1;
+static int32_t current_cylinder_ = -1;
+static bool seeking_ = false;
+
+static void FDCDelay(uint32_t port_writes) {
+  while (port_writes--) {
+    x86_outb(FDC_DELAY_PORT, 0);
+  }
+}
+
+static bool FDCWaitReady(uint8_t direction) {
+  for (uint32_t i = 0; i < FDC_TIMEOUT; i++) {
+    uint8_t status = x86_inb(kFDCPortMainStatus);
+    if ((status & (kFDCMainStatusReady | kFDCMainStatusDataIn)) ==
+        (kFDCMainStatusReady | direction)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static bool FDCCommand(const uint8_t *bytes, int count) {
+  for (int i = 0; i < count; i++) {
+    if (!FDCWaitReady(0)) {
+      return false;
+    }
+    x86_outb(kFDCPortFIFO, bytes[i]);
+  }
+
+  return true;
+}
+
+static bool FDCResult(uint8_t *bytes, int count) {
+  for (int i = 0; i < count; i++) {
+    if (!FDCWaitReady(kFDCMainStatusDataIn)) {
+      return false;
+    }
+    bytes[i] = x86_inb(kFDCPortFIFO);
+  }
+
+  return true;
+}
+
+// Poll until the controller has an interrupt to report, it answers with
+// invalid command (a single status byte) as long as nothing is pending
+static bool FDCSenseInterrupt(uint8_t *status0_out, uint8_t *cylinder_out) {
+  static const uint8_t command[] = {kFDCCommandSenseInterrupt};
+
+  for (uint32_t i = 0; i < FDC_TIMEOUT; i++) {
+    if (!FDCCommand(command, 1) || !FDCResult(status0_out, 1)) {
+      return false;
+    }
+
+    if (*status0_out != kFDCStatus0InvalidCommand) {
+      return FDCResult(cylinder_out, 1);
+    }
+  }
+
+  return false;
+}
+
+// Seek and recalibrate end with an interrupt that tells whether the heads
+// made it to the cylinder
+static bool FDCFinishSeek() {
+  if (!seeking_) {
+    return current_cylinder_ >= 0;
+  }
+
+  uint8_t status0;
+  uint8_t cylinder;
+  seeking_ = false;
+  if (!FDCSenseInterrupt(&status0, &cylinder) ||
+      (status0 & (kFDCStatus0InterruptCode | kFDCStatus0SeekEnd)) !=
+          kFDCStatus0SeekEnd ||
+      cylinder != current_cylinder_) {
+    current_cylinder_ = -1;
+    return false;
+  }
+
+  return true;
+}
+
+// Start moving the heads, FDCFinishSeek waits for them
+static bool FDCStartSeek(DISK *disk, uint16_t cylinder) {
+  if (!FDCFinishSeek() || current_cylinder_ != cylinder) {
+    uint8_t command[] = {kFDCCommandSeek, disk->id, cylinder};
+    if (!FDCCommand(command, sizeof(command))) {
+      current_cylinder_ = -1;
+      return false;
+    }
+
+    current_cylinder_ = cylinder;
+    seeking_ = true;
+  }
+
+  return true;
+}
+
+static bool FDCRecalibrate(DISK *disk) {
+  uint8_t command[] = {kFDCCommandRecalibrate, disk->id};
+
+  // Drives with more than 80 cylinders may need a second pass
+  for (int i = 0; i < 2; i++) {
+    if (!FDCCommand(command, sizeof(command))) {
+      return false;
+    }
+
+    current_cylinder_ = 0;
+    seeking_ = true;
+    if (FDCFinishSeek()) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Reset the controller and bring it to a known state. The motor bits are
+// kept so a spinning drive does not have to come up to speed again.
+static bool FDCReset(DISK *disk) {
+  uint8_t motor = kFDCDigitalOutputMotor << disk->id;
+  digital_output_ = motor | kFDCDigitalOutputDMA | disk->id;
+
+  x86_outb(kFDCPortDigitalOutput, motor | disk->id);
+  FDCDelay(10);
+  x86_outb(kFDCPortDigitalOutput, digital_output_ | kFDCDigitalOutputNotReset);
+  digital_output_ |= kFDCDigitalOutputNotReset;
+
+  // One interrupt per drive, they all have to be acknowledged
+  for (int i = 0; i < FDC_RESET_SENSES; i++) {
+    uint8_t status0;
+    uint8_t cylinder;
+    if (!FDCSenseInterrupt(&status0, &cylinder)) {
+      return false;
+    }
+  }
+
+  x86_outb(kFDCPortConfigurationControl, data_rate_);
+
+  // Implied seeks off, FIFO on with a threshold of 8 bytes, polling off
+  static const uint8_t configure[] = {kFDCCommandConfigure, 0, 0x17, 0};
+
+  // Step rate 3 ms, longest head unload, head load 4 ms, DMA mode
+  static const uint8_t specify[] = {kFDCCommandSpecify, 0xDF, 0x02};
+
+  buffered_cylinder_ = -1;
+  seeking_ = false;
+  return FDCCommand(configure, sizeof(configure)) &&
+         FDCCommand(specify, sizeof(specify)) && FDCRecalibrate(disk);
+}
+
+static void FDCSetupDMA(uint32_t size) {
+  uintptr_t address = (uintptr_t)buffer_;
+  uint16_t count = size - 1;
+
+  x86_outb(kDMAPortSingleMask, kDMAMaskSet | kDMAChannelFloppy);
+  x86_outb(kDMAPortFlipFlop, 0xFF);
+  x86_outb(kDMAPortChannel2Address, address & 0xFF);
+  x86_outb(kDMAPortChannel2Address, (address >> 8) & 0xFF);
+  x86_outb(kDMAPortChannel2Page, (address >> 16) & 0xFF);
+  x86_outb(kDMAPortFlipFlop, 0xFF);
+  x86_outb(kDMAPortChannel2Count, count & 0xFF);
+  x86_outb(kDMAPortChannel2Count, (count >> 8) & 0xFF);
+  x86_outb(kDMAPortMode, kDMAModeSingleWrite | kDMAChannelFloppy);
+  x86_outb(kDMAPortSingleMask, kDMAChannelFloppy);
+}
+
+// Read both heads of a cylinder with one multi-track command. The DMA
+// terminal count ends the command after the last sector of the last head.
+static bool FDCReadCylinder(DISK *disk, uint16_t cylinder) {
+  if (!FDCStartSeek(disk, cylinder) || !FDCFinishSeek()) {
+    return false;
+  }
+
+  FDCSetupDMA(disk->heads * disk->sectors * SECTOR_SIZE);
+
+  uint8_t flags = kFDCFlagMFM | kFDCFlagSkipDeleted;
+  flags |= disk->heads > 1 ? kFDCFlagMultiTrack : 0;
+  uint8_t command[] = {kFDCCommandReadData | flags,
+                       disk->id,
+                       cylinder,
+                       0,
+                       1,
+                       FDC_SECTOR_SIZE_CODE,
+                       disk->sectors,
+                       FDC_GAP_LENGTH,
+                       0xFF};
+  uint8_t result[7];
+
+  buffered_cylinder_ = -1;
+  if (!FDCCommand(command, sizeof(command)) ||
+      !FDCResult(result, sizeof(result)) ||
+      (result[0] & kFDCStatus0InterruptCode) != 0) {
+    return false;
+  }
+
+  buffered_cylinder_ = cylinder;
+  return true;
+}
+
+bool FDCInitialize(DISK *disk) {
+  uint32_t cylinder_size = disk->heads * disk->sectors * SECTOR_SIZE;
+  uintptr_t buffer = (uintptr_t)buffer_;
+  if (disk->id > 3 || disk->heads == 0 || disk->heads > 2 ||
+      disk->sectors == 0 || cylinder_size > MEMORY_DISK_BOUNCE_SIZE ||
+      buffer + cylinder_size > FDC_DMA_LIMIT ||
+      (buffer & (FDC_DMA_BOUNDARY - 1)) + cylinder_size > FDC_DMA_BOUNDARY) {
+    return false;
+  }
+
+  // Only the enhanced controllers are driven directly
+  static const uint8_t version[] = {kFDCCommandVersion};
+  uint8_t controller;
+  if (!FDCCommand(version, sizeof(version)) || !FDCResult(&controller, 1) ||
+      controller != FDC_VERSION_82077AA) {
+    return false;
+  }
+
+  if (disk->sectors >= 36) {
+    data_rate_ = kFDCDataRate1M;
+  } else if (disk->sectors >= 15) {
+    data_rate_ = kFDCDataRate500K;
+  } else {
+    data_rate_ = disk->cylinders > 40 ? kFDCDataRate250K : kFDCDataRate300K;
+  }
+
+  // The BIOS usually leaves the motor running after loading stage2
+  uint8_t motor = kFDCDigitalOutputMotor << disk->id;
+  bool spinning = (x86_inb(kFDCPortDigitalOutput) & motor) != 0;
+  if (!FDCReset(disk)) {
+    return false;
+  }
+
+  if (!spinning) {
+    FDCDelay(FDC_SPIN_UP_DELAY);
+  }
+
+  return true;
+}
+
+bool FDCReadSectors(DISK *disk, uint32_t lba, uint8_t sectors,
+                    void *data_out) {
+  uint32_t cylinder_sectors = disk->heads * disk->sectors;
+  uint8_t *u8_data_out = (uint8_t *)data_out;
+
+  while (sectors > 0) {
+    uint16_t cylinder = lba / cylinder_sectors;
+    uint32_t offset = lba % cylinder_sectors;
+    uint32_t chunk = min(cylinder_sectors - offset, sectors);
+
+    if (cylinder >= disk->cylinders) {
+      return false;
+    }
+
+    if (cylinder != buffered_cylinder_) {
+      int retry = 0;
+      while (!FDCReadCylinder(disk, cylinder)) {
+        if (++retry == FDC_RETRIES || !FDCReset(disk)) {
+          return false;
+        }
+      }
+
+      // Reads are mostly sequential, move on to the next cylinder while the
+      // sectors are copied out and the caller works on them
+      if (cylinder + 1 < disk->cylinders) {
+        FDCStartSeek(disk, cylinder + 1);
+      }
+    }
+
+    memcpy(u8_data_out, buffer_ + offset * SECTOR_SIZE, chunk * SECTOR_SIZE);
+    lba += chunk;
+    sectors -= chunk;
+    u8_data_out += chunk * SECTOR_SIZE;
+  }
+
+  return true;
+}
+
+void FDCStop(DISK *disk) {
+  FDCFinishSeek();
+  digital_output_ &= ~(kFDCDigitalOutputMotor << disk->id);
+  x86_outb(kFDCPortDigitalOutput, digital_output_);
+  buffered_cylinder_ = -1;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include "disk.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Protected mode driver for the 82077AA floppy controller. Reads whole
+// cylinders through ISA DMA channel 2 into MEMORY_DISK_BOUNCE and serves
+// sectors from there.
+bool FDCInitialize(DISK *disk);
+bool FDCReadSectors(DISK *disk, uint32_t lba, uint8_t sectors, void *data_out);
+
+// Turn the motor off, the BIOS timer that normally does it no longer runs
+void FDCStop(DISK *disk);
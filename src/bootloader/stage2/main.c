@@ -1,17 +1,84 @@
+#include "crc32c.h"
 #include "disk.h"
 #include "fat.h"
 #include "memdefs.h"
 #include "memory.h"
+#include "minmax.h"
 #include "stdio.h"
+#include "vbe.h"
+#include "x86.h"
+#include <boot/archive.h>
+#include <boot/bootparams.h>
+#include <boot/checksum.h>
+#include <stddef.h>
 #include <stdint.h>
 
-uint8_t *KernelLoadBuffer = (uint8_t *)MEMORY_LOAD_KERNEL;
 uint8_t *Kernel = (uint8_t *)MEMORY_KERNEL_ADDR;
 
-typedef void (*KernelStart)();
+// Largest graphics mode the kernel console is set up in
+#define SCREEN_MAX_WIDTH 1024 // NOLINT
+#define SCREEN_MAX_HEIGHT 768 // NOLINT
+
+// Files are read and checksummed this much at a time, so the CRC runs over
+// data that is still in the cache
+#define LOAD_CHUNK_SIZE 0x10000 // NOLINT
+
+typedef void (*KernelStart)(const BootParams *boot_params);
+
+static BootParams boot_params_;
+
+// Read a whole file to its final place and check its boot/checksum.h
+// trailer on the way, the FAT driver turns every chunk into one disk read
+// per contiguous run of clusters. Returns the size without the trailer, 0 on
+// failure.
+static uint32_t LoadFile(DISK *disk, const char *path, void *address,
+                         uint32_t size_limit) {
+  FATFile *fd = FATOpen(disk, path);
+  if (fd == NULL) {
+    return 0;
+  }
+
+  uint8_t *data = address;
+  uint32_t size = fd->size;
+  if (size < sizeof(BootChecksum) || size > size_limit) {
+    FATClose(fd);
+    return 0;
+  }
+
+  uint32_t data_size = size - sizeof(BootChecksum);
+  uint32_t crc = 0;
+  uint32_t read = 0;
+  while (read < size) {
+    uint32_t chunk =
+        FATRead(disk, fd, min(size - read, LOAD_CHUNK_SIZE), data + read);
+    if (chunk == 0) {
+      break;
+    }
+    if (read < data_size) {
+      crc = CRC32CUpdate(crc, data + read, min(chunk, data_size - read));
+    }
+    read += chunk;
+  }
+  FATClose(fd);
+  if (read != size) {
+    return 0;
+  }
+
+  const BootChecksum *trailer = (const BootChecksum *)(data + data_size);
+  if (trailer->magic != BOOT_CHECKSUM_MAGIC || trailer->crc32c != crc) {
+    printf("%s: checksum mismatch\r\n", path);
+    return 0;
+  }
+  return data_size;
+}
 
 void __attribute__((cdecl)) start(uint16_t boot_drive) {
+  boot_params_.timestamps[kBootPhaseStage2Entry] = x86_ReadTSC();
+  boot_params_.magic = BOOT_PARAMS_MAGIC;
+  boot_params_.boot_drive = boot_drive;
+
   clrscr();
+  CRC32CInitialize();
 
   DISK disk;
   if (!DISKInitialize(&disk, boot_drive)) {
@@ -19,25 +86,61 @@ void __attribute__((cdecl)) start(uint16_t boot_drive) {
     goto end;
   }
 
+#ifdef STAGE2_RAMDISK
+  // Everything below is served from memory, the kernel gets the image too
+  if (DISKLoadImage(&disk, MEMORY_RAMDISK_ADDR, MEMORY_RAMDISK_SIZE)) {
+    boot_params_.ramdisk_address = (uint32_t)disk.image;
+    boot_params_.ramdisk_size = DISKSize(&disk);
+    boot_params_.timestamps[kBootPhaseStage2ImageLoaded] = x86_ReadTSC();
+  } else {
+    printf("RAM disk load error, reading from the disk\r\n");
+  }
+#endif
+
   if (!FATInitialize(&disk)) {
     printf("FAT init error\r\n");
     goto end;
   }
+  boot_params_.timestamps[kBootPhaseStage2DiskReady] = x86_ReadTSC();
 
-  // Browse files in root
-  FATFile *fd = FATOpen(&disk, "/kernel.bin");
-  uint32_t read;
-  uint8_t *kernel_buffer = Kernel;
-  while ((read = FATRead(&disk, fd, MEMORY_LOAD_SIZE, KernelLoadBuffer))) {
-    memcpy(kernel_buffer, KernelLoadBuffer, read);
-    kernel_buffer += read;
+  uint32_t kernel_size =
+      LoadFile(&disk, "/kernel.bin", Kernel, MEMORY_KERNEL_SIZE);
+  if (kernel_size == 0) {
+    printf("Kernel load error\r\n");
+    goto end;
   }
 
-  FATClose(fd);
+  // Modules are optional, the kernel gets an empty table without them
+  uint32_t modules_size =
+      LoadFile(&disk, "/modules.arc", MEMORY_MODULES_ADDR, MEMORY_MODULES_SIZE);
+  if (BootArchiveIsValid(MEMORY_MODULES_ADDR, modules_size)) {
+    boot_params_.modules_address = (uint32_t)MEMORY_MODULES_ADDR;
+    boot_params_.modules_size = modules_size;
+  } else if (modules_size > 0) {
+    printf("modules.arc is not a boot archive\r\n");
+  }
+
+  DISKRelease(&disk);
+
+#ifndef STAGE2_TEXT_MODE
+  // The kernel draws its console with the BIOS font, no font no graphics
+  const uint8_t *font = VBEGetFont();
+  VBEFramebuffer framebuffer;
+  if (font != NULL &&
+      VBESetMode(SCREEN_MAX_WIDTH, SCREEN_MAX_HEIGHT, &framebuffer)) {
+    boot_params_.framebuffer_address = framebuffer.address;
+    boot_params_.framebuffer_pitch = framebuffer.pitch;
+    boot_params_.framebuffer_width = framebuffer.width;
+    boot_params_.framebuffer_height = framebuffer.height;
+    boot_params_.framebuffer_bpp = framebuffer.bpp;
+    boot_params_.font_address = (uint32_t)font;
+  }
+#endif
 
   // Execute the kernel
+  boot_params_.timestamps[kBootPhaseKernelLoaded] = x86_ReadTSC();
   KernelStart kernel_start = (KernelStart)Kernel;
-  kernel_start();
+  kernel_start(&boot_params_);
 
 end:
   for (;;)
@@ -6,18 +6,31 @@
 #define MEMORY_MIN 0x00000500 // NOLINT
 #define MEMORY_MAX 0x00080000 // NOLINT
 
-#define MEMORY_FAT_ADDR ((void *)0x20000)
+// 0x00000500 - 0x00007BFF - stack
+// 0x00007C00 - 0x00007DFF - stage 1
+// 0x00010000 - 0x0004FFFF - stage 2, see realmode.inc
+
+#define MEMORY_FAT_ADDR ((void *)0x50000)
 #define MEMORY_FAT_SIZE 0x00010000 // NOLINT
 
-#define MEMORY_LOAD_KERNEL ((void *)0x30000)
+#define MEMORY_LOAD_KERNEL ((void *)0x60000)
 #define MEMORY_LOAD_SIZE 0x00010000
 
-// 0x00020000 - 0x00030000 - stage 2
-
-// 0x00030000 - 0x00080000 - free
+// Low memory target for disk reads whose destination the BIOS cannot reach
+// or that would make the DMA cross a 64 KiB boundary
+#define MEMORY_DISK_BOUNCE ((void *)0x70000)
+#define MEMORY_DISK_BOUNCE_SIZE 0x00010000 // NOLINT
 
 // 0x00080000 - 0x0009FFFF - Extended BIOS data area
 // 0x000A0000 - 0x000C7FFF - Video
 // 0x000C8000 - 0x000FFFFF - BIOS
 
-#define MEMORY_KERNEL_ADDR ((void *)0x100000)
\ No newline at end of file
+#define MEMORY_KERNEL_ADDR ((void *)0x100000)
+#define MEMORY_KERNEL_SIZE 0x00300000 // NOLINT
+
+// Whole boot disk when stage2 is built with STAGE2_RAMDISK
+#define MEMORY_RAMDISK_ADDR ((void *)0x400000)
+#define MEMORY_RAMDISK_SIZE 0x00400000 // NOLINT
+// Boot module archive, see boot/archive.h
+#define MEMORY_MODULES_ADDR ((void *)0x800000)
+#define MEMORY_MODULES_SIZE 0x00800000 // NOLINT
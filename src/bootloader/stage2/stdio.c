@@ -275,6 +275,7 @@ void printf(const char *fmt, ...) {
       length = kPrintfLengthDefault;
       radix = 10;
       sign = false;
+      number = false;
       break;
     }
 
@@ -0,0 +1,193 @@
+#include "vbe.h"
+#include "bios.h"
+#include "memdefs.h"
+#include "memory.h"
+#include "minmax.h"
+#include <stddef.h>
+
+#define VBE_INTERRUPT 0x10      // NOLINT
+#define VBE_SUCCESS 0x004F      // NOLINT
+#define VBE_MIN_VERSION 0x0200  // NOLINT
+#define VBE_MAX_MODES 256       // NOLINT
+#define VBE_END_OF_MODES 0xFFFF // NOLINT
+#define VBE_BPP 32              // NOLINT
+
+// The mode info queries share a trip to real mode, each with its own buffer
+#define VBE_MODE_INFO_SIZE 256 // NOLINT
+
+enum VBEFunctions {
+  kVBEFunctionControllerInfo = 0x4F00,
+  kVBEFunctionModeInfo = 0x4F01,
+  kVBEFunctionSetMode = 0x4F02,
+  kVBEFunctionFont = 0x1130,
+};
+
+enum VBEModeAttributes {
+  kVBEModeSupported = 0x0001,
+  kVBEModeGraphics = 0x0010,
+  kVBEModeLinear = 0x0080,
+};
+
+enum VBEFlags {
+  kVBEMemoryModelDirect = 6,
+  kVBESetModeLinear = 0x4000,
+  kVBEFont8x16 = 0x06, // bh for the font pointer query
+};
+
+#pragma pack(push, 1)
+
+typedef struct {
+  char signature[4];
+  uint16_t version;
+  uint32_t oem_string;
+  uint32_t capabilities;
+  uint32_t video_modes; // Far pointer to a 0xFFFF terminated list
+  uint16_t total_memory;
+  uint8_t _reserved[492];
+} VBEControllerInfo;
+
+typedef struct {
+  uint16_t attributes;
+  uint8_t window_a;
+  uint8_t window_b;
+  uint16_t granularity;
+  uint16_t window_size;
+  uint16_t segment_a;
+  uint16_t segment_b;
+  uint32_t window_function;
+  uint16_t pitch;
+  uint16_t width;
+  uint16_t height;
+  uint8_t char_width;
+  uint8_t char_height;
+  uint8_t planes;
+  uint8_t bpp;
+  uint8_t banks;
+  uint8_t memory_model;
+  uint8_t bank_size;
+  uint8_t image_pages;
+  uint8_t _reserved0;
+  uint8_t red_mask;
+  uint8_t red_position;
+  uint8_t green_mask;
+  uint8_t green_position;
+  uint8_t blue_mask;
+  uint8_t blue_position;
+  uint8_t reserved_mask;
+  uint8_t reserved_position;
+  uint8_t direct_color_attributes;
+  uint32_t framebuffer;
+  uint32_t off_screen_memory;
+  uint16_t off_screen_size;
+  uint8_t _reserved1[206];
+} VBEModeInfo;
+
+#pragma pack(pop)
+
+// Disk I/O is over by the time the mode is set, so the bounce buffer holds
+// the controller info followed by the mode infos
+static VBEControllerInfo *const controller_info_ =
+    (VBEControllerInfo *)MEMORY_DISK_BOUNCE;
+static VBEModeInfo *const mode_infos_ =
+    (VBEModeInfo *)((uint8_t *)MEMORY_DISK_BOUNCE + sizeof(VBEControllerInfo));
+
+static bool VBERequestSucceeded(const BIOSRequest *request) {
+  return (request->out.eax & 0xFFFF) == VBE_SUCCESS;
+}
+
+static bool VBEIsUsable(const VBEModeInfo *info, uint32_t max_width,
+                        uint32_t max_height) {
+  uint16_t wanted = kVBEModeSupported | kVBEModeGraphics | kVBEModeLinear;
+  return (info->attributes & wanted) == wanted && info->bpp == VBE_BPP &&
+         info->memory_model == kVBEMemoryModelDirect &&
+         info->red_position == 16 && info->green_position == 8 &&
+         info->blue_position == 0 && info->width <= max_width &&
+         info->height <= max_height && info->framebuffer != 0;
+}
+
+bool VBESetMode(uint32_t max_width, uint32_t max_height,
+                VBEFramebuffer *framebuffer_out) {
+  BIOSRequest requests[BIOS_MAX_BATCH];
+
+  // Ask for the VBE 2.0 layout of the controller info
+  memcpy(controller_info_->signature, "VBE2", 4);
+  BIOSRequestInitialize(&requests[0], VBE_INTERRUPT);
+  requests[0].in.eax = kVBEFunctionControllerInfo;
+  BIOSSetBufferDI(&requests[0], controller_info_);
+  BIOSCallBatch(requests, 1);
+  if (!VBERequestSucceeded(&requests[0]) ||
+      memcmp(controller_info_->signature, "VESA", 4) != 0 ||
+      controller_info_->version < VBE_MIN_VERSION) {
+    return false;
+  }
+
+  // The list may live in the info block itself, so take a copy before the
+  // mode infos are written next to it
+  uint16_t modes[VBE_MAX_MODES];
+  const uint16_t *list = BIOSFarPointer(controller_info_->video_modes);
+  int mode_count = 0;
+  while (mode_count < VBE_MAX_MODES && list[mode_count] != VBE_END_OF_MODES) {
+    modes[mode_count] = list[mode_count];
+    mode_count++;
+  }
+
+  uint16_t best_mode = VBE_END_OF_MODES;
+  VBEModeInfo best;
+  for (int first = 0; first < mode_count; first += BIOS_MAX_BATCH) {
+    int count = min(mode_count - first, BIOS_MAX_BATCH);
+    for (int i = 0; i < count; i++) {
+      BIOSRequestInitialize(&requests[i], VBE_INTERRUPT);
+      requests[i].in.eax = kVBEFunctionModeInfo;
+      requests[i].in.ecx = modes[first + i];
+      BIOSSetBufferDI(&requests[i], &mode_infos_[i]);
+    }
+    BIOSCallBatch(requests, count);
+
+    for (int i = 0; i < count; i++) {
+      const VBEModeInfo *info = &mode_infos_[i];
+      if (VBERequestSucceeded(&requests[i]) &&
+          VBEIsUsable(info, max_width, max_height) &&
+          (best_mode == VBE_END_OF_MODES ||
+           (uint32_t)info->width * info->height >
+               (uint32_t)best.width * best.height)) {
+        best_mode = modes[first + i];
+        best = *info;
+      }
+    }
+  }
+
+  if (best_mode == VBE_END_OF_MODES) {
+    return false;
+  }
+
+  BIOSRequestInitialize(&requests[0], VBE_INTERRUPT);
+  requests[0].in.eax = kVBEFunctionSetMode;
+  requests[0].in.ebx = best_mode | kVBESetModeLinear;
+  BIOSCallBatch(requests, 1);
+  if (!VBERequestSucceeded(&requests[0])) {
+    return false;
+  }
+
+  framebuffer_out->address = best.framebuffer;
+  framebuffer_out->pitch = best.pitch;
+  framebuffer_out->width = best.width;
+  framebuffer_out->height = best.height;
+  framebuffer_out->bpp = best.bpp;
+  return true;
+}
+
+const uint8_t *VBEGetFont() {
+  BIOSRequest request;
+  BIOSRequestInitialize(&request, VBE_INTERRUPT);
+  request.in.eax = kVBEFunctionFont;
+  request.in.ebx = kVBEFont8x16 << 8;
+  BIOSCallBatch(&request, 1);
+
+  // es:bp, a BIOS without the service leaves es at 0
+  if (request.out.es == 0) {
+    return NULL;
+  }
+
+  return (const uint8_t *)(((uintptr_t)request.out.es << 4) +
+                           (request.out.ebp & 0xFFFF));
+}
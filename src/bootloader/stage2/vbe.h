@@ -0,0 +1,19 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+  uint32_t address; // Linear framebuffer
+  uint32_t pitch;   // Bytes per scan line
+  uint32_t width;
+  uint32_t height;
+  uint32_t bpp;
+} VBEFramebuffer;
+
+// Switch to the largest 32-bit direct color mode with a linear framebuffer
+// that fits in max_width x max_height. Nothing changes when there is none.
+bool VBESetMode(uint32_t max_width, uint32_t max_height,
+                VBEFramebuffer *framebuffer_out);
+
+// The VGA BIOS 8x16 font, 256 glyphs of 16 bytes, NULL if not available
+const uint8_t *VBEGetFont();
@@ -1,6 +1,10 @@
+%include "realmode.inc"
+
+section .realmode
+
 %macro x86_EnterRealMode 0
     [bits 32]
-    jmp word 18h:.pmode16
+    jmp word 18h:REAL(.pmode16)
 
 .pmode16:
     [bits 16]
@@ -8,7 +12,7 @@
     and al, ~1
     mov cr0, eax
 
-    jmp word 00h:.rmode
+    jmp word STAGE2_SEGMENT:REAL(.rmode)
 
 .rmode:
     mov ax, 0
@@ -69,158 +73,161 @@ x86_inb:
     in al, dx
     ret
 
-global x86_Disk_GetDriveParams
-x86_Disk_GetDriveParams:
+global x86_ReadTSC
+x86_ReadTSC:
     [bits 32]
-
-    ; Make new call frame
-    push ebp             ; Save old call frame
-    mov ebp, esp          ; Initialize new call frame
-
-    x86_EnterRealMode
-
-    [bits 16]
-
-    ; Save registers
-    push es
-    push bx
-    push esi
-    push di
-
-    ; Call interrupt int13h
-    mov dl, [bp + 8]
-    mov ah, 08h
-    mov di, 0
-    mov es, di
-    stc
-    int 13h
-
-    ; Return value
-    mov eax, 1
-    sbb eax, 0
-
-    ; Drive type from bl
-    LinearToSegOffset [bp + 12], es, esi, si
-    mov [es:si], bl
-
-    ; Cylinders
-    mov bl, ch          ; cylinders - lower bits in ch
-    mov bh, cl          ; cylinders - upper bits in cl (6-7)
-    shr bh, 6
-    inc bx
-
-    LinearToSegOffset [bp + 16], es, esi, si
-    mov [es:si], bx
-
-    ; Sectors
-    xor ch, ch
-    and cl, 3Fh
-
-    LinearToSegOffset [bp + 20], es, esi, si
-    mov [es:si], cx
-
-    ; Heads
-    mov cl, dh
-    inc cx
-
-    LinearToSegOffset [bp + 24], es, esi, si
-    mov [es:si], cx
-    
-    ; Restore registers
-    pop di
-    pop esi
-    pop bx
-    pop es
-
-    push eax
-
-    x86_EnterProtectedMode
-
-    [bits 32]
-
-    pop eax
-
-    mov esp, ebp
-    pop ebp
+    rdtsc
     ret
 
-global x86_Disk_Reset
-x86_Disk_Reset:
+global x86_CPUID
+x86_CPUID:
     [bits 32]
-
-    ; Make new call frame
     push ebp
     mov ebp, esp
+    push ebx
+    push esi
 
-    x86_EnterRealMode
-
-    mov ah, 0
-    mov dl, [bp + 8]
-    stc
-    int 13h
-
-    mov eax, 1
-    sbb eax, 0
-
-    push eax
-
-    x86_EnterProtectedMode
+    mov eax, [ebp + 8]
+    xor ecx, ecx
+    cpuid
 
-    pop eax
+    mov esi, [ebp + 12]
+    mov [esi], eax
+    mov [esi + 4], ebx
+    mov [esi + 8], ecx
+    mov [esi + 12], edx
 
-    ; Restore old call frame
+    pop esi
+    pop ebx
     mov esp, ebp
     pop ebp
     ret
 
-global x86_Disk_Read
-x86_Disk_Read:
+; Layout of BIOSRegisters and BIOSRequest in bios.h
+struc BIOSRegisters
+    .eax        resd 1
+    .ebx        resd 1
+    .ecx        resd 1
+    .edx        resd 1
+    .esi        resd 1
+    .edi        resd 1
+    .ebp        resd 1
+    .ds         resw 1
+    .es         resw 1
+    .eflags     resd 1
+endstruc
+
+struc BIOSRequest
+    .interrupt  resb 1
+    ._reserved  resb 3
+    .in         resb BIOSRegisters_size
+    .out        resb BIOSRegisters_size
+    .bounce     resb 12
+endstruc
+
+;
+; Run a queue of BIOS calls with a single switch to real mode and back
+; Args:
+;   - requests: BIOSRequest array, must be below 64 KiB
+;   - count: number of requests
+;
+global x86_BIOSCallBatch
+x86_BIOSCallBatch:
+    [bits 32]
+
     ; Make new call frame
     push ebp
     mov ebp, esp
 
-    x86_EnterRealMode
-
     push ebx
-    push es
-
-    ; Set up arguments
-    mov dl, [bp + 8]
+    push esi
+    push edi
 
-    mov ch, [bp + 12]
-    mov cl, [bp + 13]
-    shl cl, 6
+    x86_EnterRealMode
 
-    mov al, [bp + 16]
-    and al, 3Fh
-    or cl, al
-    
-    mov dh, [bp + 20]
+    [bits 16]
 
-    mov al, [bp + 24]
+    cld
+    mov si, [bp + 8]
+    mov cx, [bp + 12]
 
-    LinearToSegOffset [bp + 28], es, ebx, bx
+.next_request:
+    test cx, cx
+    jz .done
 
-    ; Call interrupt int13h
-    mov ah, 02h
+    push ebp
+    push cx
+    mov [cs:REAL(bios_request_)], si
+
+    ; Interrupt handlers are entered through the IVT so the vector can vary
+    movzx bx, byte [si + BIOSRequest.interrupt]
+    shl bx, 2
+    mov eax, [bx]
+    mov [cs:REAL(bios_vector_)], eax
+
+    ; Load the register image, si and ds go last since they address it. The
+    ; frame pointer is on the stack, so ebp is free to pass values in and out.
+    mov eax, [si + BIOSRequest.in + BIOSRegisters.eax]
+    mov ebx, [si + BIOSRequest.in + BIOSRegisters.ebx]
+    mov ecx, [si + BIOSRequest.in + BIOSRegisters.ecx]
+    mov edx, [si + BIOSRequest.in + BIOSRegisters.edx]
+    mov edi, [si + BIOSRequest.in + BIOSRegisters.edi]
+    mov ebp, [si + BIOSRequest.in + BIOSRegisters.ebp]
+    mov es, [si + BIOSRequest.in + BIOSRegisters.es]
+    push word [si + BIOSRequest.in + BIOSRegisters.ds]
+    mov esi, [si + BIOSRequest.in + BIOSRegisters.esi]
+    pop ds
+
+    ; Same as int n, with carry set for BIOSes that only clear it
     stc
-    int 13h
+    pushf
+    call far [cs:REAL(bios_vector_)]
 
-    ; Set return value
-    mov eax, 1
-    sbb eax, 0
+    ; Store the results back into the request
+    pushfd
+    push ds
+    push esi
 
-    ; Restore registers
-    pop es
-    pop ebx 
+    xor si, si
+    mov ds, si
+    mov si, [cs:REAL(bios_request_)]
+
+    mov [si + BIOSRequest.out + BIOSRegisters.eax], eax
+    mov [si + BIOSRequest.out + BIOSRegisters.ebx], ebx
+    mov [si + BIOSRequest.out + BIOSRegisters.ecx], ecx
+    mov [si + BIOSRequest.out + BIOSRegisters.edx], edx
+    mov [si + BIOSRequest.out + BIOSRegisters.edi], edi
+    mov [si + BIOSRequest.out + BIOSRegisters.ebp], ebp
+    mov [si + BIOSRequest.out + BIOSRegisters.es], es
+    pop dword [si + BIOSRequest.out + BIOSRegisters.esi]
+    pop word [si + BIOSRequest.out + BIOSRegisters.ds]
+    pop dword [si + BIOSRequest.out + BIOSRegisters.eflags]
+
+    ; Some BIOS services trash bp, the frame is restored from the stack
+    pop cx
+    pop ebp
 
-    push eax
+    add si, BIOSRequest_size
+    dec cx
+    jmp .next_request
 
+.done:
     x86_EnterProtectedMode
 
-    pop eax
+    [bits 32]
+
+    mov ax, 0x10
+    mov es, ax
+
+    pop edi
+    pop esi
+    pop ebx
 
     ; Restore old call frame
     mov esp, ebp
     pop ebp
-    ret
\ No newline at end of file
+    ret
+
+; Addressed through cs in real mode, so they stay in this section
+bios_vector_:       dd 0
+bios_request_:      dw 0
@@ -2,17 +2,18 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+typedef struct {
+  uint32_t eax;
+  uint32_t ebx;
+  uint32_t ecx;
+  uint32_t edx;
+} x86_CPUIDResult;
+
 void __attribute__((cdecl)) x86_outb(uint16_t port, uint8_t value);
 uint8_t __attribute__((cdecl)) x86_inb(uint16_t port);
+uint64_t __attribute__((cdecl)) x86_ReadTSC();
+void __attribute__((cdecl)) x86_CPUID(uint32_t leaf,
+                                      x86_CPUIDResult *result_out);
 
-bool __attribute__((cdecl)) x86_Disk_GetDriveParams(uint8_t drive,
-                                                    uint8_t *drive_type_out,
-                                                    uint16_t *cylinders_out,
-                                                    uint16_t *sectors_out,
-                                                    uint16_t *heads_out);
-
-bool __attribute__((cdecl)) x86_Disk_Reset(uint8_t drive);
-
-bool __attribute__((cdecl)) x86_Disk_Read(uint8_t drive, uint16_t cylinder,
-                                          uint16_t sector, uint16_t head,
-                                          uint8_t count, void *lower_data_out);
+// Runs every BIOSRequest in one visit to real mode, see bios.h
+void __attribute__((cdecl)) x86_BIOSCallBatch(void *requests, uint32_t count);
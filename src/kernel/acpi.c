@@ -0,0 +1,157 @@
+#include "acpi.h"
+#include "memory.h"
+#include <stddef.h>
+
+#pragma pack(push, 1)
+
+typedef struct {
+  char signature[8];
+  uint8_t checksum;
+  char oem_id[6];
+  uint8_t revision;
+  uint32_t rsdt_address;
+} ACPIRsdp;
+
+typedef struct {
+  char signature[4];
+  uint32_t length;
+  uint8_t revision;
+  uint8_t checksum;
+  char oem_id[6];
+  char oem_table_id[8];
+  uint32_t oem_revision;
+  uint32_t creator_id;
+  uint32_t creator_revision;
+} ACPISdtHeader;
+
+typedef struct {
+  ACPISdtHeader header;
+  uint32_t apic_address;
+  uint32_t flags;
+} ACPIMadt;
+
+typedef struct {
+  uint8_t type;
+  uint8_t length;
+} ACPIMadtEntry;
+
+typedef struct {
+  ACPIMadtEntry entry;
+  uint8_t processor_id;
+  uint8_t apic_id;
+  uint32_t flags;
+} ACPIMadtLocalApic;
+
+typedef struct {
+  ACPIMadtEntry entry;
+  uint8_t io_apic_id;
+  uint8_t _reserved;
+  uint32_t address;
+  uint32_t interrupt_base;
+} ACPIMadtIOApic;
+
+#pragma pack(pop)
+
+enum ACPIMadtEntryTypes {
+  kACPIMadtLocalApic = 0,
+  kACPIMadtIOApic = 1,
+};
+
+#define ACPI_MADT_PROCESSOR_ENABLED 0x01 // NOLINT
+#define ACPI_EBDA_SEGMENT_PTR 0x40E      // NOLINT
+#define ACPI_BIOS_AREA_START 0xE0000     // NOLINT
+#define ACPI_BIOS_AREA_END 0x100000      // NOLINT
+
+static bool ACPIChecksum(const void *table, uint32_t length) {
+  const uint8_t *bytes = (const uint8_t *)table;
+  uint8_t sum = 0;
+  for (uint32_t i = 0; i < length; i++) {
+    sum += bytes[i];
+  }
+  return sum == 0;
+}
+
+static const ACPIRsdp *ACPIScanRsdp(uint32_t start, uint32_t end) {
+  // The RSDP is always on a 16 byte boundary
+  for (uint32_t address = start; address < end; address += 16) {
+    const ACPIRsdp *rsdp = (const ACPIRsdp *)address;
+    if (memcmp(rsdp->signature, "RSD PTR ", 8) == 0 &&
+        ACPIChecksum(rsdp, sizeof(ACPIRsdp))) {
+      return rsdp;
+    }
+  }
+  return NULL;
+}
+
+static const ACPIRsdp *ACPIFindRsdp() {
+  // First KiB of the extended BIOS data area, then the BIOS ROM area
+  uint32_t ebda = (uint32_t)(*(const uint16_t *)ACPI_EBDA_SEGMENT_PTR) << 4;
+  const ACPIRsdp *rsdp = NULL;
+  if (ebda != 0) {
+    rsdp = ACPIScanRsdp(ebda, ebda + 1024);
+  }
+  if (rsdp == NULL) {
+    rsdp = ACPIScanRsdp(ACPI_BIOS_AREA_START, ACPI_BIOS_AREA_END);
+  }
+  return rsdp;
+}
+
+static const ACPISdtHeader *ACPIFindTable(const ACPIRsdp *rsdp,
+                                          const char *signature) {
+  const ACPISdtHeader *rsdt = (const ACPISdtHeader *)rsdp->rsdt_address;
+  if (memcmp(rsdt->signature, "RSDT", 4) != 0 ||
+      !ACPIChecksum(rsdt, rsdt->length)) {
+    return NULL;
+  }
+
+  const uint32_t *tables = (const uint32_t *)(rsdt + 1);
+  uint32_t count = (rsdt->length - sizeof(ACPISdtHeader)) / sizeof(uint32_t);
+  for (uint32_t i = 0; i < count; i++) {
+    const ACPISdtHeader *table = (const ACPISdtHeader *)tables[i];
+    if (memcmp(table->signature, signature, 4) == 0 &&
+        ACPIChecksum(table, table->length)) {
+      return table;
+    }
+  }
+  return NULL;
+}
+
+bool ACPIReadMadt(SMPTopology *topology) {
+  const ACPIRsdp *rsdp = ACPIFindRsdp();
+  if (rsdp == NULL) {
+    return false;
+  }
+
+  const ACPIMadt *madt = (const ACPIMadt *)ACPIFindTable(rsdp, "APIC");
+  if (madt == NULL) {
+    return false;
+  }
+
+  topology->apic_address = madt->apic_address;
+  topology->io_apic_address = 0;
+  topology->cpu_count = 0;
+
+  const uint8_t *entry = (const uint8_t *)(madt + 1);
+  const uint8_t *end = (const uint8_t *)madt + madt->header.length;
+  while (entry < end) {
+    const ACPIMadtEntry *header = (const ACPIMadtEntry *)entry;
+    if (header->length == 0) {
+      break;
+    }
+
+    if (header->type == kACPIMadtLocalApic) {
+      const ACPIMadtLocalApic *lapic = (const ACPIMadtLocalApic *)entry;
+      if ((lapic->flags & ACPI_MADT_PROCESSOR_ENABLED) &&
+          topology->cpu_count < MAX_CPUS) {
+        topology->apic_ids[topology->cpu_count++] = lapic->apic_id;
+      }
+    } else if (header->type == kACPIMadtIOApic &&
+               topology->io_apic_address == 0) {
+      topology->io_apic_address = ((const ACPIMadtIOApic *)entry)->address;
+    }
+
+    entry += header->length;
+  }
+
+  return topology->cpu_count > 0;
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include "smp.h"
+#include <stdbool.h>
+
+bool ACPIReadMadt(SMPTopology *topology);
@@ -0,0 +1,587 @@
+#include "ahci.h"
+#include "atomic.h"
+#include "block.h"
+#include "irq.h"
+#include "memory.h"
+#include "pci.h"
+#include "pic.h"
+#include "softirq.h"
+#include "spinlock.h"
+#include "stdio.h"
+#include <stddef.h>
+
+#define AHCI_MAX_DISKS 4     // NOLINT
+#define AHCI_PORT_COUNT 32   // NOLINT
+#define AHCI_SLOT_COUNT 32   // NOLINT
+#define AHCI_PRDT_ENTRIES 8  // NOLINT
+#define AHCI_ABAR 5          // NOLINT
+
+// Larger transfers are split so a single request cannot hog the queue
+#define AHCI_MAX_TRANSFER 256 // NOLINT
+
+// Byte count limit of one PRDT entry
+#define AHCI_PRD_MAX_BYTES (4 * 1024 * 1024) // NOLINT
+
+// Busy-wait bound for register handshakes, far longer than QEMU needs
+#define AHCI_SPIN_LIMIT 10000000 // NOLINT
+
+// The HBA already coalesces where it can, so every interrupt is reaped on
+// its way out
+#define AHCI_SOFTIRQ_COALESCE 1 // NOLINT
+
+enum AHCIClass {
+  kAHCIClassStorage = 0x01,
+  kAHCISubclassSATA = 0x06,
+  kAHCIProgIFAHCI = 0x01,
+};
+
+enum AHCIHBARegisters {
+  kAHCICapabilities = 0x00,
+  kAHCIGlobalControl = 0x04,
+  kAHCIInterruptStatus = 0x08,
+  kAHCIPortsImplemented = 0x0C,
+  kAHCICoalescingControl = 0x14,
+  kAHCICoalescingPorts = 0x18,
+  kAHCIPortBase = 0x100,
+  kAHCIPortSize = 0x80,
+};
+
+enum AHCIHBABits {
+  kAHCICapNCQ = 1u << 30,
+  kAHCICapCoalescing = 1u << 7,
+  kAHCIGlobalInterruptEnable = 1u << 1,
+  kAHCIGlobalAHCIEnable = 1u << 31,
+};
+
+enum AHCIPortRegisters {
+  kAHCIPortCommandList = 0x00,
+  kAHCIPortCommandListHigh = 0x04,
+  kAHCIPortFIS = 0x08,
+  kAHCIPortFISHigh = 0x0C,
+  kAHCIPortInterruptStatus = 0x10,
+  kAHCIPortInterruptEnable = 0x14,
+  kAHCIPortCommand = 0x18,
+  kAHCIPortTaskFile = 0x20,
+  kAHCIPortSignature = 0x24,
+  kAHCIPortSATAStatus = 0x28,
+  kAHCIPortSATAError = 0x30,
+  kAHCIPortSATAActive = 0x34,
+  kAHCIPortCommandIssue = 0x38,
+};
+
+enum AHCIPortBits {
+  kAHCIPortStart = 1u << 0,
+  kAHCIPortFISReceiveEnable = 1u << 4,
+  kAHCIPortFISReceiveRunning = 1u << 14,
+  kAHCIPortCommandListRunning = 1u << 15,
+
+  kAHCIPortTaskFileError = 0x01,
+  kAHCIPortTaskFileBusy = 0x88, // BSY or DRQ
+
+  // D2H register FIS, set device bits FIS and the fatal errors
+  kAHCIPortInterruptDeviceToHost = 1u << 0,
+  kAHCIPortInterruptSetDeviceBits = 1u << 3,
+  kAHCIPortInterruptErrors = (1u << 27) | (1u << 28) | (1u << 29) | (1u << 30),
+};
+
+#define AHCI_SIGNATURE_ATA 0x00000101 // NOLINT
+
+// SATA status, device present with the interface active
+#define AHCI_SSTS_DETECT_PRESENT 0x3 // NOLINT
+#define AHCI_SSTS_IPM_ACTIVE 0x1     // NOLINT
+
+enum AHCICommands {
+  kATAIdentify = 0xEC,
+  kATAReadDMAExt = 0x25,
+  kATAWriteDMAExt = 0x35,
+  kATAReadFPDMAQueued = 0x60,
+  kATAWriteFPDMAQueued = 0x61,
+};
+
+#define AHCI_FIS_HOST_TO_DEVICE 0x27 // NOLINT
+#define AHCI_FIS_COMMAND 0x80        // NOLINT
+#define AHCI_DEVICE_LBA 0x40         // NOLINT
+
+typedef struct {
+  uint32_t flags; // FIS length, write bit, PRDT length
+  volatile uint32_t transferred;
+  uint32_t table;
+  uint32_t table_high;
+  uint32_t reserved[4];
+} AHCICommandHeader;
+
+typedef struct {
+  uint32_t address;
+  uint32_t address_high;
+  uint32_t reserved;
+  uint32_t byte_count; // Minus one, bit 31 asks for an interrupt
+} AHCIPRD;
+
+typedef struct {
+  uint8_t fis[64];
+  uint8_t atapi[16];
+  uint8_t reserved[48];
+  AHCIPRD prdt[AHCI_PRDT_ENTRIES];
+} AHCICommandTable;
+
+// Everything the HBA reads or writes for one port. A slot is a command
+// header, its table and the request it works on; the tag of a queued command
+// is its slot number.
+typedef struct {
+  AHCICommandHeader headers[AHCI_SLOT_COUNT] __attribute__((aligned(1024)));
+  uint8_t received_fis[256] __attribute__((aligned(256)));
+  AHCICommandTable tables[AHCI_SLOT_COUNT] __attribute__((aligned(128)));
+
+  BlockDevice block;
+  volatile uint8_t *registers;
+  BlockRequest *slot_requests[AHCI_SLOT_COUNT];
+  uint32_t free_slots;  // Bit per slot
+  uint32_t outstanding; // Issued and not reaped yet
+  volatile uint32_t interrupt_status; // Cleared by the interrupt, not reaped
+  int depth;
+  bool ncq;
+
+  // Requests with sectors not yet handed to the disk, oldest first
+  BlockRequest *waiting;
+  BlockRequest **waiting_tail;
+
+  Spinlock lock;
+  char name[4];
+} AHCIPort;
+
+static volatile uint8_t *hba_;
+static AHCIPort ports_[AHCI_MAX_DISKS];
+static int port_count_ = 0;
+static IRQAction irq_action_;
+static SoftIRQ softirq_;
+static uint16_t identify_[256];
+
+static inline uint32_t AHCIRead(volatile uint8_t *base, uint32_t offset) {
+  return *(volatile uint32_t *)(base + offset);
+}
+
+static inline void AHCIWrite(volatile uint8_t *base, uint32_t offset,
+                             uint32_t value) {
+  *(volatile uint32_t *)(base + offset) = value;
+}
+
+static bool AHCIWaitClear(volatile uint8_t *base, uint32_t offset,
+                          uint32_t mask) {
+  for (int i = 0; i < AHCI_SPIN_LIMIT; i++) {
+    if (!(AHCIRead(base, offset) & mask)) {
+      return true;
+    }
+    CpuRelax();
+  }
+  return false;
+}
+
+static bool AHCIPortStop(AHCIPort *port) {
+  volatile uint8_t *registers = port->registers;
+  uint32_t command = AHCIRead(registers, kAHCIPortCommand);
+  AHCIWrite(registers, kAHCIPortCommand, command & ~kAHCIPortStart);
+  if (!AHCIWaitClear(registers, kAHCIPortCommand,
+                     kAHCIPortCommandListRunning)) {
+    return false;
+  }
+
+  command = AHCIRead(registers, kAHCIPortCommand);
+  AHCIWrite(registers, kAHCIPortCommand, command & ~kAHCIPortFISReceiveEnable);
+  return AHCIWaitClear(registers, kAHCIPortCommand,
+                       kAHCIPortFISReceiveRunning);
+}
+
+static void AHCIPortStart(AHCIPort *port) {
+  volatile uint8_t *registers = port->registers;
+  AHCIWrite(registers, kAHCIPortSATAError, 0xFFFFFFFF);
+  AHCIWrite(registers, kAHCIPortInterruptStatus, 0xFFFFFFFF);
+
+  uint32_t command = AHCIRead(registers, kAHCIPortCommand);
+  AHCIWrite(registers, kAHCIPortCommand,
+            command | kAHCIPortFISReceiveEnable | kAHCIPortStart);
+}
+
+// Command FIS and PRDT for one slot. The caller's buffer is physically
+// contiguous, it only needs more than one entry past the PRD size limit.
+static void AHCIBuildCommand(AHCIPort *port, int slot, uint8_t command,
+                             uint64_t lba, uint32_t count, void *buffer,
+                             bool write) {
+  AHCICommandTable *table = &port->tables[slot];
+  memset(table->fis, 0, sizeof(table->fis));
+
+  uint8_t *fis = table->fis;
+  fis[0] = AHCI_FIS_HOST_TO_DEVICE;
+  fis[1] = AHCI_FIS_COMMAND;
+  fis[2] = command;
+  fis[4] = lba;
+  fis[5] = lba >> 8;
+  fis[6] = lba >> 16;
+  fis[7] = AHCI_DEVICE_LBA;
+  fis[8] = lba >> 24;
+  fis[9] = lba >> 32;
+  fis[10] = lba >> 40;
+
+  // Queued commands carry the sector count in the features field and the
+  // tag in the count field
+  if (command == kATAReadFPDMAQueued || command == kATAWriteFPDMAQueued) {
+    fis[3] = count;
+    fis[11] = count >> 8;
+    fis[12] = slot << 3;
+  } else {
+    fis[12] = count;
+    fis[13] = count >> 8;
+  }
+
+  uint32_t address = (uint32_t)buffer;
+  uint32_t remaining = count * BLOCK_SECTOR_SIZE;
+  int entries = 0;
+  while (remaining > 0 && entries < AHCI_PRDT_ENTRIES) {
+    uint32_t bytes =
+        remaining > AHCI_PRD_MAX_BYTES ? AHCI_PRD_MAX_BYTES : remaining;
+    table->prdt[entries].address = address;
+    table->prdt[entries].address_high = 0;
+    table->prdt[entries].reserved = 0;
+    table->prdt[entries].byte_count = bytes - 1;
+    address += bytes;
+    remaining -= bytes;
+    entries++;
+  }
+
+  AHCICommandHeader *header = &port->headers[slot];
+  // Five dword command FIS
+  header->flags = 5 | (write ? 1 << 6 : 0) | ((uint32_t)entries << 16);
+  header->transferred = 0;
+}
+
+// Polled, only used while the port is otherwise idle
+static bool AHCIIdentify(AHCIPort *port) {
+  AHCIBuildCommand(port, 0, kATAIdentify, 0, 1, identify_, false);
+  port->tables[0].fis[7] = 0;
+
+  CompilerBarrier();
+  AHCIWrite(port->registers, kAHCIPortCommandIssue, 1);
+  if (!AHCIWaitClear(port->registers, kAHCIPortCommandIssue, 1)) {
+    return false;
+  }
+  return !(AHCIRead(port->registers, kAHCIPortTaskFile) &
+           kAHCIPortTaskFileError);
+}
+
+// Hand out free slots to waiting requests, then issue them all with one
+// write of the issue register. Called with the lock held.
+static void AHCIIssue(AHCIPort *port) {
+  uint32_t issue = 0;
+  while (port->waiting != NULL && port->free_slots != 0) {
+    BlockRequest *request = port->waiting;
+    uint32_t count = request->count - request->issued;
+    if (count > AHCI_MAX_TRANSFER) {
+      count = AHCI_MAX_TRANSFER;
+    }
+
+    int slot = __builtin_ctz(port->free_slots);
+    port->free_slots &= ~(1u << slot);
+    port->slot_requests[slot] = request;
+
+    uint8_t command;
+    if (port->ncq) {
+      command = request->write ? kATAWriteFPDMAQueued : kATAReadFPDMAQueued;
+    } else {
+      command = request->write ? kATAWriteDMAExt : kATAReadDMAExt;
+    }
+    AHCIBuildCommand(port, slot, command, request->lba + request->issued,
+                     count,
+                     (uint8_t *)request->buffer +
+                         request->issued * BLOCK_SECTOR_SIZE,
+                     request->write);
+    issue |= 1u << slot;
+
+    request->issued += count;
+    request->pending++;
+    if (request->issued == request->count) {
+      port->waiting = request->next;
+      if (port->waiting == NULL) {
+        port->waiting_tail = &port->waiting;
+      }
+    }
+  }
+
+  if (issue == 0) {
+    return;
+  }
+
+  // Tags have to be active before their commands are issued
+  CompilerBarrier();
+  port->outstanding |= issue;
+  if (port->ncq) {
+    AHCIWrite(port->registers, kAHCIPortSATAActive, issue);
+  }
+  AHCIWrite(port->registers, kAHCIPortCommandIssue, issue);
+}
+
+static void AHCIFinishSlot(AHCIPort *port, int slot, bool success,
+                           BlockRequest **completed) {
+  BlockRequest *request = port->slot_requests[slot];
+  if (!success) {
+    request->success = false;
+  }
+
+  port->slot_requests[slot] = NULL;
+  port->free_slots |= 1u << slot;
+  port->outstanding &= ~(1u << slot);
+
+  if (--request->pending == 0 && request->issued == request->count) {
+    request->next = *completed;
+    *completed = request;
+  }
+}
+
+// Collect finished commands and refill the queue. A task file error stops
+// the port; without reading the NCQ error log the failing tag is unknown, so
+// every command still active fails and the port restarts. Called with the
+// lock held, returns the requests that are now complete.
+static BlockRequest *AHCIReap(AHCIPort *port) {
+  BlockRequest *completed = NULL;
+  volatile uint8_t *registers = port->registers;
+
+  uint32_t status = AHCIRead(registers, kAHCIPortInterruptStatus);
+  AHCIWrite(registers, kAHCIPortInterruptStatus, status);
+  status |= AtomicExchange(&port->interrupt_status, 0);
+
+  uint32_t active = AHCIRead(registers, port->ncq ? kAHCIPortSATAActive
+                                                  : kAHCIPortCommandIssue);
+  uint32_t done = port->outstanding & ~active;
+
+  bool failed = (status & kAHCIPortInterruptErrors) ||
+                (AHCIRead(registers, kAHCIPortTaskFile) &
+                 kAHCIPortTaskFileError);
+  if (failed) {
+    done = port->outstanding;
+  }
+
+  while (done != 0) {
+    int slot = __builtin_ctz(done);
+    done &= ~(1u << slot);
+    AHCIFinishSlot(port, slot, !failed || !(active & (1u << slot)),
+                   &completed);
+  }
+
+  if (failed) {
+    printf("%s: command failed, task file %x\n", port->name,
+           AHCIRead(registers, kAHCIPortTaskFile));
+    AHCIPortStop(port);
+    AHCIPortStart(port);
+  }
+
+  AHCIIssue(port);
+  return completed;
+}
+
+static void AHCIComplete(BlockRequest *completed) {
+  while (completed != NULL) {
+    // The request belongs to its owner once completed
+    BlockRequest *next = completed->next;
+    BlockCompleteRequest(completed, completed->success);
+    completed = next;
+  }
+}
+
+static void AHCISubmit(BlockDevice *device, BlockRequest *request) {
+  AHCIPort *port = device->context;
+
+  // Cleared by the first command that fails
+  request->success = true;
+
+  uint32_t flags = SpinlockAcquireIrqSave(&port->lock);
+  *port->waiting_tail = request;
+  port->waiting_tail = &request->next;
+  AHCIIssue(port);
+  SpinlockReleaseIrqRestore(&port->lock, flags);
+}
+
+static void AHCIPoll(BlockDevice *device) {
+  AHCIPort *port = device->context;
+  uint32_t flags = SpinlockAcquireIrqSave(&port->lock);
+  BlockRequest *completed = AHCIReap(port);
+  SpinlockReleaseIrqRestore(&port->lock, flags);
+  AHCIComplete(completed);
+}
+
+// One line for the whole controller. Port status is cleared before the
+// global status, otherwise the port would raise the interrupt again, and is
+// kept for the bottom half to see errors in.
+static void AHCIInterrupt(ISRFrame *frame, void *context) {
+  uint32_t pending = AHCIRead(hba_, kAHCIInterruptStatus);
+  if (pending == 0) {
+    return;
+  }
+
+  for (int i = 0; i < port_count_; i++) {
+    AHCIPort *port = &ports_[i];
+    uint32_t status = AHCIRead(port->registers, kAHCIPortInterruptStatus);
+    AHCIWrite(port->registers, kAHCIPortInterruptStatus, status);
+    AtomicOr(&port->interrupt_status, status);
+  }
+  AHCIWrite(hba_, kAHCIInterruptStatus, pending);
+  SoftIRQRaise(&softirq_, pending);
+}
+
+// However many interrupts gathered, every disk is reaped once
+static void AHCISoftIRQ(void *context, const uint32_t *events,
+                        uint32_t count) {
+  for (int i = 0; i < port_count_; i++) {
+    AHCIPoll(&ports_[i].block);
+  }
+}
+
+static const BlockOperations kAHCIOperations = {
+    .submit = AHCISubmit,
+    .poll = AHCIPoll,
+};
+
+static uint64_t AHCIIdentifySectors() {
+  // LBA48 supported
+  if (identify_[83] & (1 << 10)) {
+    return (uint64_t)identify_[100] | (uint64_t)identify_[101] << 16 |
+           (uint64_t)identify_[102] << 32 | (uint64_t)identify_[103] << 48;
+  }
+  return identify_[60] | (uint32_t)identify_[61] << 16;
+}
+
+static bool AHCIPortProbe(AHCIPort *port, int index, uint32_t capabilities) {
+  port->registers = hba_ + kAHCIPortBase + index * kAHCIPortSize;
+  uint32_t sata_status = AHCIRead(port->registers, kAHCIPortSATAStatus);
+  if ((sata_status & 0xF) != AHCI_SSTS_DETECT_PRESENT ||
+      ((sata_status >> 8) & 0xF) != AHCI_SSTS_IPM_ACTIVE ||
+      AHCIRead(port->registers, kAHCIPortSignature) != AHCI_SIGNATURE_ATA) {
+    return false;
+  }
+
+  if (!AHCIPortStop(port)) {
+    return false;
+  }
+
+  for (int slot = 0; slot < AHCI_SLOT_COUNT; slot++) {
+    port->headers[slot].table = (uint32_t)&port->tables[slot];
+    port->headers[slot].table_high = 0;
+  }
+  AHCIWrite(port->registers, kAHCIPortCommandList, (uint32_t)port->headers);
+  AHCIWrite(port->registers, kAHCIPortCommandListHigh, 0);
+  AHCIWrite(port->registers, kAHCIPortFIS, (uint32_t)port->received_fis);
+  AHCIWrite(port->registers, kAHCIPortFISHigh, 0);
+  AHCIPortStart(port);
+
+  if (!AHCIWaitClear(port->registers, kAHCIPortTaskFile,
+                     kAHCIPortTaskFileBusy) ||
+      !AHCIIdentify(port)) {
+    return false;
+  }
+
+  // The queue is as deep as both the HBA and the disk allow
+  int slots = ((capabilities >> 8) & 0x1F) + 1;
+  port->ncq = (capabilities & kAHCICapNCQ) && (identify_[76] & (1 << 8));
+  port->depth = port->ncq ? (identify_[75] & 0x1F) + 1 : 1;
+  if (port->depth > slots) {
+    port->depth = slots;
+  }
+  port->free_slots = port->depth == 32 ? 0xFFFFFFFF : (1u << port->depth) - 1;
+  port->outstanding = 0;
+
+  port->waiting = NULL;
+  port->waiting_tail = &port->waiting;
+  SpinlockInitialize(&port->lock);
+
+  port->block.sector_count = AHCIIdentifySectors();
+  port->block.operations = &kAHCIOperations;
+  port->block.context = port;
+
+  AHCIWrite(port->registers, kAHCIPortInterruptStatus, 0xFFFFFFFF);
+  AHCIWrite(port->registers, kAHCIPortInterruptEnable,
+            kAHCIPortInterruptDeviceToHost | kAHCIPortInterruptSetDeviceBits |
+                kAHCIPortInterruptErrors);
+  return true;
+}
+
+// Completions from all disks raise one interrupt per timeout or count when
+// the HBA supports coalescing. QEMU's does not, there the bottom half still
+// reaps every finished slot per batch of interrupts.
+static void AHCIEnableCoalescing(uint32_t capabilities, uint32_t ports) {
+  if (!(capabilities & kAHCICapCoalescing)) {
+    return;
+  }
+
+  uint32_t control = AHCIRead(hba_, kAHCICoalescingControl);
+  AHCIWrite(hba_, kAHCICoalescingControl, control & ~1u);
+  AHCIWrite(hba_, kAHCICoalescingPorts, ports);
+
+  // 1 ms timeout or 16 completions, whichever comes first
+  control = (1u << 16) | (16u << 8) | (control & 0xF8) | 1u;
+  AHCIWrite(hba_, kAHCICoalescingControl, control);
+}
+
+int AHCIInitialize() {
+  PCIDevice *pci = NULL;
+  for (int i = 0; i < PCIDeviceCount() && pci == NULL; i++) {
+    PCIDevice *candidate = PCIGetDevice(i);
+    if (candidate->class_code == kAHCIClassStorage &&
+        candidate->subclass == kAHCISubclassSATA &&
+        candidate->prog_if == kAHCIProgIFAHCI) {
+      pci = candidate;
+    }
+  }
+  if (pci == NULL || PCIBarAddress(pci, AHCI_ABAR) == 0) {
+    return 0;
+  }
+
+  PCIUpdateCommand(pci, kPCICommandMemory | kPCICommandBusMaster,
+                   kPCICommandInterruptDisable);
+  hba_ = (volatile uint8_t *)PCIBarAddress(pci, AHCI_ABAR);
+  AHCIWrite(hba_, kAHCIGlobalControl,
+            AHCIRead(hba_, kAHCIGlobalControl) | kAHCIGlobalAHCIEnable);
+
+  uint32_t capabilities = AHCIRead(hba_, kAHCICapabilities);
+  uint32_t implemented = AHCIRead(hba_, kAHCIPortsImplemented);
+  uint32_t used = 0;
+
+  for (int i = 0; i < AHCI_PORT_COUNT && port_count_ < AHCI_MAX_DISKS; i++) {
+    if (!(implemented & (1u << i))) {
+      continue;
+    }
+
+    AHCIPort *port = &ports_[port_count_];
+    port->name[0] = 's';
+    port->name[1] = 'd';
+    port->name[2] = '0' + port_count_;
+    port->name[3] = '\0';
+    port->block.name = port->name;
+    if (!AHCIPortProbe(port, i, capabilities)) {
+      continue;
+    }
+
+    port_count_++;
+    used |= 1u << i;
+    BlockRegister(&port->block);
+    printf("%s: %llu MiB on port %d, %s, %d commands in flight\n", port->name,
+           port->block.sector_count / 2048, i, port->ncq ? "NCQ" : "no NCQ",
+           port->depth);
+  }
+
+  if (port_count_ == 0) {
+    return 0;
+  }
+
+  AHCIEnableCoalescing(capabilities, used);
+
+  // Without an interrupt line BlockWait still reaps completions by polling
+  if (pci->irq_line < PIC_IRQ_COUNT) {
+    softirq_.handler = AHCISoftIRQ;
+    softirq_.coalesce = AHCI_SOFTIRQ_COALESCE;
+    irq_action_.handler = AHCIInterrupt;
+    irq_action_.context = NULL;
+    IRQRegisterHandler(pci->irq_line, &irq_action_);
+  }
+
+  AHCIWrite(hba_, kAHCIInterruptStatus, 0xFFFFFFFF);
+  AHCIWrite(hba_, kAHCIGlobalControl,
+            AHCIRead(hba_, kAHCIGlobalControl) | kAHCIGlobalInterruptEnable);
+  return port_count_;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Registers every SATA disk behind the first AHCI controller as "sd0",
+// "sd1", ... Disks that support native command queuing get up to 32 commands
+// in flight, the others one at a time. Returns the number of disks found.
+int AHCIInitialize();
@@ -0,0 +1,119 @@
+#include "apic.h"
+#include "pit.h"
+#include "x86.h"
+
+enum APICRegisters {
+  kAPICRegisterId = 0x020,
+  kAPICRegisterTaskPriority = 0x080,
+  kAPICRegisterEndOfInterrupt = 0x0B0,
+  kAPICRegisterSpurious = 0x0F0,
+  kAPICRegisterCommandLow = 0x300,
+  kAPICRegisterCommandHigh = 0x310,
+  kAPICRegisterTimer = 0x320,
+  kAPICRegisterTimerInitial = 0x380,
+  kAPICRegisterTimerCurrent = 0x390,
+  kAPICRegisterTimerDivide = 0x3E0,
+};
+
+enum APICCommandBits {
+  kAPICCommandInit = 0x00000500,
+  kAPICCommandStartup = 0x00000600,
+  kAPICCommandPending = 0x00001000,
+  kAPICCommandAssert = 0x00004000,
+  kAPICCommandLevel = 0x00008000,
+};
+
+enum APICTimerBits {
+  kAPICTimerMasked = 0x00010000,
+  kAPICTimerPeriodic = 0x00020000,
+};
+
+#define APIC_BASE_MSR 0x1B               // NOLINT
+#define APIC_BASE_MSR_ENABLE 0x800       // NOLINT
+#define APIC_SPURIOUS_ENABLE 0x100       // NOLINT
+#define APIC_SPURIOUS_VECTOR 0xFF        // NOLINT
+#define CPUID_FEATURE_APIC (1 << 9)      // NOLINT
+#define APIC_TIMER_DIVIDE_16 0x3         // NOLINT
+#define APIC_CALIBRATE_DELAY 10000       // NOLINT, microseconds
+
+static volatile uint8_t *apic_ = (volatile uint8_t *)APIC_DEFAULT_ADDRESS;
+
+static inline uint32_t APICRead(uint32_t reg) {
+  return *(volatile uint32_t *)(apic_ + reg);
+}
+
+static inline void APICWrite(uint32_t reg, uint32_t value) {
+  *(volatile uint32_t *)(apic_ + reg) = value;
+}
+
+bool APICInitialize(uint32_t address) {
+  x86_CPUIDResult features;
+  x86_CPUID(1, &features);
+  if ((features.edx & CPUID_FEATURE_APIC) == 0) {
+    return false;
+  }
+
+  apic_ = (volatile uint8_t *)address;
+
+  // Make sure the APIC is globally enabled at the given base
+  uint64_t base = x86_ReadMSR(APIC_BASE_MSR);
+  x86_WriteMSR(APIC_BASE_MSR,
+               (address & 0xFFFFF000) | (base & 0xFFF) | APIC_BASE_MSR_ENABLE,
+               0);
+
+  APICEnable();
+  return true;
+}
+
+// Software-enable the local APIC of the calling CPU
+void APICEnable() {
+  APICWrite(kAPICRegisterTaskPriority, 0);
+  APICWrite(kAPICRegisterSpurious,
+            APIC_SPURIOUS_ENABLE | APIC_SPURIOUS_VECTOR);
+}
+
+uint8_t APICId() { return APICRead(kAPICRegisterId) >> 24; }
+
+static void APICSendCommand(uint8_t apic_id, uint32_t command) {
+  APICWrite(kAPICRegisterCommandHigh, (uint32_t)apic_id << 24);
+  APICWrite(kAPICRegisterCommandLow, command);
+
+  while (APICRead(kAPICRegisterCommandLow) & kAPICCommandPending)
+    ;
+}
+
+void APICSendInit(uint8_t apic_id) {
+  APICSendCommand(apic_id,
+                  kAPICCommandInit | kAPICCommandAssert | kAPICCommandLevel);
+  APICSendCommand(apic_id, kAPICCommandInit | kAPICCommandLevel);
+}
+
+void APICSendStartup(uint8_t apic_id, uint8_t vector) {
+  APICSendCommand(apic_id, kAPICCommandStartup | kAPICCommandAssert | vector);
+}
+
+void APICEndOfInterrupt() { APICWrite(kAPICRegisterEndOfInterrupt, 0); }
+
+// Count down from the maximum for a fixed PIT delay. The timer runs off the
+// bus clock, which is the same on every CPU.
+uint32_t APICTimerFrequency() {
+  APICWrite(kAPICRegisterTimerDivide, APIC_TIMER_DIVIDE_16);
+  APICWrite(kAPICRegisterTimer, kAPICTimerMasked);
+  APICWrite(kAPICRegisterTimerInitial, 0xFFFFFFFF);
+  PITDelay(APIC_CALIBRATE_DELAY);
+  uint32_t elapsed = 0xFFFFFFFF - APICRead(kAPICRegisterTimerCurrent);
+  APICWrite(kAPICRegisterTimerInitial, 0);
+
+  return elapsed * (1000000 / APIC_CALIBRATE_DELAY);
+}
+
+void APICStartTimer(uint8_t vector, uint32_t count) {
+  APICWrite(kAPICRegisterTimerDivide, APIC_TIMER_DIVIDE_16);
+  APICWrite(kAPICRegisterTimer, kAPICTimerPeriodic | vector);
+  APICWrite(kAPICRegisterTimerInitial, count);
+}
+
+void APICStopTimer() {
+  APICWrite(kAPICRegisterTimer, kAPICTimerMasked);
+  APICWrite(kAPICRegisterTimerInitial, 0);
+}
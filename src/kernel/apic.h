@@ -0,0 +1,17 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#define APIC_DEFAULT_ADDRESS 0xFEE00000 // NOLINT
+
+bool APICInitialize(uint32_t address);
+void APICEnable();
+uint8_t APICId();
+void APICSendInit(uint8_t apic_id);
+void APICSendStartup(uint8_t apic_id, uint8_t vector);
+void APICEndOfInterrupt();
+
+// Local timer of the calling CPU, counting in ticks of APICTimerFrequency
+uint32_t APICTimerFrequency();
+void APICStartTimer(uint8_t vector, uint32_t count);
+void APICStopTimer();
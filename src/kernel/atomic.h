@@ -0,0 +1,98 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Atomic operations built directly on the x86 locked instructions. Plain
+// aligned loads and stores are already atomic, and under x86 ordering loads
+// act as acquires and stores as releases, so only the compiler needs fencing
+// for those.
+
+static inline void CompilerBarrier() { __asm__ volatile("" ::: "memory"); }
+
+// Full barrier, including store-load ordering. A locked add on the stack
+// works on every i686, unlike mfence which needs SSE2.
+static inline void AtomicFence() {
+  __asm__ volatile("lock; addl $0, (%%esp)" ::: "memory", "cc");
+}
+
+static inline void CpuRelax() { __asm__ volatile("pause" ::: "memory"); }
+
+static inline uint32_t AtomicLoad(const volatile uint32_t *ptr) {
+  uint32_t value = *ptr;
+  CompilerBarrier();
+  return value;
+}
+
+static inline void AtomicStore(volatile uint32_t *ptr, uint32_t value) {
+  CompilerBarrier();
+  *ptr = value;
+}
+
+// Returns the value before the addition
+static inline uint32_t AtomicAdd(volatile uint32_t *ptr, uint32_t value) {
+  __asm__ volatile("lock; xaddl %0, %1"
+                   : "+r"(value), "+m"(*ptr)
+                   :
+                   : "memory", "cc");
+  return value;
+}
+
+static inline uint32_t AtomicSub(volatile uint32_t *ptr, uint32_t value) {
+  return AtomicAdd(ptr, -value);
+}
+
+static inline void AtomicOr(volatile uint32_t *ptr, uint32_t bits) {
+  __asm__ volatile("lock; orl %1, %0"
+                   : "+m"(*ptr)
+                   : "ir"(bits)
+                   : "memory", "cc");
+}
+
+static inline void AtomicIncrement(volatile uint32_t *ptr) {
+  __asm__ volatile("lock; incl %0" : "+m"(*ptr) : : "memory", "cc");
+}
+
+// Returns true if the counter dropped to zero
+static inline bool AtomicDecrementAndTest(volatile uint32_t *ptr) {
+  uint8_t zero;
+  __asm__ volatile("lock; decl %0; sete %1"
+                   : "+m"(*ptr), "=qm"(zero)
+                   :
+                   : "memory", "cc");
+  return zero != 0;
+}
+
+// Returns the previous value
+static inline uint32_t AtomicExchange(volatile uint32_t *ptr, uint32_t value) {
+  __asm__ volatile("xchgl %0, %1" : "+r"(value), "+m"(*ptr) : : "memory");
+  return value;
+}
+
+// Returns the value found at ptr, the exchange happened if it equals expected
+static inline uint32_t AtomicCompareExchange(volatile uint32_t *ptr,
+                                             uint32_t expected,
+                                             uint32_t desired) {
+  uint32_t previous;
+  __asm__ volatile("lock; cmpxchgl %2, %1"
+                   : "=a"(previous), "+m"(*ptr)
+                   : "r"(desired), "0"(expected)
+                   : "memory", "cc");
+  return previous;
+}
+
+static inline bool AtomicTryCompareExchange(volatile uint32_t *ptr,
+                                            uint32_t expected,
+                                            uint32_t desired) {
+  return AtomicCompareExchange(ptr, expected, desired) == expected;
+}
+
+static inline void *AtomicExchangePointer(void *volatile *ptr, void *value) {
+  return (void *)AtomicExchange((volatile uint32_t *)ptr, (uint32_t)value);
+}
+
+static inline void *AtomicCompareExchangePointer(void *volatile *ptr,
+                                                 void *expected,
+                                                 void *desired) {
+  return (void *)AtomicCompareExchange(
+      (volatile uint32_t *)ptr, (uint32_t)expected, (uint32_t)desired);
+}
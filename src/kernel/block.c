@@ -0,0 +1,111 @@
+#include "block.h"
+#include "atomic.h"
+#include "spinlock.h"
+#include <stddef.h>
+
+static BlockDevice *devices_ = NULL;
+static BlockDevice **devices_tail_ = &devices_;
+static Spinlock devices_lock_ = SPINLOCK_INITIALIZER;
+
+// Devices are never removed, so walking the list needs no lock
+void BlockRegister(BlockDevice *device) {
+  device->next = NULL;
+  SpinlockAcquire(&devices_lock_);
+  *devices_tail_ = device;
+  devices_tail_ = &device->next;
+  SpinlockRelease(&devices_lock_);
+}
+
+BlockDevice *BlockFirst() { return devices_; }
+
+static bool BlockInRange(BlockDevice *device, uint64_t lba, uint32_t count) {
+  return lba < device->sector_count && count <= device->sector_count - lba;
+}
+
+// Synchronous path for drivers that only queue requests
+static bool BlockTransfer(BlockDevice *device, bool write, uint64_t lba,
+                          uint32_t count, void *buffer) {
+  BlockRequest request = {
+      .write = write,
+      .lba = lba,
+      .count = count,
+      .buffer = buffer,
+  };
+  BlockSubmit(device, &request);
+  BlockWait(device, &request);
+  return request.success;
+}
+
+bool BlockRead(BlockDevice *device, uint64_t lba, uint32_t count,
+               void *buffer) {
+  const BlockOperations *operations = device->operations;
+  if (operations->read == NULL && operations->submit != NULL) {
+    return BlockTransfer(device, false, lba, count, buffer);
+  }
+  if (!BlockInRange(device, lba, count) || operations->read == NULL) {
+    return false;
+  }
+
+  return count == 0 || operations->read(device, lba, count, buffer);
+}
+
+bool BlockWrite(BlockDevice *device, uint64_t lba, uint32_t count,
+                const void *buffer) {
+  const BlockOperations *operations = device->operations;
+  if (operations->write == NULL && operations->submit != NULL) {
+    return BlockTransfer(device, true, lba, count, (void *)buffer);
+  }
+  if (!BlockInRange(device, lba, count) || operations->write == NULL) {
+    return false;
+  }
+
+  return count == 0 || operations->write(device, lba, count, buffer);
+}
+
+void BlockSubmit(BlockDevice *device, BlockRequest *request) {
+  const BlockOperations *operations = device->operations;
+  request->done = false;
+  request->success = false;
+  request->issued = 0;
+  request->pending = 0;
+  request->next = NULL;
+
+  if (!BlockInRange(device, request->lba, request->count)) {
+    BlockCompleteRequest(request, false);
+  } else if (request->count == 0) {
+    BlockCompleteRequest(request, true);
+  } else if (operations->submit != NULL) {
+    operations->submit(device, request);
+  } else if (request->write) {
+    BlockCompleteRequest(request, BlockWrite(device, request->lba,
+                                             request->count, request->buffer));
+  } else {
+    BlockCompleteRequest(request, BlockRead(device, request->lba,
+                                            request->count, request->buffer));
+  }
+}
+
+void BlockPoll(BlockDevice *device) {
+  if (device->operations->poll != NULL) {
+    device->operations->poll(device);
+  }
+}
+
+// Polling as well keeps this working before interrupts are enabled
+void BlockWait(BlockDevice *device, BlockRequest *request) {
+  while (!request->done) {
+    BlockPoll(device);
+    CpuRelax();
+  }
+}
+
+void BlockCompleteRequest(BlockRequest *request, bool success) {
+  request->success = success;
+  if (request->complete != NULL) {
+    request->complete(request);
+  }
+
+  // The request goes back to its owner with this store
+  CompilerBarrier();
+  request->done = true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BLOCK_SECTOR_SIZE 512 // NOLINT
+
+typedef struct BlockDevice BlockDevice;
+typedef struct BlockRequest BlockRequest;
+
+typedef void (*BlockCompletion)(BlockRequest *request);
+
+// An asynchronous transfer. The block layer and the driver own it from submit
+// until done is set, complete runs just before that and must not resubmit it.
+// The buffer is handed to the device as a physical address.
+struct BlockRequest {
+  bool write;
+  uint64_t lba;
+  uint32_t count;
+  void *buffer;
+  BlockCompletion complete; // Optional, may run in interrupt context
+  void *context;
+
+  // Set by the block layer and the driver
+  volatile bool done;
+  bool success;
+  uint32_t issued;  // Sectors handed to the device so far
+  uint32_t pending; // Driver commands still in flight
+  struct BlockRequest *next;
+};
+
+// Driver entry points, lba and count are in sectors and already checked
+// against the device size. Drivers implement read/write, submit, or both.
+// submit queues the request and completes it later through
+// BlockCompleteRequest, poll reaps finished commands without an interrupt.
+typedef struct {
+  bool (*read)(BlockDevice *device, uint64_t lba, uint32_t count,
+               void *buffer);
+  bool (*write)(BlockDevice *device, uint64_t lba, uint32_t count,
+                const void *buffer);
+  void (*submit)(BlockDevice *device, BlockRequest *request);
+  void (*poll)(BlockDevice *device);
+} BlockOperations;
+
+// Owned by the driver and must stay valid once registered
+struct BlockDevice {
+  const char *name;
+  uint64_t sector_count;
+  const BlockOperations *operations;
+  void *context;
+  struct BlockDevice *next;
+};
+
+void BlockRegister(BlockDevice *device);
+BlockDevice *BlockFirst();
+bool BlockRead(BlockDevice *device, uint64_t lba, uint32_t count,
+               void *buffer);
+bool BlockWrite(BlockDevice *device, uint64_t lba, uint32_t count,
+                const void *buffer);
+
+// Start a request, devices without submit run it synchronously. Requests
+// outside the device complete immediately with success false.
+void BlockSubmit(BlockDevice *device, BlockRequest *request);
+void BlockWait(BlockDevice *device, BlockRequest *request);
+
+// Reap whatever the device has finished, for callers waiting on several
+// requests at once
+void BlockPoll(BlockDevice *device);
+
+// Called by drivers once a submitted request has finished
+void BlockCompleteRequest(BlockRequest *request, bool success);
@@ -0,0 +1,80 @@
+#include "boot.h"
+#include "pit.h"
+#include "stdio.h"
+#include "x86.h"
+#include <stddef.h>
+
+static const char *const kBootPhaseNames[kBootPhaseCount] = {
+    [kBootPhaseStage2Entry] = "stage2-entry",
+    [kBootPhaseStage2ImageLoaded] = "stage2-image",
+    [kBootPhaseStage2DiskReady] = "stage2-disk",
+    [kBootPhaseKernelLoaded] = "kernel-loaded",
+    [kBootPhaseKernelEntry] = "kernel-entry",
+    [kBootPhaseInterruptsReady] = "interrupts",
+    [kBootPhaseSMPReady] = "smp",
+    [kBootPhaseDevicesReady] = "devices",
+    [kBootPhaseDone] = "done",
+};
+
+#define BOOT_CALIBRATION_US 10000 // NOLINT
+
+static BootParams boot_params_;
+
+// Stage2's copy lives in low memory that the kernel reuses, so keep our own
+void BootInitialize(const BootParams *boot_params) {
+  uint64_t now = x86_ReadTSC();
+
+  if (boot_params != NULL && boot_params->magic == BOOT_PARAMS_MAGIC) {
+    boot_params_ = *boot_params;
+  } else {
+    boot_params_.magic = 0;
+    boot_params_.boot_drive = 0;
+    boot_params_.ramdisk_address = 0;
+    boot_params_.ramdisk_size = 0;
+    boot_params_.modules_address = 0;
+    boot_params_.modules_size = 0;
+  }
+
+  boot_params_.timestamps[kBootPhaseKernelEntry] = now;
+}
+
+const BootParams *BootGetParams() { return &boot_params_; }
+
+void BootMarkPhase(int phase) {
+  boot_params_.timestamps[phase] = x86_ReadTSC();
+}
+
+// Phases are printed in microseconds since stage2 started, one per line so
+// scripts can pick them out of the serial log
+void BootReport() {
+  uint64_t start = x86_ReadTSC();
+  PITDelay(BOOT_CALIBRATION_US);
+  uint32_t cycles_per_us =
+      (uint32_t)((x86_ReadTSC() - start) / BOOT_CALIBRATION_US);
+  if (cycles_per_us == 0) {
+    cycles_per_us = 1;
+  }
+
+  int first = (boot_params_.magic == BOOT_PARAMS_MAGIC) ? kBootPhaseStage2Entry
+                                                        : kBootPhaseKernelEntry;
+  uint64_t origin = boot_params_.timestamps[first];
+  for (int phase = first; phase < kBootPhaseCount; phase++) {
+    uint64_t stamp = boot_params_.timestamps[phase];
+    if (stamp == 0) {
+      continue;
+    }
+
+    printf("boot: %s %u us\n", kBootPhaseNames[phase],
+           (uint32_t)((stamp - origin) / cycles_per_us));
+  }
+
+  printf("boot: tsc %u MHz\n", cycles_per_us);
+}
+
+// Leave QEMU through isa-debug-exit, real hardware just stops here
+void BootExit(uint8_t code) {
+  x86_outb(BOOT_EXIT_PORT, code);
+  for (;;) {
+    x86_Halt();
+  }
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <boot/bootparams.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Values written to QEMU's isa-debug-exit device, QEMU exits with
+// (value << 1) | 1 so a clean run reports 33
+#define BOOT_EXIT_PORT 0xF4    // NOLINT
+#define BOOT_EXIT_SUCCESS 0x10 // NOLINT
+#define BOOT_EXIT_FAILURE 0x11 // NOLINT
+
+void BootInitialize(const BootParams *boot_params);
+const BootParams *BootGetParams();
+void BootMarkPhase(int phase);
+void BootReport();
+void BootExit(uint8_t code);
@@ -0,0 +1,582 @@
+#include "fatfs.h"
+#include "memory.h"
+#include "page.h"
+#include "spinlock.h"
+#include "vfs.h"
+#include <stddef.h>
+
+#define FATFS_MAX_VOLUMES 4          // NOLINT
+#define FATFS_ENTRY_SIZE 32          // NOLINT
+#define FATFS_ENTRIES_PER_SECTOR (BLOCK_SECTOR_SIZE / FATFS_ENTRY_SIZE)
+#define FATFS_ROOT_INO 1             // NOLINT
+#define FATFS_SIGNATURE 0xAA55       // NOLINT
+#define FATFS_FAT12_CLUSTERS 4085    // NOLINT
+#define FATFS_FAT16_CLUSTERS 65525   // NOLINT
+
+enum FATFSAttributes {
+  kFATFSAttributeVolumeId = 0x08,
+  kFATFSAttributeDirectory = 0x10,
+  kFATFSAttributeLFN = 0x0F,
+};
+
+#pragma pack(push, 1)
+
+typedef struct {
+  uint8_t boot_jump_instruction[3];
+  uint8_t oem_identifier[8];
+  uint16_t bytes_per_sector;
+  uint8_t sectors_per_cluster;
+  uint16_t reserved_sectors;
+  uint8_t fat_count;
+  uint16_t dir_entry_count;
+  uint16_t total_sectors;
+  uint8_t media_descriptor_type;
+  uint16_t sectors_per_fat;
+  uint16_t sectors_per_track;
+  uint16_t heads;
+  uint32_t hidden_sectors;
+  uint32_t large_sector_count;
+
+  // FAT32 only, FAT12/16 have their extended boot record here
+  uint32_t sectors_per_fat32;
+  uint16_t flags;
+  uint16_t version;
+  uint32_t root_cluster;
+} FATFSBootSector;
+
+typedef struct {
+  uint8_t name[11];
+  uint8_t attributes;
+  uint8_t _reserved;
+  uint8_t created_time_tenths;
+  uint16_t created_time;
+  uint16_t created_date;
+  uint16_t accessed_date;
+  uint16_t first_cluster_high;
+  uint16_t modified_time;
+  uint16_t modified_date;
+  uint16_t first_cluster_low;
+  uint32_t size;
+} FATFSDirectoryEntry;
+
+#pragma pack(pop)
+
+typedef struct {
+  BlockDevice *device;
+  uint32_t bits; // 12, 16 or 32
+  uint32_t sectors_per_cluster;
+  uint32_t cluster_size;
+  uint32_t fat_lba;
+  uint32_t root_lba; // FAT12/16 keep the root directory outside clusters
+  uint32_t root_sectors;
+  uint32_t root_cluster; // FAT32 root, 0 otherwise
+  uint32_t data_lba;
+  uint32_t cluster_count;
+
+  // FAT12 entries may straddle two sectors, so two are cached
+  Spinlock fat_lock;
+  uint32_t fat_cached_lba;
+  uint8_t fat_cache[BLOCK_SECTOR_SIZE * 2];
+
+  Spinlock cursor_lock; // Inode cursors, read and written as pairs
+} FATFSVolume;
+
+// Inode fs_data slots
+enum FATFSInodeData {
+  kFATFSFirstCluster, // 0 for the FAT12/16 root directory
+
+  // A cursor into the cluster chain for sequential reads
+  kFATFSCursorCluster,
+  kFATFSCursorIndex, // Cluster number within the file, valid with the above
+};
+
+static FATFSVolume volumes_[FATFS_MAX_VOLUMES];
+static int volume_count_;
+static Spinlock volumes_lock_ = SPINLOCK_INITIALIZER;
+
+static const VFSInodeOperations kFATFSInodeOperations;
+static const VFSFileOperations kFATFSFileOperations;
+
+static uint32_t FATFSClusterToLba(const FATFSVolume *volume,
+                                  uint32_t cluster) {
+  return volume->data_lba + (cluster - 2) * volume->sectors_per_cluster;
+}
+
+// The disk is read without the lock, so other chain walks only wait for the
+// copy. Two CPUs missing at once both read, the last one installs its pair.
+static bool FATFSReadFatBytes(FATFSVolume *volume, uint32_t offset,
+                              uint32_t size, uint32_t *value_out) {
+  uint32_t lba = volume->fat_lba + offset / BLOCK_SECTOR_SIZE;
+  uint32_t within = offset % BLOCK_SECTOR_SIZE;
+  uint32_t value = 0;
+
+  SpinlockAcquire(&volume->fat_lock);
+  if (volume->fat_cached_lba == lba) {
+    memcpy(&value, volume->fat_cache + within, size);
+    SpinlockRelease(&volume->fat_lock);
+    *value_out = value;
+    return true;
+  }
+  SpinlockRelease(&volume->fat_lock);
+
+  uint8_t sectors[BLOCK_SECTOR_SIZE * 2];
+  if (!BlockRead(volume->device, lba, 2, sectors)) {
+    return false;
+  }
+  memcpy(&value, sectors + within, size);
+
+  SpinlockAcquire(&volume->fat_lock);
+  memcpy(volume->fat_cache, sectors, sizeof(sectors));
+  volume->fat_cached_lba = lba;
+  SpinlockRelease(&volume->fat_lock);
+
+  *value_out = value;
+  return true;
+}
+
+// The cluster after this one, 0 at the end of the chain or on errors
+static uint32_t FATFSNextCluster(FATFSVolume *volume, uint32_t cluster) {
+  uint32_t value;
+  uint32_t end;
+  switch (volume->bits) {
+  case 12:
+    if (!FATFSReadFatBytes(volume, cluster * 3 / 2, 2, &value)) {
+      return 0;
+    }
+    value = (cluster & 1) ? value >> 4 : value & 0x0FFF;
+    end = 0xFF8;
+    break;
+  case 16:
+    if (!FATFSReadFatBytes(volume, cluster * 2, 2, &value)) {
+      return 0;
+    }
+    end = 0xFFF8;
+    break;
+  default:
+    if (!FATFSReadFatBytes(volume, cluster * 4, 4, &value)) {
+      return 0;
+    }
+    value &= 0x0FFFFFFF;
+    end = 0x0FFFFFF8;
+    break;
+  }
+
+  return (value >= 2 && value < end && value < volume->cluster_count + 2)
+             ? value
+             : 0;
+}
+
+// "NAME.EXT" without the padding
+static uint32_t FATFSFormatName(const FATFSDirectoryEntry *entry,
+                                char *name_out) {
+  uint32_t length = 0;
+  for (int i = 0; i < 8 && entry->name[i] != ' '; i++) {
+    name_out[length++] = entry->name[i];
+  }
+  if (length > 0 && (uint8_t)name_out[0] == 0x05) {
+    name_out[0] = (char)0xE5; // Escaped deleted-entry marker
+  }
+  if (entry->name[8] != ' ') {
+    name_out[length++] = '.';
+    for (int i = 8; i < 11 && entry->name[i] != ' '; i++) {
+      name_out[length++] = entry->name[i];
+    }
+  }
+  name_out[length] = '\0';
+  return length;
+}
+
+static char FATFSUpper(char c) {
+  return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+}
+
+// Short names are stored in upper case and compared without case
+static bool FATFSNameEquals(const char *stored, uint32_t stored_length,
+                            const char *name, uint32_t length) {
+  if (stored_length != length) {
+    return false;
+  }
+  for (uint32_t i = 0; i < length; i++) {
+    if (FATFSUpper(stored[i]) != FATFSUpper(name[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool FATFSIsVisible(const FATFSDirectoryEntry *entry) {
+  return entry->name[0] != 0xE5 && entry->name[0] != '.' &&
+         (entry->attributes & kFATFSAttributeLFN) != kFATFSAttributeLFN &&
+         !(entry->attributes & kFATFSAttributeVolumeId);
+}
+
+typedef bool (*FATFSVisitor)(void *context, const FATFSDirectoryEntry *entry,
+                             uint32_t index, uint32_t lba);
+
+// Call visit for every entry from index on, reading the directory a sector
+// at a time and decoding entries in place. Stops at the end marker or when
+// visit returns false. Returns false on read errors.
+static bool FATFSScan(FATFSVolume *volume, VFSInode *directory,
+                      uint32_t index, FATFSVisitor visit, void *context) {
+  uint8_t sector[BLOCK_SECTOR_SIZE];
+  uint32_t cluster = directory->fs_data[kFATFSFirstCluster];
+  uint32_t sector_index = index / FATFS_ENTRIES_PER_SECTOR;
+
+  // Skip whole clusters up front
+  if (cluster != 0) {
+    while (sector_index >= volume->sectors_per_cluster) {
+      cluster = FATFSNextCluster(volume, cluster);
+      if (cluster == 0) {
+        return true;
+      }
+      sector_index -= volume->sectors_per_cluster;
+    }
+  }
+
+  for (;;) {
+    uint32_t lba;
+    if (cluster == 0) {
+      if (sector_index >= volume->root_sectors) {
+        return true;
+      }
+      lba = volume->root_lba + sector_index;
+    } else {
+      if (sector_index >= volume->sectors_per_cluster) {
+        cluster = FATFSNextCluster(volume, cluster);
+        if (cluster == 0) {
+          return true;
+        }
+        sector_index = 0;
+      }
+      lba = FATFSClusterToLba(volume, cluster) + sector_index;
+    }
+
+    if (!BlockRead(volume->device, lba, 1, sector)) {
+      return false;
+    }
+
+    const FATFSDirectoryEntry *entries = (const FATFSDirectoryEntry *)sector;
+    for (uint32_t i = index % FATFS_ENTRIES_PER_SECTOR;
+         i < FATFS_ENTRIES_PER_SECTOR; i++, index++) {
+      if (entries[i].name[0] == 0x00) {
+        return true;
+      }
+      if (!visit(context, &entries[i], index, lba)) {
+        return true;
+      }
+    }
+    sector_index++;
+  }
+}
+
+static uint32_t FATFSEntryCluster(const FATFSVolume *volume,
+                                  const FATFSDirectoryEntry *entry) {
+  uint32_t cluster = entry->first_cluster_low;
+  if (volume->bits == 32) {
+    cluster |= (uint32_t)entry->first_cluster_high << 16;
+  }
+  return cluster;
+}
+
+typedef struct {
+  VFSInode *directory;
+  const char *name;
+  uint32_t length;
+  VFSInode *inode;
+  bool found;
+} FATFSLookup;
+
+static bool FATFSLookupVisit(void *context, const FATFSDirectoryEntry *entry,
+                             uint32_t index, uint32_t lba) {
+  FATFSLookup *lookup = context;
+  if (!FATFSIsVisible(entry)) {
+    return true;
+  }
+
+  char name[13];
+  uint32_t length = FATFSFormatName(entry, name);
+  if (!FATFSNameEquals(name, length, lookup->name, lookup->length)) {
+    return true;
+  }
+
+  VFSSuperBlock *super = lookup->directory->super;
+  FATFSVolume *volume = super->fs_data;
+  uint32_t cluster = FATFSEntryCluster(volume, entry);
+  bool directory = (entry->attributes & kFATFSAttributeDirectory) != 0;
+
+  // The entry's position on disk names the file for the inode cache
+  VFSInode template = {
+      .ino = lba * FATFS_ENTRIES_PER_SECTOR +
+             index % FATFS_ENTRIES_PER_SECTOR + FATFS_ROOT_INO + 1,
+      .type = directory ? kVFSDirectory : kVFSRegular,
+      .size = directory ? 0 : entry->size,
+      .operations = &kFATFSInodeOperations,
+      .file_operations = &kFATFSFileOperations,
+  };
+  template.fs_data[kFATFSFirstCluster] = cluster;
+
+  // A ".." entry pointing at the root stores cluster 0, which never reaches
+  // here, but a directory without clusters would read as the root
+  if (directory && cluster == 0 && volume->root_cluster != 0) {
+    template.fs_data[kFATFSFirstCluster] = volume->root_cluster;
+  }
+
+  lookup->inode = VFSGetInode(super, &template);
+  lookup->found = true;
+  return false;
+}
+
+static int FATFSLookupName(VFSInode *directory, const char *name,
+                           uint32_t length, VFSInode **inode_out) {
+  FATFSLookup lookup = {
+      .directory = directory,
+      .name = name,
+      .length = length,
+  };
+  if (!FATFSScan(directory->super->fs_data, directory, 0, FATFSLookupVisit,
+                 &lookup)) {
+    return kVFSErrorIO;
+  }
+  if (!lookup.found) {
+    return kVFSErrorNotFound;
+  }
+  if (lookup.inode == NULL) {
+    return kVFSErrorNoMemory;
+  }
+
+  *inode_out = lookup.inode;
+  return 0;
+}
+
+typedef struct {
+  VFSDirectoryEntry *entries;
+  uint32_t count;
+  uint32_t filled;
+  uint32_t next_index;
+} FATFSReadDir;
+
+static bool FATFSReadDirVisit(void *context, const FATFSDirectoryEntry *entry,
+                              uint32_t index, uint32_t lba) {
+  FATFSReadDir *readdir = context;
+  if (readdir->filled == readdir->count) {
+    return false;
+  }
+
+  readdir->next_index = index + 1;
+  if (FATFSIsVisible(entry)) {
+    VFSDirectoryEntry *out = &readdir->entries[readdir->filled++];
+    FATFSFormatName(entry, out->name);
+    bool directory = (entry->attributes & kFATFSAttributeDirectory) != 0;
+    out->type = directory ? kVFSDirectory : kVFSRegular;
+    out->size = directory ? 0 : entry->size;
+  }
+  return true;
+}
+
+// file->position counts directory entries, deleted and hidden ones included
+static int32_t FATFSReadDirectory(VFSFile *file, VFSDirectoryEntry *entries,
+                                  uint32_t count) {
+  FATFSReadDir readdir = {
+      .entries = entries,
+      .count = count,
+      .next_index = file->position,
+  };
+  if (!FATFSScan(file->inode->super->fs_data, file->inode, file->position,
+                 FATFSReadDirVisit, &readdir)) {
+    return kVFSErrorIO;
+  }
+
+  file->position = readdir.next_index;
+  return (int32_t)readdir.filled;
+}
+
+// Cluster holding byte position of the file, continuing from the inode's
+// cursor when reading forward
+static uint32_t FATFSSeekCluster(FATFSVolume *volume, VFSInode *inode,
+                                 uint32_t position) {
+  uint32_t target = position / volume->cluster_size;
+
+  SpinlockAcquire(&volume->cursor_lock);
+  uint32_t cluster = inode->fs_data[kFATFSCursorCluster];
+  uint32_t index = inode->fs_data[kFATFSCursorIndex];
+  SpinlockRelease(&volume->cursor_lock);
+  if (cluster == 0 || index > target) {
+    cluster = inode->fs_data[kFATFSFirstCluster];
+    index = 0;
+  }
+
+  while (cluster != 0 && index < target) {
+    cluster = FATFSNextCluster(volume, cluster);
+    index++;
+  }
+
+  if (cluster != 0) {
+    SpinlockAcquire(&volume->cursor_lock);
+    inode->fs_data[kFATFSCursorCluster] = cluster;
+    inode->fs_data[kFATFSCursorIndex] = index;
+    SpinlockRelease(&volume->cursor_lock);
+  }
+  return cluster;
+}
+
+// Bytes of the file in page index
+static uint32_t FATFSPageBytes(const VFSInode *inode, uint32_t index) {
+  uint32_t position = index * PAGE_SIZE;
+  if (position >= inode->size) {
+    return 0;
+  }
+  return inode->size - position < PAGE_SIZE ? inode->size - position
+                                            : PAGE_SIZE;
+}
+
+// The sectors of a page, with clusters that follow each other on disk
+// merged into one run
+static int FATFSMapPage(VFSInode *inode, uint32_t index, VFSPageRun *runs) {
+  FATFSVolume *volume = inode->super->fs_data;
+  uint32_t position = index * PAGE_SIZE;
+  uint32_t size = FATFSPageBytes(inode, index);
+
+  uint32_t sectors = (size + BLOCK_SECTOR_SIZE - 1) / BLOCK_SECTOR_SIZE;
+  uint32_t done = 0;
+  int count = 0;
+  while (done < sectors) {
+    uint32_t cluster = FATFSSeekCluster(volume, inode, position);
+    if (cluster == 0) {
+      return kVFSErrorIO;
+    }
+
+    uint32_t in_cluster = position % volume->cluster_size;
+    uint32_t lba = FATFSClusterToLba(volume, cluster) +
+                   in_cluster / BLOCK_SECTOR_SIZE;
+    uint32_t run = (volume->cluster_size - in_cluster) / BLOCK_SECTOR_SIZE;
+    while (run < sectors - done &&
+           FATFSNextCluster(volume, cluster) == cluster + 1) {
+      cluster++;
+      run += volume->sectors_per_cluster;
+    }
+    if (run > sectors - done) {
+      run = sectors - done;
+    }
+
+    runs[count].lba = lba;
+    runs[count].count = run;
+    count++;
+    done += run;
+    position += run * BLOCK_SECTOR_SIZE;
+  }
+  return count;
+}
+
+// Sectors go straight into the page cache frame
+static int FATFSReadPage(VFSInode *inode, uint32_t index, void *page) {
+  FATFSVolume *volume = inode->super->fs_data;
+  VFSPageRun runs[VFS_PAGE_RUNS];
+  int count = FATFSMapPage(inode, index, runs);
+  if (count < 0) {
+    return count;
+  }
+
+  uint8_t *out = page;
+  uint32_t done = 0;
+  for (int i = 0; i < count; i++) {
+    if (!BlockRead(volume->device, runs[i].lba, runs[i].count,
+                   out + done * BLOCK_SECTOR_SIZE)) {
+      return kVFSErrorIO;
+    }
+    done += runs[i].count;
+  }
+
+  uint32_t size = FATFSPageBytes(inode, index);
+  memset(out + size, 0, PAGE_SIZE - size);
+  return 0;
+}
+
+static const VFSInodeOperations kFATFSInodeOperations = {
+    .lookup = FATFSLookupName,
+};
+
+static const VFSFileOperations kFATFSFileOperations = {
+    .readpage = FATFSReadPage,
+    .mappage = FATFSMapPage,
+    .readdir = FATFSReadDirectory,
+};
+
+static int FATFSMount(VFSSuperBlock *super, BlockDevice *device) {
+  if (device == NULL) {
+    return kVFSErrorInvalid;
+  }
+
+  union {
+    FATFSBootSector boot_sector;
+    uint8_t bytes[BLOCK_SECTOR_SIZE];
+  } data;
+  if (!BlockRead(device, 0, 1, data.bytes)) {
+    return kVFSErrorIO;
+  }
+
+  const FATFSBootSector *boot = &data.boot_sector;
+  uint32_t spc = boot->sectors_per_cluster;
+  if (*(uint16_t *)&data.bytes[510] != FATFS_SIGNATURE ||
+      boot->bytes_per_sector != BLOCK_SECTOR_SIZE || spc == 0 ||
+      (spc & (spc - 1)) != 0 || boot->fat_count == 0 ||
+      boot->reserved_sectors == 0) {
+    return kVFSErrorInvalid;
+  }
+
+  uint32_t total = boot->total_sectors != 0 ? boot->total_sectors
+                                            : boot->large_sector_count;
+  uint32_t fat_size = boot->sectors_per_fat != 0 ? boot->sectors_per_fat
+                                                 : boot->sectors_per_fat32;
+  uint32_t root_sectors =
+      (boot->dir_entry_count * FATFS_ENTRY_SIZE + BLOCK_SECTOR_SIZE - 1) /
+      BLOCK_SECTOR_SIZE;
+  uint32_t fat_lba = boot->reserved_sectors;
+  uint32_t root_lba = fat_lba + boot->fat_count * fat_size;
+  uint32_t data_lba = root_lba + root_sectors;
+  if (fat_size == 0 || total <= data_lba || total > device->sector_count) {
+    return kVFSErrorInvalid;
+  }
+
+  SpinlockAcquire(&volumes_lock_);
+  FATFSVolume *volume =
+      volume_count_ < FATFS_MAX_VOLUMES ? &volumes_[volume_count_++] : NULL;
+  SpinlockRelease(&volumes_lock_);
+  if (volume == NULL) {
+    return kVFSErrorNoMemory;
+  }
+
+  volume->device = device;
+  volume->sectors_per_cluster = spc;
+  volume->cluster_size = spc * BLOCK_SECTOR_SIZE;
+  volume->fat_lba = fat_lba;
+  volume->root_lba = root_lba;
+  volume->root_sectors = root_sectors;
+  volume->data_lba = data_lba;
+  volume->cluster_count = (total - data_lba) / spc;
+  volume->bits = volume->cluster_count < FATFS_FAT12_CLUSTERS   ? 12
+                 : volume->cluster_count < FATFS_FAT16_CLUSTERS ? 16
+                                                                 : 32;
+  volume->root_cluster = volume->bits == 32 ? boot->root_cluster : 0;
+  volume->fat_cached_lba = 0;
+  SpinlockInitialize(&volume->fat_lock);
+  SpinlockInitialize(&volume->cursor_lock);
+
+  VFSInode template = {
+      .ino = FATFS_ROOT_INO,
+      .type = kVFSDirectory,
+      .operations = &kFATFSInodeOperations,
+      .file_operations = &kFATFSFileOperations,
+  };
+  template.fs_data[kFATFSFirstCluster] = volume->root_cluster;
+
+  super->fs_data = volume;
+  super->root = VFSGetInode(super, &template);
+  return super->root != NULL ? 0 : kVFSErrorNoMemory;
+}
+
+static VFSFileSystem fs_ = {
+    .name = "fat",
+    .mount = FATFSMount,
+};
+
+void FATFSInitialize() { VFSRegister(&fs_); }
@@ -0,0 +1,4 @@
+#pragma once
+
+// Read-only FAT12/16/32 for the VFS, registered as "fat"
+void FATFSInitialize();
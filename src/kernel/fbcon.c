@@ -0,0 +1,220 @@
+#include "fbcon.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define FBCON_GLYPH_WIDTH 8      // NOLINT
+#define FBCON_GLYPH_HEIGHT 16    // NOLINT
+#define FBCON_GLYPH_COUNT 256    // NOLINT
+#define FBCON_BPP 32             // NOLINT
+#define FBCON_MAX_COLUMNS 160    // NOLINT
+#define FBCON_MAX_ROWS 64        // NOLINT
+#define FBCON_TAB_WIDTH 4        // NOLINT
+#define FBCON_DEFAULT_COLOR 0x07 // NOLINT
+#define FBCON_CURSOR_HEIGHT 2    // NOLINT
+
+typedef struct {
+  uint8_t character;
+  uint8_t color; // VGA attribute, background in the high nibble
+} FBConCell;
+
+// The 16 VGA text colors
+static const uint32_t kFBConPalette[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA,
+    0xAA5500, 0xAAAAAA, 0x555555, 0x5555FF, 0x55FF55, 0x55FFFF,
+    0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF,
+};
+
+static bool active_ = false;
+static uint8_t *framebuffer_;
+static uint32_t pitch_;
+static int columns_;
+static int rows_;
+
+// Glyph lines are bytes, each one is drawn through the 8 pixel masks it
+// expands to. The masks are shared by every glyph and color, so drawing a
+// pixel is bg ^ (mask & (fg ^ bg)) without branches.
+static uint8_t glyphs_[FBCON_GLYPH_COUNT][FBCON_GLYPH_HEIGHT];
+static uint32_t row_masks_[256][FBCON_GLYPH_WIDTH];
+
+// Rows form a ring, scrolling moves top_ instead of the cells
+static FBConCell cells_[FBCON_MAX_ROWS][FBCON_MAX_COLUMNS];
+static int top_ = 0;
+static int cursor_x_ = 0;
+static int cursor_y_ = 0;
+
+// Columns [start, end) of every screen row that need drawing
+static int16_t dirty_start_[FBCON_MAX_ROWS];
+static int16_t dirty_end_[FBCON_MAX_ROWS];
+
+static FBConCell *FBConRow(int y) { return cells_[(top_ + y) % rows_]; }
+
+static void FBConMarkDirty(int y, int start, int end) {
+  if (start < dirty_start_[y]) {
+    dirty_start_[y] = start;
+  }
+  if (end > dirty_end_[y]) {
+    dirty_end_[y] = end;
+  }
+}
+
+static void FBConClearRow(FBConCell *row) {
+  for (int x = 0; x < columns_; x++) {
+    row[x].character = ' ';
+    row[x].color = FBCON_DEFAULT_COLOR;
+  }
+}
+
+static void FBConMoveCursor(int x, int y) {
+  FBConMarkDirty(cursor_y_, cursor_x_, cursor_x_ + 1);
+  cursor_x_ = x;
+  cursor_y_ = y;
+  FBConMarkDirty(cursor_y_, cursor_x_, cursor_x_ + 1);
+}
+
+// Every row moves up on screen, so all of them are drawn again
+static void FBConScroll() {
+  FBConClearRow(FBConRow(0));
+  top_ = (top_ + 1) % rows_;
+  for (int y = 0; y < rows_; y++) {
+    FBConMarkDirty(y, 0, columns_);
+  }
+}
+
+bool FBConInitialize(const BootParams *boot_params) {
+  if (boot_params->framebuffer_address == 0 ||
+      boot_params->framebuffer_bpp != FBCON_BPP ||
+      boot_params->font_address == 0) {
+    return false;
+  }
+
+  framebuffer_ = (uint8_t *)boot_params->framebuffer_address;
+  pitch_ = boot_params->framebuffer_pitch;
+  columns_ = boot_params->framebuffer_width / FBCON_GLYPH_WIDTH;
+  rows_ = boot_params->framebuffer_height / FBCON_GLYPH_HEIGHT;
+  columns_ = columns_ < FBCON_MAX_COLUMNS ? columns_ : FBCON_MAX_COLUMNS;
+  rows_ = rows_ < FBCON_MAX_ROWS ? rows_ : FBCON_MAX_ROWS;
+  if (columns_ == 0 || rows_ == 0) {
+    return false;
+  }
+
+  for (int y = 0; y < rows_; y++) {
+    dirty_start_[y] = FBCON_MAX_COLUMNS;
+    dirty_end_[y] = 0;
+  }
+
+  // The font sits in the VGA BIOS, copy it next to the masks
+  const uint8_t *font = (const uint8_t *)boot_params->font_address;
+  for (int glyph = 0; glyph < FBCON_GLYPH_COUNT; glyph++) {
+    for (int line = 0; line < FBCON_GLYPH_HEIGHT; line++) {
+      glyphs_[glyph][line] = font[glyph * FBCON_GLYPH_HEIGHT + line];
+    }
+  }
+
+  for (int bits = 0; bits < 256; bits++) {
+    for (int x = 0; x < FBCON_GLYPH_WIDTH; x++) {
+      row_masks_[bits][x] = (bits & (0x80 >> x)) ? 0xFFFFFFFF : 0;
+    }
+  }
+
+  active_ = true;
+  FBConClear();
+  FBConFlush();
+  return true;
+}
+
+bool FBConIsActive() { return active_; }
+
+void FBConClear() {
+  for (int y = 0; y < rows_; y++) {
+    FBConClearRow(FBConRow(y));
+    FBConMarkDirty(y, 0, columns_);
+  }
+
+  FBConMoveCursor(0, 0);
+}
+
+void FBConPutc(char c) {
+  int x = cursor_x_;
+  int y = cursor_y_;
+
+  switch (c) {
+  case '\n':
+    x = 0;
+    y++;
+    break;
+
+  case '\t':
+    do {
+      FBConPutc(' ');
+    } while (cursor_x_ % FBCON_TAB_WIDTH != 0);
+    return;
+
+  case '\r':
+    x = 0;
+    break;
+
+  default:
+    FBConRow(y)[x].character = (uint8_t)c;
+    FBConRow(y)[x].color = FBCON_DEFAULT_COLOR;
+    FBConMarkDirty(y, x, x + 1);
+    x++;
+    break;
+  }
+
+  if (x >= columns_) {
+    x = 0;
+    y++;
+  }
+  if (y >= rows_) {
+    FBConScroll();
+    y = rows_ - 1;
+  }
+
+  FBConMoveCursor(x, y);
+}
+
+// Scan lines are written left to right in one pass over the dirty cells,
+// which keeps the stores to the (write combined) framebuffer sequential
+static void FBConDrawRow(int y, int start, int end) {
+  const FBConCell *row = FBConRow(y);
+
+  for (int line = 0; line < FBCON_GLYPH_HEIGHT; line++) {
+    uint32_t *pixels =
+        (uint32_t *)(framebuffer_ +
+                     (y * FBCON_GLYPH_HEIGHT + line) * pitch_) +
+        start * FBCON_GLYPH_WIDTH;
+    bool cursor_line = y == cursor_y_ &&
+                       line >= FBCON_GLYPH_HEIGHT - FBCON_CURSOR_HEIGHT;
+
+    for (int x = start; x < end; x++) {
+      uint32_t foreground = kFBConPalette[row[x].color & 0x0F];
+      uint32_t background = kFBConPalette[row[x].color >> 4];
+      uint8_t bits = glyphs_[row[x].character][line];
+      if (cursor_line && x == cursor_x_) {
+        bits = 0xFF;
+      }
+
+      const uint32_t *masks = row_masks_[bits];
+      uint32_t difference = foreground ^ background;
+      for (int i = 0; i < FBCON_GLYPH_WIDTH; i++) {
+        pixels[i] = background ^ (masks[i] & difference);
+      }
+      pixels += FBCON_GLYPH_WIDTH;
+    }
+  }
+}
+
+void FBConFlush() {
+  if (!active_) {
+    return;
+  }
+
+  for (int y = 0; y < rows_; y++) {
+    if (dirty_start_[y] < dirty_end_[y]) {
+      FBConDrawRow(y, dirty_start_[y], dirty_end_[y]);
+    }
+
+    dirty_start_[y] = FBCON_MAX_COLUMNS;
+    dirty_end_[y] = 0;
+  }
+}
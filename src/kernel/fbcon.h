@@ -0,0 +1,12 @@
+#pragma once
+#include <boot/bootparams.h>
+#include <stdbool.h>
+
+// Text console drawn on the linear framebuffer stage2 set up. Output goes to
+// a cell buffer, FBConFlush draws the cells that changed. Callers serialize,
+// stdio.c holds the console lock around all of it.
+bool FBConInitialize(const BootParams *boot_params);
+bool FBConIsActive();
+void FBConPutc(char c);
+void FBConClear();
+void FBConFlush();
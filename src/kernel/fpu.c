@@ -0,0 +1,207 @@
+#include "fpu.h"
+#include "isr.h"
+#include "memory.h"
+#include "percpu.h"
+#include "stdio.h"
+#include "x86.h"
+#include <stddef.h>
+
+#define FPU_DEVICE_NOT_AVAILABLE 7 // NOLINT
+
+enum FPUControlBits {
+  kCR0MonitorCoprocessor = 1u << 1,
+  kCR0Emulation = 1u << 2,
+  kCR0TaskSwitched = 1u << 3,
+  kCR0NumericError = 1u << 5,
+  kCR4OSFXSR = 1u << 9,
+  kCR4OSXMMEXCPT = 1u << 10,
+};
+
+enum FPUCPUIDBits {
+  kCPUIDFeatureFPU = 1u << 0,
+  kCPUIDFeatureFXSR = 1u << 24,
+  kCPUIDFeatureSSE = 1u << 25,
+};
+
+// Power-on control words with every exception masked
+#define FPU_DEFAULT_FCW 0x037F    // NOLINT
+#define FPU_DEFAULT_MXCSR 0x1F80  // NOLINT
+#define FPU_FXSAVE_FCW 0          // NOLINT
+#define FPU_FXSAVE_MXCSR 24       // NOLINT
+
+static bool present_ = false;
+static bool fxsr_ = false;
+static bool sse_ = false;
+
+static inline uint32_t FPUReadCR0() {
+  uint32_t value;
+  __asm__ volatile("mov %%cr0, %0" : "=r"(value));
+  return value;
+}
+
+static inline void FPUWriteCR0(uint32_t value) {
+  __asm__ volatile("mov %0, %%cr0" : : "r"(value) : "memory");
+}
+
+static inline uint32_t FPUReadCR4() {
+  uint32_t value;
+  __asm__ volatile("mov %%cr4, %0" : "=r"(value));
+  return value;
+}
+
+static inline void FPUWriteCR4(uint32_t value) {
+  __asm__ volatile("mov %0, %%cr4" : : "r"(value) : "memory");
+}
+
+static inline void FPUClearTaskSwitched() { __asm__ volatile("clts"); }
+
+static inline void FPUSetTaskSwitched() {
+  FPUWriteCR0(FPUReadCR0() | kCR0TaskSwitched);
+}
+
+static void FPUSave(FPUState *state) {
+  if (fxsr_) {
+    __asm__ volatile("fxsave %0" : "=m"(state->area));
+  } else {
+    __asm__ volatile("fnsave %0; fwait" : "=m"(state->area));
+  }
+}
+
+static void FPURestore(FPUState *state) {
+  if (!state->initialized) {
+    memset(state->area, 0, sizeof(state->area));
+    if (fxsr_) {
+      *(uint16_t *)&state->area[FPU_FXSAVE_FCW] = FPU_DEFAULT_FCW;
+      *(uint32_t *)&state->area[FPU_FXSAVE_MXCSR] = FPU_DEFAULT_MXCSR;
+    } else {
+      // fnsave layout, tag word all empty
+      *(uint16_t *)&state->area[0] = FPU_DEFAULT_FCW;
+      *(uint16_t *)&state->area[8] = 0xFFFF;
+    }
+    state->initialized = true;
+  }
+
+  if (fxsr_) {
+    __asm__ volatile("fxrstor %0" : : "m"(state->area));
+  } else {
+    __asm__ volatile("frstor %0" : : "m"(state->area));
+  }
+}
+
+// The current context touched the FPU while another context's registers,
+// or nobody's, were loaded
+static void FPUDeviceNotAvailable(ISRFrame *frame) {
+  PerCpu *cpu = PerCpuThis();
+  FPUClearTaskSwitched();
+
+  if (cpu->fpu_owner == cpu->fpu_current) {
+    return;
+  }
+  if (cpu->fpu_owner != NULL) {
+    FPUSave(cpu->fpu_owner);
+  }
+
+  if (cpu->fpu_current != NULL) {
+    FPURestore(cpu->fpu_current);
+  } else {
+    __asm__ volatile("fninit");
+  }
+  cpu->fpu_owner = cpu->fpu_current;
+}
+
+void FPUInitializeCpu() {
+  if (!present_) {
+    return;
+  }
+
+  // Native error reporting, and wait/fwait honours TS like every other
+  // FPU instruction
+  uint32_t cr0 = FPUReadCR0();
+  cr0 &= ~(kCR0Emulation | kCR0TaskSwitched);
+  cr0 |= kCR0MonitorCoprocessor | kCR0NumericError;
+  FPUWriteCR0(cr0);
+
+  if (fxsr_) {
+    uint32_t cr4 = FPUReadCR4() | kCR4OSFXSR;
+    if (sse_) {
+      cr4 |= kCR4OSXMMEXCPT;
+    }
+    FPUWriteCR4(cr4);
+  }
+
+  __asm__ volatile("fninit");
+  if (sse_) {
+    uint32_t mxcsr = FPU_DEFAULT_MXCSR;
+    __asm__ volatile("ldmxcsr %0" : : "m"(mxcsr));
+  }
+}
+
+void FPUInitialize() {
+  x86_CPUIDResult features;
+  x86_CPUID(1, &features);
+  present_ = (features.edx & kCPUIDFeatureFPU) != 0;
+  fxsr_ = (features.edx & kCPUIDFeatureFXSR) != 0;
+  sse_ = fxsr_ && (features.edx & kCPUIDFeatureSSE) != 0;
+
+  if (!present_) {
+    printf("FPU: not present\n");
+    return;
+  }
+
+  ISRRegisterHandler(FPU_DEVICE_NOT_AVAILABLE, FPUDeviceNotAvailable);
+  FPUInitializeCpu();
+  printf("FPU: x87%s, %s state\n", sse_ ? " and SSE" : "",
+         fxsr_ ? "fxsave" : "fnsave");
+}
+
+bool FPUHasSSE() { return sse_; }
+
+void FPUSwitch(FPUState *state) {
+  PerCpu *cpu = PerCpuThis();
+  cpu->fpu_current = state;
+
+  // Registers already hold this context, the trap would be wasted
+  if (cpu->fpu_owner == state) {
+    FPUClearTaskSwitched();
+  } else {
+    FPUSetTaskSwitched();
+  }
+}
+
+void FPURelease(FPUState *state) {
+  PerCpu *cpu = PerCpuThis();
+  if (cpu->fpu_owner == state) {
+    cpu->fpu_owner = NULL;
+  }
+  if (cpu->fpu_current == state) {
+    FPUSwitch(NULL);
+  }
+}
+
+void FPUKernelBegin() {
+  uint32_t flags = x86_SaveFlagsAndDisableInterrupts();
+  PerCpu *cpu = PerCpuThis();
+
+  if (cpu->fpu_kernel_depth++ == 0) {
+    FPUClearTaskSwitched();
+    if (cpu->fpu_owner != NULL) {
+      FPUSave(cpu->fpu_owner);
+      cpu->fpu_owner = NULL;
+    }
+  }
+
+  x86_RestoreFlags(flags);
+}
+
+// The registers now hold kernel scratch values, so the context has to
+// reload its state on its next FPU instruction
+void FPUKernelEnd() {
+  uint32_t flags = x86_SaveFlagsAndDisableInterrupts();
+  PerCpu *cpu = PerCpuThis();
+
+  if (--cpu->fpu_kernel_depth == 0 && cpu->fpu_current != NULL) {
+    FPUSetTaskSwitched();
+  }
+
+  x86_RestoreFlags(flags);
+}
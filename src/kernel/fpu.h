@@ -0,0 +1,31 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FPU_STATE_SIZE 512 // NOLINT, fxsave area, fnsave needs 108 bytes
+
+// x87/SSE register state of one execution context, owned by the caller
+typedef struct FPUState {
+  uint8_t area[FPU_STATE_SIZE] __attribute__((aligned(16)));
+  bool initialized; // Loaded with defaults on first use
+} FPUState;
+
+// Enable the FPU, and SSE if the CPU has it, on the calling CPU. The BSP
+// also installs the #NM handler, so it goes first.
+void FPUInitialize();
+void FPUInitializeCpu();
+bool FPUHasSSE();
+
+// Lazy switching for a scheduler: make state the current context of this
+// CPU. The registers are only saved and reloaded once the new context
+// executes an FPU instruction and traps with #NM. NULL means no context.
+void FPUSwitch(FPUState *state);
+
+// Drop state from the registers without saving it, before it is freed
+void FPURelease(FPUState *state);
+
+// Bracket kernel code that uses x87 or SSE instructions. Saves whatever
+// context state is live first, sections nest, and must not be entered from
+// interrupt handlers.
+void FPUKernelBegin();
+void FPUKernelEnd();
@@ -0,0 +1,129 @@
+#include "gdt.h"
+#include "percpu.h"
+#include "x86.h"
+
+#pragma pack(push, 1)
+
+typedef struct {
+  uint16_t limit_low;
+  uint16_t base_low;
+  uint8_t base_middle;
+  uint8_t access;
+  uint8_t flags_limit_high;
+  uint8_t base_high;
+} GDTEntry;
+
+typedef struct {
+  uint16_t limit;
+  GDTEntry *entries;
+} GDTPointer;
+
+// Only the ring 0 stack is used, there is no hardware task switching
+typedef struct {
+  uint16_t link, _reserved0;
+  uint32_t esp0;
+  uint16_t ss0, _reserved1;
+  uint32_t esp1;
+  uint16_t ss1, _reserved2;
+  uint32_t esp2;
+  uint16_t ss2, _reserved3;
+  uint32_t cr3, eip, eflags, eax, ecx, edx, ebx, esp, ebp, esi, edi;
+  uint16_t es, _reserved4, cs, _reserved5, ss, _reserved6, ds, _reserved7;
+  uint16_t fs, _reserved8, gs, _reserved9, ldt, _reserved10;
+  uint16_t trap, iomap_base;
+} GDTTaskState;
+
+#pragma pack(pop)
+
+enum GDTAccess {
+  kGDTAccessCodeReadable = 0x02,
+  kGDTAccessDataWritable = 0x02,
+  kGDTAccessCodeSegment = 0x18,
+  kGDTAccessDataSegment = 0x10,
+  kGDTAccessRing0 = 0x00,
+  kGDTAccessRing3 = 0x60,
+  kGDTAccessTaskState = 0x09, // Available 32-bit TSS
+  kGDTAccessPresent = 0x80,
+};
+
+enum GDTFlags {
+  kGDTFlag32Bit = 0x40,
+  kGDTFlagGranularity4K = 0x80,
+};
+
+#define GDT_ENTRY_COUNT (kGDTTaskStateSelector / 8 + MAX_CPUS) // NOLINT
+
+static GDTEntry gdt_[GDT_ENTRY_COUNT];
+static GDTTaskState task_states_[MAX_CPUS];
+static GDTPointer gdt_descriptor_ = { sizeof(gdt_) - 1, gdt_ };
+
+void GDTSetEntry(int index, uint32_t base, uint32_t limit, uint8_t access,
+                 uint8_t flags) {
+  gdt_[index].limit_low = limit & 0xFFFF;
+  gdt_[index].base_low = base & 0xFFFF;
+  gdt_[index].base_middle = (base >> 16) & 0xFF;
+  gdt_[index].access = access;
+  gdt_[index].flags_limit_high = (flags & 0xF0) | ((limit >> 16) & 0x0F);
+  gdt_[index].base_high = (base >> 24) & 0xFF;
+}
+
+void GDTInitialize() {
+  // Same flat layout as stage2 so the selectors in use stay valid
+  GDTSetEntry(0, 0, 0, 0, 0);
+  GDTSetEntry(kGDTCodeSelector / 8, 0, 0xFFFFF,
+              kGDTAccessPresent | kGDTAccessRing0 | kGDTAccessCodeSegment |
+                  kGDTAccessCodeReadable,
+              kGDTFlag32Bit | kGDTFlagGranularity4K);
+  GDTSetEntry(kGDTDataSelector / 8, 0, 0xFFFFF,
+              kGDTAccessPresent | kGDTAccessRing0 | kGDTAccessDataSegment |
+                  kGDTAccessDataWritable,
+              kGDTFlag32Bit | kGDTFlagGranularity4K);
+  GDTSetEntry(kGDTUserCodeSelector / 8, 0, 0xFFFFF,
+              kGDTAccessPresent | kGDTAccessRing3 | kGDTAccessCodeSegment |
+                  kGDTAccessCodeReadable,
+              kGDTFlag32Bit | kGDTFlagGranularity4K);
+  GDTSetEntry(kGDTUserDataSelector / 8, 0, 0xFFFFF,
+              kGDTAccessPresent | kGDTAccessRing3 | kGDTAccessDataSegment |
+                  kGDTAccessDataWritable,
+              kGDTFlag32Bit | kGDTFlagGranularity4K);
+
+  // An I/O bitmap offset past the limit denies user code every port
+  for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+    GDTTaskState *tss = &task_states_[cpu];
+    tss->ss0 = kGDTDataSelector;
+    tss->iomap_base = sizeof(GDTTaskState);
+    GDTSetEntry(kGDTTaskStateSelector / 8 + cpu, (uint32_t)tss,
+                sizeof(GDTTaskState) - 1,
+                kGDTAccessPresent | kGDTAccessRing0 | kGDTAccessTaskState, 0);
+  }
+
+  GDTLoad();
+}
+
+void GDTLoad() {
+  x86_LoadGDT(&gdt_descriptor_, kGDTCodeSelector, kGDTDataSelector);
+}
+
+const void *GDTDescriptor() { return &gdt_descriptor_; }
+
+// Per-CPU data is reached through GS, so every CPU gets a byte-granular data
+// segment whose base is its own per-CPU area
+void GDTSetPerCpuBase(int cpu, void *base, uint32_t limit) {
+  GDTSetEntry(kGDTPerCpuSelector / 8 + cpu, (uint32_t)base, limit - 1,
+              kGDTAccessPresent | kGDTAccessRing0 | kGDTAccessDataSegment |
+                  kGDTAccessDataWritable,
+              kGDTFlag32Bit);
+}
+
+uint16_t GDTPerCpuSelector(int cpu) {
+  return kGDTPerCpuSelector + cpu * 8;
+}
+
+void GDTLoadTaskState(int cpu) {
+  uint16_t selector = kGDTTaskStateSelector + cpu * 8;
+  __asm__ volatile("ltr %0" : : "r"(selector));
+}
+
+void GDTSetKernelStack(uint32_t esp0) {
+  task_states_[PerCpuIndex()].esp0 = esp0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+
+#define MAX_CPUS 16 // NOLINT
+
+// sysenter/sysexit require the user segments to follow the kernel ones in
+// this order
+enum GDTSelectors {
+  kGDTNullSelector = 0x00,
+  kGDTCodeSelector = 0x08,
+  kGDTDataSelector = 0x10,
+  kGDTUserCodeSelector = 0x18,
+  kGDTUserDataSelector = 0x20,
+  kGDTPerCpuSelector = 0x28,
+  kGDTTaskStateSelector = kGDTPerCpuSelector + MAX_CPUS * 8,
+};
+
+enum GDTPrivilege {
+  kGDTRing0 = 0,
+  kGDTRing3 = 3,
+};
+
+void GDTInitialize();
+void GDTLoad();
+const void *GDTDescriptor();
+void GDTSetPerCpuBase(int cpu, void *base, uint32_t limit);
+uint16_t GDTPerCpuSelector(int cpu);
+
+// Every CPU has its own task state segment, only used for the stack the CPU
+// switches to when user code is interrupted
+void GDTLoadTaskState(int cpu);
+void GDTSetKernelStack(uint32_t esp0);
@@ -0,0 +1,40 @@
+#include "idt.h"
+#include "x86.h"
+
+#pragma pack(push, 1)
+
+typedef struct {
+  uint16_t base_low;
+  uint16_t segment;
+  uint8_t _reserved;
+  uint8_t flags;
+  uint16_t base_high;
+} IDTEntry;
+
+typedef struct {
+  uint16_t limit;
+  IDTEntry *entries;
+} IDTPointer;
+
+#pragma pack(pop)
+
+#define IDT_ENTRY_COUNT 256 // NOLINT
+
+static IDTEntry idt_[IDT_ENTRY_COUNT];
+static IDTPointer idt_descriptor_ = { sizeof(idt_) - 1, idt_ };
+
+void IDTSetGate(int vector, void *handler, uint16_t segment, uint8_t flags) {
+  idt_[vector].base_low = (uint32_t)handler & 0xFFFF;
+  idt_[vector].segment = segment;
+  idt_[vector]._reserved = 0;
+  idt_[vector].flags = flags;
+  idt_[vector].base_high = ((uint32_t)handler >> 16) & 0xFFFF;
+}
+
+void IDTEnableGate(int vector) { idt_[vector].flags |= kIDTFlagPresent; }
+
+void IDTDisableGate(int vector) { idt_[vector].flags &= ~kIDTFlagPresent; }
+
+void IDTInitialize() { IDTLoad(); }
+
+void IDTLoad() { x86_LoadIDT(&idt_descriptor_); }
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+
+enum IDTFlags {
+  kIDTFlagGateTask = 0x5,
+  kIDTFlagGate16BitInterrupt = 0x6,
+  kIDTFlagGate16BitTrap = 0x7,
+  kIDTFlagGate32BitInterrupt = 0xE,
+  kIDTFlagGate32BitTrap = 0xF,
+
+  kIDTFlagRing0 = (0 << 5),
+  kIDTFlagRing1 = (1 << 5),
+  kIDTFlagRing2 = (2 << 5),
+  kIDTFlagRing3 = (3 << 5),
+
+  kIDTFlagPresent = 0x80,
+};
+
+void IDTInitialize();
+void IDTLoad();
+void IDTSetGate(int vector, void *handler, uint16_t segment, uint8_t flags);
+void IDTEnableGate(int vector);
+void IDTDisableGate(int vector);
@@ -0,0 +1,252 @@
+#include "ipc.h"
+#include "atomic.h"
+#include "page.h"
+#include "ring.h"
+#include "spinlock.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define IPC_CHANNEL_SLOTS 32 // NOLINT, a power of two
+#define IPC_CHANNEL_MASK (IPC_CHANNEL_SLOTS - 1)
+
+// What a page needs to be sent: memory of the process's own that it could
+// have written to, and not a page cache page
+#define IPC_PAGE_FLAGS (kPagePresent | kPageWritable | kPageUser | kPageOwned)
+
+typedef struct {
+  Ring ring; // Over one page
+  int owner;
+  bool used;
+} IPCPipe;
+
+// A message in flight, the frames belong to it until it is received
+typedef struct {
+  uint32_t frames[IPC_MESSAGE_PAGES];
+  uint32_t size;
+  uint32_t tag;
+} IPCSlot;
+
+// The sender only writes head and the receiver only tail, the same as Ring
+typedef struct {
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  int owner;
+  bool used;
+  IPCSlot slots[IPC_CHANNEL_SLOTS];
+} IPCChannel;
+
+static Spinlock lock_ = SPINLOCK_INITIALIZER; // Creating and closing
+static IPCPipe pipes_[IPC_MAX_PIPES];
+static IPCChannel channels_[IPC_MAX_CHANNELS];
+
+static IPCPipe *IPCFindPipe(int id) {
+  if (id < 0 || id >= IPC_MAX_PIPES || !pipes_[id].used) {
+    return NULL;
+  }
+  return &pipes_[id];
+}
+
+static IPCChannel *IPCFindChannel(int id) {
+  if (id < 0 || id >= IPC_MAX_CHANNELS || !channels_[id].used) {
+    return NULL;
+  }
+  return &channels_[id];
+}
+
+static uint32_t IPCPages(uint32_t size) {
+  return (size + PAGE_SIZE - 1) / PAGE_SIZE;
+}
+
+int IPCPipeCreate(int owner) {
+  void *buffer = PageAlloc();
+  if (buffer == NULL) {
+    return kIPCErrorNoMemory;
+  }
+
+  SpinlockAcquire(&lock_);
+  for (int i = 0; i < IPC_MAX_PIPES; i++) {
+    if (!pipes_[i].used) {
+      RingInitialize(&pipes_[i].ring, buffer, PAGE_SIZE);
+      pipes_[i].owner = owner;
+      pipes_[i].used = true;
+      SpinlockRelease(&lock_);
+      return i;
+    }
+  }
+  SpinlockRelease(&lock_);
+
+  PageFree(buffer);
+  return kIPCErrorNoMemory;
+}
+
+int IPCPipeClose(int id) {
+  SpinlockAcquire(&lock_);
+  IPCPipe *pipe = IPCFindPipe(id);
+  if (pipe == NULL) {
+    SpinlockRelease(&lock_);
+    return kIPCErrorNotFound;
+  }
+  pipe->used = false;
+  void *buffer = (void *)pipe->ring.buffer;
+  SpinlockRelease(&lock_);
+
+  PageFree(buffer);
+  return 0;
+}
+
+int32_t IPCPipeWrite(int id, const void *data, uint32_t size) {
+  IPCPipe *pipe = IPCFindPipe(id);
+  return pipe != NULL ? (int32_t)RingWrite(&pipe->ring, data, size)
+                      : kIPCErrorNotFound;
+}
+
+int32_t IPCPipeRead(int id, void *data, uint32_t size) {
+  IPCPipe *pipe = IPCFindPipe(id);
+  return pipe != NULL ? (int32_t)RingRead(&pipe->ring, data, size)
+                      : kIPCErrorNotFound;
+}
+
+int IPCChannelCreate(int owner) {
+  SpinlockAcquire(&lock_);
+  for (int i = 0; i < IPC_MAX_CHANNELS; i++) {
+    if (!channels_[i].used) {
+      channels_[i].head = 0;
+      channels_[i].tail = 0;
+      channels_[i].owner = owner;
+      channels_[i].used = true;
+      SpinlockRelease(&lock_);
+      return i;
+    }
+  }
+  SpinlockRelease(&lock_);
+  return kIPCErrorNoMemory;
+}
+
+int IPCChannelClose(int id) {
+  SpinlockAcquire(&lock_);
+  IPCChannel *channel = IPCFindChannel(id);
+  if (channel == NULL) {
+    SpinlockRelease(&lock_);
+    return kIPCErrorNotFound;
+  }
+  channel->used = false;
+  SpinlockRelease(&lock_);
+
+  for (uint32_t i = channel->tail; i != channel->head; i++) {
+    IPCSlot *slot = &channel->slots[i & IPC_CHANNEL_MASK];
+    for (uint32_t page = 0; page < IPCPages(slot->size); page++) {
+      PageFree((void *)slot->frames[page]);
+    }
+  }
+  return 0;
+}
+
+// Every page is checked before any is taken, so a bad message leaves the
+// sender as it was
+static bool IPCTakePages(AddressSpace *space, MMapTable *maps,
+                         const IPCMessage *message, IPCSlot *slot) {
+  uint32_t pages = IPCPages(message->size);
+  if (message->address % PAGE_SIZE != 0 || pages == 0 ||
+      pages > IPC_MESSAGE_PAGES) {
+    return false;
+  }
+  for (uint32_t i = 0; i < pages; i++) {
+    uint32_t entry = PagingLookup(space, message->address + i * PAGE_SIZE);
+    if ((entry & IPC_PAGE_FLAGS) != IPC_PAGE_FLAGS) {
+      return false;
+    }
+  }
+
+  for (uint32_t i = 0; i < pages; i++) {
+    slot->frames[i] =
+        PagingUnmap(space, message->address + i * PAGE_SIZE) & PAGE_FRAME_MASK;
+  }
+  // A message passed on whole frees the range it was received into
+  MMapForget(maps, message->address, pages * PAGE_SIZE);
+  slot->size = message->size;
+  slot->tag = message->tag;
+  return true;
+}
+
+static bool IPCGivePages(AddressSpace *space, MMapTable *maps,
+                         const IPCSlot *slot, IPCMessage *message_out) {
+  uint32_t pages = IPCPages(slot->size);
+  uint32_t address;
+  if (!MMapAnonymous(maps, pages, &address)) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < pages; i++) {
+    if (!PagingMap(space, address + i * PAGE_SIZE, slot->frames[i],
+                   kPageWritable | kPageUser | kPageOwned)) {
+      // The frames stay with the message
+      while (i-- > 0) {
+        PagingUnmap(space, address + i * PAGE_SIZE);
+      }
+      MMapForget(maps, address, pages * PAGE_SIZE);
+      return false;
+    }
+  }
+
+  message_out->address = address;
+  message_out->size = slot->size;
+  message_out->tag = slot->tag;
+  return true;
+}
+
+int32_t IPCChannelSend(int id, AddressSpace *space, MMapTable *maps,
+                       const IPCMessage *messages, uint32_t count) {
+  IPCChannel *channel = IPCFindChannel(id);
+  if (channel == NULL) {
+    return kIPCErrorNotFound;
+  }
+
+  uint32_t head = channel->head;
+  uint32_t space_left =
+      IPC_CHANNEL_SLOTS - (head - AtomicLoad(&channel->tail));
+  uint32_t sent = 0;
+  bool valid = true;
+  while (sent < count && sent < space_left && valid) {
+    valid = IPCTakePages(space, maps, &messages[sent],
+                         &channel->slots[(head + sent) & IPC_CHANNEL_MASK]);
+    sent += valid ? 1 : 0;
+  }
+
+  AtomicStore(&channel->head, head + sent);
+  return sent > 0 || valid ? (int32_t)sent : kIPCErrorInvalid;
+}
+
+int32_t IPCChannelReceive(int id, AddressSpace *space, MMapTable *maps,
+                          IPCMessage *messages_out, uint32_t count) {
+  IPCChannel *channel = IPCFindChannel(id);
+  if (channel == NULL) {
+    return kIPCErrorNotFound;
+  }
+
+  uint32_t tail = channel->tail;
+  uint32_t available = AtomicLoad(&channel->head) - tail;
+  uint32_t received = 0;
+  bool mapped = true;
+  while (received < count && received < available && mapped) {
+    mapped = IPCGivePages(space, maps,
+                          &channel->slots[(tail + received) & IPC_CHANNEL_MASK],
+                          &messages_out[received]);
+    received += mapped ? 1 : 0;
+  }
+
+  AtomicStore(&channel->tail, tail + received);
+  return received > 0 || mapped ? (int32_t)received : kIPCErrorNoMemory;
+}
+
+void IPCReleaseOwner(int owner) {
+  for (int i = 0; i < IPC_MAX_PIPES; i++) {
+    if (pipes_[i].used && pipes_[i].owner == owner) {
+      IPCPipeClose(i);
+    }
+  }
+  for (int i = 0; i < IPC_MAX_CHANNELS; i++) {
+    if (channels_[i].used && channels_[i].owner == owner) {
+      IPCChannelClose(i);
+    }
+  }
+}
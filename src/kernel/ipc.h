@@ -0,0 +1,53 @@
+#pragma once
+#include "mmap.h"
+#include "paging.h"
+#include <stdint.h>
+#include <sys/ipc.h>
+
+// Pipes and message channels. Each has one producer and one consumer at a
+// time, which only meet in a lock-free single-producer/single-consumer ring,
+// so the two ends can run on different CPUs without taking a lock.
+//
+// Pipes copy bytes through a page sized ring. Channels carry page frames:
+// a send unmaps the pages from the sender, a receive maps the same frames
+// into the receiver, so bulk data moves without a copy per hop. Both take
+// and return batches, one ring update covers the whole call.
+//
+// Ids are shared by everyone, and every pipe and channel belongs to the
+// process that created it (0 for the kernel) and goes away with it.
+
+#define IPC_MAX_PIPES 16    // NOLINT
+#define IPC_MAX_CHANNELS 16 // NOLINT
+
+enum IPCError {
+  kIPCErrorInvalid = -1,
+  kIPCErrorNoMemory = -2,
+  kIPCErrorNotFound = -3,
+};
+
+int IPCPipeCreate(int owner);
+int IPCPipeClose(int id);
+
+// Both move as much as they can without waiting: a full pipe takes 0 bytes,
+// an empty one gives 0 bytes
+int32_t IPCPipeWrite(int id, const void *data, uint32_t size);
+int32_t IPCPipeRead(int id, void *data, uint32_t size);
+
+// Closing drops the frames of messages nobody received
+int IPCChannelCreate(int owner);
+int IPCChannelClose(int id);
+
+// Send messages out of space until the channel is full or one of them is
+// not valid, returns how many were sent. Received ranges in maps that a
+// message covers are dropped with their pages.
+int32_t IPCChannelSend(int id, AddressSpace *space, MMapTable *maps,
+                       const IPCMessage *messages, uint32_t count);
+
+// Receive up to count messages, each mapped into space as an anonymous range
+// of maps, which stays until it is unmapped or sent on. Fails with
+// kIPCErrorNoMemory while the table is full.
+int32_t IPCChannelReceive(int id, AddressSpace *space, MMapTable *maps,
+                          IPCMessage *messages_out, uint32_t count);
+
+// Close everything a process left open
+void IPCReleaseOwner(int owner);
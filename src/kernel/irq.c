@@ -0,0 +1,69 @@
+#include "irq.h"
+#include "pic.h"
+#include "rcu.h"
+#include "softirq.h"
+#include "spinlock.h"
+#include <stddef.h>
+
+// Handler chains are read on every interrupt and almost never change, so
+// dispatch walks them under RCU without taking any lock
+static IRQAction *actions_[PIC_IRQ_COUNT];
+static Spinlock actions_lock_ = SPINLOCK_INITIALIZER;
+
+static void IRQDispatch(ISRFrame *frame) {
+  int irq = frame->vector - IRQ_VECTOR_BASE;
+  if (PICIsSpurious(irq)) {
+    return;
+  }
+
+  RCUReadLock();
+  for (IRQAction *action = RCUDereference(actions_[irq]); action != NULL;
+       action = RCUDereference(action->next)) {
+    action->handler(frame, action->context);
+  }
+  RCUReadUnlock();
+
+  // Work the handlers deferred runs after the acknowledgement, so the line
+  // can interrupt the bottom half again
+  PICSendEndOfInterrupt(irq);
+  SoftIRQExit();
+}
+
+void IRQInitialize() {
+  PICInitialize(IRQ_VECTOR_BASE, IRQ_VECTOR_BASE + 8);
+
+  for (int i = 0; i < PIC_IRQ_COUNT; i++) {
+    ISRRegisterHandler(IRQ_VECTOR_BASE + i, IRQDispatch);
+  }
+}
+
+void IRQRegisterHandler(int irq, IRQAction *action) {
+  uint32_t flags = SpinlockAcquireIrqSave(&actions_lock_);
+
+  // Fully set up before it becomes reachable
+  action->next = actions_[irq];
+  RCUAssignPointer(actions_[irq], action);
+  PICUnmask(irq);
+
+  SpinlockReleaseIrqRestore(&actions_lock_, flags);
+}
+
+void IRQUnregisterHandler(int irq, IRQAction *action) {
+  uint32_t flags = SpinlockAcquireIrqSave(&actions_lock_);
+
+  IRQAction **link = &actions_[irq];
+  while (*link != NULL && *link != action) {
+    link = &(*link)->next;
+  }
+  if (*link != NULL) {
+    RCUAssignPointer(*link, action->next);
+  }
+  if (actions_[irq] == NULL) {
+    PICMask(irq);
+  }
+
+  SpinlockReleaseIrqRestore(&actions_lock_, flags);
+
+  // Wait out dispatches that may still be running the old chain
+  RCUSynchronize();
+}
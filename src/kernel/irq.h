@@ -0,0 +1,20 @@
+#pragma once
+#include "isr.h"
+
+#define IRQ_VECTOR_BASE 0x20 // NOLINT
+
+typedef void (*IRQHandler)(ISRFrame *frame, void *context);
+
+// One handler on an interrupt line, lines may be shared by several devices.
+// The action is owned by the caller and must stay valid until unregistered.
+// Handlers run with interrupts disabled, anything more than acknowledging
+// the device belongs in a SoftIRQ.
+typedef struct IRQAction {
+  IRQHandler handler;
+  void *context;
+  struct IRQAction *next;
+} IRQAction;
+
+void IRQInitialize();
+void IRQRegisterHandler(int irq, IRQAction *action);
+void IRQUnregisterHandler(int irq, IRQAction *action);
@@ -0,0 +1,84 @@
+; Interrupt service routine stubs
+;
+; Every vector gets a stub that pushes a dummy error code (unless the CPU
+; already pushed one) and the vector number, then joins the common path which
+; saves the remaining state and calls ISRDispatch with a pointer to it.
+; GS is left alone in the kernel, it holds the per-CPU segment. Coming from
+; user mode it is reloaded, the task register tells which CPU this is, and
+; iret hands user code a null GS again.
+
+; Selectors from gdt.h, the per-CPU segments come MAX_CPUS descriptors
+; before the task state segments
+%define ISR_KERNEL_DATA 0x10
+%define ISR_TASK_STATE_TO_PER_CPU (16 * 8)
+
+; Offset of the saved cs once isr_common pushed everything
+%define ISR_FRAME_CS 56
+
+section .text
+
+extern ISRDispatch
+
+global isr_load_per_cpu
+
+isr_common:
+    [bits 32]
+    pusha
+    push ds
+    push es
+    push fs
+
+    mov ax, ISR_KERNEL_DATA
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    cld
+
+    test byte [esp + ISR_FRAME_CS], 3
+    jz .kernel
+    call isr_load_per_cpu
+
+.kernel:
+    push esp
+    call ISRDispatch
+    add esp, 4
+
+    pop fs
+    pop es
+    pop ds
+    popa
+
+    ; Drop the vector number and error code
+    add esp, 8
+    iret
+
+; Point GS at the calling CPU's per-CPU segment, clobbers ax
+isr_load_per_cpu:
+    [bits 32]
+    str ax
+    sub ax, ISR_TASK_STATE_TO_PER_CPU
+    mov gs, ax
+    ret
+
+%assign i 0
+%rep 256
+isr_stub_%+i:
+%if (i == 8) || (i >= 10 && i <= 14) || (i == 17) || (i == 21) || (i == 29) || (i == 30)
+    ; The CPU pushed an error code
+%else
+    push dword 0
+%endif
+    push dword i
+    jmp isr_common
+%assign i i+1
+%endrep
+
+section .data
+
+global isr_stub_table
+isr_stub_table:
+%assign i 0
+%rep 256
+    dd isr_stub_%+i
+%assign i i+1
+%endrep
@@ -0,0 +1,102 @@
+#include "isr.h"
+#include "gdt.h"
+#include "idt.h"
+#include "process.h"
+#include "stdio.h"
+#include "x86.h"
+#include <stddef.h>
+
+#define ISR_EXCEPTION_COUNT 32 // NOLINT
+#define ISR_VECTOR_COUNT 256   // NOLINT
+
+extern void *isr_stub_table[ISR_VECTOR_COUNT];
+
+static ISRHandler handlers_[ISR_VECTOR_COUNT];
+
+static const char *const kExceptions[ISR_EXCEPTION_COUNT] = {
+  "Divide by zero error",
+  "Debug",
+  "Non-maskable interrupt",
+  "Breakpoint",
+  "Overflow",
+  "Bound range exceeded",
+  "Invalid opcode",
+  "Device not available",
+  "Double fault",
+  "Coprocessor segment overrun",
+  "Invalid TSS",
+  "Segment not present",
+  "Stack-segment fault",
+  "General protection fault",
+  "Page fault",
+  "",
+  "x87 floating-point exception",
+  "Alignment check",
+  "Machine check",
+  "SIMD floating-point exception",
+  "Virtualization exception",
+  "Control protection exception",
+  "",
+  "",
+  "",
+  "",
+  "",
+  "",
+  "Hypervisor injection exception",
+  "VMM communication exception",
+  "Security exception",
+  "",
+};
+
+void ISRInitialize() {
+  for (int i = 0; i < ISR_VECTOR_COUNT; i++) {
+    IDTSetGate(i, isr_stub_table[i], kGDTCodeSelector,
+               kIDTFlagRing0 | kIDTFlagGate32BitInterrupt);
+    IDTEnableGate(i);
+  }
+}
+
+void ISRRegisterHandler(int vector, ISRHandler handler) {
+  handlers_[vector] = handler;
+}
+
+void ISRAllowUser(int vector) {
+  IDTSetGate(vector, isr_stub_table[vector], kGDTCodeSelector,
+             kIDTFlagRing3 | kIDTFlagGate32BitInterrupt);
+  IDTEnableGate(vector);
+}
+
+void __attribute__((cdecl)) ISRDispatch(ISRFrame *frame) {
+  ISRHandler handler = handlers_[frame->vector];
+  if (handler != NULL) {
+    handler(frame);
+    return;
+  }
+
+  // Stray interrupts, such as the local APIC spurious vector, are ignored
+  if (frame->vector >= ISR_EXCEPTION_COUNT) {
+    return;
+  }
+
+  // Faulting user code only takes its process down
+  if (ISRFromUser(frame)) {
+    ProcessFault(frame);
+  }
+  ISRPanic(frame);
+}
+
+void ISRPanic(ISRFrame *frame) {
+  printf("Unhandled exception %u: %s\n", frame->vector,
+         kExceptions[frame->vector]);
+  printf("  eax=%x ebx=%x ecx=%x edx=%x esi=%x edi=%x\n", frame->eax,
+         frame->ebx, frame->ecx, frame->edx, frame->esi, frame->edi);
+  printf("  esp=%x ebp=%x eip=%x eflags=%x cs=%x ds=%x\n", frame->kernel_esp,
+         frame->ebp, frame->eip, frame->eflags, frame->cs, frame->ds);
+  printf("  error=%x\n", frame->error);
+  printf("KERNEL PANIC!\n");
+
+  x86_DisableInterrupts();
+  for (;;) {
+    x86_Halt();
+  }
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Register state pushed by the interrupt stubs in isr.asm
+typedef struct {
+  uint32_t fs, es, ds;
+  uint32_t edi, esi, ebp, kernel_esp, ebx, edx, ecx, eax;
+  uint32_t vector, error;
+  uint32_t eip, cs, eflags;
+  uint32_t esp, ss; // Only pushed by the CPU on a privilege change
+} __attribute__((packed)) ISRFrame;
+
+typedef void (*ISRHandler)(ISRFrame *frame);
+
+void ISRInitialize();
+void ISRRegisterHandler(int vector, ISRHandler handler);
+
+// Let user code raise the vector with int, for system calls
+void ISRAllowUser(int vector);
+
+static inline bool ISRFromUser(const ISRFrame *frame) {
+  return (frame->cs & 3) != 0;
+}
+
+// Report an exception the kernel cannot handle and stop, for handlers that
+// only take care of some cases of their vector
+void __attribute__((noreturn)) ISRPanic(ISRFrame *frame);
@@ -0,0 +1,553 @@
+#include "kbench.h"
+#include "fpu.h"
+#include "ipc.h"
+#include "isr.h"
+#include "memory.h"
+#include "mmap.h"
+#include "module.h"
+#include "page.h"
+#include "pagecache.h"
+#include "paging.h"
+#include "pit.h"
+#include "softirq.h"
+#include "stdio.h"
+#include "vfs.h"
+#include "x86.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/image.h>
+
+// Scratch memory between the boot modules and the SMP benchmark region
+#define KBENCH_REGION ((uint8_t *)0x01000000) // NOLINT
+#define KBENCH_REGION_SIZE 0x01000000         // NOLINT
+
+#define KBENCH_MAX_SAMPLES 1000         // NOLINT
+#define KBENCH_MIN_SAMPLES 16           // NOLINT
+#define KBENCH_BYTES_PER_SIZE 0x400000  // NOLINT, copied per size and case
+#define KBENCH_CALIBRATION_US 10000     // NOLINT
+#define KBENCH_VECTOR 0xF1              // NOLINT
+#define KBENCH_PORT 0x80                // NOLINT, POST codes, free to poke
+
+typedef void (*KBenchFunction)();
+
+typedef struct {
+  const char *name;
+  void (*run)();
+  const char *unavailable; // Why the kernel cannot measure it yet
+} KBench;
+
+static uint32_t samples_[KBENCH_MAX_SAMPLES];
+static uint32_t overhead_;
+static uint32_t cycles_per_us_;
+
+// Operands of the function being measured
+static uint8_t *destination_;
+static const uint8_t *source_;
+static uint32_t size_;
+
+static uint32_t KBenchTime(KBenchFunction function) {
+  uint64_t start = x86_ReadTSC();
+  function();
+  uint64_t cycles = x86_ReadTSC() - start;
+  return cycles > overhead_ ? (uint32_t)(cycles - overhead_) : 0;
+}
+
+static void KBenchEmpty() {}
+
+static void KBenchSort(uint32_t *values, int count) {
+  for (int i = 1; i < count; i++) {
+    uint32_t value = values[i];
+    int j = i;
+    while (j > 0 && values[j - 1] > value) {
+      values[j] = values[j - 1];
+      j--;
+    }
+    values[j] = value;
+  }
+}
+
+static uint32_t KBenchPercentile(int count, int percent) {
+  int index = (count * percent + 99) / 100 - 1;
+  return samples_[index < 0 ? 0 : index];
+}
+
+// Warm caches and branch predictors with a quarter of the samples first,
+// then report the spread. Bandwidth comes from the median.
+static void KBenchMeasure(const char *name, KBenchFunction function,
+                          int count, uint32_t bytes) {
+  if (count > KBENCH_MAX_SAMPLES) {
+    count = KBENCH_MAX_SAMPLES;
+  }
+
+  for (int i = 0; i < count / 4 + 1; i++) {
+    function();
+  }
+  for (int i = 0; i < count; i++) {
+    samples_[i] = KBenchTime(function);
+  }
+  KBenchSort(samples_, count);
+
+  uint32_t median = KBenchPercentile(count, 50);
+  printf("kbench: %s min %u p50 %u p90 %u p99 %u cycles", name, samples_[0],
+         median, KBenchPercentile(count, 90), KBenchPercentile(count, 99));
+  if (bytes > 0 && median > 0) {
+    printf(", %u MB/s",
+           (uint32_t)((uint64_t)bytes * cycles_per_us_ / median));
+  }
+  printf("\n");
+}
+
+// Builds "name value case" benchmark labels, separated by spaces
+static int KBenchAppend(char *buffer, int length, const char *str) {
+  if (length > 0) {
+    buffer[length++] = ' ';
+  }
+  while (*str) {
+    buffer[length++] = *str++;
+  }
+  buffer[length] = '\0';
+  return length;
+}
+
+static int KBenchAppendNumber(char *buffer, int length, uint32_t value) {
+  char digits[11];
+  int pos = sizeof(digits) - 1;
+  digits[pos] = '\0';
+  do {
+    digits[--pos] = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+  return KBenchAppend(buffer, length, &digits[pos]);
+}
+
+static void KBenchMemcpyOnce() { memcpy(destination_, source_, size_); }
+static void KBenchMemsetOnce() { memset(destination_, 0xA5, size_); }
+
+static const uint32_t kKBenchSizes[] = {64, 512, 4096, 65536, 1048576};
+
+// Every size aligned, with the destination off by one and with both off by
+// different amounts, which defeats any word-at-a-time fast path
+static void KBenchMemory(const char *routine, KBenchFunction function) {
+  static const struct {
+    const char *name;
+    uint32_t destination_offset;
+    uint32_t source_offset;
+  } kCases[] = {
+      {"aligned", 0, 0},
+      {"dst+1", 1, 0},
+      {"dst+1/src+3", 1, 3},
+  };
+
+  for (uint32_t i = 0; i < sizeof(kKBenchSizes) / sizeof(kKBenchSizes[0]);
+       i++) {
+    for (uint32_t j = 0; j < sizeof(kCases) / sizeof(kCases[0]); j++) {
+      size_ = kKBenchSizes[i];
+      destination_ = KBENCH_REGION + kCases[j].destination_offset;
+      source_ =
+          KBENCH_REGION + KBENCH_REGION_SIZE / 2 + kCases[j].source_offset;
+
+      char name[48];
+      int length = KBenchAppend(name, 0, routine);
+      length = KBenchAppendNumber(name, length, size_);
+      KBenchAppend(name, length, kCases[j].name);
+
+      int count = KBENCH_BYTES_PER_SIZE / size_;
+      KBenchMeasure(name, function,
+                    count < KBENCH_MIN_SAMPLES ? KBENCH_MIN_SAMPLES : count,
+                    size_);
+    }
+  }
+}
+
+static void KBenchMemcpy() { KBenchMemory("memcpy", KBenchMemcpyOnce); }
+static void KBenchMemset() { KBenchMemory("memset", KBenchMemsetOnce); }
+
+// A typical status line, ending in a carriage return so the console keeps
+// overwriting a single row
+static void KBenchPrintfOnce() {
+  printf("kbench: printf %d %x %s\r", 12345, 0xBEEF, "throughput");
+}
+
+static void KBenchPrintf() {
+  KBenchMeasure("printf", KBenchPrintfOnce, 200, 0);
+  printf("\n");
+}
+
+static void KBenchInbOnce() { x86_inb(KBENCH_PORT); }
+static void KBenchOutbOnce() { x86_outb(KBENCH_PORT, 0); }
+
+static void KBenchPortIO() {
+  KBenchMeasure("inb", KBenchInbOnce, KBENCH_MAX_SAMPLES, 0);
+  KBenchMeasure("outb", KBenchOutbOnce, KBENCH_MAX_SAMPLES, 0);
+}
+
+static void KBenchInterrupt(ISRFrame *frame) {}
+
+// Software interrupt through the same stubs and dispatch as device
+// interrupts, without the PIC round trip
+static void KBenchIntOnce() {
+  __asm__ volatile("int %0" : : "i"(KBENCH_VECTOR) : "memory");
+}
+
+static void KBenchIRQ() {
+  ISRRegisterHandler(KBENCH_VECTOR, KBenchInterrupt);
+  KBenchMeasure("interrupt", KBenchIntOnce, KBENCH_MAX_SAMPLES, 0);
+  ISRRegisterHandler(KBENCH_VECTOR, NULL);
+}
+
+static uint32_t kbench_softirq_events_;
+
+static void KBenchSoftIRQHandler(void *context, const uint32_t *events,
+                                 uint32_t count) {
+  kbench_softirq_events_ += count;
+}
+
+static SoftIRQ kbench_softirq_ = {
+    .handler = KBenchSoftIRQHandler,
+    .coalesce = SOFTIRQ_BATCH,
+};
+
+// What a top half raising events and the bottom half running them costs,
+// one at a time and a burst of a full batch. Draining opens interrupts for
+// a moment, the devices are quiet while the benchmarks run.
+static void KBenchSoftIRQOnce() {
+  SoftIRQRaise(&kbench_softirq_, 0);
+  SoftIRQRun();
+}
+
+static void KBenchSoftIRQBatchOnce() {
+  for (uint32_t i = 0; i < SOFTIRQ_BATCH; i++) {
+    SoftIRQRaise(&kbench_softirq_, i);
+  }
+  SoftIRQRun();
+}
+
+static void KBenchSoftIRQ() {
+  KBenchMeasure("softirq event-1", KBenchSoftIRQOnce, KBENCH_MAX_SAMPLES, 0);
+  KBenchMeasure("softirq batch-32", KBenchSoftIRQBatchOnce,
+                KBENCH_MAX_SAMPLES, 0);
+}
+
+static FPUState kbench_fpu_[2];
+static int kbench_fpu_next_;
+
+static void KBenchFPUKernelOnce() {
+  FPUKernelBegin();
+  FPUKernelEnd();
+}
+
+// Alternate two contexts so every fwait traps and swaps the register state
+static void KBenchFPUSwitchOnce() {
+  FPUSwitch(&kbench_fpu_[kbench_fpu_next_]);
+  kbench_fpu_next_ ^= 1;
+  __asm__ volatile("fwait");
+}
+
+static void KBenchFPU() {
+  KBenchMeasure("fpu kernel-section", KBenchFPUKernelOnce, KBENCH_MAX_SAMPLES,
+                0);
+  KBenchMeasure("fpu lazy-switch", KBenchFPUSwitchOnce, KBENCH_MAX_SAMPLES, 0);
+
+  // Hand the registers back to nobody
+  FPUSwitch(NULL);
+  KBenchFPUKernelOnce();
+}
+
+#define KBENCH_PAGE_SAMPLES 160 // NOLINT, plus warm-up fits the zeroed pool
+#define KBENCH_MAX_PAGES 512    // NOLINT
+
+static void *kbench_pages_[KBENCH_MAX_PAGES];
+static int kbench_page_count_;
+
+static void KBenchPageZeroedOnce() {
+  kbench_pages_[kbench_page_count_++] = PageAllocZeroed();
+}
+
+static void KBenchPageZeroIdleOnce() { PageZeroIdle(); }
+
+// A cleared page from the pool against one cleared on demand, and what the
+// idle loop spends per page to refill the pool
+static void KBenchPage() {
+  if (PageFreeCount() < KBENCH_MAX_PAGES * 2) {
+    printf("kbench: page unavailable, not enough memory\n");
+    return;
+  }
+
+  while (PageZeroIdle()) {
+  }
+  kbench_page_count_ = 0;
+  KBenchMeasure("page zeroed-pool", KBenchPageZeroedOnce, KBENCH_PAGE_SAMPLES,
+                0);
+
+  while (PageZeroedCount() > 0) {
+    kbench_pages_[kbench_page_count_++] = PageAllocZeroed();
+  }
+  KBenchMeasure("page zeroed-clear", KBenchPageZeroedOnce,
+                KBENCH_PAGE_SAMPLES, 4096);
+
+  for (int i = 0; i < kbench_page_count_; i++) {
+    PageFree(kbench_pages_[i]);
+  }
+  KBenchMeasure("page zero-idle", KBenchPageZeroIdleOnce, KBENCH_PAGE_SAMPLES,
+                4096);
+}
+
+#define KBENCH_TMPFS_PATH "/kbench" // NOLINT
+#define KBENCH_TMPFS_SIZE 0x100000 // NOLINT
+
+static VFSFile kbench_file_;
+static uint32_t kbench_random_ = 1;
+
+// Page aligned positions all over the file, so reads hit the radix tree
+// rather than one hot page
+static void KBenchTmpFSSeek() {
+  kbench_random_ = kbench_random_ * 1103515245 + 12345;
+  kbench_file_.position =
+      (kbench_random_ >> 8) % (KBENCH_TMPFS_SIZE / 4096) * 4096;
+}
+
+static void KBenchTmpFSReadOnce() {
+  KBenchTmpFSSeek();
+  VFSRead(&kbench_file_, destination_, 4096);
+}
+
+static void KBenchTmpFSWriteOnce() {
+  KBenchTmpFSSeek();
+  VFSWrite(&kbench_file_, source_, 4096);
+}
+
+static void KBenchLookupOnce() {
+  VFSStat stat;
+  VFSStatPath(KBENCH_TMPFS_PATH, &stat);
+}
+
+static void KBenchNegativeLookupOnce() {
+  VFSStat stat;
+  VFSStatPath("/kbench-missing", &stat);
+}
+
+static void KBenchTmpFS() {
+  int result = VFSCreate(KBENCH_TMPFS_PATH, kVFSRegular);
+  if ((result < 0 && result != kVFSErrorExists) ||
+      VFSOpen(KBENCH_TMPFS_PATH, &kbench_file_) < 0) {
+    printf("kbench: tmpfs unavailable, nothing mounted\n");
+    return;
+  }
+
+  destination_ = KBENCH_REGION;
+  source_ = KBENCH_REGION + KBENCH_REGION_SIZE / 2;
+  VFSWrite(&kbench_file_, source_, KBENCH_TMPFS_SIZE);
+
+  KBenchMeasure("tmpfs read-4k", KBenchTmpFSReadOnce, KBENCH_MAX_SAMPLES,
+                4096);
+  KBenchMeasure("tmpfs write-4k", KBenchTmpFSWriteOnce, KBENCH_MAX_SAMPLES,
+                4096);
+  KBenchMeasure("vfs lookup", KBenchLookupOnce, KBENCH_MAX_SAMPLES, 0);
+  KBenchMeasure("vfs negative-lookup", KBenchNegativeLookupOnce,
+                KBENCH_MAX_SAMPLES, 0);
+  VFSClose(&kbench_file_);
+}
+
+#define KBENCH_IPC_SIZE (IPC_MESSAGE_PAGES * 4096)
+
+static AddressSpace kbench_space_;
+static MMapTable kbench_maps_;
+static IPCMessage kbench_message_;
+static int kbench_pipe_;
+static int kbench_channel_;
+
+static void KBenchPipeOnce() {
+  IPCPipeWrite(kbench_pipe_, source_, 4096);
+  IPCPipeRead(kbench_pipe_, destination_, 4096);
+}
+
+// The message leaves the space and comes back at a new address
+static void KBenchChannelOnce() {
+  IPCChannelSend(kbench_channel_, &kbench_space_, &kbench_maps_,
+                 &kbench_message_, 1);
+  IPCChannelReceive(kbench_channel_, &kbench_space_, &kbench_maps_,
+                    &kbench_message_, 1);
+}
+
+static void KBenchIPCCopyOnce() {
+  memcpy(destination_, source_, KBENCH_IPC_SIZE);
+}
+
+// A page through a pipe, and a 64 KiB message over a channel in a scratch
+// address space against copying it
+static void KBenchIPC() {
+  kbench_pipe_ = IPCPipeCreate(0);
+  kbench_channel_ = IPCChannelCreate(0);
+  bool ready = kbench_pipe_ >= 0 && kbench_channel_ >= 0 &&
+               PagingIsEnabled() && PagingCreateSpace(&kbench_space_);
+  if (ready) {
+    MMapCreateTable(&kbench_maps_);
+    kbench_message_.address = USER_BASE;
+    kbench_message_.size = KBENCH_IPC_SIZE;
+    for (uint32_t i = 0; i < IPC_MESSAGE_PAGES && ready; i++) {
+      void *page = PageAlloc();
+      ready = page != NULL &&
+              PagingMap(&kbench_space_, USER_BASE + i * 4096, (uint32_t)page,
+                        kPageWritable | kPageUser | kPageOwned);
+      if (!ready && page != NULL) {
+        PageFree(page);
+      }
+    }
+    if (!ready) {
+      PagingDestroySpace(&kbench_space_);
+    }
+  }
+  if (!ready) {
+    printf("kbench: ipc unavailable, no paging or memory\n");
+    IPCPipeClose(kbench_pipe_);
+    IPCChannelClose(kbench_channel_);
+    return;
+  }
+
+  destination_ = KBENCH_REGION;
+  source_ = KBENCH_REGION + KBENCH_REGION_SIZE / 2;
+  KBenchMeasure("ipc pipe-4k", KBenchPipeOnce, KBENCH_MAX_SAMPLES, 4096);
+  KBenchMeasure("ipc channel-64k", KBenchChannelOnce, KBENCH_MAX_SAMPLES,
+                KBENCH_IPC_SIZE);
+  KBenchMeasure("ipc copy-64k", KBenchIPCCopyOnce, KBENCH_MAX_SAMPLES,
+                KBENCH_IPC_SIZE);
+
+  IPCPipeClose(kbench_pipe_);
+  IPCChannelClose(kbench_channel_);
+  MMapDestroyTable(&kbench_maps_, &kbench_space_);
+  PagingDestroySpace(&kbench_space_);
+}
+
+#define KBENCH_FAULT_PATH "/disk/kernel.bin" // NOLINT
+
+static AddressSpace kbench_fault_space_;
+static MMapTable kbench_fault_maps_;
+static VFSInode *kbench_fault_inode_;
+static uint32_t kbench_fault_start_;
+static uint32_t kbench_fault_pages_;
+static uint32_t kbench_fault_next_;
+
+// What the page fault handler does for a file page already in the cache:
+// find the mapping and the cached page and map it. The page is dropped
+// again so every sample faults, walking the file as sequential reads would.
+static void KBenchPageFaultOnce() {
+  uint32_t address = kbench_fault_start_ + kbench_fault_next_ * 4096;
+  MMapPopulate(&kbench_fault_maps_, &kbench_fault_space_, address, 1);
+  if (PagingUnmap(&kbench_fault_space_, address) != 0) {
+    PageCacheRelease(kbench_fault_inode_, kbench_fault_next_);
+  }
+  kbench_fault_next_ = (kbench_fault_next_ + 1) % kbench_fault_pages_;
+}
+
+// The trap itself costs what the interrupt benchmark measures, so this
+// runs the handler's part directly in a scratch address space
+static void KBenchPageFault() {
+  uint32_t length = 0;
+  if (!PagingIsEnabled() || !PagingCreateSpace(&kbench_fault_space_)) {
+    printf("kbench: page-fault unavailable, no paging or memory\n");
+    return;
+  }
+  MMapCreateTable(&kbench_fault_maps_);
+  if (MMapFile(&kbench_fault_maps_, KBENCH_FAULT_PATH, 0, &length,
+               &kbench_fault_start_) < 0) {
+    printf("kbench: page-fault unavailable, no %s\n", KBENCH_FAULT_PATH);
+    PagingDestroySpace(&kbench_fault_space_);
+    return;
+  }
+
+  kbench_fault_inode_ = kbench_fault_maps_.mappings[0].file.inode;
+  kbench_fault_pages_ = (length + 4095) / 4096;
+  kbench_fault_next_ = 0;
+  KBenchMeasure("page-fault cached", KBenchPageFaultOnce, KBENCH_MAX_SAMPLES,
+                4096);
+
+  MMapDestroyTable(&kbench_fault_maps_, &kbench_fault_space_);
+  PagingDestroySpace(&kbench_fault_space_);
+}
+
+static const KBench kBenchmarks[] = {
+    {"memcpy", KBenchMemcpy, NULL},
+    {"memset", KBenchMemset, NULL},
+    {"printf", KBenchPrintf, NULL},
+    {"portio", KBenchPortIO, NULL},
+    {"irq", KBenchIRQ, NULL},
+    {"softirq", KBenchSoftIRQ, NULL},
+    {"fpu", KBenchFPU, NULL},
+    {"page", KBenchPage, NULL},
+    {"tmpfs", KBenchTmpFS, NULL},
+    {"ipc", KBenchIPC, NULL},
+    {"context-switch", NULL, "no threads"},
+    {"page-fault", KBenchPageFault, NULL},
+};
+
+static bool KBenchIsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Empty lists select everything
+static bool KBenchSelected(const Module *module, const char *name) {
+  const char *text = module->data;
+  uint32_t i = 0;
+  bool empty = true;
+
+  while (i < module->size) {
+    while (i < module->size && KBenchIsSpace(text[i])) {
+      i++;
+    }
+    uint32_t start = i;
+    while (i < module->size && !KBenchIsSpace(text[i])) {
+      i++;
+    }
+    if (i == start) {
+      break;
+    }
+
+    empty = false;
+    uint32_t length = 0;
+    while (name[length] != '\0') {
+      length++;
+    }
+    if (i - start == length && memcmp(text + start, name, length) == 0) {
+      return true;
+    }
+  }
+  return empty;
+}
+
+void KBenchRun() {
+  Module module;
+  if (!ModuleFind("kbench", &module)) {
+    return;
+  }
+
+  uint64_t start = x86_ReadTSC();
+  PITDelay(KBENCH_CALIBRATION_US);
+  cycles_per_us_ = (uint32_t)((x86_ReadTSC() - start) / KBENCH_CALIBRATION_US);
+
+  // Nothing but the benchmark may run in between the timestamps
+  uint32_t flags = x86_SaveFlagsAndDisableInterrupts();
+
+  overhead_ = 0;
+  for (int i = 0; i < KBENCH_MAX_SAMPLES; i++) {
+    samples_[i] = KBenchTime(KBenchEmpty);
+  }
+  KBenchSort(samples_, KBENCH_MAX_SAMPLES);
+  overhead_ = samples_[0];
+  printf("kbench: tsc %u MHz, timing overhead %u cycles\n", cycles_per_us_,
+         overhead_);
+
+  for (uint32_t i = 0; i < sizeof(kBenchmarks) / sizeof(kBenchmarks[0]);
+       i++) {
+    const KBench *bench = &kBenchmarks[i];
+    if (!KBenchSelected(&module, bench->name)) {
+      continue;
+    }
+    if (bench->run == NULL) {
+      printf("kbench: %s unavailable, %s\n", bench->name, bench->unavailable);
+      continue;
+    }
+    bench->run();
+  }
+
+  x86_RestoreFlags(flags);
+}
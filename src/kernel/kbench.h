@@ -0,0 +1,7 @@
+#pragma once
+
+// Microbenchmarks of the kernel's own primitives, run when the boot module
+// archive holds a "kbench" module. The module lists the benchmarks to run
+// separated by whitespace, an empty one runs them all. Results go to the
+// console and serial port as "kbench:" lines with TSC cycle percentiles.
+void KBenchRun();
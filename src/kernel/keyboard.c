@@ -0,0 +1,234 @@
+#include "keyboard.h"
+#include "irq.h"
+#include "percpu.h"
+#include "ring.h"
+#include "x86.h"
+#include <stddef.h>
+
+enum KeyboardPorts {
+  kKeyboardDataPort = 0x60,
+  kKeyboardStatusPort = 0x64,
+};
+
+enum KeyboardStatus {
+  kKeyboardStatusOutputFull = 0x01,
+};
+
+enum KeyboardScancodes {
+  kScancodeRelease = 0x80,
+  kScancodeExtended = 0xE0,
+  kScancodePause = 0xE1,
+};
+
+#define KEYBOARD_IRQ 1         // NOLINT
+#define KEYBOARD_RING_SIZE 256 // NOLINT
+
+// Scan code set 1 (what the controller translates to) to key code
+static const uint8_t kScancodeToKey[0x59] = {
+  0x00, 0x29, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, // 0x00
+  0x24, 0x25, 0x26, 0x27, 0x2D, 0x2E, 0x2A, 0x2B, // 0x08
+  0x14, 0x1A, 0x08, 0x15, 0x17, 0x1C, 0x18, 0x0C, // 0x10
+  0x12, 0x13, 0x2F, 0x30, 0x28, 0xE0, 0x04, 0x16, // 0x18
+  0x07, 0x09, 0x0A, 0x0B, 0x0D, 0x0E, 0x0F, 0x33, // 0x20
+  0x34, 0x35, 0xE1, 0x31, 0x1D, 0x1B, 0x06, 0x19, // 0x28
+  0x05, 0x11, 0x10, 0x36, 0x37, 0x38, 0xE5, 0x55, // 0x30
+  0xE2, 0x2C, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, // 0x38
+  0x3F, 0x40, 0x41, 0x42, 0x43, 0x53, 0x47, 0x5F, // 0x40
+  0x60, 0x61, 0x56, 0x5C, 0x5D, 0x5E, 0x57, 0x59, // 0x48
+  0x5A, 0x5B, 0x62, 0x63, 0x00, 0x00, 0x64, 0x44, // 0x50
+  0x45,                                           // 0x58
+};
+
+// Scan codes following an 0xE0 prefix
+static const uint8_t kExtendedScancodeToKey[0x80] = {
+  [0x1C] = kKeyKeypadEnter, [0x1D] = kKeyRightControl,
+  [0x35] = kKeyKeypadSlash, [0x37] = kKeyPrintScreen,
+  [0x38] = kKeyRightAlt,    [0x47] = kKeyHome,
+  [0x48] = kKeyUp,          [0x49] = kKeyPageUp,
+  [0x4B] = kKeyLeft,        [0x4D] = kKeyRight,
+  [0x4F] = kKeyEnd,         [0x50] = kKeyDown,
+  [0x51] = kKeyPageDown,    [0x52] = kKeyInsert,
+  [0x53] = kKeyDelete,      [0x5B] = kKeyLeftGui,
+  [0x5C] = kKeyRightGui,
+};
+
+static const char kKeyToAscii[0x65] = {
+  0,    0,    0,    0,    'a',  'b',  'c',  'd',  // 0x00
+  'e',  'f',  'g',  'h',  'i',  'j',  'k',  'l',  // 0x08
+  'm',  'n',  'o',  'p',  'q',  'r',  's',  't',  // 0x10
+  'u',  'v',  'w',  'x',  'y',  'z',  '1',  '2',  // 0x18
+  '3',  '4',  '5',  '6',  '7',  '8',  '9',  '0',  // 0x20
+  '\n', 0x1B, '\b', '\t', ' ',  '-',  '=',  '[',  // 0x28
+  ']',  '\\', '#',  ';',  '\'', '`',  ',',  '.',  // 0x30
+  '/',  0,    0,    0,    0,    0,    0,    0,    // 0x38
+  0,    0,    0,    0,    0,    0,    0,    0,    // 0x40
+  0,    0,    0,    0,    0,    0,    0,    0,    // 0x48
+  0,    0,    0,    0,    '/',  '*',  '-',  '+',  // 0x50
+  '\n', '1',  '2',  '3',  '4',  '5',  '6',  '7',  // 0x58
+  '8',  '9',  '0',  '.',  '\\',                   // 0x60
+};
+
+static const char kKeyToAsciiShifted[0x65] = {
+  0,    0,    0,    0,    'A',  'B',  'C',  'D',  // 0x00
+  'E',  'F',  'G',  'H',  'I',  'J',  'K',  'L',  // 0x08
+  'M',  'N',  'O',  'P',  'Q',  'R',  'S',  'T',  // 0x10
+  'U',  'V',  'W',  'X',  'Y',  'Z',  '!',  '@',  // 0x18
+  '#',  '$',  '%',  '^',  '&',  '*',  '(',  ')',  // 0x20
+  '\n', 0x1B, '\b', '\t', ' ',  '_',  '+',  '{',  // 0x28
+  '}',  '|',  '~',  ':',  '"',  '~',  '<',  '>',  // 0x30
+  '?',  0,    0,    0,    0,    0,    0,    0,    // 0x38
+  0,    0,    0,    0,    0,    0,    0,    0,    // 0x40
+  0,    0,    0,    0,    0,    0,    0,    0,    // 0x48
+  0,    0,    0,    0,    '/',  '*',  '-',  '+',  // 0x50
+  '\n', '1',  '2',  '3',  '4',  '5',  '6',  '7',  // 0x58
+  '8',  '9',  '0',  '.',  '|',                    // 0x60
+};
+
+// Filled by the interrupt handler, drained by KeyboardReadEvent
+static uint8_t ring_buffer_[KEYBOARD_RING_SIZE];
+static Ring ring_;
+static IRQAction irq_action_;
+
+// Decoder state, only touched by the consumer
+static uint8_t held_modifiers_ = 0; // One bit per key from kKeyLeftControl on
+static bool caps_lock_ = false;
+static bool extended_ = false;
+static int pause_bytes_ = 0;
+
+static void KeyboardInterrupt(ISRFrame *frame, void *context) {
+  if (x86_inb(kKeyboardStatusPort) & kKeyboardStatusOutputFull) {
+    // A full ring drops keys rather than stalling the interrupt
+    RingPush(&ring_, x86_inb(kKeyboardDataPort));
+  }
+}
+
+void KeyboardInitialize() {
+  RingInitialize(&ring_, ring_buffer_, KEYBOARD_RING_SIZE);
+
+  // Throw away anything left over from the BIOS
+  while (x86_inb(kKeyboardStatusPort) & kKeyboardStatusOutputFull) {
+    x86_inb(kKeyboardDataPort);
+  }
+
+  irq_action_.handler = KeyboardInterrupt;
+  irq_action_.context = NULL;
+  IRQRegisterHandler(KEYBOARD_IRQ, &irq_action_);
+}
+
+static uint8_t KeyboardModifiers() {
+  uint8_t modifiers = 0;
+  if (held_modifiers_ & 0x22) {
+    modifiers |= kKeyModifierShift;
+  }
+  if (held_modifiers_ & 0x11) {
+    modifiers |= kKeyModifierControl;
+  }
+  if (held_modifiers_ & 0x44) {
+    modifiers |= kKeyModifierAlt;
+  }
+  if (caps_lock_) {
+    modifiers |= kKeyModifierCapsLock;
+  }
+  return modifiers;
+}
+
+static char KeyboardTranslate(uint8_t code, uint8_t modifiers) {
+  if (code >= sizeof(kKeyToAscii)) {
+    return '\0';
+  }
+
+  bool shift = (modifiers & kKeyModifierShift) != 0;
+  if (code >= kKeyA && code <= kKeyZ && (modifiers & kKeyModifierCapsLock)) {
+    shift = !shift;
+  }
+
+  char ascii = shift ? kKeyToAsciiShifted[code] : kKeyToAscii[code];
+  if ((modifiers & kKeyModifierControl) && code >= kKeyA && code <= kKeyZ) {
+    ascii &= 0x1F;
+  }
+  return ascii;
+}
+
+// Decode queued scan codes until one complete key event is available
+bool KeyboardReadEvent(KeyEvent *event_out) {
+  uint8_t scancode;
+  while (RingPop(&ring_, &scancode)) {
+    if (pause_bytes_ > 0) {
+      pause_bytes_--;
+      continue;
+    }
+
+    if (scancode == kScancodeExtended) {
+      extended_ = true;
+      continue;
+    }
+
+    // Pause sends E1 1D 45 E1 9D C5 on press and nothing on release
+    if (scancode == kScancodePause) {
+      pause_bytes_ = 5;
+      event_out->code = kKeyPause;
+      event_out->modifiers = KeyboardModifiers();
+      event_out->pressed = true;
+      event_out->ascii = '\0';
+      return true;
+    }
+
+    bool pressed = (scancode & kScancodeRelease) == 0;
+    uint8_t index = scancode & ~kScancodeRelease;
+    uint8_t code = 0;
+    if (extended_) {
+      code = kExtendedScancodeToKey[index];
+    } else if (index < sizeof(kScancodeToKey)) {
+      code = kScancodeToKey[index];
+    }
+    extended_ = false;
+
+    if (code == kKeyNone) {
+      continue;
+    }
+
+    if (code >= kKeyLeftControl) {
+      uint8_t bit = 1 << (code - kKeyLeftControl);
+      held_modifiers_ = pressed ? (held_modifiers_ | bit)
+                                : (held_modifiers_ & ~bit);
+    } else if (code == kKeyCapsLock && pressed) {
+      caps_lock_ = !caps_lock_;
+    }
+
+    event_out->code = code;
+    event_out->modifiers = KeyboardModifiers();
+    event_out->pressed = pressed;
+    event_out->ascii =
+        pressed ? KeyboardTranslate(code, event_out->modifiers) : '\0';
+    return true;
+  }
+
+  return false;
+}
+
+// Only the BSP receives the keyboard interrupt, other CPUs have to spin
+static void KeyboardWait() {
+  uint32_t flags = x86_SaveFlagsAndDisableInterrupts();
+  if (RingIsEmpty(&ring_)) {
+    if (PerCpuIndex() == 0) {
+      x86_WaitForInterrupt();
+    } else {
+      CpuRelax();
+    }
+  }
+  x86_RestoreFlags(flags);
+}
+
+// Block until a key that produces a character is pressed
+char KeyboardGetChar() {
+  KeyEvent event;
+  for (;;) {
+    while (KeyboardReadEvent(&event)) {
+      if (event.pressed && event.ascii != '\0') {
+        return event.ascii;
+      }
+    }
+
+    KeyboardWait();
+  }
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Key codes follow the USB HID keyboard usage table
+enum KeyCodes {
+  kKeyNone = 0x00,
+  kKeyA = 0x04,
+  kKeyZ = 0x1D,
+  kKey1 = 0x1E,
+  kKey0 = 0x27,
+  kKeyEnter = 0x28,
+  kKeyEscape = 0x29,
+  kKeyBackspace = 0x2A,
+  kKeyTab = 0x2B,
+  kKeySpace = 0x2C,
+  kKeyMinus = 0x2D,
+  kKeyEqual = 0x2E,
+  kKeyLeftBracket = 0x2F,
+  kKeyRightBracket = 0x30,
+  kKeyBackslash = 0x31,
+  kKeySemicolon = 0x33,
+  kKeyApostrophe = 0x34,
+  kKeyGrave = 0x35,
+  kKeyComma = 0x36,
+  kKeyPeriod = 0x37,
+  kKeySlash = 0x38,
+  kKeyCapsLock = 0x39,
+  kKeyF1 = 0x3A,
+  kKeyF10 = 0x43,
+  kKeyF11 = 0x44,
+  kKeyF12 = 0x45,
+  kKeyPrintScreen = 0x46,
+  kKeyScrollLock = 0x47,
+  kKeyPause = 0x48,
+  kKeyInsert = 0x49,
+  kKeyHome = 0x4A,
+  kKeyPageUp = 0x4B,
+  kKeyDelete = 0x4C,
+  kKeyEnd = 0x4D,
+  kKeyPageDown = 0x4E,
+  kKeyRight = 0x4F,
+  kKeyLeft = 0x50,
+  kKeyDown = 0x51,
+  kKeyUp = 0x52,
+  kKeyNumLock = 0x53,
+  kKeyKeypadSlash = 0x54,
+  kKeyKeypadAsterisk = 0x55,
+  kKeyKeypadMinus = 0x56,
+  kKeyKeypadPlus = 0x57,
+  kKeyKeypadEnter = 0x58,
+  kKeyKeypad1 = 0x59,
+  kKeyKeypad0 = 0x62,
+  kKeyKeypadPeriod = 0x63,
+  kKeyNonUSBackslash = 0x64,
+  kKeyLeftControl = 0xE0,
+  kKeyLeftShift = 0xE1,
+  kKeyLeftAlt = 0xE2,
+  kKeyLeftGui = 0xE3,
+  kKeyRightControl = 0xE4,
+  kKeyRightShift = 0xE5,
+  kKeyRightAlt = 0xE6,
+  kKeyRightGui = 0xE7,
+};
+
+enum KeyModifiers {
+  kKeyModifierShift = 0x01,
+  kKeyModifierControl = 0x02,
+  kKeyModifierAlt = 0x04,
+  kKeyModifierCapsLock = 0x08,
+};
+
+typedef struct {
+  uint8_t code;
+  uint8_t modifiers;
+  bool pressed;
+  char ascii; // '\0' if the key has no character
+} KeyEvent;
+
+void KeyboardInitialize();
+bool KeyboardReadEvent(KeyEvent *event_out);
+char KeyboardGetChar();
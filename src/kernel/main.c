@@ -1,18 +1,117 @@
+#include <stddef.h>
 #include <stdint.h>
+#include "ahci.h"
+#include "boot.h"
+#include "fatfs.h"
+#include "fbcon.h"
+#include "fpu.h"
+#include "gdt.h"
+#include "idt.h"
+#include "irq.h"
+#include "isr.h"
+#include "kbench.h"
+#include "keyboard.h"
 #include "stdio.h"
 #include "memory.h"
+#include "module.h"
+#include "page.h"
+#include "paging.h"
+#include "pci.h"
+#include "process.h"
+#include "profile.h"
+#include "ramdisk.h"
+#include "serial.h"
+#include "smp.h"
+#include "smpbench.h"
+#include "softirq.h"
+#include "tmpfs.h"
+#include "vfs.h"
+#include "virtioblk.h"
+#include "x86.h"
 
 extern uint8_t __bss_start;
 extern uint8_t __end;
 
-void __attribute__((section(".entry"))) start(uint16_t boot_drive) {
+// Nothing is scheduled yet, so the idle loop is the bottom half's worker:
+// deferred interrupt work first, then clearing free pages until the pool is
+// full, and then the CPU sleeps until the next interrupt. The last check is
+// made with interrupts off so an event raised just before cannot wait out
+// the sleep.
+static void __attribute__((noreturn)) Idle() {
+  for (;;) {
+    if (SoftIRQRun() || PageZeroIdle()) {
+      continue;
+    }
+    x86_DisableInterrupts();
+    if (!SoftIRQPending()) {
+      x86_WaitForInterrupt();
+    }
+    x86_EnableInterrupts();
+  }
+}
+
+void __attribute__((section(".entry")))
+start(const BootParams *boot_params) {
   memset(&__bss_start, 0, (&__end) - (&__bss_start));
+  BootInitialize(boot_params);
+  FBConInitialize(BootGetParams());
 
+  SerialInitialize(SERIAL_COM1);
   clrscr();
 
   printf("Hello from the kernel!\n");
 
+  GDTInitialize();
+  ISRInitialize();
+  IDTInitialize();
+  FPUInitialize();
+  PageInitialize();
+  PagingInitialize();
+  BootMarkPhase(kBootPhaseInterruptsReady);
+
+  SMPInitialize();
+  printf("SMP: %d CPUs online\n", SMPOnlineCount());
+  BootMarkPhase(kBootPhaseSMPReady);
+
+#ifdef PROFILE
+  ProfileInitialize();
+#endif
+
+  IRQInitialize();
+  KeyboardInitialize();
+  RamdiskInitialize(BootGetParams());
+  ModuleInitialize(BootGetParams());
+  PCIInitialize();
+  VirtioBlkInitialize();
+  AHCIInitialize();
+  x86_EnableInterrupts();
+  VFSInitialize();
+  FATFSInitialize();
+  TmpFSInitialize();
+  VFSMount("/", "tmpfs", NULL);
+  VFSCreate("/disk", kVFSDirectory);
+  VFSMountDevice("/disk");
+  BootMarkPhase(kBootPhaseDevicesReady);
+
+  KBenchRun();
+
+#ifdef SMP_BENCHMARK
+  SMPBenchmark();
+#endif
+
+#ifdef PROFILE
+  ProfileDump();
+#endif
+
+  BootMarkPhase(kBootPhaseDone);
+
+#ifdef BOOT_BENCHMARK
+  BootReport();
+  BootExit(BOOT_EXIT_SUCCESS);
+#endif
+
+  ProcessStartInit();
+
 end:
-  for (;;)
-    ;
-}
\ No newline at end of file
+  Idle();
+}
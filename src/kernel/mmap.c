@@ -0,0 +1,271 @@
+#include "mmap.h"
+#include "isr.h"
+#include "memory.h"
+#include "page.h"
+#include "pagecache.h"
+#include "process.h"
+#include "x86.h"
+#include <stddef.h>
+#include <sys/image.h>
+
+#define MMAP_PAGE_FAULT 14     // NOLINT
+#define MMAP_EFLAGS_IF 0x200   // NOLINT
+
+enum MMapFaultError {
+  kMMapFaultPresent = 1u << 0,
+  kMMapFaultWrite = 1u << 1,
+};
+
+static inline uint32_t MMapReadCR2() {
+  uint32_t value;
+  __asm__ volatile("mov %%cr2, %0" : "=r"(value));
+  return value;
+}
+
+static MMapMapping *MMapFreeSlot(MMapTable *table) {
+  for (int i = 0; i < MMAP_MAX_MAPPINGS; i++) {
+    if (table->mappings[i].start == 0) {
+      return &table->mappings[i];
+    }
+  }
+  return NULL;
+}
+
+static MMapMapping *MMapFind(MMapTable *table, uint32_t address) {
+  for (int i = 0; i < MMAP_MAX_MAPPINGS; i++) {
+    MMapMapping *mapping = &table->mappings[i];
+    if (mapping->start != 0 && address >= mapping->start &&
+        address < mapping->end) {
+      return mapping;
+    }
+  }
+  return NULL;
+}
+
+// Map the page cache page behind address, false outside every mapping or
+// past the end of the file
+static bool MMapFaultIn(MMapTable *table, AddressSpace *space,
+                        uint32_t address) {
+  MMapMapping *mapping = MMapFind(table, address);
+  if (mapping == NULL) {
+    return false;
+  }
+
+  address &= PAGE_FRAME_MASK;
+  if (PagingLookup(space, address) != 0) {
+    return true;
+  }
+  // Anonymous pages that are not there were sent away
+  if (mapping->anonymous) {
+    return false;
+  }
+
+  VFSInode *inode = mapping->file.inode;
+  uint32_t index = mapping->first_index + (address - mapping->start) / PAGE_SIZE;
+  if ((uint64_t)index * PAGE_SIZE >= inode->size) {
+    return false;
+  }
+
+  void *page = PageCacheGet(inode, index, &mapping->file.readahead);
+  if (page == NULL) {
+    return false;
+  }
+  if (!PagingMap(space, address, (uint32_t)page, kPageUser)) {
+    PageCacheRelease(inode, index);
+    return false;
+  }
+  return true;
+}
+
+// Reading a page may have to wait for the disk, so interrupts come back on
+// whenever the faulting code had them
+static void MMapPageFault(ISRFrame *frame) {
+  uint32_t address = MMapReadCR2();
+  Process *process = ProcessCurrent();
+
+  if (process != NULL &&
+      !(frame->error & (kMMapFaultPresent | kMMapFaultWrite))) {
+    if (frame->eflags & MMAP_EFLAGS_IF) {
+      x86_EnableInterrupts();
+    }
+    bool mapped = MMapFaultIn(&process->maps, &process->space, address);
+    x86_DisableInterrupts();
+    if (mapped) {
+      return;
+    }
+  }
+
+  if (ISRFromUser(frame)) {
+    ProcessFault(frame);
+  }
+  ISRPanic(frame);
+}
+
+void MMapInitialize() {
+  ISRRegisterHandler(MMAP_PAGE_FAULT, MMapPageFault);
+}
+
+void MMapCreateTable(MMapTable *table) {
+  memset(table, 0, sizeof(*table));
+}
+
+void MMapDestroyTable(MMapTable *table, AddressSpace *space) {
+  for (int i = 0; i < MMAP_MAX_MAPPINGS; i++) {
+    if (table->mappings[i].start != 0) {
+      MMapUnmap(table, space, table->mappings[i].start);
+    }
+  }
+}
+
+// The lowest gap in the window that holds the pages and a guard page after
+// them, stepping past every mapping (and its guard page) in the way
+static bool MMapReserve(MMapTable *table, uint32_t pages,
+                        uint32_t *address_out) {
+  uint32_t limit = USER_STACK_TOP - USER_STACK_SIZE;
+  if (pages == 0 || pages >= (limit - USER_MAP_BASE) / PAGE_SIZE) {
+    return false;
+  }
+
+  uint32_t size = (pages + 1) * PAGE_SIZE;
+  uint32_t start = USER_MAP_BASE;
+  bool moved = true;
+  while (moved) {
+    if (start > limit - size) {
+      return false;
+    }
+    moved = false;
+    for (int i = 0; i < MMAP_MAX_MAPPINGS; i++) {
+      const MMapMapping *mapping = &table->mappings[i];
+      if (mapping->start != 0 && mapping->start < start + size &&
+          mapping->end + PAGE_SIZE > start) {
+        start = mapping->end + PAGE_SIZE;
+        moved = true;
+      }
+    }
+  }
+
+  *address_out = start;
+  return true;
+}
+
+int MMapFile(MMapTable *table, const char *path, uint32_t offset,
+             uint32_t *length_inout, uint32_t *address_out) {
+  if (offset % PAGE_SIZE != 0) {
+    return kVFSErrorInvalid;
+  }
+
+  MMapMapping *mapping = MMapFreeSlot(table);
+  if (mapping == NULL) {
+    return kVFSErrorNoMemory;
+  }
+
+  int result = VFSOpen(path, &mapping->file);
+  if (result < 0) {
+    return result;
+  }
+
+  VFSInode *inode = mapping->file.inode;
+  if (inode->type != kVFSRegular || inode->file_operations == NULL ||
+      inode->file_operations->readpage == NULL) {
+    VFSClose(&mapping->file);
+    return inode->type != kVFSRegular ? kVFSErrorIsDirectory
+                                      : kVFSErrorNotSupported;
+  }
+  if (offset >= inode->size) {
+    VFSClose(&mapping->file);
+    return kVFSErrorInvalid;
+  }
+
+  uint32_t length = *length_inout;
+  if (length == 0 || length > inode->size - offset) {
+    length = inode->size - offset;
+  }
+
+  uint32_t start;
+  uint32_t pages = (length + PAGE_SIZE - 1) / PAGE_SIZE;
+  if (!MMapReserve(table, pages, &start)) {
+    VFSClose(&mapping->file);
+    return kVFSErrorNoMemory;
+  }
+
+  mapping->start = start;
+  mapping->end = start + pages * PAGE_SIZE;
+  mapping->anonymous = false;
+  mapping->first_index = offset / PAGE_SIZE;
+
+  *length_inout = length;
+  *address_out = start;
+  return 0;
+}
+
+int MMapUnmap(MMapTable *table, AddressSpace *space, uint32_t address) {
+  MMapMapping *mapping = MMapFind(table, address);
+  if (mapping == NULL || mapping->start != address) {
+    return kVFSErrorInvalid;
+  }
+
+  for (uint32_t page = mapping->start; page < mapping->end;
+       page += PAGE_SIZE) {
+    uint32_t entry = PagingUnmap(space, page);
+    if (entry == 0) {
+      continue;
+    }
+    if (mapping->anonymous) {
+      if (entry & kPageOwned) {
+        PageFree((void *)(entry & PAGE_FRAME_MASK));
+      }
+    } else {
+      PageCacheRelease(mapping->file.inode,
+                       mapping->first_index +
+                           (page - mapping->start) / PAGE_SIZE);
+    }
+  }
+
+  if (!mapping->anonymous) {
+    VFSClose(&mapping->file);
+  }
+  mapping->start = 0;
+  mapping->end = 0;
+  return 0;
+}
+
+bool MMapAnonymous(MMapTable *table, uint32_t pages, uint32_t *address_out) {
+  MMapMapping *mapping = MMapFreeSlot(table);
+  uint32_t start;
+  if (mapping == NULL || !MMapReserve(table, pages, &start)) {
+    return false;
+  }
+
+  memset(mapping, 0, sizeof(*mapping));
+  mapping->start = start;
+  mapping->end = start + pages * PAGE_SIZE;
+  mapping->anonymous = true;
+  *address_out = start;
+  return true;
+}
+
+void MMapForget(MMapTable *table, uint32_t address, uint32_t size) {
+  for (int i = 0; i < MMAP_MAX_MAPPINGS; i++) {
+    MMapMapping *mapping = &table->mappings[i];
+    if (mapping->start != 0 && mapping->anonymous &&
+        mapping->start >= address && mapping->end - address <= size) {
+      mapping->start = 0;
+      mapping->end = 0;
+    }
+  }
+}
+
+void MMapPopulate(MMapTable *table, AddressSpace *space, uint32_t address,
+                  uint32_t size) {
+  if (size == 0 || address + size < address) {
+    return;
+  }
+
+  uint32_t last = (address + size - 1) & PAGE_FRAME_MASK;
+  for (uint32_t page = address & PAGE_FRAME_MASK;; page += PAGE_SIZE) {
+    MMapFaultIn(table, space, page);
+    if (page == last) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "paging.h"
+#include "vfs.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Per process, file mappings and received messages together
+#define MMAP_MAX_MAPPINGS 32 // NOLINT
+
+// Read-only file mapping, backed by page cache pages that are mapped in on
+// the first access, or an anonymous range of pages the kernel mapped in
+// itself with kPageOwned, which unmapping frees
+typedef struct {
+  uint32_t start; // 0 for a free slot
+  uint32_t end;
+  bool anonymous;
+  uint32_t first_index; // File page mapped at start
+  VFSFile file;         // Holds the file open, its readahead follows faults
+} MMapMapping;
+
+// Mappings of one process, which only its own CPU touches
+typedef struct {
+  MMapMapping mappings[MMAP_MAX_MAPPINGS];
+} MMapTable;
+
+// Install the page fault handler that fills in mappings
+void MMapInitialize();
+
+void MMapCreateTable(MMapTable *table);
+void MMapDestroyTable(MMapTable *table, AddressSpace *space);
+
+// Map length bytes of the file from offset, which must be page aligned. A
+// length of 0, or one past the end, maps the rest of the file. Returns VFS
+// errors.
+int MMapFile(MMapTable *table, const char *path, uint32_t offset,
+             uint32_t *length_inout, uint32_t *address_out);
+int MMapUnmap(MMapTable *table, AddressSpace *space, uint32_t address);
+
+// Record an anonymous range for pages the caller maps in itself. Ranges go
+// into the lowest gap that fits, so unmapped ones are reused. False when the
+// table or the window is full.
+bool MMapAnonymous(MMapTable *table, uint32_t pages, uint32_t *address_out);
+
+// Drop anonymous ranges lying within address and size without touching
+// their pages, once those have been unmapped and handed on
+void MMapForget(MMapTable *table, uint32_t address, uint32_t size);
+
+// Map in whatever the range covers, before the kernel checks and touches
+// user memory itself
+void MMapPopulate(MMapTable *table, AddressSpace *space, uint32_t address,
+                  uint32_t size);
@@ -0,0 +1,57 @@
+#include "module.h"
+#include "stdio.h"
+#include <boot/archive.h>
+#include <stddef.h>
+
+static const BootArchiveHeader *archive_ = NULL;
+
+static const BootArchiveEntry *ModuleEntries() {
+  return (const BootArchiveEntry *)(archive_ + 1);
+}
+
+void ModuleInitialize(const BootParams *boot_params) {
+  const BootArchiveHeader *archive =
+      (const BootArchiveHeader *)boot_params->modules_address;
+  if (boot_params->modules_size == 0 ||
+      !BootArchiveIsValid(archive, boot_params->modules_size)) {
+    return;
+  }
+
+  archive_ = archive;
+  for (uint32_t i = 0; i < archive_->entry_count; i++) {
+    printf("module: %s %u bytes\n", ModuleEntries()[i].name,
+           ModuleEntries()[i].size);
+  }
+}
+
+int ModuleCount() { return archive_ != NULL ? archive_->entry_count : 0; }
+
+bool ModuleGet(int index, Module *module_out) {
+  if (index < 0 || index >= ModuleCount()) {
+    return false;
+  }
+
+  const BootArchiveEntry *entry = &ModuleEntries()[index];
+  module_out->name = entry->name;
+  module_out->data = (const uint8_t *)archive_ + entry->offset;
+  module_out->size = entry->size;
+  return true;
+}
+
+static bool ModuleNameEquals(const char *a, const char *b) {
+  while (*a != '\0' && *a == *b) {
+    a++;
+    b++;
+  }
+  return *a == *b;
+}
+
+bool ModuleFind(const char *name, Module *module_out) {
+  for (int i = 0; i < ModuleCount(); i++) {
+    if (ModuleNameEquals(ModuleEntries()[i].name, name)) {
+      return ModuleGet(i, module_out);
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <boot/bootparams.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// A file from the boot module archive, used in place where stage2 put it
+typedef struct {
+  const char *name;
+  const void *data;
+  uint32_t size;
+} Module;
+
+void ModuleInitialize(const BootParams *boot_params);
+int ModuleCount();
+bool ModuleGet(int index, Module *module_out);
+bool ModuleFind(const char *name, Module *module_out);
@@ -0,0 +1,152 @@
+#include "mptable.h"
+#include "apic.h"
+#include "memory.h"
+#include <stddef.h>
+
+#pragma pack(push, 1)
+
+typedef struct {
+  char signature[4];
+  uint32_t config_table;
+  uint8_t length;
+  uint8_t spec_revision;
+  uint8_t checksum;
+  uint8_t features[5];
+} MPFloatingPointer;
+
+typedef struct {
+  char signature[4];
+  uint16_t base_length;
+  uint8_t spec_revision;
+  uint8_t checksum;
+  char oem_id[8];
+  char product_id[12];
+  uint32_t oem_table;
+  uint16_t oem_table_size;
+  uint16_t entry_count;
+  uint32_t apic_address;
+  uint16_t extended_length;
+  uint8_t extended_checksum;
+  uint8_t _reserved;
+} MPConfigTable;
+
+typedef struct {
+  uint8_t type;
+  uint8_t apic_id;
+  uint8_t apic_version;
+  uint8_t flags;
+  uint32_t signature;
+  uint32_t features;
+  uint32_t _reserved[2];
+} MPProcessorEntry;
+
+typedef struct {
+  uint8_t type;
+  uint8_t io_apic_id;
+  uint8_t io_apic_version;
+  uint8_t flags;
+  uint32_t address;
+} MPIOApicEntry;
+
+#pragma pack(pop)
+
+enum MPEntryTypes {
+  kMPEntryProcessor = 0,
+  kMPEntryBus = 1,
+  kMPEntryIOApic = 2,
+  kMPEntryIOInterrupt = 3,
+  kMPEntryLocalInterrupt = 4,
+};
+
+#define MP_PROCESSOR_ENABLED 0x01     // NOLINT
+#define MP_EBDA_SEGMENT_PTR 0x40E     // NOLINT
+#define MP_BASE_MEMORY_END 0xA0000    // NOLINT
+#define MP_BIOS_AREA_START 0xF0000    // NOLINT
+#define MP_BIOS_AREA_END 0x100000     // NOLINT
+#define MP_DEFAULT_IO_APIC 0xFEC00000 // NOLINT
+
+static bool MPChecksum(const void *table, uint32_t length) {
+  const uint8_t *bytes = (const uint8_t *)table;
+  uint8_t sum = 0;
+  for (uint32_t i = 0; i < length; i++) {
+    sum += bytes[i];
+  }
+  return sum == 0;
+}
+
+static const MPFloatingPointer *MPScan(uint32_t start, uint32_t end) {
+  for (uint32_t address = start; address < end; address += 16) {
+    const MPFloatingPointer *mp = (const MPFloatingPointer *)address;
+    if (memcmp(mp->signature, "_MP_", 4) == 0 &&
+        MPChecksum(mp, mp->length * 16)) {
+      return mp;
+    }
+  }
+  return NULL;
+}
+
+static const MPFloatingPointer *MPFindFloatingPointer() {
+  uint32_t ebda = (uint32_t)(*(const uint16_t *)MP_EBDA_SEGMENT_PTR) << 4;
+  const MPFloatingPointer *mp = NULL;
+  if (ebda != 0) {
+    mp = MPScan(ebda, ebda + 1024);
+  }
+  if (mp == NULL) {
+    mp = MPScan(MP_BASE_MEMORY_END - 1024, MP_BASE_MEMORY_END);
+  }
+  if (mp == NULL) {
+    mp = MPScan(MP_BIOS_AREA_START, MP_BIOS_AREA_END);
+  }
+  return mp;
+}
+
+bool MPReadTable(SMPTopology *topology) {
+  const MPFloatingPointer *mp = MPFindFloatingPointer();
+  if (mp == NULL) {
+    return false;
+  }
+
+  topology->apic_address = APIC_DEFAULT_ADDRESS;
+  topology->io_apic_address = MP_DEFAULT_IO_APIC;
+  topology->cpu_count = 0;
+
+  // No table means one of the default configurations, which all have two CPUs
+  if (mp->config_table == 0) {
+    topology->apic_ids[topology->cpu_count++] = 0;
+    topology->apic_ids[topology->cpu_count++] = 1;
+    return true;
+  }
+
+  const MPConfigTable *table = (const MPConfigTable *)mp->config_table;
+  if (memcmp(table->signature, "PCMP", 4) != 0 ||
+      !MPChecksum(table, table->base_length)) {
+    return false;
+  }
+
+  topology->apic_address = table->apic_address;
+
+  const uint8_t *entry = (const uint8_t *)(table + 1);
+  for (uint16_t i = 0; i < table->entry_count; i++) {
+    switch (*entry) {
+    case kMPEntryProcessor: {
+      const MPProcessorEntry *cpu = (const MPProcessorEntry *)entry;
+      if ((cpu->flags & MP_PROCESSOR_ENABLED) &&
+          topology->cpu_count < MAX_CPUS) {
+        topology->apic_ids[topology->cpu_count++] = cpu->apic_id;
+      }
+      entry += sizeof(MPProcessorEntry);
+      break;
+    }
+    case kMPEntryIOApic:
+      topology->io_apic_address = ((const MPIOApicEntry *)entry)->address;
+      entry += sizeof(MPIOApicEntry);
+      break;
+    default:
+      // Bus and interrupt assignment entries are all 8 bytes
+      entry += 8;
+      break;
+    }
+  }
+
+  return topology->cpu_count > 0;
+}
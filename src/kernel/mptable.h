@@ -0,0 +1,5 @@
+#pragma once
+#include "smp.h"
+#include <stdbool.h>
+
+bool MPReadTable(SMPTopology *topology);
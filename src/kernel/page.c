@@ -0,0 +1,205 @@
+#include "page.h"
+#include "spinlock.h"
+#include "stdio.h"
+#include "x86.h"
+#include <stddef.h>
+#include <sys/image.h>
+
+// Frames start above the profiler buffers, the highest fixed region, and
+// stop where the user window hides the identity mapping
+#define PAGE_POOL_START 0x04000000 // NOLINT
+
+#define PAGE_CMOS_ADDRESS 0x70          // NOLINT
+#define PAGE_CMOS_DATA 0x71             // NOLINT
+#define PAGE_CMOS_NMI_DISABLE 0x80      // NOLINT
+#define PAGE_CMOS_EXTENDED_LOW 0x30     // NOLINT, KiB above 1 MiB
+#define PAGE_CMOS_EXTENDED_HIGH 0x31    // NOLINT
+#define PAGE_CMOS_ABOVE_16M_LOW 0x34    // NOLINT, 64 KiB blocks above 16 MiB
+#define PAGE_CMOS_ABOVE_16M_HIGH 0x35   // NOLINT
+
+#define PAGE_ZEROED_TARGET 256 // NOLINT, frames kept cleared, 1 MiB
+
+enum PageCPUIDBits {
+  kCPUIDFeatureSSE2 = 1u << 26,
+};
+
+// Freed frames are linked through their first word
+typedef struct PageFreeFrame {
+  struct PageFreeFrame *next;
+} PageFreeFrame;
+
+static Spinlock lock_ = SPINLOCK_INITIALIZER;
+static PageFreeFrame *free_list_;
+static PageFreeFrame *zeroed_list_; // Cleared but for the link word
+static uint32_t zeroed_count_;
+static uint32_t next_;  // Frames from here to end_ were never handed out
+static uint32_t end_;
+static uint32_t free_count_; // Cleared frames included
+static bool movnti_ = false;
+
+static uint8_t PageReadCMOS(uint8_t reg) {
+  x86_outb(PAGE_CMOS_ADDRESS, PAGE_CMOS_NMI_DISABLE | reg);
+  return x86_inb(PAGE_CMOS_DATA);
+}
+
+// The BIOS leaves the memory size in CMOS, which is all that is known
+// without an E820 map from stage2
+static uint32_t PageMemoryTop() {
+  uint32_t blocks = PageReadCMOS(PAGE_CMOS_ABOVE_16M_LOW) |
+                    (PageReadCMOS(PAGE_CMOS_ABOVE_16M_HIGH) << 8);
+  if (blocks != 0) {
+    return 0x1000000 + blocks * 0x10000;
+  }
+
+  uint32_t kilobytes = PageReadCMOS(PAGE_CMOS_EXTENDED_LOW) |
+                       (PageReadCMOS(PAGE_CMOS_EXTENDED_HIGH) << 8);
+  return 0x100000 + kilobytes * 1024;
+}
+
+void PageInitialize() {
+  uint32_t top = PageMemoryTop();
+  if (top > USER_BASE) {
+    top = USER_BASE;
+  }
+
+  next_ = PAGE_POOL_START;
+  end_ = top > PAGE_POOL_START ? top & ~(PAGE_SIZE - 1) : PAGE_POOL_START;
+  free_count_ = (end_ - next_) / PAGE_SIZE;
+
+  x86_CPUIDResult features;
+  x86_CPUID(1, &features);
+  movnti_ = (features.edx & kCPUIDFeatureSSE2) != 0;
+
+  printf("Page: %u frames free, memory ends at %x\n", free_count_, top);
+}
+
+// An uncleared frame, NULL when only cleared ones are left
+static void *PageTakeDirtyLocked() {
+  void *page = NULL;
+  if (free_list_ != NULL) {
+    page = free_list_;
+    free_list_ = free_list_->next;
+  } else if (next_ < end_) {
+    page = (void *)next_;
+    next_ += PAGE_SIZE;
+  }
+  if (page != NULL) {
+    free_count_--;
+  }
+  return page;
+}
+
+static void *PageTakeZeroedLocked() {
+  PageFreeFrame *frame = zeroed_list_;
+  if (frame != NULL) {
+    zeroed_list_ = frame->next;
+    zeroed_count_--;
+    free_count_--;
+    frame->next = NULL;
+  }
+  return frame;
+}
+
+// Cleared frames are the last resort, there is no point wasting the work
+void *PageAlloc() {
+  uint32_t flags = SpinlockAcquireIrqSave(&lock_);
+  void *page = PageTakeDirtyLocked();
+  if (page == NULL) {
+    page = PageTakeZeroedLocked();
+  }
+  SpinlockReleaseIrqRestore(&lock_, flags);
+  return page;
+}
+
+// For a frame about to be used, through the cache like any other store
+static void PageZeroCached(void *page) {
+  uint32_t count = PAGE_SIZE / sizeof(uint32_t);
+  __asm__ volatile("rep stosl"
+                   : "+D"(page), "+c"(count)
+                   : "a"(0)
+                   : "memory");
+}
+
+// Streams zeros to memory without pulling the frame into the cache, 64
+// bytes per iteration. The sfence orders the weakly ordered stores before
+// the frame is published.
+static void PageZeroNonTemporal(void *page) {
+  uint32_t *words = page;
+  for (uint32_t i = 0; i < PAGE_SIZE / sizeof(uint32_t); i += 16) {
+    __asm__ volatile("movnti %1, 0(%0)\n\t"
+                     "movnti %1, 4(%0)\n\t"
+                     "movnti %1, 8(%0)\n\t"
+                     "movnti %1, 12(%0)\n\t"
+                     "movnti %1, 16(%0)\n\t"
+                     "movnti %1, 20(%0)\n\t"
+                     "movnti %1, 24(%0)\n\t"
+                     "movnti %1, 28(%0)\n\t"
+                     "movnti %1, 32(%0)\n\t"
+                     "movnti %1, 36(%0)\n\t"
+                     "movnti %1, 40(%0)\n\t"
+                     "movnti %1, 44(%0)\n\t"
+                     "movnti %1, 48(%0)\n\t"
+                     "movnti %1, 52(%0)\n\t"
+                     "movnti %1, 56(%0)\n\t"
+                     "movnti %1, 60(%0)"
+                     :
+                     : "r"(&words[i]), "r"(0)
+                     : "memory");
+  }
+  __asm__ volatile("sfence" ::: "memory");
+}
+
+void *PageAllocZeroed() {
+  uint32_t flags = SpinlockAcquireIrqSave(&lock_);
+  void *page = PageTakeZeroedLocked();
+  bool clear = page == NULL;
+  if (clear) {
+    page = PageTakeDirtyLocked();
+  }
+  SpinlockReleaseIrqRestore(&lock_, flags);
+
+  if (clear && page != NULL) {
+    PageZeroCached(page);
+  }
+  return page;
+}
+
+bool PageZeroIdle() {
+  uint32_t flags = SpinlockAcquireIrqSave(&lock_);
+  void *page =
+      zeroed_count_ < PAGE_ZEROED_TARGET ? PageTakeDirtyLocked() : NULL;
+  SpinlockReleaseIrqRestore(&lock_, flags);
+  if (page == NULL) {
+    return false;
+  }
+
+  if (movnti_) {
+    PageZeroNonTemporal(page);
+  } else {
+    PageZeroCached(page);
+  }
+
+  flags = SpinlockAcquireIrqSave(&lock_);
+  PageFreeFrame *frame = page;
+  frame->next = zeroed_list_;
+  zeroed_list_ = frame;
+  zeroed_count_++;
+  free_count_++;
+  SpinlockReleaseIrqRestore(&lock_, flags);
+  return true;
+}
+
+uint32_t PageZeroedCount() { return zeroed_count_; }
+
+void PageFree(void *page) {
+  uint32_t flags = SpinlockAcquireIrqSave(&lock_);
+
+  PageFreeFrame *frame = page;
+  frame->next = free_list_;
+  free_list_ = frame;
+  free_count_++;
+
+  SpinlockReleaseIrqRestore(&lock_, flags);
+}
+
+uint32_t PageFreeCount() { return free_count_; }
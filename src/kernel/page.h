@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+
+#define PAGE_SIZE 4096 // NOLINT
+#define PAGE_SHIFT 12  // NOLINT
+
+#include <stdbool.h>
+
+// Physical page frames from the memory above every fixed kernel region.
+// The kernel maps memory one to one, so a frame's address is also a
+// pointer to it. PageAlloc frames are not cleared.
+void PageInitialize();
+void *PageAlloc();
+void PageFree(void *page);
+uint32_t PageFreeCount();
+
+// A cleared frame, taken from a pool that the idle loop keeps filled, so
+// callers on the fault path pay for clearing only when the pool ran dry
+void *PageAllocZeroed();
+
+// Clear one free frame into the pool, false once the pool is full. Uses
+// non-temporal stores, so the idle loop does not flush the caches.
+bool PageZeroIdle();
+uint32_t PageZeroedCount();
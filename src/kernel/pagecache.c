@@ -0,0 +1,459 @@
+#include "pagecache.h"
+#include "atomic.h"
+#include "memory.h"
+#include "page.h"
+#include "rcu.h"
+#include "spinlock.h"
+#include <stddef.h>
+
+#define PAGE_CACHE_ENTRIES 2048        // NOLINT, 8 MiB of file data
+#define PAGE_CACHE_BUCKETS 1024        // NOLINT
+#define PAGE_CACHE_READAHEAD_MIN 4     // NOLINT, pages
+#define PAGE_CACHE_READAHEAD_MAX 64    // NOLINT
+#define PAGE_CACHE_READS 64            // NOLINT, read ahead pages in flight
+
+enum PageCacheState {
+  kPageCacheLoading, // The first user is reading it, others wait
+  kPageCacheReady,
+  kPageCacheFailed, // Unhashed, freed by whoever drops the last reference
+};
+
+typedef struct PageCacheEntry {
+  VFSSuperBlock *super;
+  uint32_t ino;
+  uint32_t index;
+  void *page; // Kept across reuse of the entry
+  volatile uint32_t state;
+
+  uint32_t references;
+  struct PageCacheEntry *hash_next;
+  struct PageCacheEntry *lru_previous;
+  struct PageCacheEntry *lru_next;
+} PageCacheEntry;
+
+// A page read ahead without waiting, one request per sector run. Its entry
+// stays loading, with the reference of the read, until the cache notices
+// every request is done. The requests belong to the block layer from
+// submit until then.
+typedef struct PageCacheIO {
+  PageCacheEntry *entry;
+  uint32_t size;    // Bytes of the file in the page
+  uint32_t covered; // Bytes the requests fill in
+  uint32_t count;
+  bool failed;
+  bool submitted; // Guarded by the lock, nothing is looked at before
+  BlockRequest requests[VFS_PAGE_RUNS];
+  struct PageCacheIO *next;
+} PageCacheIO;
+
+static Spinlock lock_ = SPINLOCK_INITIALIZER;
+static PageCacheEntry entries_[PAGE_CACHE_ENTRIES];
+static uint32_t entries_used_; // Entries from here on were never handed out
+static PageCacheEntry *free_;
+static PageCacheEntry *buckets_[PAGE_CACHE_BUCKETS];
+static PageCacheEntry *lru_head_;
+static PageCacheEntry *lru_tail_;
+static PageCacheStats stats_;
+static PageCacheIO reads_[PAGE_CACHE_READS];
+static uint32_t reads_used_;
+static PageCacheIO *free_reads_;
+static PageCacheIO *active_reads_;
+
+static uint32_t PageCacheBucket(const VFSSuperBlock *super, uint32_t ino,
+                                uint32_t index) {
+  uint32_t hash = ((uint32_t)super >> 4) ^ (ino * 2654435761u) ^
+                  (index * 2246822519u);
+  return (hash ^ (hash >> 15)) % PAGE_CACHE_BUCKETS;
+}
+
+static void PageCacheLruRemove(PageCacheEntry *entry) {
+  if (entry->lru_previous != NULL) {
+    entry->lru_previous->lru_next = entry->lru_next;
+  } else {
+    lru_head_ = entry->lru_next;
+  }
+  if (entry->lru_next != NULL) {
+    entry->lru_next->lru_previous = entry->lru_previous;
+  } else {
+    lru_tail_ = entry->lru_previous;
+  }
+  entry->lru_previous = NULL;
+  entry->lru_next = NULL;
+}
+
+static void PageCacheLruAppend(PageCacheEntry *entry) {
+  entry->lru_next = NULL;
+  entry->lru_previous = lru_tail_;
+  if (lru_tail_ != NULL) {
+    lru_tail_->lru_next = entry;
+  } else {
+    lru_head_ = entry;
+  }
+  lru_tail_ = entry;
+}
+
+static void PageCacheUnhash(PageCacheEntry *entry) {
+  PageCacheEntry **link =
+      &buckets_[PageCacheBucket(entry->super, entry->ino, entry->index)];
+  while (*link != entry) {
+    link = &(*link)->hash_next;
+  }
+  *link = entry->hash_next;
+}
+
+static PageCacheEntry *PageCacheFindLocked(const VFSInode *inode,
+                                           uint32_t index) {
+  PageCacheEntry *entry =
+      buckets_[PageCacheBucket(inode->super, inode->ino, index)];
+  while (entry != NULL &&
+         (entry->index != index || entry->ino != inode->ino ||
+          entry->super != inode->super)) {
+    entry = entry->hash_next;
+  }
+  return entry;
+}
+
+// An entry with a frame: a free one, a new one while frames last, or the
+// least recently used page
+static PageCacheEntry *PageCacheAllocLocked() {
+  PageCacheEntry *entry = free_;
+  if (entry == NULL && entries_used_ < PAGE_CACHE_ENTRIES) {
+    entry = &entries_[entries_used_];
+    if ((entry->page = PageAlloc()) != NULL) {
+      entries_used_++;
+      return entry;
+    }
+  } else if (entry != NULL) {
+    free_ = entry->hash_next;
+    return entry;
+  }
+
+  entry = lru_head_;
+  if (entry != NULL) {
+    PageCacheLruRemove(entry);
+    PageCacheUnhash(entry);
+    stats_.reclaims++;
+  }
+  return entry;
+}
+
+static void PageCacheReleaseLocked(PageCacheEntry *entry) {
+  if (--entry->references != 0) {
+    return;
+  }
+  if (entry->state == kPageCacheFailed) {
+    entry->hash_next = free_;
+    free_ = entry;
+  } else {
+    PageCacheLruAppend(entry);
+  }
+}
+
+static void PageCacheReleaseEntry(PageCacheEntry *entry) {
+  SpinlockAcquire(&lock_);
+  PageCacheReleaseLocked(entry);
+  SpinlockRelease(&lock_);
+}
+
+static void PageCacheInsertLocked(PageCacheEntry *entry, VFSInode *inode,
+                                  uint32_t index) {
+  entry->super = inode->super;
+  entry->ino = inode->ino;
+  entry->index = index;
+  entry->state = kPageCacheLoading;
+  entry->references = 1;
+  uint32_t bucket = PageCacheBucket(inode->super, inode->ino, index);
+  entry->hash_next = buckets_[bucket];
+  buckets_[bucket] = entry;
+}
+
+// Settle every read whose requests are all done: the page becomes ready, or
+// leaves the hash on an error, and the read drops its reference
+static void PageCacheReapLocked() {
+  PageCacheIO **link = &active_reads_;
+  while (*link != NULL) {
+    PageCacheIO *read = *link;
+    bool done = read->submitted;
+    bool success = !read->failed;
+    for (uint32_t i = 0; i < read->count && done; i++) {
+      done = read->requests[i].done;
+      success = success && read->requests[i].success;
+    }
+    if (!done) {
+      link = &read->next;
+      continue;
+    }
+    *link = read->next;
+
+    PageCacheEntry *entry = read->entry;
+    if (success) {
+      // The last sector may run past the end of the file
+      memset((uint8_t *)entry->page + read->size, 0,
+             read->covered - read->size);
+      CompilerBarrier();
+      entry->state = kPageCacheReady;
+    } else {
+      PageCacheUnhash(entry);
+      entry->state = kPageCacheFailed;
+    }
+    PageCacheReleaseLocked(entry);
+
+    read->next = free_reads_;
+    free_reads_ = read;
+  }
+}
+
+static PageCacheIO *PageCacheAllocReadLocked() {
+  PageCacheIO *read = free_reads_;
+  if (read != NULL) {
+    free_reads_ = read->next;
+  } else if (reads_used_ < PAGE_CACHE_READS) {
+    read = &reads_[reads_used_++];
+  }
+  return read;
+}
+
+// Pages read ahead are only settled under the lock, so whoever waits for
+// one polls the device and settles finished reads itself
+static void PageCacheWaitStep(VFSInode *inode) {
+  if (inode->super->device != NULL) {
+    BlockPoll(inode->super->device);
+  }
+  if (RCUDereference(active_reads_) != NULL) {
+    SpinlockAcquire(&lock_);
+    PageCacheReapLocked();
+    SpinlockRelease(&lock_);
+  }
+  CpuRelax();
+}
+
+// The referenced, ready entry for a page, reading it on a miss. The
+// filesystem runs without the lock, other users of the page wait for it.
+static PageCacheEntry *PageCacheLoad(VFSInode *inode, uint32_t index,
+                                     bool ahead) {
+  SpinlockAcquire(&lock_);
+  PageCacheEntry *entry = PageCacheFindLocked(inode, index);
+  if (entry != NULL) {
+    if (entry->references++ == 0) {
+      PageCacheLruRemove(entry);
+    }
+    if (!ahead) {
+      stats_.hits++;
+    }
+    SpinlockRelease(&lock_);
+
+    while (entry->state == kPageCacheLoading) {
+      PageCacheWaitStep(inode);
+    }
+    if (entry->state != kPageCacheReady) {
+      PageCacheReleaseEntry(entry);
+      return NULL;
+    }
+    return entry;
+  }
+
+  entry = PageCacheAllocLocked();
+  if (entry == NULL) {
+    SpinlockRelease(&lock_);
+    return NULL;
+  }
+  PageCacheInsertLocked(entry, inode, index);
+  if (ahead) {
+    stats_.readahead++;
+  } else {
+    stats_.misses++;
+  }
+  SpinlockRelease(&lock_);
+
+  int result = inode->file_operations->readpage(inode, index, entry->page);
+  CompilerBarrier();
+  if (result < 0) {
+    SpinlockAcquire(&lock_);
+    PageCacheUnhash(entry);
+    entry->state = kPageCacheFailed;
+    PageCacheReleaseLocked(entry);
+    SpinlockRelease(&lock_);
+    return NULL;
+  }
+
+  entry->state = kPageCacheReady;
+  return entry;
+}
+
+// Start reading a page ahead and return without waiting for it, false when
+// no more can be started. Filesystems that cannot say where a page is on
+// disk read it right away instead.
+static bool PageCacheStartRead(VFSInode *inode, uint32_t index) {
+  if (inode->file_operations->mappage == NULL ||
+      inode->super->device == NULL) {
+    PageCacheEntry *entry = PageCacheLoad(inode, index, true);
+    if (entry != NULL) {
+      PageCacheReleaseEntry(entry);
+    }
+    return entry != NULL;
+  }
+
+  SpinlockAcquire(&lock_);
+  PageCacheReapLocked();
+  if (PageCacheFindLocked(inode, index) != NULL) {
+    SpinlockRelease(&lock_);
+    return true;
+  }
+  PageCacheIO *read = PageCacheAllocReadLocked();
+  PageCacheEntry *entry = read != NULL ? PageCacheAllocLocked() : NULL;
+  if (entry == NULL) {
+    if (read != NULL) {
+      read->next = free_reads_;
+      free_reads_ = read;
+    }
+    SpinlockRelease(&lock_);
+    return false;
+  }
+  PageCacheInsertLocked(entry, inode, index);
+  stats_.readahead++;
+  read->entry = entry;
+  read->submitted = false;
+  read->next = active_reads_;
+  active_reads_ = read;
+  SpinlockRelease(&lock_);
+
+  VFSPageRun runs[VFS_PAGE_RUNS];
+  int count = inode->file_operations->mappage(inode, index, runs);
+  read->failed = count < 0;
+  read->count = count > 0 ? (uint32_t)count : 0;
+  uint32_t position = index * PAGE_SIZE;
+  read->size = inode->size - position < PAGE_SIZE ? inode->size - position
+                                                  : PAGE_SIZE;
+  read->covered = 0;
+  for (uint32_t i = 0; i < read->count; i++) {
+    BlockRequest *request = &read->requests[i];
+    request->write = false;
+    request->lba = runs[i].lba;
+    request->count = runs[i].count;
+    request->buffer = (uint8_t *)entry->page + read->covered;
+    request->complete = NULL;
+    read->covered += runs[i].count * BLOCK_SECTOR_SIZE;
+  }
+  if (read->covered < read->size) {
+    read->failed = true;
+  }
+  memset((uint8_t *)entry->page + read->covered, 0,
+         PAGE_SIZE - read->covered);
+
+  for (uint32_t i = 0; i < read->count && !read->failed; i++) {
+    BlockSubmit(inode->super->device, &read->requests[i]);
+  }
+  if (read->failed) {
+    read->count = 0;
+  }
+
+  SpinlockAcquire(&lock_);
+  read->submitted = true;
+  SpinlockRelease(&lock_);
+  return !read->failed;
+}
+
+// Once a sequence gets within half a window of the pages already read
+// ahead, the window doubles and the next stretch is read. Any jump starts
+// over without reading ahead.
+static void PageCacheReadahead(VFSInode *inode, uint32_t index,
+                               VFSReadahead *readahead) {
+  if (index != readahead->next) {
+    readahead->window = 0;
+    readahead->ahead = index + 1;
+  }
+  readahead->next = index + 1;
+  if (readahead->ahead > index + readahead->window / 2) {
+    return;
+  }
+
+  uint32_t window = readahead->window * 2;
+  if (window < PAGE_CACHE_READAHEAD_MIN) {
+    window = PAGE_CACHE_READAHEAD_MIN;
+  }
+  if (window > PAGE_CACHE_READAHEAD_MAX) {
+    window = PAGE_CACHE_READAHEAD_MAX;
+  }
+  readahead->window = window;
+
+  uint32_t pages = (uint32_t)(((uint64_t)inode->size + PAGE_SIZE - 1) >>
+                              PAGE_SHIFT);
+  uint32_t start = readahead->ahead > index + 1 ? readahead->ahead : index + 1;
+  uint32_t end = index + 1 + window;
+  if (end > pages) {
+    end = pages;
+  }
+
+  for (uint32_t i = start; i < end; i++) {
+    if (!PageCacheStartRead(inode, i)) {
+      end = i;
+      break;
+    }
+  }
+  if (end > readahead->ahead) {
+    readahead->ahead = end;
+  }
+}
+
+static PageCacheEntry *PageCacheGetEntry(VFSInode *inode, uint32_t index,
+                                         VFSReadahead *readahead) {
+  PageCacheEntry *entry = PageCacheLoad(inode, index, false);
+  if (entry != NULL && readahead != NULL) {
+    PageCacheReadahead(inode, index, readahead);
+  }
+  return entry;
+}
+
+void *PageCacheGet(VFSInode *inode, uint32_t index, VFSReadahead *readahead) {
+  PageCacheEntry *entry = PageCacheGetEntry(inode, index, readahead);
+  return entry != NULL ? entry->page : NULL;
+}
+
+void PageCacheRelease(VFSInode *inode, uint32_t index) {
+  SpinlockAcquire(&lock_);
+  PageCacheEntry *entry = PageCacheFindLocked(inode, index);
+  if (entry != NULL) {
+    PageCacheReleaseLocked(entry);
+  }
+  SpinlockRelease(&lock_);
+}
+
+int32_t PageCacheRead(VFSFile *file, void *buffer, uint32_t size) {
+  VFSInode *inode = file->inode;
+  uint32_t position = file->position;
+  if (position >= inode->size) {
+    return 0;
+  }
+  if (size > inode->size - position) {
+    size = inode->size - position;
+  }
+
+  uint8_t *out = buffer;
+  uint32_t done = 0;
+  while (done < size) {
+    uint32_t offset = position % PAGE_SIZE;
+    uint32_t take = PAGE_SIZE - offset;
+    if (take > size - done) {
+      take = size - done;
+    }
+
+    PageCacheEntry *entry =
+        PageCacheGetEntry(inode, position >> PAGE_SHIFT, &file->readahead);
+    if (entry == NULL) {
+      return done > 0 ? (int32_t)done : kVFSErrorIO;
+    }
+    memcpy(out + done, (const uint8_t *)entry->page + offset, take);
+    PageCacheReleaseEntry(entry);
+
+    done += take;
+    position += take;
+  }
+
+  return (int32_t)done;
+}
+
+void PageCacheGetStats(PageCacheStats *stats_out) {
+  SpinlockAcquire(&lock_);
+  *stats_out = stats_;
+  SpinlockRelease(&lock_);
+}
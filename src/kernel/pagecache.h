@@ -0,0 +1,27 @@
+#pragma once
+#include "vfs.h"
+#include <stdint.h>
+
+// Pages of files keyed by (superblock, inode number, page index), filled by
+// the filesystem's readpage straight into the frame. Pages nobody holds
+// stay cached on an LRU list until their frame is needed again.
+
+// A referenced frame holding page index of the file, NULL on read errors or
+// when every cached page is in use. Reads ahead when readahead sees
+// sequential access, growing its window as the sequence continues. Pages
+// read ahead are submitted to the device without waiting, so only the page
+// asked for is waited on.
+void *PageCacheGet(VFSInode *inode, uint32_t index, VFSReadahead *readahead);
+void PageCacheRelease(VFSInode *inode, uint32_t index);
+
+// VFSRead for files with readpage, copying out of the cached pages
+int32_t PageCacheRead(VFSFile *file, void *buffer, uint32_t size);
+
+typedef struct {
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t readahead; // Pages read before anybody asked for them
+  uint32_t reclaims;
+} PageCacheStats;
+
+void PageCacheGetStats(PageCacheStats *stats_out);
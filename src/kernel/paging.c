@@ -0,0 +1,248 @@
+#include "paging.h"
+#include "memory.h"
+#include "page.h"
+#include "stdio.h"
+#include "x86.h"
+#include <stddef.h>
+#include <sys/image.h>
+
+#define PAGING_ENTRIES 1024       // NOLINT
+#define PAGING_LARGE_SHIFT 22     // NOLINT
+#define PAGING_USER_FIRST (USER_BASE >> PAGING_LARGE_SHIFT) // NOLINT
+#define PAGING_USER_LAST (USER_END >> PAGING_LARGE_SHIFT)   // NOLINT
+
+enum PagingControlBits {
+  kCR0Paging = 1u << 31,
+  kCR4PageSizeExtension = 1u << 4,
+  kCR4PageGlobalEnable = 1u << 7,
+};
+
+enum PagingCPUIDBits {
+  kCPUIDFeaturePSE = 1u << 3,
+  kCPUIDFeaturePGE = 1u << 13,
+};
+
+static uint32_t kernel_directory_[PAGING_ENTRIES]
+    __attribute__((aligned(PAGE_SIZE)));
+static bool enabled_ = false;
+static bool global_ = false;
+
+static inline uint32_t PagingReadCR0() {
+  uint32_t value;
+  __asm__ volatile("mov %%cr0, %0" : "=r"(value));
+  return value;
+}
+
+static inline void PagingWriteCR0(uint32_t value) {
+  __asm__ volatile("mov %0, %%cr0" : : "r"(value) : "memory");
+}
+
+static inline uint32_t PagingReadCR3() {
+  uint32_t value;
+  __asm__ volatile("mov %%cr3, %0" : "=r"(value));
+  return value;
+}
+
+static inline void PagingWriteCR3(uint32_t value) {
+  __asm__ volatile("mov %0, %%cr3" : : "r"(value) : "memory");
+}
+
+static inline uint32_t PagingReadCR4() {
+  uint32_t value;
+  __asm__ volatile("mov %%cr4, %0" : "=r"(value));
+  return value;
+}
+
+static inline void PagingWriteCR4(uint32_t value) {
+  __asm__ volatile("mov %0, %%cr4" : : "r"(value) : "memory");
+}
+
+static inline void PagingInvalidate(uint32_t address) {
+  __asm__ volatile("invlpg (%0)" : : "r"(address) : "memory");
+}
+
+static bool PagingIsUser(uint32_t address) {
+  return address >= USER_BASE && address < USER_END;
+}
+
+// Firmware and device memory keep their MTRR types, the page attributes
+// leave them alone just like with paging off
+void PagingInitialize() {
+  x86_CPUIDResult features;
+  x86_CPUID(1, &features);
+  if (!(features.edx & kCPUIDFeaturePSE)) {
+    printf("Paging: no 4 MiB pages, staying unpaged\n");
+    return;
+  }
+  global_ = (features.edx & kCPUIDFeaturePGE) != 0;
+
+  for (uint32_t i = 0; i < PAGING_ENTRIES; i++) {
+    if (i >= PAGING_USER_FIRST && i < PAGING_USER_LAST) {
+      kernel_directory_[i] = 0;
+      continue;
+    }
+    kernel_directory_[i] = (i << PAGING_LARGE_SHIFT) | kPageLarge |
+                           kPageWritable | kPagePresent |
+                           (global_ ? kPageGlobal : 0);
+  }
+
+  enabled_ = true;
+  PagingInitializeCpu();
+  printf("Paging: on, user window %x-%x\n", USER_BASE, USER_END);
+}
+
+void PagingInitializeCpu() {
+  if (!enabled_) {
+    return;
+  }
+
+  uint32_t cr4 = PagingReadCR4() | kCR4PageSizeExtension;
+  if (global_) {
+    cr4 |= kCR4PageGlobalEnable;
+  }
+  PagingWriteCR4(cr4);
+  PagingWriteCR3((uint32_t)kernel_directory_);
+  PagingWriteCR0(PagingReadCR0() | kCR0Paging);
+}
+
+bool PagingIsEnabled() { return enabled_; }
+
+// The kernel half is copied once and never changes afterwards, so spaces
+// never have to be synchronized with each other
+bool PagingCreateSpace(AddressSpace *space) {
+  uint32_t *directory = PageAlloc();
+  if (directory == NULL) {
+    return false;
+  }
+
+  memcpy(directory, kernel_directory_, PAGE_SIZE);
+  space->directory = directory;
+  SpinlockInitialize(&space->lock);
+  return true;
+}
+
+void PagingDestroySpace(AddressSpace *space) {
+  for (uint32_t i = PAGING_USER_FIRST; i < PAGING_USER_LAST; i++) {
+    uint32_t entry = space->directory[i];
+    if (!(entry & kPagePresent)) {
+      continue;
+    }
+
+    uint32_t *table = (uint32_t *)(entry & PAGE_FRAME_MASK);
+    for (uint32_t j = 0; j < PAGING_ENTRIES; j++) {
+      if ((table[j] & (kPagePresent | kPageOwned)) ==
+          (kPagePresent | kPageOwned)) {
+        PageFree((void *)(table[j] & PAGE_FRAME_MASK));
+      }
+    }
+    PageFree(table);
+  }
+
+  PageFree(space->directory);
+  space->directory = NULL;
+}
+
+void PagingSwitch(AddressSpace *space) {
+  uint32_t *directory = space != NULL ? space->directory : kernel_directory_;
+  if (PagingReadCR3() != (uint32_t)directory) {
+    PagingWriteCR3((uint32_t)directory);
+  }
+}
+
+// Page table entry of a user address, with the table allocated on demand
+static uint32_t *PagingEntry(AddressSpace *space, uint32_t address,
+                             bool create) {
+  uint32_t *pde = &space->directory[address >> PAGING_LARGE_SHIFT];
+  if (!(*pde & kPagePresent)) {
+    if (!create) {
+      return NULL;
+    }
+    uint32_t *table = PageAllocZeroed();
+    if (table == NULL) {
+      return NULL;
+    }
+
+    // Access is decided by the page table entries alone
+    *pde = (uint32_t)table | kPageUser | kPageWritable | kPagePresent;
+  }
+
+  uint32_t *table = (uint32_t *)(*pde & PAGE_FRAME_MASK);
+  return &table[(address >> PAGE_SHIFT) & (PAGING_ENTRIES - 1)];
+}
+
+// Other CPUs never run the space yet, the local TLB is all there is to
+// invalidate
+static void PagingFlush(AddressSpace *space, uint32_t address) {
+  if (PagingReadCR3() == (uint32_t)space->directory) {
+    PagingInvalidate(address);
+  }
+}
+
+bool PagingMap(AddressSpace *space, uint32_t address, uint32_t physical,
+               uint32_t flags) {
+  if (!PagingIsUser(address)) {
+    return false;
+  }
+
+  uint32_t lock_flags = SpinlockAcquireIrqSave(&space->lock);
+  uint32_t *pte = PagingEntry(space, address, true);
+  if (pte != NULL) {
+    bool flush = (*pte & kPagePresent) != 0;
+    *pte = (physical & PAGE_FRAME_MASK) | (flags & ~PAGE_FRAME_MASK) |
+           kPagePresent;
+    if (flush) {
+      PagingFlush(space, address);
+    }
+  }
+  SpinlockReleaseIrqRestore(&space->lock, lock_flags);
+
+  return pte != NULL;
+}
+
+uint32_t PagingUnmap(AddressSpace *space, uint32_t address) {
+  if (!PagingIsUser(address)) {
+    return 0;
+  }
+
+  uint32_t lock_flags = SpinlockAcquireIrqSave(&space->lock);
+  uint32_t entry = 0;
+  uint32_t *pte = PagingEntry(space, address, false);
+  if (pte != NULL && (*pte & kPagePresent)) {
+    entry = *pte;
+    *pte = 0;
+    PagingFlush(space, address);
+  }
+  SpinlockReleaseIrqRestore(&space->lock, lock_flags);
+
+  return entry;
+}
+
+uint32_t PagingLookup(AddressSpace *space, uint32_t address) {
+  if (!PagingIsUser(address)) {
+    return 0;
+  }
+
+  uint32_t *pte = PagingEntry(space, address, false);
+  return pte != NULL && (*pte & kPagePresent) ? *pte : 0;
+}
+
+bool PagingCheckUser(AddressSpace *space, uint32_t address, uint32_t size,
+                     bool write) {
+  if (size == 0) {
+    return true;
+  }
+  if (!PagingIsUser(address) || size > USER_END - address) {
+    return false;
+  }
+
+  uint32_t required = kPagePresent | kPageUser | (write ? kPageWritable : 0);
+  uint32_t last = (address + size - 1) & PAGE_FRAME_MASK;
+  for (uint32_t page = address & PAGE_FRAME_MASK;; page += PAGE_SIZE) {
+    if ((PagingLookup(space, page) & required) != required) {
+      return false;
+    }
+    if (page == last) {
+      return true;
+    }
+  }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "spinlock.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Every address space maps the kernel one to one with 4 MiB pages, except
+// the user window between USER_BASE and USER_END (sys/image.h), which has
+// 4 KiB pages of its own
+enum PagingFlags {
+  kPagePresent = 1u << 0,
+  kPageWritable = 1u << 1,
+  kPageUser = 1u << 2,
+  kPageWriteThrough = 1u << 3,
+  kPageCacheDisable = 1u << 4,
+  kPageAccessed = 1u << 5,
+  kPageDirty = 1u << 6,
+  kPageLarge = 1u << 7,
+  kPageGlobal = 1u << 8,
+  kPageOwned = 1u << 9, // Available to software: freed with the space
+};
+
+#define PAGE_FRAME_MASK 0xFFFFF000 // NOLINT
+
+typedef struct {
+  uint32_t *directory;
+  Spinlock lock;
+} AddressSpace;
+
+// The BSP builds the kernel directory and turns paging on, APs only turn it
+// on
+void PagingInitialize();
+void PagingInitializeCpu();
+bool PagingIsEnabled();
+
+bool PagingCreateSpace(AddressSpace *space);
+void PagingDestroySpace(AddressSpace *space);
+
+// NULL switches back to the kernel directory
+void PagingSwitch(AddressSpace *space);
+
+// Map one user page, physical is a frame address. Fails when a page table
+// cannot be allocated or the address is outside the user window.
+bool PagingMap(AddressSpace *space, uint32_t address, uint32_t physical,
+               uint32_t flags);
+
+// Both return the page table entry, 0 when nothing was mapped
+uint32_t PagingUnmap(AddressSpace *space, uint32_t address);
+uint32_t PagingLookup(AddressSpace *space, uint32_t address);
+
+// Whether user code may access the whole range, for system call arguments
+bool PagingCheckUser(AddressSpace *space, uint32_t address, uint32_t size,
+                     bool write);
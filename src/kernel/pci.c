@@ -0,0 +1,182 @@
+#include "pci.h"
+#include "spinlock.h"
+#include "stdio.h"
+#include "x86.h"
+#include <stddef.h>
+
+enum PCIPorts {
+  kPCIConfigAddress = 0xCF8,
+  kPCIConfigData = 0xCFC,
+};
+
+#define PCI_ENABLE_BIT 0x80000000u     // NOLINT
+#define PCI_BUS_COUNT 256              // NOLINT
+#define PCI_SLOT_COUNT 32              // NOLINT
+#define PCI_FUNCTION_COUNT 8           // NOLINT
+#define PCI_MULTIFUNCTION 0x80         // NOLINT
+#define PCI_BAR_IO 0x01                // NOLINT
+#define PCI_BAR_TYPE_64 0x04           // NOLINT
+#define PCI_STATUS_CAPABILITIES 0x10   // NOLINT
+
+static PCIDevice devices_[PCI_MAX_DEVICES];
+static int device_count_ = 0;
+
+// Address and data are two separate port accesses
+static Spinlock config_lock_ = SPINLOCK_INITIALIZER;
+
+static uint32_t PCIConfigAddress(uint8_t bus, uint8_t slot, uint8_t function,
+                                 uint8_t offset) {
+  return PCI_ENABLE_BIT | ((uint32_t)bus << 16) | ((uint32_t)slot << 11) |
+         ((uint32_t)function << 8) | (offset & 0xFC);
+}
+
+static uint32_t PCIRawRead32(uint8_t bus, uint8_t slot, uint8_t function,
+                             uint8_t offset) {
+  uint32_t flags = SpinlockAcquireIrqSave(&config_lock_);
+  x86_outl(kPCIConfigAddress, PCIConfigAddress(bus, slot, function, offset));
+  uint32_t value = x86_inl(kPCIConfigData);
+  SpinlockReleaseIrqRestore(&config_lock_, flags);
+  return value;
+}
+
+uint32_t PCIConfigRead32(const PCIDevice *device, uint8_t offset) {
+  return PCIRawRead32(device->bus, device->slot, device->function, offset);
+}
+
+uint16_t PCIConfigRead16(const PCIDevice *device, uint8_t offset) {
+  return PCIConfigRead32(device, offset) >> ((offset & 2) * 8);
+}
+
+uint8_t PCIConfigRead8(const PCIDevice *device, uint8_t offset) {
+  return PCIConfigRead32(device, offset) >> ((offset & 3) * 8);
+}
+
+void PCIConfigWrite32(const PCIDevice *device, uint8_t offset,
+                      uint32_t value) {
+  uint32_t flags = SpinlockAcquireIrqSave(&config_lock_);
+  x86_outl(kPCIConfigAddress, PCIConfigAddress(device->bus, device->slot,
+                                               device->function, offset));
+  x86_outl(kPCIConfigData, value);
+  SpinlockReleaseIrqRestore(&config_lock_, flags);
+}
+
+// The data port is byte addressable, so a 16-bit write leaves its neighbour
+// alone (and does not clear write-1-to-clear status bits next to command)
+void PCIConfigWrite16(const PCIDevice *device, uint8_t offset,
+                      uint16_t value) {
+  uint32_t flags = SpinlockAcquireIrqSave(&config_lock_);
+  x86_outl(kPCIConfigAddress, PCIConfigAddress(device->bus, device->slot,
+                                               device->function, offset));
+  x86_outw(kPCIConfigData + (offset & 2), value);
+  SpinlockReleaseIrqRestore(&config_lock_, flags);
+}
+
+void PCIUpdateCommand(const PCIDevice *device, uint16_t set, uint16_t clear) {
+  uint16_t command = PCIConfigRead16(device, kPCICommand);
+  PCIConfigWrite16(device, kPCICommand, (command & ~clear) | set);
+}
+
+uint8_t PCIFindCapability(const PCIDevice *device, uint8_t id, uint8_t start) {
+  if (!(PCIConfigRead16(device, kPCIStatus) & PCI_STATUS_CAPABILITIES)) {
+    return 0;
+  }
+
+  uint8_t offset = start == 0 ? PCIConfigRead8(device, kPCICapabilities)
+                              : PCIConfigRead8(device, start + 1);
+
+  // Bounded so a broken list cannot loop forever
+  for (int i = 0; i < 48 && offset >= 0x40; i++) {
+    offset &= 0xFC;
+    if (PCIConfigRead8(device, offset) == id) {
+      return offset;
+    }
+    offset = PCIConfigRead8(device, offset + 1);
+  }
+  return 0;
+}
+
+bool PCIBarIsIO(const PCIDevice *device, int bar) {
+  return (device->bars[bar] & PCI_BAR_IO) != 0;
+}
+
+uint32_t PCIBarAddress(const PCIDevice *device, int bar) {
+  uint32_t value = device->bars[bar];
+  if (value & PCI_BAR_IO) {
+    return value & ~0x3u;
+  }
+
+  if ((value & 0x6) == PCI_BAR_TYPE_64 &&
+      (bar + 1 >= PCI_BAR_COUNT || device->bars[bar + 1] != 0)) {
+    return 0;
+  }
+  return value & ~0xFu;
+}
+
+static void PCIAddFunction(uint8_t bus, uint8_t slot, uint8_t function,
+                           uint32_t id) {
+  if (device_count_ == PCI_MAX_DEVICES) {
+    return;
+  }
+
+  PCIDevice *device = &devices_[device_count_++];
+  device->bus = bus;
+  device->slot = slot;
+  device->function = function;
+  device->vendor_id = id & 0xFFFF;
+  device->device_id = id >> 16;
+
+  uint32_t class_register = PCIConfigRead32(device, 0x08);
+  device->prog_if = class_register >> 8;
+  device->subclass = class_register >> 16;
+  device->class_code = class_register >> 24;
+
+  // Bridges only have two BARs, the rest of their header means other things
+  uint8_t header_type = PCIConfigRead8(device, kPCIHeaderType) & 0x7F;
+  int bar_count = header_type == 0 ? PCI_BAR_COUNT : header_type == 1 ? 2 : 0;
+  for (int i = 0; i < bar_count; i++) {
+    device->bars[i] = PCIConfigRead32(device, kPCIBar0 + i * 4);
+  }
+
+  device->irq_line = PCIConfigRead8(device, kPCIInterruptPin) != 0
+                         ? PCIConfigRead8(device, kPCIInterruptLine)
+                         : 0xFF;
+
+  printf("PCI %x:%x.%d %x:%x class %x.%x", bus, slot, function,
+         device->vendor_id, device->device_id, device->class_code,
+         device->subclass);
+  if (device->irq_line != 0xFF) {
+    printf(" irq %d", device->irq_line);
+  }
+  printf("\n");
+}
+
+void PCIInitialize() {
+  device_count_ = 0;
+
+  for (int bus = 0; bus < PCI_BUS_COUNT; bus++) {
+    for (int slot = 0; slot < PCI_SLOT_COUNT; slot++) {
+      uint32_t id = PCIRawRead32(bus, slot, 0, kPCIVendorID);
+      if ((id & 0xFFFF) == 0xFFFF) {
+        continue;
+      }
+
+      PCIAddFunction(bus, slot, 0, id);
+      if (!(PCIRawRead32(bus, slot, 0, 0x0C) >> 16 & PCI_MULTIFUNCTION)) {
+        continue;
+      }
+
+      for (int function = 1; function < PCI_FUNCTION_COUNT; function++) {
+        id = PCIRawRead32(bus, slot, function, kPCIVendorID);
+        if ((id & 0xFFFF) != 0xFFFF) {
+          PCIAddFunction(bus, slot, function, id);
+        }
+      }
+    }
+  }
+}
+
+int PCIDeviceCount() { return device_count_; }
+
+PCIDevice *PCIGetDevice(int index) {
+  return index >= 0 && index < device_count_ ? &devices_[index] : NULL;
+}
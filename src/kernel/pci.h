@@ -0,0 +1,71 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PCI_MAX_DEVICES 64 // NOLINT
+#define PCI_BAR_COUNT 6    // NOLINT
+
+enum PCIConfigRegisters {
+  kPCIVendorID = 0x00,
+  kPCIDeviceID = 0x02,
+  kPCICommand = 0x04,
+  kPCIStatus = 0x06,
+  kPCIProgIF = 0x09,
+  kPCISubclass = 0x0A,
+  kPCIClass = 0x0B,
+  kPCIHeaderType = 0x0E,
+  kPCIBar0 = 0x10,
+  kPCICapabilities = 0x34,
+  kPCIInterruptLine = 0x3C,
+  kPCIInterruptPin = 0x3D,
+};
+
+enum PCICommandBits {
+  kPCICommandIO = 0x0001,
+  kPCICommandMemory = 0x0002,
+  kPCICommandBusMaster = 0x0004,
+  kPCICommandInterruptDisable = 0x0400,
+};
+
+enum PCICapabilityIDs {
+  kPCICapabilityMSI = 0x05,
+  kPCICapabilityVendor = 0x09,
+  kPCICapabilityMSIX = 0x11,
+};
+
+// A function found on the bus, as the BIOS left it configured
+typedef struct {
+  uint8_t bus;
+  uint8_t slot;
+  uint8_t function;
+  uint16_t vendor_id;
+  uint16_t device_id;
+  uint8_t class_code;
+  uint8_t subclass;
+  uint8_t prog_if;
+  uint8_t irq_line; // 0xFF if the function has no interrupt pin
+  uint32_t bars[PCI_BAR_COUNT];
+} PCIDevice;
+
+// Scan every bus through configuration mechanism #1
+void PCIInitialize();
+int PCIDeviceCount();
+PCIDevice *PCIGetDevice(int index);
+
+uint32_t PCIConfigRead32(const PCIDevice *device, uint8_t offset);
+uint16_t PCIConfigRead16(const PCIDevice *device, uint8_t offset);
+uint8_t PCIConfigRead8(const PCIDevice *device, uint8_t offset);
+void PCIConfigWrite32(const PCIDevice *device, uint8_t offset, uint32_t value);
+void PCIConfigWrite16(const PCIDevice *device, uint8_t offset, uint16_t value);
+
+// Sets the given kPCICommand bits and clears the ones in clear
+void PCIUpdateCommand(const PCIDevice *device, uint16_t set, uint16_t clear);
+
+// Offset of the next capability with the given ID after start, 0 for the
+// first one. Returns 0 if there is none.
+uint8_t PCIFindCapability(const PCIDevice *device, uint8_t id, uint8_t start);
+
+// Decoded base address, 0 if the BAR is unused or a 64-bit BAR is mapped
+// above 4 GiB where the kernel cannot reach it
+bool PCIBarIsIO(const PCIDevice *device, int bar);
+uint32_t PCIBarAddress(const PCIDevice *device, int bar);
@@ -0,0 +1,30 @@
+#include "percpu.h"
+#include "x86.h"
+
+static PerCpu cpus_[MAX_CPUS];
+static int cpu_count_ = 0;
+
+void PerCpuInitialize(int cpu, uint8_t apic_id) {
+  PerCpu *data = &cpus_[cpu];
+  data->self = data;
+  data->index = cpu;
+  data->apic_id = apic_id;
+  data->online = false;
+
+  GDTSetPerCpuBase(cpu, data, sizeof(PerCpu));
+
+  if (cpu >= cpu_count_) {
+    cpu_count_ = cpu + 1;
+  }
+}
+
+// Point GS at the per-CPU area of the calling CPU. The task register goes
+// with it, interrupts from user mode find GS again through it.
+void PerCpuLoad(int cpu) {
+  x86_LoadGS(GDTPerCpuSelector(cpu));
+  GDTLoadTaskState(cpu);
+}
+
+PerCpu *PerCpuGet(int cpu) { return &cpus_[cpu]; }
+
+int PerCpuCount() { return cpu_count_; }
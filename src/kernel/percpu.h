@@ -0,0 +1,43 @@
+#pragma once
+#include "gdt.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct PerCpu {
+  struct PerCpu *self; // Must stay first, read through %gs:0
+  int index;
+  uint8_t apic_id;
+  volatile bool online;
+
+  // Read-side RCU state, see rcu.h
+  volatile uint32_t rcu_state;
+  uint32_t rcu_nesting;
+
+  // Lazy FPU switching, see fpu.h. The owner's state is in the registers,
+  // the current context is the one running.
+  struct FPUState *fpu_owner;
+  struct FPUState *fpu_current;
+  uint32_t fpu_kernel_depth;
+
+  // User process running on this CPU, NULL in the kernel's own context
+  struct Process *process;
+} PerCpu;
+
+void PerCpuInitialize(int cpu, uint8_t apic_id);
+void PerCpuLoad(int cpu);
+PerCpu *PerCpuGet(int cpu);
+int PerCpuCount();
+
+static inline PerCpu *PerCpuThis() {
+  PerCpu *self;
+  __asm__ volatile("movl %%gs:0, %0" : "=r"(self));
+  return self;
+}
+
+static inline int PerCpuIndex() {
+  int index;
+  __asm__ volatile("movl %%gs:%c1, %0"
+                   : "=r"(index)
+                   : "i"(__builtin_offsetof(PerCpu, index)));
+  return index;
+}
@@ -0,0 +1,110 @@
+#include "pic.h"
+#include "x86.h"
+
+enum PICPorts {
+  kPICMasterCommandPort = 0x20,
+  kPICMasterDataPort = 0x21,
+  kPICSlaveCommandPort = 0xA0,
+  kPICSlaveDataPort = 0xA1,
+};
+
+enum PICICW1 {
+  kPICICW1ICW4 = 0x01,
+  kPICICW1Initialize = 0x10,
+};
+
+enum PICICW4 {
+  kPICICW48086 = 0x01,
+};
+
+enum PICCommands {
+  kPICCommandEndOfInterrupt = 0x20,
+  kPICCommandReadIRR = 0x0A,
+  kPICCommandReadISR = 0x0B,
+};
+
+#define PIC_CASCADE_IRQ 2 // NOLINT
+
+static uint16_t mask_ = 0xFFFF;
+
+// Give the PIC time to settle between initialization words
+static void PICIOWait() { x86_outb(0x80, 0); }
+
+static void PICWriteMask() {
+  x86_outb(kPICMasterDataPort, mask_ & 0xFF);
+  x86_outb(kPICSlaveDataPort, mask_ >> 8);
+}
+
+void PICInitialize(uint8_t offset_master, uint8_t offset_slave) {
+  x86_outb(kPICMasterCommandPort, kPICICW1ICW4 | kPICICW1Initialize);
+  PICIOWait();
+  x86_outb(kPICSlaveCommandPort, kPICICW1ICW4 | kPICICW1Initialize);
+  PICIOWait();
+
+  x86_outb(kPICMasterDataPort, offset_master);
+  PICIOWait();
+  x86_outb(kPICSlaveDataPort, offset_slave);
+  PICIOWait();
+
+  // Slave hangs off IRQ2 of the master
+  x86_outb(kPICMasterDataPort, 1 << PIC_CASCADE_IRQ);
+  PICIOWait();
+  x86_outb(kPICSlaveDataPort, PIC_CASCADE_IRQ);
+  PICIOWait();
+
+  x86_outb(kPICMasterDataPort, kPICICW48086);
+  PICIOWait();
+  x86_outb(kPICSlaveDataPort, kPICICW48086);
+  PICIOWait();
+
+  // Everything masked until a handler is registered
+  mask_ = 0xFFFF & ~(1 << PIC_CASCADE_IRQ);
+  PICWriteMask();
+}
+
+void PICMask(int irq) {
+  mask_ |= 1 << irq;
+  PICWriteMask();
+}
+
+void PICUnmask(int irq) {
+  mask_ &= ~(1 << irq);
+  PICWriteMask();
+}
+
+void PICSendEndOfInterrupt(int irq) {
+  if (irq >= 8) {
+    x86_outb(kPICSlaveCommandPort, kPICCommandEndOfInterrupt);
+  }
+  x86_outb(kPICMasterCommandPort, kPICCommandEndOfInterrupt);
+}
+
+static uint16_t PICReadInService() {
+  x86_outb(kPICMasterCommandPort, kPICCommandReadISR);
+  x86_outb(kPICSlaveCommandPort, kPICCommandReadISR);
+  return x86_inb(kPICMasterCommandPort) |
+         ((uint16_t)x86_inb(kPICSlaveCommandPort) << 8);
+}
+
+// IRQ7 and IRQ15 also fire when a request goes away before it is
+// acknowledged. Those are not in service and must not get an end of
+// interrupt, except that the master still needs one for a slave spurious.
+bool PICIsSpurious(int irq) {
+  if (irq != 7 && irq != 15) {
+    return false;
+  }
+
+  if (PICReadInService() & (1 << irq)) {
+    return false;
+  }
+
+  if (irq == 15) {
+    x86_outb(kPICMasterCommandPort, kPICCommandEndOfInterrupt);
+  }
+  return true;
+}
+
+void PICDisable() {
+  mask_ = 0xFFFF;
+  PICWriteMask();
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PIC_IRQ_COUNT 16 // NOLINT
+
+void PICInitialize(uint8_t offset_master, uint8_t offset_slave);
+void PICMask(int irq);
+void PICUnmask(int irq);
+void PICSendEndOfInterrupt(int irq);
+bool PICIsSpurious(int irq);
+void PICDisable();
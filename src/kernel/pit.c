@@ -0,0 +1,47 @@
+#include "pit.h"
+#include "x86.h"
+
+enum PITPorts {
+  kPITPortChannel2 = 0x42,
+  kPITPortCommand = 0x43,
+  kPITPortSpeaker = 0x61,
+};
+
+enum PITSpeakerBits {
+  kPITSpeakerGate = 0x01,
+  kPITSpeakerData = 0x02,
+  kPITSpeakerOutput = 0x20,
+};
+
+// Channel 2, lobyte/hibyte access, mode 0 (interrupt on terminal count)
+#define PIT_CHANNEL2_ONESHOT 0xB0 // NOLINT
+
+// Longest single countdown that still fits in the 16-bit counter
+#define PIT_MAX_DELAY 50000 // NOLINT
+
+// Busy-wait on PIT channel 2, which works before any interrupts are set up
+void PITDelay(uint32_t microseconds) {
+  while (microseconds > 0) {
+    uint32_t chunk =
+        (microseconds > PIT_MAX_DELAY) ? PIT_MAX_DELAY : microseconds;
+    uint32_t count = chunk * (PIT_FREQUENCY / 1000) / 1000;
+    if (count == 0) {
+      count = 1;
+    }
+
+    // Gate low with the speaker disconnected, then program the countdown
+    uint8_t speaker =
+        x86_inb(kPITPortSpeaker) & ~(kPITSpeakerGate | kPITSpeakerData);
+    x86_outb(kPITPortSpeaker, speaker);
+    x86_outb(kPITPortCommand, PIT_CHANNEL2_ONESHOT);
+    x86_outb(kPITPortChannel2, count & 0xFF);
+    x86_outb(kPITPortChannel2, (count >> 8) & 0xFF);
+
+    // Raising the gate starts the count, OUT2 goes high at terminal count
+    x86_outb(kPITPortSpeaker, speaker | kPITSpeakerGate);
+    while ((x86_inb(kPITPortSpeaker) & kPITSpeakerOutput) == 0)
+      ;
+
+    microseconds -= chunk;
+  }
+}
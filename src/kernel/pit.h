@@ -0,0 +1,6 @@
+#pragma once
+#include <stdint.h>
+
+#define PIT_FREQUENCY 1193182 // NOLINT
+
+void PITDelay(uint32_t microseconds);
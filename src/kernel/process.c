@@ -0,0 +1,153 @@
+#include "process.h"
+#include "ipc.h"
+#include "memory.h"
+#include "module.h"
+#include "page.h"
+#include "percpu.h"
+#include "stdio.h"
+#include "syscall.h"
+#include "timepage.h"
+#include "x86.h"
+#include <stddef.h>
+#include <sys/image.h>
+
+#define PROCESS_FAULT_STATUS 128 // NOLINT
+
+static int next_id_ = 1;
+
+// Fresh pages, zeroed, for every page of the range
+static bool ProcessMapZeroed(Process *process, uint32_t start, uint32_t end,
+                             uint32_t flags) {
+  for (uint32_t address = start; address < end; address += PAGE_SIZE) {
+    void *page = PageAllocZeroed();
+    if (page == NULL) {
+      return false;
+    }
+
+    if (!PagingMap(&process->space, address, (uint32_t)page,
+                   flags | kPageUser | kPageOwned)) {
+      PageFree(page);
+      return false;
+    }
+  }
+  return true;
+}
+
+// The image is copied through the identity mapping of its frames
+static void ProcessCopyIn(Process *process, uint32_t address,
+                          const uint8_t *data, uint32_t size) {
+  while (size > 0) {
+    uint32_t offset = address & (PAGE_SIZE - 1);
+    uint32_t chunk = PAGE_SIZE - offset;
+    if (chunk > size) {
+      chunk = size;
+    }
+
+    uint32_t frame = PagingLookup(&process->space, address) & PAGE_FRAME_MASK;
+    memcpy((void *)(frame + offset), data, chunk);
+    address += chunk;
+    data += chunk;
+    size -= chunk;
+  }
+}
+
+bool ProcessCreate(Process *process, const void *image, uint32_t size) {
+  const UserImageHeader *header = image;
+  bool valid = size >= sizeof(UserImageHeader) &&
+               header->magic == USER_IMAGE_MAGIC &&
+               header->end >= USER_BASE + size &&
+               header->end <= USER_MAP_BASE &&
+               header->entry >= USER_BASE && header->entry < header->end;
+  if (!valid) {
+    printf("Process: not a user image\n");
+    return false;
+  }
+
+  if (!PagingCreateSpace(&process->space)) {
+    return false;
+  }
+  process->entry = header->entry;
+  process->id = next_id_++;
+  process->exit_status = 0;
+  process->fpu.initialized = false;
+  MMapCreateTable(&process->maps);
+
+  uint32_t image_end = (header->end + PAGE_SIZE - 1) & PAGE_FRAME_MASK;
+  if (!ProcessMapZeroed(process, USER_BASE, image_end, kPageWritable) ||
+      !ProcessMapZeroed(process, USER_STACK_TOP - USER_STACK_SIZE,
+                        USER_STACK_TOP, kPageWritable) ||
+      !PagingMap(&process->space, USER_SHARED_PAGE,
+                 (uint32_t)TimePageGet(), kPageUser)) {
+    printf("Process: out of memory\n");
+    PagingDestroySpace(&process->space);
+    return false;
+  }
+
+  ProcessCopyIn(process, USER_BASE, image, size);
+  return true;
+}
+
+void ProcessDestroy(Process *process) {
+  IPCReleaseOwner(process->id);
+  MMapDestroyTable(&process->maps, &process->space);
+  PagingDestroySpace(&process->space);
+}
+
+Process *ProcessCurrent() { return PerCpuThis()->process; }
+
+int ProcessRun(Process *process) {
+  uint32_t flags = x86_SaveFlagsAndDisableInterrupts();
+  PerCpu *cpu = PerCpuThis();
+  Process *previous = cpu->process;
+
+  cpu->process = process;
+  PagingSwitch(&process->space);
+  FPUSwitch(&process->fpu);
+  SyscallSetKernelStack((uint32_t)&process->kernel_stack[sizeof(
+      process->kernel_stack)]);
+
+  process->exit_status = x86_EnterUser(&process->kernel_esp, process->entry,
+                                       USER_STACK_TOP);
+
+  x86_DisableInterrupts();
+  FPURelease(&process->fpu);
+  PagingSwitch(previous != NULL ? &previous->space : NULL);
+  cpu->process = previous;
+
+  x86_RestoreFlags(flags);
+  return process->exit_status;
+}
+
+void ProcessExit(int status) {
+  x86_DisableInterrupts();
+  x86_LeaveUser(ProcessCurrent()->kernel_esp, status);
+}
+
+void ProcessFault(ISRFrame *frame) {
+  Process *process = ProcessCurrent();
+  printf("Process %d: exception %u at eip %x, error %x\n", process->id,
+         frame->vector, frame->eip, frame->error);
+  ProcessExit(PROCESS_FAULT_STATUS + frame->vector);
+}
+
+void ProcessStartInit() {
+  Module module;
+  if (!ModuleFind("init", &module)) {
+    return;
+  }
+  if (!PagingIsEnabled() || !SyscallInitialize()) {
+    printf("Process: cannot run init without paging\n");
+    return;
+  }
+  MMapInitialize();
+
+  static Process init;
+  if (!ProcessCreate(&init, module.data, module.size)) {
+    return;
+  }
+
+  printf("Process %d: init started\n", init.id);
+  int status = ProcessRun(&init);
+  printf("Process %d: init exited with status %d\n", init.id, status);
+  ProcessDestroy(&init);
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "fpu.h"
+#include "isr.h"
+#include "mmap.h"
+#include "paging.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PROCESS_KERNEL_STACK_SIZE 8192 // NOLINT
+
+// A user program in its own address space. There is no scheduler yet, so a
+// process runs on the CPU that calls ProcessRun until it exits or faults.
+typedef struct Process {
+  AddressSpace space;
+  MMapTable maps;
+  uint32_t entry;
+  int id;
+  int exit_status;
+  uint32_t kernel_esp; // Where ProcessRun's context was left
+  FPUState fpu;
+  uint8_t kernel_stack[PROCESS_KERNEL_STACK_SIZE] __attribute__((aligned(16)));
+} Process;
+
+// Load a flat image with a UserImageHeader (sys/image.h) into a new address
+// space with a stack and the shared page
+bool ProcessCreate(Process *process, const void *image, uint32_t size);
+void ProcessDestroy(Process *process);
+
+// Returns the exit status, 128 + the exception vector after a fault
+int ProcessRun(Process *process);
+Process *ProcessCurrent();
+
+// Leave the current process from a system call or exception handler
+void __attribute__((noreturn)) ProcessExit(int status);
+void __attribute__((noreturn)) ProcessFault(ISRFrame *frame);
+
+// Run the "init" boot module as the first process, if there is one
+void ProcessStartInit();
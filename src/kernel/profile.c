@@ -0,0 +1,167 @@
+#include "profile.h"
+#include "apic.h"
+#include "atomic.h"
+#include "isr.h"
+#include "percpu.h"
+#include "serial.h"
+#include "smp.h"
+#include "stdio.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Scratch memory above the SMP benchmark region, 1 MiB of samples per CPU
+#define PROFILE_REGION 0x03000000  // NOLINT
+#define PROFILE_CPU_SIZE 0x100000  // NOLINT
+#define PROFILE_CPU_WORDS ((PROFILE_CPU_SIZE - sizeof(ProfileBuffer)) / 4)
+#define PROFILE_MAX_DEPTH 32       // NOLINT
+
+// Largest gap between two saved frame pointers that is still believed
+#define PROFILE_MAX_FRAME 0x10000 // NOLINT
+
+// Followed by the samples, each a word with the number of addresses and
+// then the addresses, innermost first
+typedef struct {
+  volatile uint32_t used;
+  uint32_t samples;
+  uint32_t dropped;
+} ProfileBuffer;
+
+extern uint8_t __end;
+
+// APIC ticks between samples, the APs wait until it is set
+static volatile uint32_t timer_count_ = 0;
+static volatile bool recording_ = false;
+
+static ProfileBuffer *ProfileGetBuffer(int cpu) {
+  return (ProfileBuffer *)(PROFILE_REGION + cpu * PROFILE_CPU_SIZE);
+}
+
+// All stacks live below the end of the kernel image. Frames have to move
+// up the stack, which also stops the walk at a broken chain.
+static int ProfileWalk(uint32_t ebp, uint32_t *addresses, int max) {
+  uint32_t limit = (uint32_t)&__end;
+  int depth = 0;
+
+  while (depth < max && ebp != 0 && (ebp & 3) == 0 && ebp + 8 <= limit) {
+    const uint32_t *frame = (const uint32_t *)ebp;
+    addresses[depth++] = frame[1];
+    if (frame[0] <= ebp || frame[0] - ebp > PROFILE_MAX_FRAME) {
+      break;
+    }
+    ebp = frame[0];
+  }
+  return depth;
+}
+
+static void ProfileSample(ISRFrame *frame) {
+  ProfileBuffer *buffer = ProfileGetBuffer(PerCpuIndex());
+  uint32_t *words = (uint32_t *)(buffer + 1);
+
+  if (recording_) {
+    uint32_t addresses[PROFILE_MAX_DEPTH];
+    addresses[0] = frame->eip;
+    int depth = 1 + ProfileWalk(frame->ebp, addresses + 1,
+                                PROFILE_MAX_DEPTH - 1);
+
+    // Published only once complete, ProfileDump may be reading
+    uint32_t used = buffer->used;
+    if (used + 1 + depth > PROFILE_CPU_WORDS) {
+      buffer->dropped++;
+    } else {
+      words[used] = depth;
+      for (int i = 0; i < depth; i++) {
+        words[used + 1 + i] = addresses[i];
+      }
+      buffer->samples++;
+      CompilerBarrier();
+      buffer->used = used + 1 + depth;
+    }
+  }
+
+  APICEndOfInterrupt();
+}
+
+void ProfileInitialize() {
+  if (SMPGetTopology()->cpu_count == 0) {
+    printf("profile: no local APIC, not sampling\n");
+    return;
+  }
+
+  for (int cpu = 0; cpu < SMPOnlineCount(); cpu++) {
+    ProfileBuffer *buffer = ProfileGetBuffer(cpu);
+    buffer->used = 0;
+    buffer->samples = 0;
+    buffer->dropped = 0;
+  }
+
+  ISRRegisterHandler(PROFILE_VECTOR, ProfileSample);
+  uint32_t frequency = APICTimerFrequency();
+  recording_ = true;
+
+  // Releases the APs waiting in ProfileStartCpu
+  AtomicStore(&timer_count_, frequency / PROFILE_HZ);
+  ProfileStartCpu();
+
+  printf("profile: sampling %d CPUs at %u Hz\n", SMPOnlineCount(),
+         PROFILE_HZ);
+}
+
+void ProfileStartCpu() {
+  while (AtomicLoad(&timer_count_) == 0) {
+    CpuRelax();
+  }
+  APICStartTimer(PROFILE_VECTOR, timer_count_);
+}
+
+static void ProfileWrite(const char *str) {
+  while (*str) {
+    SerialPutc(*str++);
+  }
+}
+
+static void ProfileWriteHex(uint32_t value) {
+  static const char kDigits[] = "0123456789abcdef";
+  char buffer[9];
+  int pos = 8;
+  buffer[pos] = '\0';
+  do {
+    buffer[--pos] = kDigits[value & 0xF];
+    value >>= 4;
+  } while (value != 0);
+  ProfileWrite(&buffer[pos]);
+}
+
+// Straight to the serial port, the console would take far longer to draw
+// thousands of lines than the samples took to collect
+void ProfileDump() {
+  if (timer_count_ == 0 || !SerialIsReady()) {
+    return;
+  }
+
+  recording_ = false;
+  APICStopTimer();
+
+  uint32_t samples = 0;
+  uint32_t dropped = 0;
+  ProfileWrite("profile: begin\n");
+  for (int cpu = 0; cpu < SMPOnlineCount(); cpu++) {
+    ProfileBuffer *buffer = ProfileGetBuffer(cpu);
+    const uint32_t *words = (const uint32_t *)(buffer + 1);
+    uint32_t used = AtomicLoad(&buffer->used);
+    samples += buffer->samples;
+    dropped += buffer->dropped;
+
+    for (uint32_t i = 0; i < used; i += 1 + words[i]) {
+      ProfileWrite("sample ");
+      ProfileWriteHex(cpu);
+      for (uint32_t j = 1; j <= words[i]; j++) {
+        ProfileWrite(" ");
+        ProfileWriteHex(words[i + j]);
+      }
+      ProfileWrite("\n");
+    }
+  }
+  ProfileWrite("profile: end\n");
+
+  printf("profile: %u samples, %u dropped\n", samples, dropped);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#define PROFILE_VECTOR 0xF0 // NOLINT
+#define PROFILE_HZ 1000     // NOLINT
+
+// Sampling profiler driven by the local APIC timer of every CPU. A sample is
+// the interrupted EIP plus the return addresses found by following saved
+// frame pointers. Samples stay in per-CPU buffers until ProfileDump writes
+// them to the serial port, where profile.sh turns them into folded stacks.
+//
+// ProfileInitialize runs on the BSP once the other CPUs are up, each AP calls
+// ProfileStartCpu and waits there for the timer calibration.
+void ProfileInitialize();
+void ProfileStartCpu();
+void ProfileDump();
@@ -0,0 +1,44 @@
+#include "ramdisk.h"
+#include "block.h"
+#include "memory.h"
+#include "stdio.h"
+
+static uint8_t *image_;
+
+static bool RamdiskRead(BlockDevice *device, uint64_t lba, uint32_t count,
+                        void *buffer) {
+  memcpy(buffer, image_ + (uint32_t)lba * BLOCK_SECTOR_SIZE,
+         count * BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+static bool RamdiskWrite(BlockDevice *device, uint64_t lba, uint32_t count,
+                         const void *buffer) {
+  memcpy(image_ + (uint32_t)lba * BLOCK_SECTOR_SIZE, buffer,
+         count * BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+static const BlockOperations kRamdiskOperations = {
+    .read = RamdiskRead,
+    .write = RamdiskWrite,
+};
+
+static BlockDevice device_ = {
+    .name = "ram0",
+    .operations = &kRamdiskOperations,
+};
+
+bool RamdiskInitialize(const BootParams *boot_params) {
+  if (boot_params->ramdisk_size == 0) {
+    return false;
+  }
+
+  image_ = (uint8_t *)boot_params->ramdisk_address;
+  device_.sector_count = boot_params->ramdisk_size / BLOCK_SECTOR_SIZE;
+  BlockRegister(&device_);
+
+  printf("%s: %u KiB at %x\n", device_.name, boot_params->ramdisk_size / 1024,
+         boot_params->ramdisk_address);
+  return true;
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include <boot/bootparams.h>
+#include <stdbool.h>
+
+// Registers the boot disk copy stage2 left in memory as block device "ram0"
+bool RamdiskInitialize(const BootParams *boot_params);
@@ -0,0 +1,32 @@
+#include "rcu.h"
+
+// Only the low 31 bits are published, comparisons are wrap-around safe
+volatile uint32_t rcu_epoch_ = 1;
+
+static bool RCUEpochBefore(uint32_t a, uint32_t b) {
+  return (int32_t)((a - b) << 1) < 0;
+}
+
+void RCUSynchronize() {
+  // Readers that start after this see the new pointer, so only the ones that
+  // published an older epoch need to be waited for
+  uint32_t epoch = AtomicAdd(&rcu_epoch_, 1) + 1;
+
+  int self = PerCpuIndex();
+  int count = PerCpuCount();
+  for (int i = 0; i < count; i++) {
+    PerCpu *cpu = PerCpuGet(i);
+    if (i == self || !cpu->online) {
+      continue;
+    }
+
+    for (;;) {
+      uint32_t state = AtomicLoad(&cpu->rcu_state);
+      if ((state & RCU_STATE_ACTIVE) == 0 ||
+          !RCUEpochBefore(state >> 1, epoch)) {
+        break;
+      }
+      CpuRelax();
+    }
+  }
+}
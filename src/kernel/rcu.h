@@ -0,0 +1,47 @@
+#pragma once
+#include "atomic.h"
+#include "percpu.h"
+
+// Epoch based read-copy-update for read-mostly tables.
+//
+// Readers only touch their own per-CPU state: the outermost RCUReadLock
+// publishes the current epoch, RCUReadUnlock clears it. A writer publishes a
+// new version with RCUAssignPointer, then RCUSynchronize waits until every CPU
+// that may still see the old version has left its read section, after which
+// the old version can be reused. Read sections nest, may run in interrupt
+// handlers, and must not block.
+
+#define RCU_STATE_ACTIVE 1 // NOLINT
+
+extern volatile uint32_t rcu_epoch_;
+
+static inline void RCUReadLock() {
+  PerCpu *cpu = PerCpuThis();
+  cpu->rcu_nesting++;
+
+  // An interrupt between the two steps may already have published an
+  // (older, so more conservative) epoch for us, which is fine to keep.
+  // The exchange is a full barrier so the writer sees the state before we
+  // load any protected pointer.
+  if ((cpu->rcu_state & RCU_STATE_ACTIVE) == 0) {
+    AtomicExchange(&cpu->rcu_state,
+                   (AtomicLoad(&rcu_epoch_) << 1) | RCU_STATE_ACTIVE);
+  }
+}
+
+static inline void RCUReadUnlock() {
+  PerCpu *cpu = PerCpuThis();
+  if (--cpu->rcu_nesting == 0) {
+    AtomicStore(&cpu->rcu_state, 0);
+  }
+}
+
+#define RCUDereference(pointer) (*(__typeof__(pointer) volatile *)&(pointer))
+
+#define RCUAssignPointer(pointer, value)                                       \
+  do {                                                                         \
+    CompilerBarrier();                                                         \
+    *(__typeof__(pointer) volatile *)&(pointer) = (value);                     \
+  } while (0)
+
+void RCUSynchronize();
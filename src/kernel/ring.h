@@ -0,0 +1,91 @@
+#pragma once
+#include "atomic.h"
+#include "memory.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Single-producer/single-consumer byte ring. The producer only writes head
+// and the consumer only writes tail, so neither side needs a lock or a
+// locked instruction. The size must be a power of two.
+typedef struct {
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  uint32_t mask;
+  volatile uint8_t *buffer;
+} Ring;
+
+static inline void RingInitialize(Ring *ring, void *buffer, uint32_t size) {
+  ring->head = 0;
+  ring->tail = 0;
+  ring->mask = size - 1;
+  ring->buffer = (volatile uint8_t *)buffer;
+}
+
+static inline uint32_t RingCount(const Ring *ring) {
+  return AtomicLoad(&ring->head) - AtomicLoad(&ring->tail);
+}
+
+static inline bool RingIsEmpty(const Ring *ring) {
+  return RingCount(ring) == 0;
+}
+
+static inline bool RingPush(Ring *ring, uint8_t value) {
+  uint32_t head = ring->head;
+  if (head - AtomicLoad(&ring->tail) > ring->mask) {
+    return false;
+  }
+
+  ring->buffer[head & ring->mask] = value;
+  AtomicStore(&ring->head, head + 1);
+  return true;
+}
+
+static inline bool RingPop(Ring *ring, uint8_t *value_out) {
+  uint32_t tail = ring->tail;
+  if (tail == AtomicLoad(&ring->head)) {
+    return false;
+  }
+
+  *value_out = ring->buffer[tail & ring->mask];
+  AtomicStore(&ring->tail, tail + 1);
+  return true;
+}
+
+// Copy in as much of data as fits, in at most two pieces around the end of
+// the buffer. The consumer sees all of it at once, with one store of head.
+static inline uint32_t RingWrite(Ring *ring, const void *data, uint32_t size) {
+  uint32_t head = ring->head;
+  uint32_t space = ring->mask + 1 - (head - AtomicLoad(&ring->tail));
+  if (size > space) {
+    size = space;
+  }
+
+  uint32_t offset = head & ring->mask;
+  uint32_t first = ring->mask + 1 - offset;
+  if (first > size) {
+    first = size;
+  }
+  memcpy((uint8_t *)ring->buffer + offset, data, first);
+  memcpy((uint8_t *)ring->buffer, (const uint8_t *)data + first, size - first);
+  AtomicStore(&ring->head, head + size);
+  return size;
+}
+
+// Copy out up to size bytes, giving the space back with one store of tail
+static inline uint32_t RingRead(Ring *ring, void *data, uint32_t size) {
+  uint32_t tail = ring->tail;
+  uint32_t count = AtomicLoad(&ring->head) - tail;
+  if (size > count) {
+    size = count;
+  }
+
+  uint32_t offset = tail & ring->mask;
+  uint32_t first = ring->mask + 1 - offset;
+  if (first > size) {
+    first = size;
+  }
+  memcpy(data, (const uint8_t *)ring->buffer + offset, first);
+  memcpy((uint8_t *)data + first, (const uint8_t *)ring->buffer, size - first);
+  AtomicStore(&ring->tail, tail + size);
+  return size;
+}
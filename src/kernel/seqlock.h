@@ -0,0 +1,54 @@
+#pragma once
+#include "atomic.h"
+#include "spinlock.h"
+
+// Sequence lock for small, frequently read data such as the current time.
+// Readers never write shared memory, they retry if a writer was active.
+typedef struct {
+  volatile uint32_t sequence;
+  Spinlock lock;
+} Seqlock;
+
+#define SEQLOCK_INITIALIZER { 0, SPINLOCK_INITIALIZER } // NOLINT
+
+static inline uint32_t SeqlockReadBegin(const Seqlock *seqlock) {
+  uint32_t sequence;
+  while ((sequence = AtomicLoad(&seqlock->sequence)) & 1) {
+    CpuRelax();
+  }
+  return sequence;
+}
+
+// Loads are not reordered with other loads on x86, so checking the sequence
+// again is enough to know the data read in between is consistent
+static inline bool SeqlockReadRetry(const Seqlock *seqlock, uint32_t sequence) {
+  CompilerBarrier();
+  return seqlock->sequence != sequence;
+}
+
+static inline void SeqlockWriteBegin(Seqlock *seqlock) {
+  SpinlockAcquire(&seqlock->lock);
+  seqlock->sequence++;
+  CompilerBarrier();
+}
+
+static inline void SeqlockWriteEnd(Seqlock *seqlock) {
+  CompilerBarrier();
+  seqlock->sequence++;
+  SpinlockRelease(&seqlock->lock);
+}
+
+// For writers running in interrupt context, or racing with one
+static inline uint32_t SeqlockWriteBeginIrqSave(Seqlock *seqlock) {
+  uint32_t flags = SpinlockAcquireIrqSave(&seqlock->lock);
+  seqlock->sequence++;
+  CompilerBarrier();
+  return flags;
+}
+
+static inline void SeqlockWriteEndIrqRestore(Seqlock *seqlock,
+                                             uint32_t flags) {
+  CompilerBarrier();
+  seqlock->sequence++;
+  SpinlockReleaseIrqRestore(&seqlock->lock, flags);
+}
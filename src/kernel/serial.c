@@ -0,0 +1,62 @@
+#include "serial.h"
+#include "x86.h"
+
+// Register offsets from the UART base port
+enum SerialRegisters {
+  kSerialData = 0,
+  kSerialInterruptEnable = 1,
+  kSerialDivisorLow = 0,
+  kSerialDivisorHigh = 1,
+  kSerialFifoControl = 2,
+  kSerialLineControl = 3,
+  kSerialModemControl = 4,
+  kSerialLineStatus = 5,
+};
+
+enum SerialBits {
+  kSerialLineControl8N1 = 0x03,
+  kSerialLineControlDivisorLatch = 0x80,
+  kSerialFifoEnableClear14 = 0xC7,
+  kSerialModemControlNormal = 0x0F, // DTR, RTS, OUT1, OUT2
+  kSerialModemControlLoopback = 0x1E,
+  kSerialLineStatusTransmitEmpty = 0x20,
+};
+
+#define SERIAL_DIVISOR_115200 1 // NOLINT
+#define SERIAL_TEST_BYTE 0xAE   // NOLINT
+
+static uint16_t port_ = 0;
+
+// 115200 8N1, no interrupts. Fails if nothing answers the loopback test, so
+// machines without a UART don't hang on the transmit poll.
+bool SerialInitialize(uint16_t port) {
+  x86_outb(port + kSerialInterruptEnable, 0);
+  x86_outb(port + kSerialLineControl, kSerialLineControlDivisorLatch);
+  x86_outb(port + kSerialDivisorLow, SERIAL_DIVISOR_115200);
+  x86_outb(port + kSerialDivisorHigh, 0);
+  x86_outb(port + kSerialLineControl, kSerialLineControl8N1);
+  x86_outb(port + kSerialFifoControl, kSerialFifoEnableClear14);
+
+  x86_outb(port + kSerialModemControl, kSerialModemControlLoopback);
+  x86_outb(port + kSerialData, SERIAL_TEST_BYTE);
+  if (x86_inb(port + kSerialData) != SERIAL_TEST_BYTE) {
+    return false;
+  }
+
+  x86_outb(port + kSerialModemControl, kSerialModemControlNormal);
+  port_ = port;
+  return true;
+}
+
+bool SerialIsReady() { return port_ != 0; }
+
+void SerialPutc(char c) {
+  if (port_ == 0) {
+    return;
+  }
+
+  while ((x86_inb(port_ + kSerialLineStatus) &
+          kSerialLineStatusTransmitEmpty) == 0)
+    ;
+  x86_outb(port_ + kSerialData, c);
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SERIAL_COM1 0x3F8 // NOLINT
+
+bool SerialInitialize(uint16_t port);
+bool SerialIsReady();
+void SerialPutc(char c);
@@ -0,0 +1,129 @@
+#include "smp.h"
+#include "acpi.h"
+#include "apic.h"
+#include "atomic.h"
+#include "fpu.h"
+#include "gdt.h"
+#include "idt.h"
+#include "memory.h"
+#include "mptable.h"
+#include "paging.h"
+#include "percpu.h"
+#include "pit.h"
+#include "profile.h"
+#include "stdio.h"
+#include "taskpool.h"
+#include "x86.h"
+
+// Startup IPIs can only target a 4 KiB aligned page below 1 MiB
+#define SMP_TRAMPOLINE_ADDR 0x8000 // NOLINT
+#define SMP_AP_STACK_SIZE 16384    // NOLINT
+#define SMP_APIC_ID_COUNT 256      // NOLINT
+
+// INIT-SIPI-SIPI timings from the MultiProcessor Specification
+#define SMP_INIT_DELAY 10000    // NOLINT
+#define SMP_STARTUP_DELAY 200   // NOLINT
+#define SMP_ONLINE_TIMEOUT 1000 // NOLINT
+
+extern uint8_t smp_trampoline_start;
+extern uint8_t smp_trampoline_gdtr;
+extern uint8_t smp_trampoline_end;
+
+// Read by the trampoline, indexed by initial APIC id. A stack of 0 means the
+// AP was never given a slot and halts.
+uint32_t smp_ap_stacks_[SMP_APIC_ID_COUNT];
+int smp_ap_cpus_[SMP_APIC_ID_COUNT];
+
+static uint8_t ap_stacks_[MAX_CPUS][SMP_AP_STACK_SIZE]
+    __attribute__((aligned(16)));
+static SMPTopology topology_;
+static volatile uint32_t online_count_ = 1;
+
+void __attribute__((cdecl)) SMPApMain(int cpu) {
+  GDTLoad();
+  IDTLoad();
+  PerCpuLoad(cpu);
+  APICEnable();
+  FPUInitializeCpu();
+  PagingInitializeCpu();
+
+  PerCpuThis()->online = true;
+  AtomicIncrement(&online_count_);
+
+#ifdef PROFILE
+  // The sampling timer is the only interrupt an AP ever takes
+  ProfileStartCpu();
+  x86_EnableInterrupts();
+#endif
+
+  TaskPoolWorker();
+}
+
+static bool SMPStartCpu(int cpu, uint8_t apic_id) {
+  PerCpu *data = PerCpuGet(cpu);
+
+  smp_ap_cpus_[apic_id] = cpu;
+  smp_ap_stacks_[apic_id] = (uint32_t)&ap_stacks_[cpu][SMP_AP_STACK_SIZE];
+
+  APICSendInit(apic_id);
+  PITDelay(SMP_INIT_DELAY);
+
+  // The second startup IPI is only needed if the first one was missed
+  for (int attempt = 0; attempt < 2 && !data->online; attempt++) {
+    APICSendStartup(apic_id, SMP_TRAMPOLINE_ADDR >> 12);
+    PITDelay(SMP_STARTUP_DELAY);
+  }
+
+  for (int i = 0; i < SMP_ONLINE_TIMEOUT && !data->online; i++) {
+    PITDelay(100);
+  }
+
+  return data->online;
+}
+
+void SMPInitialize() {
+  if (!ACPIReadMadt(&topology_) && !MPReadTable(&topology_)) {
+    topology_.cpu_count = 0;
+  }
+
+  if (topology_.cpu_count == 0 || !APICInitialize(topology_.apic_address)) {
+    // Uniprocessor machine, or no usable local APIC
+    PerCpuInitialize(0, 0);
+    PerCpuLoad(0);
+    PerCpuThis()->online = true;
+    return;
+  }
+
+  // The BSP is always CPU 0, whatever its APIC id
+  uint8_t bsp_apic_id = APICId();
+  PerCpuInitialize(0, bsp_apic_id);
+  PerCpuLoad(0);
+  PerCpuThis()->online = true;
+
+  // Copy the real mode entry code and point it at the kernel GDT
+  uint8_t *trampoline = (uint8_t *)SMP_TRAMPOLINE_ADDR;
+  memcpy(trampoline, &smp_trampoline_start,
+         &smp_trampoline_end - &smp_trampoline_start);
+  memcpy(trampoline + (&smp_trampoline_gdtr - &smp_trampoline_start),
+         GDTDescriptor(), 6);
+
+  int cpu = 1;
+  for (int i = 0; i < topology_.cpu_count; i++) {
+    uint8_t apic_id = topology_.apic_ids[i];
+    if (apic_id == bsp_apic_id) {
+      continue;
+    }
+
+    // A CPU that misses the timeout keeps its slot and its own stack, so it
+    // can still show up late without disturbing the ones after it
+    PerCpuInitialize(cpu, apic_id);
+    if (!SMPStartCpu(cpu, apic_id)) {
+      printf("SMP: CPU with APIC id %u did not come online\n", apic_id);
+    }
+    cpu++;
+  }
+}
+
+const SMPTopology *SMPGetTopology() { return &topology_; }
+
+int SMPOnlineCount() { return online_count_; }
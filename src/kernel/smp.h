@@ -0,0 +1,15 @@
+#pragma once
+#include "gdt.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+  uint32_t apic_address;
+  uint32_t io_apic_address;
+  int cpu_count;
+  uint8_t apic_ids[MAX_CPUS];
+} SMPTopology;
+
+void SMPInitialize();
+const SMPTopology *SMPGetTopology();
+int SMPOnlineCount();
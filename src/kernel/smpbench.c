@@ -0,0 +1,81 @@
+#include "smpbench.h"
+#include "memory.h"
+#include "smp.h"
+#include "stdio.h"
+#include "taskpool.h"
+#include "x86.h"
+#include <stddef.h>
+
+// Scratch memory well above the kernel image, QEMU and Bochs both default to
+// 128 MiB of RAM
+#define SMP_BENCH_REGION ((uint8_t *)0x02000000) // NOLINT
+#define SMP_BENCH_SIZE 0x01000000                // NOLINT
+#define SMP_BENCH_PAGE_SIZE 4096                 // NOLINT
+#define SMP_BENCH_PAGES (SMP_BENCH_SIZE / SMP_BENCH_PAGE_SIZE)
+
+static uint32_t page_sums_[SMP_BENCH_PAGES];
+
+static void SMPBenchZero(void *argument, uint32_t begin, uint32_t end) {
+  memset(SMP_BENCH_REGION + begin * SMP_BENCH_PAGE_SIZE, 0,
+         (end - begin) * SMP_BENCH_PAGE_SIZE);
+}
+
+// Fletcher-32 over each page
+static void SMPBenchChecksum(void *argument, uint32_t begin, uint32_t end) {
+  for (uint32_t page = begin; page < end; page++) {
+    const uint16_t *words =
+        (const uint16_t *)(SMP_BENCH_REGION + page * SMP_BENCH_PAGE_SIZE);
+    uint32_t sum1 = 0xFFFF;
+    uint32_t sum2 = 0xFFFF;
+    for (uint32_t i = 0; i < SMP_BENCH_PAGE_SIZE / 2; i++) {
+      sum1 += words[i];
+      sum2 += sum1;
+      if ((i & 0xFF) == 0xFF) {
+        sum1 = (sum1 & 0xFFFF) + (sum1 >> 16);
+        sum2 = (sum2 & 0xFFFF) + (sum2 >> 16);
+      }
+    }
+    sum1 = (sum1 & 0xFFFF) + (sum1 >> 16);
+    sum2 = (sum2 & 0xFFFF) + (sum2 >> 16);
+    page_sums_[page] = (sum2 << 16) | sum1;
+  }
+}
+
+static uint32_t SMPBenchRun(TaskFunction function) {
+  uint64_t start = x86_ReadTSC();
+  TaskPoolParallelFor(SMP_BENCH_PAGES, function, NULL);
+  return (uint32_t)((x86_ReadTSC() - start) / 1000);
+}
+
+static void SMPBenchPrintRow(const char *name, int cpus, uint32_t kcycles,
+                             uint32_t base) {
+  uint32_t speedup = base * 100 / kcycles;
+  printf("  %s cpus=%d kcycles=%u speedup=%u.%u%u\n", name, cpus, kcycles,
+         speedup / 100, (speedup / 10) % 10, speedup % 10);
+}
+
+// Run each workload on 1..N CPUs, ideal scaling gives speedup = N
+void SMPBenchmark() {
+  int online = SMPOnlineCount();
+  uint32_t zero_base = 0;
+  uint32_t checksum_base = 0;
+
+  printf("SMP benchmark: %u KiB in %u pages\n", SMP_BENCH_SIZE / 1024,
+         SMP_BENCH_PAGES);
+
+  for (int cpus = 1; cpus <= online; cpus++) {
+    TaskPoolSetActiveCpus(cpus);
+
+    uint32_t zero = SMPBenchRun(SMPBenchZero);
+    uint32_t checksum = SMPBenchRun(SMPBenchChecksum);
+    if (cpus == 1) {
+      zero_base = zero;
+      checksum_base = checksum;
+    }
+
+    SMPBenchPrintRow("zero    ", cpus, zero, zero_base);
+    SMPBenchPrintRow("checksum", cpus, checksum, checksum_base);
+  }
+
+  TaskPoolSetActiveCpus(online);
+}
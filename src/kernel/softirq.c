@@ -0,0 +1,156 @@
+#include "softirq.h"
+#include "atomic.h"
+#include "gdt.h"
+#include "percpu.h"
+#include "x86.h"
+#include <stddef.h>
+
+#define SOFTIRQ_QUEUE_MASK (SOFTIRQ_QUEUE_SIZE - 1)
+
+typedef struct {
+  SoftIRQ *softirq;
+  uint32_t event;
+} SoftIRQEntry;
+
+// head and the producer's counters are only written by interrupt handlers,
+// tail and the rest only by the bottom half
+typedef struct {
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  SoftIRQEntry entries[SOFTIRQ_QUEUE_SIZE];
+
+  volatile bool due;     // Enough has gathered for the next interrupt exit
+  volatile bool running; // The bottom half is somewhere on this CPU's stack
+  SoftIRQStats stats;
+} SoftIRQQueue;
+
+static SoftIRQQueue queues_[MAX_CPUS];
+
+static inline SoftIRQQueue *SoftIRQThisQueue() {
+  return &queues_[PerCpuIndex()];
+}
+
+bool SoftIRQRaise(SoftIRQ *softirq, uint32_t event) {
+  SoftIRQQueue *queue = SoftIRQThisQueue();
+  uint32_t head = queue->head;
+  uint32_t count = head - AtomicLoad(&queue->tail);
+  if (count > SOFTIRQ_QUEUE_MASK) {
+    queue->stats.dropped++;
+    queue->due = true;
+    return false;
+  }
+
+  SoftIRQEntry *entry = &queue->entries[head & SOFTIRQ_QUEUE_MASK];
+  entry->softirq = softirq;
+  entry->event = event;
+  AtomicStore(&queue->head, head + 1);
+
+  queue->stats.raised++;
+  if (count + 1 >= softirq->coalesce) {
+    queue->due = true;
+  }
+  return true;
+}
+
+bool SoftIRQPending() {
+  SoftIRQQueue *queue = SoftIRQThisQueue();
+  return AtomicLoad(&queue->head) != queue->tail;
+}
+
+// Take up to a batch off the queue with one store of tail, then hand every
+// handler all of its events in that batch at once
+static uint32_t SoftIRQRunBatch(SoftIRQQueue *queue) {
+  SoftIRQEntry batch[SOFTIRQ_BATCH];
+  uint32_t tail = queue->tail;
+  uint32_t count = AtomicLoad(&queue->head) - tail;
+  if (count > SOFTIRQ_BATCH) {
+    count = SOFTIRQ_BATCH;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    batch[i] = queue->entries[(tail + i) & SOFTIRQ_QUEUE_MASK];
+  }
+  AtomicStore(&queue->tail, tail + count);
+
+  uint32_t events[SOFTIRQ_BATCH];
+  for (uint32_t i = 0; i < count; i++) {
+    SoftIRQ *softirq = batch[i].softirq;
+    if (softirq == NULL) {
+      continue;
+    }
+
+    uint32_t gathered = 0;
+    for (uint32_t j = i; j < count; j++) {
+      if (batch[j].softirq == softirq) {
+        events[gathered++] = batch[j].event;
+        batch[j].softirq = NULL;
+      }
+    }
+    softirq->handler(softirq->context, events, gathered);
+    queue->stats.batches++;
+  }
+
+  queue->stats.handled += count;
+  return count;
+}
+
+// Called with interrupts disabled and running claimed, returns the same way.
+// Events raised meanwhile by interrupts of the batches are picked up too.
+static bool SoftIRQDrain(SoftIRQQueue *queue, uint32_t budget) {
+  queue->due = false;
+  x86_EnableInterrupts();
+
+  uint32_t done = 0;
+  uint32_t count;
+  while (done < budget && (count = SoftIRQRunBatch(queue)) != 0) {
+    done += count;
+  }
+
+  x86_DisableInterrupts();
+  // Out of budget, the next exit carries on where this one stopped
+  if (queue->head != queue->tail) {
+    queue->due = true;
+  }
+  return done != 0;
+}
+
+bool SoftIRQRun() {
+  uint32_t flags = x86_SaveFlagsAndDisableInterrupts();
+  SoftIRQQueue *queue = SoftIRQThisQueue();
+  if (queue->running || queue->head == queue->tail) {
+    x86_RestoreFlags(flags);
+    return false;
+  }
+
+  queue->running = true;
+  bool ran = SoftIRQDrain(queue, UINT32_MAX);
+  queue->running = false;
+  x86_RestoreFlags(flags);
+  return ran;
+}
+
+// An interrupt that arrives while the bottom half runs only queues its
+// events, the loop in SoftIRQDrain takes them before it returns
+void SoftIRQExit() {
+  SoftIRQQueue *queue = SoftIRQThisQueue();
+  if (!queue->due || queue->running) {
+    return;
+  }
+
+  queue->running = true;
+  SoftIRQDrain(queue, SOFTIRQ_EXIT_BUDGET);
+  queue->running = false;
+}
+
+// Counters are read without stopping the CPUs, so the sums may be a few
+// events out while interrupts come in
+void SoftIRQGetStats(SoftIRQStats *stats_out) {
+  SoftIRQStats total = {0};
+  for (int i = 0; i < PerCpuCount(); i++) {
+    const SoftIRQStats *stats = &queues_[i].stats;
+    total.raised += stats->raised;
+    total.dropped += stats->dropped;
+    total.batches += stats->batches;
+    total.handled += stats->handled;
+  }
+  *stats_out = total;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Deferred interrupt work. Top halves only acknowledge their device and
+// raise an event onto the queue of the CPU they run on. The queue is drained
+// in batches with interrupts enabled: on the way out of an interrupt once
+// enough has gathered, and from the idle loop or SoftIRQRun otherwise.
+//
+// Each CPU's queue has a single producer, its interrupt handlers running
+// with interrupts disabled, and a single consumer, the bottom half on the
+// same CPU, so neither side takes a lock.
+
+#define SOFTIRQ_QUEUE_SIZE 256  // NOLINT, events per CPU, a power of two
+#define SOFTIRQ_BATCH 32        // NOLINT, events taken off the queue at once
+#define SOFTIRQ_EXIT_BUDGET 128 // NOLINT, events run per interrupt exit
+
+// Called with the events raised for it since the last call, at most
+// SOFTIRQ_BATCH of them, in the order they were raised. Events only say
+// that something happened: when a queue overflows they are lost, so the
+// handler must find the actual work from the device.
+typedef void (*SoftIRQHandler)(void *context, const uint32_t *events,
+                               uint32_t count);
+
+// Owned by the driver and must stay valid while events may be queued.
+// coalesce is how many events a CPU gathers before an interrupt exit runs
+// its queue, 0 or 1 runs it on the next exit. Fewer wait until the CPU
+// idles or somebody calls SoftIRQRun.
+typedef struct {
+  SoftIRQHandler handler;
+  void *context;
+  uint32_t coalesce;
+} SoftIRQ;
+
+typedef struct {
+  uint32_t raised;
+  uint32_t dropped; // Raised onto a full queue
+  uint32_t batches;
+  uint32_t handled;
+} SoftIRQStats;
+
+// Top halves only, with interrupts disabled. False if the queue was full.
+bool SoftIRQRaise(SoftIRQ *softirq, uint32_t event);
+
+// Whether this CPU has events waiting, with interrupts disabled
+bool SoftIRQPending();
+
+// Drain this CPU's queue with interrupts enabled. False if there was
+// nothing to do or the bottom half is already running further up the stack.
+bool SoftIRQRun();
+
+// The interrupt exit path, with interrupts disabled and the interrupt
+// acknowledged. Runs the queue if it is due, and returns with interrupts
+// disabled again.
+void SoftIRQExit();
+
+void SoftIRQGetStats(SoftIRQStats *stats_out);
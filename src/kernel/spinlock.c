@@ -0,0 +1,91 @@
+#include "spinlock.h"
+#include "atomic.h"
+#include "x86.h"
+#include <stddef.h>
+
+#define SPINLOCK_TICKET 0x10000 // NOLINT
+
+void SpinlockInitialize(Spinlock *lock) { lock->value = 0; }
+
+void SpinlockAcquire(Spinlock *lock) {
+  uint32_t ticket = AtomicAdd(&lock->value, SPINLOCK_TICKET) >> 16;
+  while (lock->tickets.owner != (uint16_t)ticket) {
+    CpuRelax();
+  }
+  CompilerBarrier();
+}
+
+bool SpinlockTryAcquire(Spinlock *lock) {
+  uint32_t value = AtomicLoad(&lock->value);
+  if ((value >> 16) != (value & 0xFFFF)) {
+    return false;
+  }
+  return AtomicTryCompareExchange(&lock->value, value,
+                                  value + SPINLOCK_TICKET);
+}
+
+// Only the owner writes the low half, and a 16-bit store cannot clobber a
+// concurrent xadd on the high half
+void SpinlockRelease(Spinlock *lock) {
+  CompilerBarrier();
+  lock->tickets.owner++;
+}
+
+bool SpinlockIsLocked(Spinlock *lock) {
+  uint32_t value = AtomicLoad(&lock->value);
+  return (value >> 16) != (value & 0xFFFF);
+}
+
+uint32_t SpinlockAcquireIrqSave(Spinlock *lock) {
+  uint32_t flags = x86_SaveFlagsAndDisableInterrupts();
+  SpinlockAcquire(lock);
+  return flags;
+}
+
+void SpinlockReleaseIrqRestore(Spinlock *lock, uint32_t flags) {
+  SpinlockRelease(lock);
+  x86_RestoreFlags(flags);
+}
+
+void MCSLockAcquire(MCSLock *lock, MCSNode *node) {
+  node->next = NULL;
+  node->locked = 1;
+
+  MCSNode *previous = AtomicExchangePointer((void *volatile *)&lock->tail, node);
+  if (previous == NULL) {
+    return;
+  }
+
+  previous->next = node;
+  while (AtomicLoad(&node->locked)) {
+    CpuRelax();
+  }
+}
+
+void MCSLockRelease(MCSLock *lock, MCSNode *node) {
+  if (node->next == NULL) {
+    // No known successor, try to mark the lock free
+    if (AtomicCompareExchangePointer((void *volatile *)&lock->tail, node,
+                                     NULL) == node) {
+      return;
+    }
+
+    // A successor swapped itself in but has not linked up yet
+    while (node->next == NULL) {
+      CpuRelax();
+    }
+  }
+
+  AtomicStore(&node->next->locked, 0);
+}
+
+uint32_t MCSLockAcquireIrqSave(MCSLock *lock, MCSNode *node) {
+  uint32_t flags = x86_SaveFlagsAndDisableInterrupts();
+  MCSLockAcquire(lock, node);
+  return flags;
+}
+
+void MCSLockReleaseIrqRestore(MCSLock *lock, MCSNode *node, uint32_t flags) {
+  MCSLockRelease(lock, node);
+  x86_RestoreFlags(flags);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Ticket lock, CPUs acquire in the order they asked. The owner count lives in
+// the low half so a single xadd on the whole word takes a ticket.
+typedef union {
+  volatile uint32_t value;
+  struct {
+    volatile uint16_t owner;
+    volatile uint16_t next;
+  } tickets;
+} Spinlock;
+
+#define SPINLOCK_INITIALIZER { 0 } // NOLINT
+
+void SpinlockInitialize(Spinlock *lock);
+void SpinlockAcquire(Spinlock *lock);
+bool SpinlockTryAcquire(Spinlock *lock);
+void SpinlockRelease(Spinlock *lock);
+bool SpinlockIsLocked(Spinlock *lock);
+
+// Variants that also keep interrupts off while the lock is held, for data
+// shared with interrupt handlers
+uint32_t SpinlockAcquireIrqSave(Spinlock *lock);
+void SpinlockReleaseIrqRestore(Spinlock *lock, uint32_t flags);
+
+// MCS queue lock, every waiter spins on its own node so contended handoffs
+// touch a single remote cache line. The node must stay valid until released.
+typedef struct MCSNode {
+  struct MCSNode *volatile next;
+  volatile uint32_t locked;
+} MCSNode;
+
+typedef struct {
+  MCSNode *volatile tail;
+} MCSLock;
+
+#define MCS_LOCK_INITIALIZER { 0 } // NOLINT
+
+void MCSLockAcquire(MCSLock *lock, MCSNode *node);
+void MCSLockRelease(MCSLock *lock, MCSNode *node);
+
+uint32_t MCSLockAcquireIrqSave(MCSLock *lock, MCSNode *node);
+void MCSLockReleaseIrqRestore(MCSLock *lock, MCSNode *node, uint32_t flags);
@@ -1,4 +1,8 @@
 #include "stdio.h"
+#include "fbcon.h"
+#include "keyboard.h"
+#include "serial.h"
+#include "spinlock.h"
 #include "x86.h"
 
 #include <stdarg.h>
@@ -12,6 +16,9 @@ uint8_t *screen_buffer_ = (uint8_t *)0xB8000;
 int screen_x_ = 0;
 int screen_y_ = 0;
 
+// Serializes console output between CPUs and interrupt handlers
+static Spinlock console_lock_ = SPINLOCK_INITIALIZER;
+
 void putchr(int x, int y, char c) {
   screen_buffer_[2 * (y * kScreenWidth + x)] = c;
 }
@@ -36,6 +43,15 @@ void setcursor(int x, int y) {
 }
 
 void clrscr() {
+  uint32_t flags = SpinlockAcquireIrqSave(&console_lock_);
+
+  if (FBConIsActive()) {
+    FBConClear();
+    FBConFlush();
+    SpinlockReleaseIrqRestore(&console_lock_, flags);
+    return;
+  }
+
   for (int y = 0; y < kScreenHeight; y++) {
     for (int x = 0; x < kScreenWidth; x++) {
       putchr(x, y, '\0');
@@ -46,6 +62,8 @@ void clrscr() {
   screen_x_ = 0;
   screen_y_ = 0;
   setcursor(screen_x_, screen_y_);
+
+  SpinlockReleaseIrqRestore(&console_lock_, flags);
 }
 
 void scrollback(int lines) {
@@ -66,7 +84,7 @@ void scrollback(int lines) {
   screen_y_ -= lines;
 }
 
-void putc(char c) {
+static void putc_screen(char c) {
   switch (c) {
   case '\n':
     screen_x_ = 0;
@@ -75,7 +93,7 @@ void putc(char c) {
 
   case '\t':
     for (int i = 0; i < 4 - (screen_x_ % 4); i++) {
-      putc(' ');
+      putc_screen(' ');
     }
     break;
 
@@ -100,13 +118,40 @@ void putc(char c) {
   setcursor(screen_x_, screen_y_);
 }
 
-void puts(const char *str) {
+// The console is mirrored to the serial port for headless runs
+static void putc_unlocked(char c) {
+  if (c == '\n') {
+    SerialPutc('\r');
+  }
+  SerialPutc(c);
+  if (FBConIsActive()) {
+    FBConPutc(c);
+  } else {
+    putc_screen(c);
+  }
+}
+
+static void puts_unlocked(const char *str) {
   while (*str) {
-    putc(*str);
+    putc_unlocked(*str);
     str++;
   }
 }
 
+void putc(char c) {
+  uint32_t flags = SpinlockAcquireIrqSave(&console_lock_);
+  putc_unlocked(c);
+  FBConFlush();
+  SpinlockReleaseIrqRestore(&console_lock_, flags);
+}
+
+void puts(const char *str) {
+  uint32_t flags = SpinlockAcquireIrqSave(&console_lock_);
+  puts_unlocked(str);
+  FBConFlush();
+  SpinlockReleaseIrqRestore(&console_lock_, flags);
+}
+
 const char kHexChars[] = "0123456789abcdef";
 
 void printf_unsigned(unsigned long long number, int radix) {
@@ -120,13 +165,13 @@ void printf_unsigned(unsigned long long number, int radix) {
   } while (number > 0);
 
   while (--pos >= 0) {
-    putc(buffer[pos]);
+    putc_unlocked(buffer[pos]);
   }
 }
 
 void printf_signed(long long number, int radix) {
   if (number < 0) {
-    putc('-');
+    putc_unlocked('-');
     printf_unsigned(-number, radix);
   } else {
     printf_unsigned(number, radix);
@@ -152,6 +197,7 @@ enum PrintfLength {
 void printf(const char *fmt, ...) {
   va_list args;
   va_start(args, fmt);
+  uint32_t flags = SpinlockAcquireIrqSave(&console_lock_);
 
   int state = kPrintfStateNormal;
   int length = kPrintfLengthDefault;
@@ -167,7 +213,7 @@ void printf(const char *fmt, ...) {
         state = kPrintfStateLength;
         break;
       default:
-        putc(*fmt);
+        putc_unlocked(*fmt);
         break;
       }
       break;
@@ -205,13 +251,13 @@ void printf(const char *fmt, ...) {
     PRINTF_STATE_SPEC_:
       switch (*fmt) {
       case 'c':
-        putc((char)va_arg(args, int));
+        putc_unlocked((char)va_arg(args, int));
         break;
       case 's':
-        puts(va_arg(args, const char *));
+        puts_unlocked(va_arg(args, const char *));
         break;
       case '%':
-        putc('%');
+        putc_unlocked('%');
         break;
       case 'd':
       case 'i':
@@ -275,10 +321,16 @@ void printf(const char *fmt, ...) {
       length = kPrintfLengthDefault;
       radix = 10;
       sign = false;
+      number = false;
       break;
     }
 
     fmt++;
   }
+
+  FBConFlush();
+  SpinlockReleaseIrqRestore(&console_lock_, flags);
   va_end(args);
 }
+
+char getc() { return KeyboardGetChar(); }
@@ -2,6 +2,7 @@
 #include <stdint.h>
 
 void clrscr();
+char getc();                       // NOLINT
 void putc(char c);                 // NOLINT
 void puts(const char *str);        // NOLINT
 void printf(const char *fmt, ...); // NOLINT
\ No newline at end of file
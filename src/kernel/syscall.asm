@@ -0,0 +1,94 @@
+; System call entry through sysenter, and the user side entries the kernel
+; copies to the start of the shared page (sys/timepage.h)
+
+; Selectors from gdt.h, user ones with RPL 3
+%define SYSCALL_KERNEL_DATA 0x10
+%define SYSCALL_USER_CODE 0x1B
+%define SYSCALL_USER_DATA 0x23
+
+; From sys/image.h and sys/syscall.h
+%define SYSCALL_SHARED_PAGE 0x7FFFF000
+%define SYSCALL_VECTOR 0x80
+
+%define SYSCALL_EFLAGS_TF 0x100
+%define SYSCALL_EFLAGS_IF 0x200
+
+section .text
+
+extern SyscallDispatch
+extern isr_load_per_cpu
+
+; sysenter arrives with interrupts off on the stack in SYSENTER_ESP. Build
+; the frame int 0x80 would have pushed, so one dispatcher serves both.
+; Nothing but the stack may be touched until DS is the kernel's again.
+global syscall_sysenter
+syscall_sysenter:
+    [bits 32]
+    push dword SYSCALL_USER_DATA
+    push ebp
+    pushfd
+    or dword [esp], SYSCALL_EFLAGS_IF
+    push dword SYSCALL_USER_CODE
+    push dword SYSCALL_SHARED_PAGE + (syscall_entry_sysenter.resume - syscall_entry_sysenter)
+    push dword 0
+    push dword SYSCALL_VECTOR
+    pusha
+    push ds
+    push es
+    push fs
+
+    mov ax, SYSCALL_KERNEL_DATA
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    call isr_load_per_cpu
+    cld
+
+    push esp
+    call SyscallDispatch
+    add esp, 4
+
+    ; User code must not keep the per-CPU segment, popa restores eax
+    xor eax, eax
+    mov gs, ax
+
+    pop fs
+    pop es
+    pop ds
+    popa
+    add esp, 8
+
+    ; sysexit continues at edx with the stack at ecx. Flags come back with
+    ; interrupts off until sti, whose shadow covers sysexit.
+    mov edx, [esp]
+    mov ecx, [esp + 12]
+    push dword [esp + 8]
+    and dword [esp], ~(SYSCALL_EFLAGS_IF | SYSCALL_EFLAGS_TF)
+    popfd
+    sti
+    sysexit
+
+; Copied into the shared page, user code calls these with the arguments in
+; registers. ecx and edx are saved because sysexit overwrites them.
+global syscall_entry_sysenter
+global syscall_entry_sysenter_end
+global syscall_entry_int
+global syscall_entry_int_end
+
+syscall_entry_sysenter:
+    push ecx
+    push edx
+    push ebp
+    mov ebp, esp
+    sysenter
+.resume:
+    pop ebp
+    pop edx
+    pop ecx
+    ret
+syscall_entry_sysenter_end:
+
+syscall_entry_int:
+    int SYSCALL_VECTOR
+    ret
+syscall_entry_int_end:
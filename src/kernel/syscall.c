@@ -0,0 +1,319 @@
+#include "syscall.h"
+#include "gdt.h"
+#include "ipc.h"
+#include "memory.h"
+#include "mmap.h"
+#include "page.h"
+#include "paging.h"
+#include "percpu.h"
+#include "process.h"
+#include "stdio.h"
+#include "timepage.h"
+#include "vfs.h"
+#include "x86.h"
+#include <stddef.h>
+
+#define SYSCALL_MSR_SYSENTER_CS 0x174  // NOLINT
+#define SYSCALL_MSR_SYSENTER_ESP 0x175 // NOLINT
+#define SYSCALL_MSR_SYSENTER_EIP 0x176 // NOLINT
+
+#define SYSCALL_WRITE_MAX 4096 // NOLINT
+#define SYSCALL_PATH_MAX 256   // NOLINT
+
+enum SyscallCPUIDBits {
+  kCPUIDFeatureSEP = 1u << 11,
+};
+
+typedef int32_t (*SyscallHandler)(uint32_t arg1, uint32_t arg2,
+                                  uint32_t arg3, uint32_t arg4,
+                                  uint32_t arg5);
+
+extern void syscall_sysenter();
+extern uint8_t syscall_entry_sysenter[], syscall_entry_sysenter_end[];
+extern uint8_t syscall_entry_int[], syscall_entry_int_end[];
+
+static bool sysenter_ = false;
+
+// The Pentium Pro reports SEP without implementing it
+static bool SyscallHasSysenter() {
+  x86_CPUIDResult features;
+  x86_CPUID(1, &features);
+  if (!(features.edx & kCPUIDFeatureSEP)) {
+    return false;
+  }
+
+  uint32_t family = (features.eax >> 8) & 0xF;
+  uint32_t model = (features.eax >> 4) & 0xF;
+  uint32_t stepping = features.eax & 0xF;
+  return !(family == 6 && model < 3 && stepping < 3);
+}
+
+static void SyscallInterrupt(ISRFrame *frame) { SyscallDispatch(frame); }
+
+bool SyscallInitialize() {
+  sysenter_ = SyscallHasSysenter();
+  if (sysenter_) {
+    x86_WriteMSR(SYSCALL_MSR_SYSENTER_CS, kGDTCodeSelector, 0);
+    x86_WriteMSR(SYSCALL_MSR_SYSENTER_EIP, (uint32_t)syscall_sysenter, 0);
+  }
+
+  ISRRegisterHandler(SYSCALL_VECTOR, SyscallInterrupt);
+  ISRAllowUser(SYSCALL_VECTOR);
+
+  const uint8_t *entry = sysenter_ ? syscall_entry_sysenter : syscall_entry_int;
+  const uint8_t *end =
+      sysenter_ ? syscall_entry_sysenter_end : syscall_entry_int_end;
+  if (!TimePageInitialize(entry, end - entry,
+                          sysenter_ ? kTimePageSysenter : 0)) {
+    printf("Syscall: no memory for the shared page\n");
+    return false;
+  }
+
+  printf("Syscall: %s, %u TSC cycles per us\n",
+         sysenter_ ? "sysenter" : "int 0x80", TimePageGet()->tsc_per_us);
+  return true;
+}
+
+void SyscallSetKernelStack(uint32_t esp0) {
+  GDTSetKernelStack(esp0);
+  if (sysenter_) {
+    x86_WriteMSR(SYSCALL_MSR_SYSENTER_ESP, esp0, 0);
+  }
+}
+
+// File mappings are filled in first, the kernel must not fault on them
+static bool SyscallCheckUser(uint32_t address, uint32_t size, bool write) {
+  Process *process = ProcessCurrent();
+  MMapPopulate(&process->maps, &process->space, address, size);
+  return PagingCheckUser(&process->space, address, size, write);
+}
+
+// A NUL-terminated string, checked one page at a time
+static bool SyscallCopyPath(char *path_out, uint32_t address) {
+  for (uint32_t i = 0; i < SYSCALL_PATH_MAX; i++) {
+    if ((i == 0 || (address + i) % PAGE_SIZE == 0) &&
+        !SyscallCheckUser(address + i, 1, false)) {
+      return false;
+    }
+    path_out[i] = ((const char *)address)[i];
+    if (path_out[i] == '\0') {
+      return true;
+    }
+  }
+  return false;
+}
+
+static int32_t SyscallError(int vfs_error) {
+  switch (vfs_error) {
+  case kVFSErrorNotFound:
+    return kSyscallErrorNotFound;
+  case kVFSErrorNoMemory:
+    return kSyscallErrorNoMemory;
+  default:
+    return kSyscallErrorInvalid;
+  }
+}
+
+static int32_t SyscallIPCError(int ipc_error) {
+  switch (ipc_error) {
+  case kIPCErrorNotFound:
+    return kSyscallErrorNotFound;
+  case kIPCErrorNoMemory:
+    return kSyscallErrorNoMemory;
+  default:
+    return kSyscallErrorInvalid;
+  }
+}
+
+static int32_t SyscallNull(uint32_t arg1, uint32_t arg2, uint32_t arg3,
+                           uint32_t arg4, uint32_t arg5) {
+  return 0;
+}
+
+static int32_t SyscallExit(uint32_t status, uint32_t arg2, uint32_t arg3,
+                           uint32_t arg4, uint32_t arg5) {
+  ProcessExit((int)status);
+}
+
+static int32_t SyscallWrite(uint32_t buffer, uint32_t size, uint32_t arg3,
+                            uint32_t arg4, uint32_t arg5) {
+  if (size > SYSCALL_WRITE_MAX) {
+    size = SYSCALL_WRITE_MAX;
+  }
+  if (!SyscallCheckUser(buffer, size, false)) {
+    return kSyscallErrorFault;
+  }
+
+  const char *text = (const char *)buffer;
+  for (uint32_t i = 0; i < size; i++) {
+    putc(text[i]);
+  }
+  return (int32_t)size;
+}
+
+static int32_t SyscallGetCpu(uint32_t arg1, uint32_t arg2, uint32_t arg3,
+                             uint32_t arg4, uint32_t arg5) {
+  return PerCpuIndex();
+}
+
+static int32_t SyscallClock(uint32_t microseconds_out, uint32_t arg2,
+                            uint32_t arg3, uint32_t arg4, uint32_t arg5) {
+  if (!SyscallCheckUser(microseconds_out, sizeof(uint64_t), true)) {
+    return kSyscallErrorFault;
+  }
+
+  *(uint64_t *)microseconds_out = TimePageMicroseconds();
+  return 0;
+}
+
+static int32_t SyscallMap(uint32_t path, uint32_t offset,
+                          uint32_t length_inout, uint32_t arg4,
+                          uint32_t arg5) {
+  char kernel_path[SYSCALL_PATH_MAX];
+  if (!SyscallCopyPath(kernel_path, path) ||
+      !SyscallCheckUser(length_inout, sizeof(uint32_t), true)) {
+    return kSyscallErrorFault;
+  }
+
+  Process *process = ProcessCurrent();
+  uint32_t length = *(uint32_t *)length_inout;
+  uint32_t address;
+  int result =
+      MMapFile(&process->maps, kernel_path, offset, &length, &address);
+  if (result < 0) {
+    return SyscallError(result);
+  }
+
+  *(uint32_t *)length_inout = length;
+  return (int32_t)address;
+}
+
+static int32_t SyscallUnmap(uint32_t address, uint32_t arg2, uint32_t arg3,
+                            uint32_t arg4, uint32_t arg5) {
+  Process *process = ProcessCurrent();
+  int result = MMapUnmap(&process->maps, &process->space, address);
+  return result < 0 ? SyscallError(result) : 0;
+}
+
+static int32_t SyscallPipeCreate(uint32_t arg1, uint32_t arg2, uint32_t arg3,
+                                 uint32_t arg4, uint32_t arg5) {
+  int result = IPCPipeCreate(ProcessCurrent()->id);
+  return result < 0 ? SyscallIPCError(result) : result;
+}
+
+static int32_t SyscallPipeClose(uint32_t pipe, uint32_t arg2, uint32_t arg3,
+                                uint32_t arg4, uint32_t arg5) {
+  int result = IPCPipeClose((int)pipe);
+  return result < 0 ? SyscallIPCError(result) : 0;
+}
+
+// Straight between the ring and user memory, nothing a pipe cannot hold is
+// worth checking
+static int32_t SyscallPipeWrite(uint32_t pipe, uint32_t buffer, uint32_t size,
+                                uint32_t arg4, uint32_t arg5) {
+  if (size > PAGE_SIZE) {
+    size = PAGE_SIZE;
+  }
+  if (!SyscallCheckUser(buffer, size, false)) {
+    return kSyscallErrorFault;
+  }
+
+  int32_t result = IPCPipeWrite((int)pipe, (const void *)buffer, size);
+  return result < 0 ? SyscallIPCError(result) : result;
+}
+
+static int32_t SyscallPipeRead(uint32_t pipe, uint32_t buffer, uint32_t size,
+                               uint32_t arg4, uint32_t arg5) {
+  if (size > PAGE_SIZE) {
+    size = PAGE_SIZE;
+  }
+  if (!SyscallCheckUser(buffer, size, true)) {
+    return kSyscallErrorFault;
+  }
+
+  int32_t result = IPCPipeRead((int)pipe, (void *)buffer, size);
+  return result < 0 ? SyscallIPCError(result) : result;
+}
+
+static int32_t SyscallChannelCreate(uint32_t arg1, uint32_t arg2,
+                                    uint32_t arg3, uint32_t arg4,
+                                    uint32_t arg5) {
+  int result = IPCChannelCreate(ProcessCurrent()->id);
+  return result < 0 ? SyscallIPCError(result) : result;
+}
+
+static int32_t SyscallChannelClose(uint32_t channel, uint32_t arg2,
+                                   uint32_t arg3, uint32_t arg4,
+                                   uint32_t arg5) {
+  int result = IPCChannelClose((int)channel);
+  return result < 0 ? SyscallIPCError(result) : 0;
+}
+
+// The messages are copied in first, they may sit in pages being sent
+static int32_t SyscallChannelSend(uint32_t channel, uint32_t messages,
+                                  uint32_t count, uint32_t arg4,
+                                  uint32_t arg5) {
+  IPCMessage batch[IPC_BATCH_MAX];
+  if (count > IPC_BATCH_MAX) {
+    count = IPC_BATCH_MAX;
+  }
+  if (!SyscallCheckUser(messages, count * sizeof(IPCMessage), false)) {
+    return kSyscallErrorFault;
+  }
+  memcpy(batch, (const void *)messages, count * sizeof(IPCMessage));
+
+  Process *process = ProcessCurrent();
+  int32_t result = IPCChannelSend((int)channel, &process->space,
+                                  &process->maps, batch, count);
+  return result < 0 ? SyscallIPCError(result) : result;
+}
+
+static int32_t SyscallChannelReceive(uint32_t channel, uint32_t messages_out,
+                                     uint32_t count, uint32_t arg4,
+                                     uint32_t arg5) {
+  IPCMessage batch[IPC_BATCH_MAX];
+  if (count > IPC_BATCH_MAX) {
+    count = IPC_BATCH_MAX;
+  }
+  if (!SyscallCheckUser(messages_out, count * sizeof(IPCMessage), true)) {
+    return kSyscallErrorFault;
+  }
+
+  Process *process = ProcessCurrent();
+  int32_t result = IPCChannelReceive((int)channel, &process->space,
+                                     &process->maps, batch, count);
+  if (result < 0) {
+    return SyscallIPCError(result);
+  }
+  memcpy((void *)messages_out, batch, result * sizeof(IPCMessage));
+  return result;
+}
+
+static const SyscallHandler kHandlers[kSyscallCount] = {
+    [kSyscallNull] = SyscallNull,     [kSyscallExit] = SyscallExit,
+    [kSyscallWrite] = SyscallWrite,   [kSyscallGetCpu] = SyscallGetCpu,
+    [kSyscallClock] = SyscallClock,   [kSyscallMap] = SyscallMap,
+    [kSyscallUnmap] = SyscallUnmap,
+    [kSyscallPipeCreate] = SyscallPipeCreate,
+    [kSyscallPipeClose] = SyscallPipeClose,
+    [kSyscallPipeWrite] = SyscallPipeWrite,
+    [kSyscallPipeRead] = SyscallPipeRead,
+    [kSyscallChannelCreate] = SyscallChannelCreate,
+    [kSyscallChannelClose] = SyscallChannelClose,
+    [kSyscallChannelSend] = SyscallChannelSend,
+    [kSyscallChannelReceive] = SyscallChannelReceive,
+};
+
+// Both gates arrive with interrupts off, the handlers run with them on
+void __attribute__((cdecl)) SyscallDispatch(ISRFrame *frame) {
+  x86_EnableInterrupts();
+
+  if (frame->eax < kSyscallCount) {
+    frame->eax = kHandlers[frame->eax](frame->ebx, frame->ecx, frame->edx,
+                                       frame->esi, frame->edi);
+  } else {
+    frame->eax = (uint32_t)kSyscallErrorNoSys;
+  }
+
+  x86_DisableInterrupts();
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "isr.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+
+// Sets up sysenter on the calling CPU when it has it, the int
+// SYSCALL_VECTOR gate and the shared page with the matching entry
+bool SyscallInitialize();
+
+// Stack the CPU switches to when user code enters the kernel
+void SyscallSetKernelStack(uint32_t esp0);
+
+// Called by both entry paths with the user registers, the result goes back
+// in eax
+void __attribute__((cdecl)) SyscallDispatch(ISRFrame *frame);
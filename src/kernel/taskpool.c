@@ -0,0 +1,177 @@
+#include "taskpool.h"
+#include "atomic.h"
+#include "percpu.h"
+#include "smp.h"
+#include <stddef.h>
+
+// Capacity of each per-CPU deque, must be a power of two
+#define TASKPOOL_DEQUE_SIZE 256 // NOLINT
+#define TASKPOOL_DEQUE_MASK (TASKPOOL_DEQUE_SIZE - 1)
+
+// Chunks handed out per active CPU by TaskPoolParallelFor, so that faster
+// CPUs can steal the leftovers of slower ones
+#define TASKPOOL_CHUNKS_PER_CPU 4 // NOLINT
+#define TASKPOOL_MAX_CHUNKS 64    // NOLINT
+
+// Chase-Lev work-stealing deque: the owner pushes and pops at the bottom,
+// thieves take from the top
+typedef struct {
+  volatile uint32_t top;
+  volatile uint32_t bottom;
+  Task *volatile tasks[TASKPOOL_DEQUE_SIZE];
+} __attribute__((aligned(64))) TaskDeque;
+
+static TaskDeque deques_[MAX_CPUS];
+static volatile int active_cpus_ = MAX_CPUS;
+
+// Indices only ever grow, their difference is the number of queued tasks
+static bool TaskDequePush(TaskDeque *deque, Task *task) {
+  uint32_t bottom = deque->bottom;
+  uint32_t top = AtomicLoad(&deque->top);
+  if ((int32_t)(bottom - top) >= TASKPOOL_DEQUE_SIZE) {
+    return false;
+  }
+
+  deque->tasks[bottom & TASKPOOL_DEQUE_MASK] = task;
+  AtomicStore(&deque->bottom, bottom + 1);
+  return true;
+}
+
+static Task *TaskDequePop(TaskDeque *deque) {
+  uint32_t bottom = deque->bottom - 1;
+  deque->bottom = bottom;
+  AtomicFence();
+  uint32_t top = deque->top;
+
+  if ((int32_t)(bottom - top) < 0) {
+    deque->bottom = bottom + 1;
+    return NULL;
+  }
+
+  Task *task = deque->tasks[bottom & TASKPOOL_DEQUE_MASK];
+  if (top == bottom) {
+    // Last task, race the thieves for it
+    if (!AtomicTryCompareExchange(&deque->top, top, top + 1)) {
+      task = NULL;
+    }
+    deque->bottom = bottom + 1;
+  }
+
+  return task;
+}
+
+static Task *TaskDequeSteal(TaskDeque *deque) {
+  uint32_t top = AtomicLoad(&deque->top);
+  uint32_t bottom = AtomicLoad(&deque->bottom);
+
+  if ((int32_t)(bottom - top) <= 0) {
+    return NULL;
+  }
+
+  Task *task = deque->tasks[top & TASKPOOL_DEQUE_MASK];
+  if (!AtomicTryCompareExchange(&deque->top, top, top + 1)) {
+    return NULL;
+  }
+
+  return task;
+}
+
+static void TaskRun(Task *task) {
+  TaskGroup *group = task->group;
+  task->function(task->argument, task->begin, task->end);
+  AtomicSub(&group->pending, 1);
+}
+
+static Task *TaskFind(int cpu) {
+  Task *task = TaskDequePop(&deques_[cpu]);
+  if (task != NULL) {
+    return task;
+  }
+
+  // Start at the next CPU so that thieves spread over the victims
+  int count = PerCpuCount();
+  for (int i = 1; i < count; i++) {
+    int victim = (cpu + i) % count;
+    task = TaskDequeSteal(&deques_[victim]);
+    if (task != NULL) {
+      return task;
+    }
+  }
+
+  return NULL;
+}
+
+void TaskPoolSubmit(TaskGroup *group, Task *task) {
+  task->group = group;
+  AtomicIncrement(&group->pending);
+
+  // A full deque degrades to running the task inline
+  if (!TaskDequePush(&deques_[PerCpuIndex()], task)) {
+    TaskRun(task);
+  }
+}
+
+// Help with any available work, not just the group's, until it is done
+void TaskPoolWait(TaskGroup *group) {
+  int cpu = PerCpuIndex();
+  while (AtomicLoad(&group->pending) > 0) {
+    Task *task = TaskFind(cpu);
+    if (task != NULL) {
+      TaskRun(task);
+    } else {
+      CpuRelax();
+    }
+  }
+}
+
+void TaskPoolParallelFor(uint32_t count, TaskFunction function,
+                         void *argument) {
+  Task tasks[TASKPOOL_MAX_CHUNKS];
+  TaskGroup group = { 0 };
+
+  uint32_t chunks = TaskPoolActiveCpus() * TASKPOOL_CHUNKS_PER_CPU;
+  if (chunks > TASKPOOL_MAX_CHUNKS) {
+    chunks = TASKPOOL_MAX_CHUNKS;
+  }
+  if (chunks > count) {
+    chunks = count;
+  }
+
+  uint32_t begin = 0;
+  for (uint32_t i = 0; i < chunks; i++) {
+    uint32_t end = begin + (count - begin) / (chunks - i);
+    tasks[i].function = function;
+    tasks[i].argument = argument;
+    tasks[i].begin = begin;
+    tasks[i].end = end;
+    TaskPoolSubmit(&group, &tasks[i]);
+    begin = end;
+  }
+
+  TaskPoolWait(&group);
+}
+
+// Main loop of every application processor
+void TaskPoolWorker() {
+  int cpu = PerCpuIndex();
+  for (;;) {
+    Task *task = NULL;
+    if (cpu < active_cpus_) {
+      task = TaskFind(cpu);
+    }
+
+    if (task != NULL) {
+      TaskRun(task);
+    } else {
+      CpuRelax();
+    }
+  }
+}
+
+// Limit stealing to the first count CPUs, used to measure scaling
+void TaskPoolSetActiveCpus(int count) { active_cpus_ = count; }
+
+int TaskPoolActiveCpus() {
+  int online = SMPOnlineCount();
+  return (active_cpus_ < online) ? active_cpus_ : online;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef void (*TaskFunction)(void *argument, uint32_t begin, uint32_t end);
+
+typedef struct {
+  volatile uint32_t pending;
+} TaskGroup;
+
+typedef struct {
+  TaskFunction function;
+  void *argument;
+  uint32_t begin;
+  uint32_t end;
+  TaskGroup *group;
+} Task;
+
+void TaskPoolSubmit(TaskGroup *group, Task *task);
+void TaskPoolWait(TaskGroup *group);
+void TaskPoolParallelFor(uint32_t count, TaskFunction function,
+                         void *argument);
+void TaskPoolWorker();
+
+void TaskPoolSetActiveCpus(int count);
+int TaskPoolActiveCpus();
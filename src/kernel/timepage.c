@@ -0,0 +1,82 @@
+#include "timepage.h"
+#include "atomic.h"
+#include "boot.h"
+#include "gdt.h"
+#include "memory.h"
+#include "page.h"
+#include "pit.h"
+#include "smp.h"
+#include "x86.h"
+#include <stddef.h>
+
+#define TIMEPAGE_CALIBRATION_US 10000 // NOLINT
+
+static TimePage *page_;
+
+static uint64_t TimePageMicrosecondsAt(uint64_t tsc) {
+  return page_->us_base + (tsc - page_->tsc_base) / page_->tsc_per_us;
+}
+
+// Rebase the clock on the current TSC reading, as a seqlock writer since
+// readers in user mode only see the sequence. Only initialization calls it,
+// on the BSP, so there is no lock.
+static void TimePageUpdate() {
+  uint32_t flags = x86_SaveFlagsAndDisableInterrupts();
+  uint64_t now = x86_ReadTSC();
+  uint64_t us = TimePageMicrosecondsAt(now);
+
+  page_->sequence++;
+  CompilerBarrier();
+  page_->tsc_base = now;
+  page_->us_base = us;
+  CompilerBarrier();
+  page_->sequence++;
+
+  x86_RestoreFlags(flags);
+}
+
+bool TimePageInitialize(const void *entry, uint32_t entry_size,
+                        uint32_t flags) {
+  if (entry_size > TIMEPAGE_ENTRY_SIZE) {
+    return false;
+  }
+
+  page_ = PageAlloc();
+  if (page_ == NULL) {
+    return false;
+  }
+  memset(page_, 0, PAGE_SIZE);
+  memcpy(page_->syscall_entry, entry, entry_size);
+  page_->flags = flags;
+  page_->tss_selector_base = kGDTTaskStateSelector;
+  page_->cpu_count = SMPOnlineCount();
+
+  uint64_t start = x86_ReadTSC();
+  PITDelay(TIMEPAGE_CALIBRATION_US);
+  uint64_t end = x86_ReadTSC();
+  page_->tsc_per_us = (uint32_t)((end - start) / TIMEPAGE_CALIBRATION_US);
+  if (page_->tsc_per_us == 0) {
+    page_->tsc_per_us = 1;
+  }
+
+  // Time starts at the first kernel instruction
+  page_->tsc_base = BootGetParams()->timestamps[kBootPhaseKernelEntry];
+  page_->us_base = 0;
+  TimePageUpdate();
+  return true;
+}
+
+TimePage *TimePageGet() { return page_; }
+
+uint64_t TimePageMicroseconds() {
+  uint32_t sequence;
+  uint64_t us;
+  do {
+    while ((sequence = AtomicLoad(&page_->sequence)) & 1) {
+      CpuRelax();
+    }
+    us = TimePageMicrosecondsAt(x86_ReadTSC());
+    CompilerBarrier();
+  } while (page_->sequence != sequence);
+  return us;
+}
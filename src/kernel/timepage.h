@@ -0,0 +1,13 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/timepage.h>
+
+// The kernel side of the shared page. Initialization calibrates the TSC and
+// copies the system call entry, which must fit TIMEPAGE_ENTRY_SIZE. The
+// clock fields are written once at boot, readers extrapolate from the TSC.
+bool TimePageInitialize(const void *entry, uint32_t entry_size,
+                        uint32_t flags);
+TimePage *TimePageGet();
+
+uint64_t TimePageMicroseconds();
@@ -0,0 +1,319 @@
+#include "tmpfs.h"
+#include "memory.h"
+#include "page.h"
+#include "spinlock.h"
+#include "vfs.h"
+#include <stddef.h>
+
+#define TMPFS_MAX_NODES 512 // NOLINT
+
+// Interior radix nodes are page frames full of pointers, so two levels
+// index 2^20 pages, every byte a 32-bit size can reach
+#define TMPFS_RADIX_SHIFT 10 // NOLINT
+#define TMPFS_RADIX_SLOTS (1u << TMPFS_RADIX_SHIFT)
+#define TMPFS_RADIX_MASK (TMPFS_RADIX_SLOTS - 1)
+#define TMPFS_MAX_HEIGHT 2 // NOLINT
+
+typedef struct TmpFSNode {
+  char name[VFS_NAME_MAX + 1];
+  uint32_t length;
+  uint32_t type;
+  uint32_t ino;
+
+  // Namespace, guarded by the tmpfs lock. Children are kept in creation
+  // order so readdir positions stay valid while entries are added.
+  struct TmpFSNode *parent;
+  struct TmpFSNode *first_child;
+  struct TmpFSNode *last_child;
+  struct TmpFSNode *next;
+
+  // Contents, guarded by the node lock. A height of h covers
+  // TMPFS_RADIX_SLOTS^h pages, height 0 is a single data page at the root.
+  Spinlock lock;
+  uint32_t size;
+  void *radix_root;
+  uint32_t radix_height;
+} TmpFSNode;
+
+static TmpFSNode nodes_[TMPFS_MAX_NODES];
+static TmpFSNode *free_nodes_;
+static Spinlock lock_ = SPINLOCK_INITIALIZER;
+
+static const VFSInodeOperations kTmpFSInodeOperations;
+static const VFSFileOperations kTmpFSFileOperations;
+
+static TmpFSNode *TmpFSAllocNode(uint32_t type) {
+  TmpFSNode *node = free_nodes_;
+  if (node == NULL) {
+    return NULL;
+  }
+  free_nodes_ = node->next;
+
+  uint32_t ino = node->ino;
+  memset(node, 0, sizeof(*node));
+  node->ino = ino;
+  node->type = type;
+  SpinlockInitialize(&node->lock);
+  return node;
+}
+
+static VFSInode *TmpFSGetInode(VFSSuperBlock *super, TmpFSNode *node) {
+  VFSInode template = {
+      .ino = node->ino,
+      .type = node->type,
+      .size = node->size,
+      .operations = &kTmpFSInodeOperations,
+      .file_operations = &kTmpFSFileOperations,
+  };
+  template.fs_data[0] = (uintptr_t)node;
+  return VFSGetInode(super, &template);
+}
+
+static TmpFSNode *TmpFSFindChildLocked(TmpFSNode *directory, const char *name,
+                                       uint32_t length) {
+  TmpFSNode *child = directory->first_child;
+  while (child != NULL && (child->length != length ||
+                           memcmp(child->name, name, length) != 0)) {
+    child = child->next;
+  }
+  return child;
+}
+
+static int TmpFSLookup(VFSInode *directory, const char *name, uint32_t length,
+                       VFSInode **inode_out) {
+  SpinlockAcquire(&lock_);
+  TmpFSNode *child =
+      TmpFSFindChildLocked((TmpFSNode *)directory->fs_data[0], name, length);
+  SpinlockRelease(&lock_);
+  if (child == NULL) {
+    return kVFSErrorNotFound;
+  }
+
+  // Nodes are never freed, so the pointer stays good without the lock
+  *inode_out = TmpFSGetInode(directory->super, child);
+  return *inode_out != NULL ? 0 : kVFSErrorNoMemory;
+}
+
+static int TmpFSCreate(VFSInode *directory, const char *name, uint32_t length,
+                       uint32_t type, VFSInode **inode_out) {
+  if (type != kVFSRegular && type != kVFSDirectory) {
+    return kVFSErrorInvalid;
+  }
+
+  TmpFSNode *parent = (TmpFSNode *)directory->fs_data[0];
+  SpinlockAcquire(&lock_);
+  if (TmpFSFindChildLocked(parent, name, length) != NULL) {
+    SpinlockRelease(&lock_);
+    return kVFSErrorExists;
+  }
+  TmpFSNode *node = TmpFSAllocNode(type);
+  if (node == NULL) {
+    SpinlockRelease(&lock_);
+    return kVFSErrorNoMemory;
+  }
+
+  memcpy(node->name, name, length);
+  node->length = length;
+  node->parent = parent;
+  if (parent->last_child != NULL) {
+    parent->last_child->next = node;
+  } else {
+    parent->first_child = node;
+  }
+  parent->last_child = node;
+  SpinlockRelease(&lock_);
+
+  *inode_out = TmpFSGetInode(directory->super, node);
+  return *inode_out != NULL ? 0 : kVFSErrorNoMemory;
+}
+
+// Data page index of the file, NULL for a hole. With allocate set, holes on
+// the way are filled, and the data page is cleared unless overwrite says
+// the caller is about to write all of it.
+static void *TmpFSFindPageLocked(TmpFSNode *node, uint32_t index,
+                                 bool allocate, bool overwrite) {
+  uint32_t height = node->radix_height;
+  while (height < TMPFS_MAX_HEIGHT &&
+         (index >> (height * TMPFS_RADIX_SHIFT)) != 0) {
+    height++;
+  }
+
+  // Grow the tree upwards, the old root becomes the first slot
+  if (height != node->radix_height) {
+    if (!allocate) {
+      return NULL;
+    }
+    if (node->radix_root == NULL) {
+      node->radix_height = height;
+    }
+    while (node->radix_height < height) {
+      void **table = PageAllocZeroed();
+      if (table == NULL) {
+        return NULL;
+      }
+      table[0] = node->radix_root;
+      node->radix_root = table;
+      node->radix_height++;
+    }
+  }
+
+  void **slot = &node->radix_root;
+  for (uint32_t level = node->radix_height; level > 0; level--) {
+    if (*slot == NULL) {
+      if (!allocate || (*slot = PageAllocZeroed()) == NULL) {
+        return NULL;
+      }
+    }
+    void **table = *slot;
+    slot = &table[(index >> ((level - 1) * TMPFS_RADIX_SHIFT)) &
+                  TMPFS_RADIX_MASK];
+  }
+
+  if (*slot == NULL && allocate) {
+    *slot = overwrite ? PageAlloc() : PageAllocZeroed();
+  }
+  return *slot;
+}
+
+// Straight from the page frames into the caller's buffer, holes read as
+// zeros without allocating anything
+static int32_t TmpFSRead(VFSFile *file, void *buffer, uint32_t size) {
+  TmpFSNode *node = (TmpFSNode *)file->inode->fs_data[0];
+  uint8_t *out = buffer;
+
+  SpinlockAcquire(&node->lock);
+  uint32_t position = file->position;
+  if (position >= node->size) {
+    SpinlockRelease(&node->lock);
+    return 0;
+  }
+  if (size > node->size - position) {
+    size = node->size - position;
+  }
+
+  uint32_t done = 0;
+  while (done < size) {
+    uint32_t offset = position % PAGE_SIZE;
+    uint32_t take = PAGE_SIZE - offset;
+    if (take > size - done) {
+      take = size - done;
+    }
+
+    const uint8_t *page =
+        TmpFSFindPageLocked(node, position >> PAGE_SHIFT, false, false);
+    if (page != NULL) {
+      memcpy(out + done, page + offset, take);
+    } else {
+      memset(out + done, 0, take);
+    }
+    done += take;
+    position += take;
+  }
+  SpinlockRelease(&node->lock);
+
+  return (int32_t)done;
+}
+
+static int32_t TmpFSWrite(VFSFile *file, const void *buffer, uint32_t size) {
+  TmpFSNode *node = (TmpFSNode *)file->inode->fs_data[0];
+  const uint8_t *in = buffer;
+  uint32_t position = file->position;
+  if (size > UINT32_MAX - position) {
+    size = UINT32_MAX - position;
+  }
+  if (size > INT32_MAX) {
+    size = INT32_MAX;
+  }
+
+  SpinlockAcquire(&node->lock);
+  uint32_t done = 0;
+  while (done < size) {
+    uint32_t offset = position % PAGE_SIZE;
+    uint32_t take = PAGE_SIZE - offset;
+    if (take > size - done) {
+      take = size - done;
+    }
+
+    uint8_t *page = TmpFSFindPageLocked(node, position >> PAGE_SHIFT, true,
+                                        take == PAGE_SIZE);
+    if (page == NULL) {
+      break;
+    }
+    memcpy(page + offset, in + done, take);
+    done += take;
+    position += take;
+  }
+
+  if (position > node->size) {
+    node->size = position;
+    file->inode->size = position;
+  }
+  SpinlockRelease(&node->lock);
+
+  return done > 0 || size == 0 ? (int32_t)done : kVFSErrorNoMemory;
+}
+
+// file->position counts children in creation order
+static int32_t TmpFSReadDirectory(VFSFile *file, VFSDirectoryEntry *entries,
+                                  uint32_t count) {
+  TmpFSNode *directory = (TmpFSNode *)file->inode->fs_data[0];
+
+  SpinlockAcquire(&lock_);
+  TmpFSNode *child = directory->first_child;
+  for (uint32_t i = 0; i < file->position && child != NULL; i++) {
+    child = child->next;
+  }
+
+  uint32_t filled = 0;
+  for (; child != NULL && filled < count; child = child->next) {
+    VFSDirectoryEntry *entry = &entries[filled++];
+    memcpy(entry->name, child->name, child->length + 1);
+    entry->type = child->type;
+    entry->size = child->size;
+  }
+  SpinlockRelease(&lock_);
+
+  file->position += filled;
+  return (int32_t)filled;
+}
+
+static const VFSInodeOperations kTmpFSInodeOperations = {
+    .lookup = TmpFSLookup,
+    .create = TmpFSCreate,
+};
+
+static const VFSFileOperations kTmpFSFileOperations = {
+    .read = TmpFSRead,
+    .write = TmpFSWrite,
+    .readdir = TmpFSReadDirectory,
+};
+
+static int TmpFSMount(VFSSuperBlock *super, BlockDevice *device) {
+  if (device != NULL) {
+    return kVFSErrorInvalid;
+  }
+
+  SpinlockAcquire(&lock_);
+  TmpFSNode *root = TmpFSAllocNode(kVFSDirectory);
+  SpinlockRelease(&lock_);
+  if (root == NULL) {
+    return kVFSErrorNoMemory;
+  }
+
+  super->root = TmpFSGetInode(super, root);
+  return super->root != NULL ? 0 : kVFSErrorNoMemory;
+}
+
+static VFSFileSystem fs_ = {
+    .name = "tmpfs",
+    .mount = TmpFSMount,
+};
+
+void TmpFSInitialize() {
+  for (int i = TMPFS_MAX_NODES - 1; i >= 0; i--) {
+    nodes_[i].ino = i + 1;
+    nodes_[i].next = free_nodes_;
+    free_nodes_ = &nodes_[i];
+  }
+  VFSRegister(&fs_);
+}
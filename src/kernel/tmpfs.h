@@ -0,0 +1,4 @@
+#pragma once
+
+// Files in page frames for the VFS, registered as "tmpfs"
+void TmpFSInitialize();
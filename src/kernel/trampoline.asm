@@ -0,0 +1,65 @@
+; Application processor startup code
+;
+; The 16-bit part is copied to a page below 1 MiB and entered in real mode
+; through the startup IPI, with cs pointing at that page and ip = 0. It loads
+; the kernel GDT from the parameter block the BSP fills in at the end of the
+; copy, then far jumps into the 32-bit part which runs from the kernel image.
+
+section .text
+
+extern smp_ap_stacks_
+extern smp_ap_cpus_
+extern SMPApMain
+
+global smp_trampoline_start
+global smp_trampoline_gdtr
+global smp_trampoline_end
+
+smp_trampoline_start:
+    [bits 16]
+    cli
+    cld
+
+    mov ax, cs
+    mov ds, ax
+
+    o32 lgdt [smp_trampoline_gdtr - smp_trampoline_start]
+
+    mov eax, cr0
+    or al, 1
+    mov cr0, eax
+
+    jmp dword 08h:smp_ap_pmode
+
+                    align 4
+smp_trampoline_gdtr:
+                    dw 0                ; limit, filled in by the BSP
+                    dd 0                ; base, filled in by the BSP
+
+smp_trampoline_end:
+
+smp_ap_pmode:
+    [bits 32]
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov ss, ax
+
+    ; Every AP finds its own parameters by initial APIC id, so one that
+    ; arrives late cannot take over the slot of the CPU started after it
+    mov eax, 1
+    cpuid
+    shr ebx, 24
+    mov esp, [smp_ap_stacks_ + ebx * 4]
+    test esp, esp
+    jz .halt
+    xor ebp, ebp
+
+    push dword [smp_ap_cpus_ + ebx * 4]
+    call SMPApMain
+
+.halt:
+    cli
+    hlt
+    jmp .halt
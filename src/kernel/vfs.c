@@ -0,0 +1,724 @@
+#include "vfs.h"
+#include "memory.h"
+#include "pagecache.h"
+#include "spinlock.h"
+#include "stdio.h"
+#include <stddef.h>
+
+#define VFS_DENTRY_COUNT 256       // NOLINT
+#define VFS_DENTRY_BUCKETS 256     // NOLINT
+#define VFS_INODE_COUNT 256        // NOLINT
+#define VFS_INODE_BUCKETS 128      // NOLINT
+#define VFS_MAX_MOUNTS 8           // NOLINT
+#define VFS_FNV_OFFSET 2166136261u // NOLINT
+#define VFS_FNV_PRIME 16777619u    // NOLINT
+
+struct VFSDentry {
+  char name[VFS_NAME_MAX + 1];
+  uint32_t length;
+  uint32_t hash;
+  VFSDentry *parent; // Referenced, NULL for mount roots
+  VFSInode *inode;   // Referenced, NULL for a negative entry
+
+  // A mount root points at the directory it covers and back
+  VFSDentry *mounted;
+  VFSDentry *covered;
+
+  uint32_t references;
+  bool hashed;
+  VFSDentry *hash_next;
+  VFSDentry *lru_previous;
+  VFSDentry *lru_next;
+};
+
+static Spinlock lock_ = SPINLOCK_INITIALIZER;
+static VFSFileSystem *filesystems_;
+
+// Both caches keep their unused entries on a list, least recently used at
+// the head. Slots never handed out sit on a free list instead.
+static VFSDentry dentries_[VFS_DENTRY_COUNT];
+static VFSDentry *dentry_buckets_[VFS_DENTRY_BUCKETS];
+static VFSDentry *dentry_free_;
+static VFSDentry *dentry_lru_head_;
+static VFSDentry *dentry_lru_tail_;
+
+static VFSInode inodes_[VFS_INODE_COUNT];
+static VFSInode *inode_buckets_[VFS_INODE_BUCKETS];
+static VFSInode *inode_free_;
+static VFSInode *inode_lru_head_;
+static VFSInode *inode_lru_tail_;
+
+static VFSSuperBlock supers_[VFS_MAX_MOUNTS];
+static VFSDentry *root_;
+
+static VFSCacheStats stats_;
+
+static uint32_t VFSHashName(const VFSDentry *parent, const char *name,
+                            uint32_t length) {
+  uint32_t hash = VFS_FNV_OFFSET ^ (uint32_t)parent;
+  for (uint32_t i = 0; i < length; i++) {
+    hash = (hash ^ (uint8_t)name[i]) * VFS_FNV_PRIME;
+  }
+  return hash;
+}
+
+static uint32_t VFSInodeBucket(const VFSSuperBlock *super, uint32_t ino) {
+  return ((uint32_t)super / sizeof(VFSSuperBlock) + ino * 2654435761u) %
+         VFS_INODE_BUCKETS;
+}
+
+void VFSInitialize() {
+  for (int i = VFS_DENTRY_COUNT - 1; i >= 0; i--) {
+    dentries_[i].hash_next = dentry_free_;
+    dentry_free_ = &dentries_[i];
+  }
+  for (int i = VFS_INODE_COUNT - 1; i >= 0; i--) {
+    inodes_[i].hash_next = inode_free_;
+    inode_free_ = &inodes_[i];
+  }
+}
+
+void VFSRegister(VFSFileSystem *fs) {
+  SpinlockAcquire(&lock_);
+  fs->next = filesystems_;
+  filesystems_ = fs;
+  SpinlockRelease(&lock_);
+}
+
+//
+// Inode cache
+//
+
+static void VFSInodeLruRemove(VFSInode *inode) {
+  if (inode->lru_previous != NULL) {
+    inode->lru_previous->lru_next = inode->lru_next;
+  } else {
+    inode_lru_head_ = inode->lru_next;
+  }
+  if (inode->lru_next != NULL) {
+    inode->lru_next->lru_previous = inode->lru_previous;
+  } else {
+    inode_lru_tail_ = inode->lru_previous;
+  }
+  inode->lru_previous = NULL;
+  inode->lru_next = NULL;
+}
+
+static void VFSInodeLruAppend(VFSInode *inode) {
+  inode->lru_next = NULL;
+  inode->lru_previous = inode_lru_tail_;
+  if (inode_lru_tail_ != NULL) {
+    inode_lru_tail_->lru_next = inode;
+  } else {
+    inode_lru_head_ = inode;
+  }
+  inode_lru_tail_ = inode;
+}
+
+static void VFSInodeUnhash(VFSInode *inode) {
+  VFSInode **link = &inode_buckets_[VFSInodeBucket(inode->super, inode->ino)];
+  while (*link != inode) {
+    link = &(*link)->hash_next;
+  }
+  *link = inode->hash_next;
+}
+
+// The filesystem forgets its part before the slot is reused
+static VFSInode *VFSInodeAllocLocked() {
+  VFSInode *inode = inode_free_;
+  if (inode != NULL) {
+    inode_free_ = inode->hash_next;
+    return inode;
+  }
+
+  inode = inode_lru_head_;
+  if (inode == NULL) {
+    return NULL;
+  }
+  VFSInodeLruRemove(inode);
+  VFSInodeUnhash(inode);
+  if (inode->super->operations != NULL &&
+      inode->super->operations->evict != NULL) {
+    inode->super->operations->evict(inode);
+  }
+  stats_.inode_reclaims++;
+  return inode;
+}
+
+VFSInode *VFSGetInode(VFSSuperBlock *super, const VFSInode *template) {
+  SpinlockAcquire(&lock_);
+
+  uint32_t bucket = VFSInodeBucket(super, template->ino);
+  VFSInode *inode = inode_buckets_[bucket];
+  while (inode != NULL &&
+         (inode->super != super || inode->ino != template->ino)) {
+    inode = inode->hash_next;
+  }
+
+  if (inode != NULL) {
+    if (inode->references++ == 0) {
+      VFSInodeLruRemove(inode);
+    }
+    stats_.inode_hits++;
+  } else if ((inode = VFSInodeAllocLocked()) != NULL) {
+    *inode = *template;
+    inode->super = super;
+    inode->references = 1;
+    inode->lru_previous = NULL;
+    inode->lru_next = NULL;
+    inode->hash_next = inode_buckets_[bucket];
+    inode_buckets_[bucket] = inode;
+    stats_.inode_misses++;
+  }
+
+  SpinlockRelease(&lock_);
+  return inode;
+}
+
+static void VFSReleaseInodeLocked(VFSInode *inode) {
+  if (--inode->references == 0) {
+    VFSInodeLruAppend(inode);
+  }
+}
+
+void VFSReleaseInode(VFSInode *inode) {
+  SpinlockAcquire(&lock_);
+  VFSReleaseInodeLocked(inode);
+  SpinlockRelease(&lock_);
+}
+
+//
+// Dentry cache
+//
+
+static void VFSDentryLruRemove(VFSDentry *dentry) {
+  if (dentry->lru_previous != NULL) {
+    dentry->lru_previous->lru_next = dentry->lru_next;
+  } else {
+    dentry_lru_head_ = dentry->lru_next;
+  }
+  if (dentry->lru_next != NULL) {
+    dentry->lru_next->lru_previous = dentry->lru_previous;
+  } else {
+    dentry_lru_tail_ = dentry->lru_previous;
+  }
+  dentry->lru_previous = NULL;
+  dentry->lru_next = NULL;
+}
+
+static void VFSDentryLruAppend(VFSDentry *dentry) {
+  dentry->lru_next = NULL;
+  dentry->lru_previous = dentry_lru_tail_;
+  if (dentry_lru_tail_ != NULL) {
+    dentry_lru_tail_->lru_next = dentry;
+  } else {
+    dentry_lru_head_ = dentry;
+  }
+  dentry_lru_tail_ = dentry;
+}
+
+static void VFSDentryUnhash(VFSDentry *dentry) {
+  VFSDentry **link = &dentry_buckets_[dentry->hash % VFS_DENTRY_BUCKETS];
+  while (*link != dentry) {
+    link = &(*link)->hash_next;
+  }
+  *link = dentry->hash_next;
+  dentry->hashed = false;
+}
+
+static void VFSReleaseDentryLocked(VFSDentry *dentry);
+
+// Only unused dentries are on the LRU list, and a dentry with cached
+// children is in use by them, so reclaim always takes leaves
+static VFSDentry *VFSDentryAllocLocked() {
+  VFSDentry *dentry = dentry_free_;
+  if (dentry != NULL) {
+    dentry_free_ = dentry->hash_next;
+    return dentry;
+  }
+
+  dentry = dentry_lru_head_;
+  if (dentry == NULL) {
+    return NULL;
+  }
+  VFSDentryLruRemove(dentry);
+  if (dentry->hashed) {
+    VFSDentryUnhash(dentry);
+  }
+  if (dentry->inode != NULL) {
+    VFSReleaseInodeLocked(dentry->inode);
+  }
+  if (dentry->parent != NULL) {
+    VFSReleaseDentryLocked(dentry->parent);
+  }
+  stats_.dentry_reclaims++;
+  return dentry;
+}
+
+static void VFSReleaseDentryLocked(VFSDentry *dentry) {
+  if (--dentry->references == 0) {
+    VFSDentryLruAppend(dentry);
+  }
+}
+
+static void VFSReleaseDentry(VFSDentry *dentry) {
+  SpinlockAcquire(&lock_);
+  VFSReleaseDentryLocked(dentry);
+  SpinlockRelease(&lock_);
+}
+
+static void VFSGetDentryLocked(VFSDentry *dentry) {
+  if (dentry->references++ == 0) {
+    VFSDentryLruRemove(dentry);
+  }
+}
+
+static VFSDentry *VFSFindDentryLocked(VFSDentry *parent, const char *name,
+                                      uint32_t length, uint32_t hash) {
+  VFSDentry *dentry = dentry_buckets_[hash % VFS_DENTRY_BUCKETS];
+  while (dentry != NULL &&
+         (dentry->hash != hash || dentry->parent != parent ||
+          dentry->length != length || memcmp(dentry->name, name, length))) {
+    dentry = dentry->hash_next;
+  }
+  return dentry;
+}
+
+// Takes over the inode reference, fails only when every dentry is in use
+static VFSDentry *VFSNewDentryLocked(VFSDentry *parent, const char *name,
+                                     uint32_t length, uint32_t hash,
+                                     VFSInode *inode) {
+  VFSDentry *dentry = VFSDentryAllocLocked();
+  if (dentry == NULL) {
+    return NULL;
+  }
+
+  memcpy(dentry->name, name, length);
+  dentry->name[length] = '\0';
+  dentry->length = length;
+  dentry->hash = hash;
+  dentry->parent = parent;
+  dentry->inode = inode;
+  dentry->mounted = NULL;
+  dentry->covered = NULL;
+  dentry->references = 1;
+  dentry->lru_previous = NULL;
+  dentry->lru_next = NULL;
+  dentry->hashed = parent != NULL;
+  if (parent != NULL) {
+    VFSGetDentryLocked(parent);
+    dentry->hash_next = dentry_buckets_[hash % VFS_DENTRY_BUCKETS];
+    dentry_buckets_[hash % VFS_DENTRY_BUCKETS] = dentry;
+  }
+  return dentry;
+}
+
+// Child of a directory, from the cache or the filesystem. Negative results
+// are cached too, so a missing name costs the disk only once.
+static int VFSLookupChild(VFSDentry *parent, const char *name,
+                          uint32_t length, VFSDentry **child_out) {
+  uint32_t hash = VFSHashName(parent, name, length);
+
+  SpinlockAcquire(&lock_);
+  VFSDentry *child = VFSFindDentryLocked(parent, name, length, hash);
+  if (child != NULL) {
+    VFSGetDentryLocked(child);
+    stats_.dentry_hits++;
+  }
+  SpinlockRelease(&lock_);
+
+  if (child == NULL) {
+    VFSInode *directory = parent->inode;
+    VFSInode *inode = NULL;
+    int result = directory->operations->lookup(directory, name, length, &inode);
+    if (result < 0 && result != kVFSErrorNotFound) {
+      return result;
+    }
+
+    // Another CPU may have raced us to the same name
+    SpinlockAcquire(&lock_);
+    stats_.dentry_misses++;
+    child = VFSFindDentryLocked(parent, name, length, hash);
+    if (child != NULL) {
+      VFSGetDentryLocked(child);
+      if (inode != NULL) {
+        VFSReleaseInodeLocked(inode);
+      }
+    } else {
+      child = VFSNewDentryLocked(parent, name, length, hash, inode);
+      if (child == NULL && inode != NULL) {
+        VFSReleaseInodeLocked(inode);
+      }
+    }
+    SpinlockRelease(&lock_);
+
+    if (child == NULL) {
+      return kVFSErrorNoMemory;
+    }
+  }
+
+  if (child->inode == NULL) {
+    VFSReleaseDentry(child);
+    return kVFSErrorNotFound;
+  }
+
+  // Step onto whatever is mounted there
+  SpinlockAcquire(&lock_);
+  while (child->mounted != NULL) {
+    VFSDentry *root = child->mounted;
+    VFSGetDentryLocked(root);
+    VFSReleaseDentryLocked(child);
+    child = root;
+  }
+  SpinlockRelease(&lock_);
+
+  *child_out = child;
+  return 0;
+}
+
+// The parent of a mount root is the parent of the directory it covers
+static VFSDentry *VFSParent(VFSDentry *dentry) {
+  SpinlockAcquire(&lock_);
+  while (dentry->covered != NULL) {
+    dentry = dentry->covered;
+  }
+  VFSDentry *parent = dentry->parent != NULL ? dentry->parent : root_;
+  VFSGetDentryLocked(parent);
+  SpinlockRelease(&lock_);
+  return parent;
+}
+
+// Resolve the path up to end from the root to a positive, referenced dentry
+static int VFSWalkTo(const char *path, const char *end,
+                     VFSDentry **dentry_out) {
+  SpinlockAcquire(&lock_);
+  VFSDentry *current = root_;
+  if (current != NULL) {
+    VFSGetDentryLocked(current);
+  }
+  SpinlockRelease(&lock_);
+  if (current == NULL) {
+    return kVFSErrorNotFound;
+  }
+
+  while (path < end) {
+    while (path < end && *path == '/') {
+      path++;
+    }
+    const char *name = path;
+    while (path < end && *path != '/') {
+      path++;
+    }
+    uint32_t length = path - name;
+    if (length == 0 || (length == 1 && name[0] == '.')) {
+      continue;
+    }
+    if (length > VFS_NAME_MAX) {
+      VFSReleaseDentry(current);
+      return kVFSErrorNameTooLong;
+    }
+    if (current->inode->type != kVFSDirectory) {
+      VFSReleaseDentry(current);
+      return kVFSErrorNotDirectory;
+    }
+
+    VFSDentry *next;
+    if (length == 2 && name[0] == '.' && name[1] == '.') {
+      next = VFSParent(current);
+    } else {
+      int result = VFSLookupChild(current, name, length, &next);
+      if (result < 0) {
+        VFSReleaseDentry(current);
+        return result;
+      }
+    }
+    VFSReleaseDentry(current);
+    current = next;
+  }
+
+  *dentry_out = current;
+  return 0;
+}
+
+static int VFSWalk(const char *path, VFSDentry **dentry_out) {
+  const char *end = path;
+  while (*end != '\0') {
+    end++;
+  }
+  return VFSWalkTo(path, end, dentry_out);
+}
+
+//
+// Mounts
+//
+
+static bool VFSStringEquals(const char *a, const char *b) {
+  while (*a != '\0' && *a == *b) {
+    a++;
+    b++;
+  }
+  return *a == *b;
+}
+
+int VFSMount(const char *path, const char *fs_name, BlockDevice *device) {
+  VFSFileSystem *fs = filesystems_;
+  while (fs != NULL && !VFSStringEquals(fs->name, fs_name)) {
+    fs = fs->next;
+  }
+  if (fs == NULL) {
+    return kVFSErrorNotSupported;
+  }
+
+  bool is_root = path[0] == '/' && path[1] == '\0';
+  if (is_root != (root_ == NULL)) {
+    return kVFSErrorInvalid;
+  }
+
+  VFSDentry *covered = NULL;
+  if (!is_root) {
+    int result = VFSWalk(path, &covered);
+    if (result < 0) {
+      return result;
+    }
+    if (covered->inode->type != kVFSDirectory || covered->mounted != NULL) {
+      VFSReleaseDentry(covered);
+      return kVFSErrorInvalid;
+    }
+  }
+
+  // A slot is claimed by setting its fs
+  SpinlockAcquire(&lock_);
+  VFSSuperBlock *super = NULL;
+  for (int i = 0; i < VFS_MAX_MOUNTS && super == NULL; i++) {
+    if (supers_[i].fs == NULL) {
+      super = &supers_[i];
+      memset(super, 0, sizeof(*super));
+      super->fs = fs;
+    }
+  }
+  SpinlockRelease(&lock_);
+  if (super == NULL) {
+    if (covered != NULL) {
+      VFSReleaseDentry(covered);
+    }
+    return kVFSErrorNoMemory;
+  }
+
+  super->device = device;
+  int result = fs->mount(super, device);
+  if (result < 0) {
+    super->fs = NULL;
+    if (covered != NULL) {
+      VFSReleaseDentry(covered);
+    }
+    return result;
+  }
+
+  // The mount keeps its root and the covered directory referenced
+  SpinlockAcquire(&lock_);
+  VFSDentry *root = VFSNewDentryLocked(NULL, "/", 1, 0, super->root);
+  if (root != NULL) {
+    if (covered != NULL) {
+      root->covered = covered;
+      covered->mounted = root;
+    } else {
+      root_ = root;
+    }
+  } else {
+    VFSReleaseInodeLocked(super->root);
+    if (covered != NULL) {
+      VFSReleaseDentryLocked(covered);
+    }
+    super->fs = NULL;
+  }
+  SpinlockRelease(&lock_);
+
+  if (root == NULL) {
+    return kVFSErrorNoMemory;
+  }
+  printf("VFS: %s%s%s mounted on %s\n", fs->name, device != NULL ? " " : "",
+         device != NULL ? device->name : "", path);
+  return 0;
+}
+
+// Any filesystem that recognizes a block device, in registration order
+int VFSMountDevice(const char *path) {
+  for (BlockDevice *device = BlockFirst(); device != NULL;
+       device = device->next) {
+    for (VFSFileSystem *fs = filesystems_; fs != NULL; fs = fs->next) {
+      if (VFSMount(path, fs->name, device) == 0) {
+        return 0;
+      }
+    }
+  }
+  return kVFSErrorNotFound;
+}
+
+bool VFSHasRoot() { return root_ != NULL; }
+
+//
+// Files
+//
+
+int VFSOpen(const char *path, VFSFile *file_out) {
+  VFSDentry *dentry;
+  int result = VFSWalk(path, &dentry);
+  if (result < 0) {
+    return result;
+  }
+
+  file_out->dentry = dentry;
+  file_out->inode = dentry->inode;
+  file_out->position = 0;
+  memset(&file_out->readahead, 0, sizeof(file_out->readahead));
+  file_out->fs_data[0] = 0;
+  file_out->fs_data[1] = 0;
+  return 0;
+}
+
+int VFSCreate(const char *path, uint32_t type) {
+  const char *end = path;
+  while (*end != '\0') {
+    end++;
+  }
+  while (end > path && end[-1] == '/') {
+    end--;
+  }
+  const char *name = end;
+  while (name > path && name[-1] != '/') {
+    name--;
+  }
+  uint32_t length = end - name;
+  if (length == 0 || (name[0] == '.' && (length == 1 ||
+                                         (length == 2 && name[1] == '.')))) {
+    return kVFSErrorInvalid;
+  }
+  if (length > VFS_NAME_MAX) {
+    return kVFSErrorNameTooLong;
+  }
+
+  VFSDentry *parent;
+  int result = VFSWalkTo(path, name, &parent);
+  if (result < 0) {
+    return result;
+  }
+  VFSInode *directory = parent->inode;
+  if (directory->type != kVFSDirectory) {
+    VFSReleaseDentry(parent);
+    return kVFSErrorNotDirectory;
+  }
+  if (directory->operations->create == NULL) {
+    VFSReleaseDentry(parent);
+    return kVFSErrorNotSupported;
+  }
+
+  // Usually answered by the cache, and leaves a negative dentry to fill in
+  VFSDentry *child;
+  result = VFSLookupChild(parent, name, length, &child);
+  if (result == 0) {
+    VFSReleaseDentry(child);
+    VFSReleaseDentry(parent);
+    return kVFSErrorExists;
+  }
+  if (result != kVFSErrorNotFound) {
+    VFSReleaseDentry(parent);
+    return result;
+  }
+
+  VFSInode *inode;
+  result = directory->operations->create(directory, name, length, type, &inode);
+  if (result < 0) {
+    VFSReleaseDentry(parent);
+    return result;
+  }
+
+  uint32_t hash = VFSHashName(parent, name, length);
+  SpinlockAcquire(&lock_);
+  child = VFSFindDentryLocked(parent, name, length, hash);
+  if (child != NULL && child->inode == NULL) {
+    child->inode = inode;
+  } else if (child != NULL ||
+             (child = VFSNewDentryLocked(parent, name, length, hash,
+                                         inode)) == NULL) {
+    // The file exists either way, the cache just does not know it yet
+    VFSReleaseInodeLocked(inode);
+  } else {
+    VFSReleaseDentryLocked(child);
+  }
+  VFSReleaseDentryLocked(parent);
+  SpinlockRelease(&lock_);
+  return 0;
+}
+
+void VFSClose(VFSFile *file) {
+  VFSReleaseDentry(file->dentry);
+  file->dentry = NULL;
+  file->inode = NULL;
+}
+
+int32_t VFSRead(VFSFile *file, void *buffer, uint32_t size) {
+  const VFSFileOperations *operations = file->inode->file_operations;
+  if (file->inode->type == kVFSDirectory) {
+    return kVFSErrorIsDirectory;
+  }
+  if (operations == NULL ||
+      (operations->read == NULL && operations->readpage == NULL)) {
+    return kVFSErrorNotSupported;
+  }
+
+  int32_t result = operations->read != NULL
+                       ? operations->read(file, buffer, size)
+                       : PageCacheRead(file, buffer, size);
+  if (result > 0) {
+    file->position += result;
+  }
+  return result;
+}
+
+int32_t VFSWrite(VFSFile *file, const void *buffer, uint32_t size) {
+  const VFSFileOperations *operations = file->inode->file_operations;
+  if (file->inode->type == kVFSDirectory) {
+    return kVFSErrorIsDirectory;
+  }
+  if (operations == NULL || operations->write == NULL) {
+    return kVFSErrorNotSupported;
+  }
+
+  int32_t result = operations->write(file, buffer, size);
+  if (result > 0) {
+    file->position += result;
+  }
+  return result;
+}
+
+int32_t VFSReadDir(VFSFile *file, VFSDirectoryEntry *entries,
+                   uint32_t count) {
+  const VFSFileOperations *operations = file->inode->file_operations;
+  if (file->inode->type != kVFSDirectory) {
+    return kVFSErrorNotDirectory;
+  }
+  if (operations == NULL || operations->readdir == NULL) {
+    return kVFSErrorNotSupported;
+  }
+  return operations->readdir(file, entries, count);
+}
+
+int VFSStatPath(const char *path, VFSStat *stat_out) {
+  VFSDentry *dentry;
+  int result = VFSWalk(path, &dentry);
+  if (result < 0) {
+    return result;
+  }
+
+  stat_out->type = dentry->inode->type;
+  stat_out->size = dentry->inode->size;
+  stat_out->ino = dentry->inode->ino;
+  VFSReleaseDentry(dentry);
+  return 0;
+}
+
+void VFSGetCacheStats(VFSCacheStats *stats_out) {
+  SpinlockAcquire(&lock_);
+  *stats_out = stats_;
+  SpinlockRelease(&lock_);
+}
@@ -0,0 +1,176 @@
+#pragma once
+#include "block.h"
+#include "page.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Virtual file system: path resolution through a hashed cache of names
+// (dentries, negative ones included) and a cache of reference counted
+// inodes, with per-filesystem operation tables underneath. Unused entries
+// of both caches stay around on LRU lists until their slot is needed.
+
+#define VFS_NAME_MAX 255 // NOLINT
+
+// A page never needs more sector runs than it has sectors
+#define VFS_PAGE_RUNS (PAGE_SIZE / BLOCK_SECTOR_SIZE) // NOLINT
+
+typedef struct VFSInode VFSInode;
+typedef struct VFSSuperBlock VFSSuperBlock;
+typedef struct VFSFile VFSFile;
+
+enum VFSInodeType {
+  kVFSRegular = 1,
+  kVFSDirectory = 2,
+};
+
+// Negative results report errors
+enum VFSError {
+  kVFSErrorNotFound = -1,
+  kVFSErrorNotDirectory = -2,
+  kVFSErrorIsDirectory = -3,
+  kVFSErrorIO = -4,
+  kVFSErrorNoMemory = -5,
+  kVFSErrorInvalid = -6,
+  kVFSErrorNotSupported = -7,
+  kVFSErrorExists = -8,
+  kVFSErrorNameTooLong = -9,
+};
+
+// One decoded directory entry, many are returned per readdir call
+typedef struct {
+  char name[VFS_NAME_MAX + 1];
+  uint32_t type;
+  uint32_t size;
+} VFSDirectoryEntry;
+
+typedef struct {
+  uint32_t type;
+  uint32_t size;
+  uint32_t ino;
+} VFSStat;
+
+// Sectors on the superblock's device that hold part of a file page
+typedef struct {
+  uint64_t lba;
+  uint32_t count;
+} VFSPageRun;
+
+typedef struct {
+  // Find name in a directory. On success the filesystem stores the inode it
+  // got from VFSGetInode, kVFSErrorNotFound makes a negative dentry.
+  int (*lookup)(VFSInode *directory, const char *name, uint32_t length,
+                VFSInode **inode_out);
+
+  // Add a file or directory that does not exist yet, optional
+  int (*create)(VFSInode *directory, const char *name, uint32_t length,
+                uint32_t type, VFSInode **inode_out);
+} VFSInodeOperations;
+
+typedef struct {
+  // From file->position, which the VFS advances by the result. Files with
+  // readpage and no read are read through the page cache instead.
+  int32_t (*read)(VFSFile *file, void *buffer, uint32_t size);
+  int32_t (*write)(VFSFile *file, const void *buffer, uint32_t size);
+
+  // Fill up to count entries and move file->position past them, 0 at the end
+  int32_t (*readdir)(VFSFile *file, VFSDirectoryEntry *entries,
+                     uint32_t count);
+
+  // Fill a page frame with page index of the file, zeros past the end
+  int (*readpage)(VFSInode *inode, uint32_t index, void *page);
+
+  // Optional, where the sectors of page index are on disk, in page order,
+  // so the page cache can read it without waiting. Returns the number of
+  // runs, 0 for a page past the end.
+  int (*mappage)(VFSInode *inode, uint32_t index, VFSPageRun *runs);
+} VFSFileOperations;
+
+typedef struct {
+  // Release what the filesystem keeps for an inode leaving the cache. Runs
+  // with the VFS lock held, so it must not call back into the VFS.
+  void (*evict)(VFSInode *inode);
+} VFSSuperOperations;
+
+struct VFSInode {
+  VFSSuperBlock *super;
+  uint32_t ino;
+  uint32_t type;
+  uint32_t size;
+  const VFSInodeOperations *operations;
+  const VFSFileOperations *file_operations;
+  uintptr_t fs_data[4]; // Owned by the filesystem
+
+  // Cache state, guarded by the VFS lock
+  uint32_t references;
+  struct VFSInode *hash_next;
+  struct VFSInode *lru_previous;
+  struct VFSInode *lru_next;
+};
+
+struct VFSSuperBlock {
+  const struct VFSFileSystem *fs;
+  const VFSSuperOperations *operations;
+  BlockDevice *device;
+  VFSInode *root;
+  void *fs_data;
+};
+
+// Registered by a filesystem driver, owned by it
+typedef struct VFSFileSystem {
+  const char *name;
+
+  // Fill in super, root inode included, device may be NULL
+  int (*mount)(VFSSuperBlock *super, BlockDevice *device);
+  struct VFSFileSystem *next;
+} VFSFileSystem;
+
+typedef struct VFSDentry VFSDentry;
+
+// Sequential access detection for the page cache, in pages
+typedef struct {
+  uint32_t next;   // Index that continues the sequence
+  uint32_t window; // Pages read ahead at a time, 0 after random access
+  uint32_t ahead;  // First index not read ahead yet
+} VFSReadahead;
+
+// An open file, owned by the caller
+struct VFSFile {
+  VFSDentry *dentry;
+  VFSInode *inode;
+  uint32_t position;
+  VFSReadahead readahead;
+  uintptr_t fs_data[2]; // Owned by the filesystem, zero after open
+};
+
+void VFSInitialize();
+void VFSRegister(VFSFileSystem *fs);
+
+// The first mount must go to "/", later ones cover existing directories
+int VFSMount(const char *path, const char *fs_name, BlockDevice *device);
+int VFSMountDevice(const char *path);
+bool VFSHasRoot();
+
+int VFSOpen(const char *path, VFSFile *file_out);
+int VFSCreate(const char *path, uint32_t type);
+void VFSClose(VFSFile *file);
+int32_t VFSRead(VFSFile *file, void *buffer, uint32_t size);
+int32_t VFSWrite(VFSFile *file, const void *buffer, uint32_t size);
+int32_t VFSReadDir(VFSFile *file, VFSDirectoryEntry *entries, uint32_t count);
+int VFSStatPath(const char *path, VFSStat *stat_out);
+
+// For filesystems: the cached inode for template->ino, or a new one copied
+// from the template's ino, type, size, operations and fs_data. Comes with a
+// reference, NULL when the cache is full of inodes in use.
+VFSInode *VFSGetInode(VFSSuperBlock *super, const VFSInode *template);
+void VFSReleaseInode(VFSInode *inode);
+
+typedef struct {
+  uint32_t dentry_hits;
+  uint32_t dentry_misses;
+  uint32_t dentry_reclaims;
+  uint32_t inode_hits;
+  uint32_t inode_misses;
+  uint32_t inode_reclaims;
+} VFSCacheStats;
+
+void VFSGetCacheStats(VFSCacheStats *stats_out);
@@ -0,0 +1,320 @@
+#include "virtio.h"
+#include "atomic.h"
+#include "memory.h"
+#include "x86.h"
+#include <stddef.h>
+
+// Legacy interface, offsets into I/O BAR 0
+enum VirtioLegacyRegisters {
+  kVirtioLegacyDeviceFeatures = 0x00,
+  kVirtioLegacyDriverFeatures = 0x04,
+  kVirtioLegacyQueueAddress = 0x08,
+  kVirtioLegacyQueueSize = 0x0C,
+  kVirtioLegacyQueueSelect = 0x0E,
+  kVirtioLegacyQueueNotify = 0x10,
+  kVirtioLegacyStatus = 0x12,
+  kVirtioLegacyISR = 0x13,
+  kVirtioLegacyConfig = 0x14, // Without MSI-X, which is never enabled
+};
+
+// Modern common configuration structure
+enum VirtioCommonRegisters {
+  kVirtioCommonDeviceFeatureSelect = 0,
+  kVirtioCommonDeviceFeature = 4,
+  kVirtioCommonDriverFeatureSelect = 8,
+  kVirtioCommonDriverFeature = 12,
+  kVirtioCommonStatus = 20,
+  kVirtioCommonQueueSelect = 22,
+  kVirtioCommonQueueSize = 24,
+  kVirtioCommonQueueEnable = 28,
+  kVirtioCommonQueueNotifyOffset = 30,
+  kVirtioCommonQueueDescriptors = 32,
+  kVirtioCommonQueueDriver = 40,
+  kVirtioCommonQueueDevice = 48,
+};
+
+// cfg_type of the vendor capabilities that locate the modern structures
+enum VirtioCapabilityTypes {
+  kVirtioCapabilityCommon = 1,
+  kVirtioCapabilityNotify = 2,
+  kVirtioCapabilityISR = 3,
+  kVirtioCapabilityDevice = 4,
+};
+
+static inline void VirtioWrite8(volatile uint8_t *base, uint32_t offset,
+                                uint8_t value) {
+  *(volatile uint8_t *)(base + offset) = value;
+}
+
+static inline void VirtioWrite16(volatile uint8_t *base, uint32_t offset,
+                                 uint16_t value) {
+  *(volatile uint16_t *)(base + offset) = value;
+}
+
+static inline void VirtioWrite32(volatile uint8_t *base, uint32_t offset,
+                                 uint32_t value) {
+  *(volatile uint32_t *)(base + offset) = value;
+}
+
+static inline uint8_t VirtioRead8(volatile uint8_t *base, uint32_t offset) {
+  return *(volatile uint8_t *)(base + offset);
+}
+
+static inline uint16_t VirtioRead16(volatile uint8_t *base, uint32_t offset) {
+  return *(volatile uint16_t *)(base + offset);
+}
+
+static inline uint32_t VirtioRead32(volatile uint8_t *base, uint32_t offset) {
+  return *(volatile uint32_t *)(base + offset);
+}
+
+static volatile uint8_t *VirtioCapabilityAddress(PCIDevice *pci,
+                                                 uint8_t capability) {
+  uint8_t bar = PCIConfigRead8(pci, capability + 4);
+  if (bar >= PCI_BAR_COUNT || PCIBarIsIO(pci, bar) ||
+      PCIBarAddress(pci, bar) == 0) {
+    return NULL;
+  }
+  return (volatile uint8_t *)(PCIBarAddress(pci, bar) +
+                              PCIConfigRead32(pci, capability + 8));
+}
+
+// Every structure has to be reachable, otherwise the legacy interface is used
+static bool VirtioFindModern(VirtioDevice *device) {
+  PCIDevice *pci = device->pci;
+  for (uint8_t capability = PCIFindCapability(pci, kPCICapabilityVendor, 0);
+       capability != 0;
+       capability = PCIFindCapability(pci, kPCICapabilityVendor, capability)) {
+    volatile uint8_t *address = VirtioCapabilityAddress(pci, capability);
+    switch (PCIConfigRead8(pci, capability + 3)) {
+    case kVirtioCapabilityCommon:
+      device->common = device->common ? device->common : address;
+      break;
+    case kVirtioCapabilityNotify:
+      if (device->notify == NULL) {
+        device->notify = address;
+        device->notify_multiplier = PCIConfigRead32(pci, capability + 16);
+      }
+      break;
+    case kVirtioCapabilityISR:
+      device->isr = device->isr ? device->isr : address;
+      break;
+    case kVirtioCapabilityDevice:
+      device->device_config =
+          device->device_config ? device->device_config : address;
+      break;
+    }
+  }
+
+  return device->common != NULL && device->notify != NULL &&
+         device->isr != NULL && device->device_config != NULL;
+}
+
+static void VirtioSetStatus(VirtioDevice *device, uint8_t status) {
+  if (device->modern) {
+    VirtioWrite8(device->common, kVirtioCommonStatus, status);
+  } else {
+    x86_outb(device->io_base + kVirtioLegacyStatus, status);
+  }
+}
+
+static uint8_t VirtioGetStatus(VirtioDevice *device) {
+  return device->modern ? VirtioRead8(device->common, kVirtioCommonStatus)
+                        : x86_inb(device->io_base + kVirtioLegacyStatus);
+}
+
+bool VirtioInitialize(VirtioDevice *device, PCIDevice *pci) {
+  memset(device, 0, sizeof(*device));
+  device->pci = pci;
+
+  if (VirtioFindModern(device)) {
+    device->modern = true;
+    PCIUpdateCommand(pci, kPCICommandMemory | kPCICommandBusMaster,
+                     kPCICommandInterruptDisable);
+  } else if (PCIBarIsIO(pci, 0) && PCIBarAddress(pci, 0) != 0) {
+    device->io_base = PCIBarAddress(pci, 0);
+    PCIUpdateCommand(pci, kPCICommandIO | kPCICommandBusMaster,
+                     kPCICommandInterruptDisable);
+  } else {
+    return false;
+  }
+
+  // A modern device finishes resetting when status reads back as zero
+  VirtioSetStatus(device, 0);
+  while (device->modern && VirtioGetStatus(device) != 0) {
+    CpuRelax();
+  }
+
+  VirtioSetStatus(device, kVirtioStatusAcknowledge);
+  VirtioSetStatus(device, kVirtioStatusAcknowledge | kVirtioStatusDriver);
+  return true;
+}
+
+bool VirtioNegotiate(VirtioDevice *device, uint64_t wanted) {
+  uint64_t offered;
+  if (device->modern) {
+    VirtioWrite32(device->common, kVirtioCommonDeviceFeatureSelect, 0);
+    offered = VirtioRead32(device->common, kVirtioCommonDeviceFeature);
+    VirtioWrite32(device->common, kVirtioCommonDeviceFeatureSelect, 1);
+    offered |= (uint64_t)VirtioRead32(device->common,
+                                      kVirtioCommonDeviceFeature)
+               << 32;
+  } else {
+    offered = x86_inl(device->io_base + kVirtioLegacyDeviceFeatures);
+  }
+
+  // The legacy interface has no room for feature bits past 31, the modern
+  // one only works with virtio 1.0 semantics
+  if (!device->modern) {
+    device->features = offered & wanted & 0xFFFFFFFF;
+    x86_outl(device->io_base + kVirtioLegacyDriverFeatures, device->features);
+    return true;
+  }
+
+  if (!(offered & (1ull << kVirtioFeatureVersion1))) {
+    return false;
+  }
+  device->features = (offered & wanted) | (1ull << kVirtioFeatureVersion1);
+
+  VirtioWrite32(device->common, kVirtioCommonDriverFeatureSelect, 0);
+  VirtioWrite32(device->common, kVirtioCommonDriverFeature, device->features);
+  VirtioWrite32(device->common, kVirtioCommonDriverFeatureSelect, 1);
+  VirtioWrite32(device->common, kVirtioCommonDriverFeature,
+                device->features >> 32);
+
+  uint8_t status = VirtioGetStatus(device);
+  VirtioSetStatus(device, status | kVirtioStatusFeaturesOk);
+  return (VirtioGetStatus(device) & kVirtioStatusFeaturesOk) != 0;
+}
+
+bool VirtioHasFeature(const VirtioDevice *device, int feature) {
+  return (device->features >> feature) & 1;
+}
+
+// Descriptors, then the driver ring, then the device ring on its own page,
+// which is the only layout legacy devices understand
+static bool VirtqueueLayout(Virtqueue *queue, uint16_t size) {
+  uint32_t avail_offset = size * sizeof(VirtqDescriptor);
+  uint32_t used_offset = (avail_offset + sizeof(VirtqAvail) +
+                          (size + 1) * sizeof(uint16_t) + VIRTQ_ALIGNMENT -
+                          1) &
+                         ~(VIRTQ_ALIGNMENT - 1);
+  uint32_t end = used_offset + sizeof(VirtqUsed) +
+                 size * sizeof(VirtqUsedElement) + sizeof(uint16_t);
+  if (size == 0 || size > VIRTQ_MAX_SIZE || end > VIRTQ_MEMORY_SIZE) {
+    return false;
+  }
+
+  memset(queue->memory, 0, VIRTQ_MEMORY_SIZE);
+  queue->descriptors = (volatile VirtqDescriptor *)queue->memory;
+  queue->avail = (volatile VirtqAvail *)(queue->memory + avail_offset);
+  queue->used = (volatile VirtqUsed *)(queue->memory + used_offset);
+  queue->size = size;
+  queue->avail_index = 0;
+  queue->used_index = 0;
+  return true;
+}
+
+bool VirtioSetupQueue(VirtioDevice *device, uint16_t index, Virtqueue *queue) {
+  queue->queue_index = index;
+
+  if (!device->modern) {
+    x86_outw(device->io_base + kVirtioLegacyQueueSelect, index);
+    if (!VirtqueueLayout(queue,
+                         x86_inw(device->io_base + kVirtioLegacyQueueSize))) {
+      return false;
+    }
+    x86_outl(device->io_base + kVirtioLegacyQueueAddress,
+             (uint32_t)queue->memory / VIRTQ_ALIGNMENT);
+    return true;
+  }
+
+  // Modern devices let the driver pick a smaller queue
+  volatile uint8_t *common = device->common;
+  VirtioWrite16(common, kVirtioCommonQueueSelect, index);
+  uint16_t size = VirtioRead16(common, kVirtioCommonQueueSize);
+  if (size > VIRTQ_MAX_SIZE) {
+    size = VIRTQ_MAX_SIZE;
+  }
+  if (!VirtqueueLayout(queue, size)) {
+    return false;
+  }
+
+  VirtioWrite16(common, kVirtioCommonQueueSize, size);
+  VirtioWrite32(common, kVirtioCommonQueueDescriptors,
+                (uint32_t)queue->descriptors);
+  VirtioWrite32(common, kVirtioCommonQueueDescriptors + 4, 0);
+  VirtioWrite32(common, kVirtioCommonQueueDriver, (uint32_t)queue->avail);
+  VirtioWrite32(common, kVirtioCommonQueueDriver + 4, 0);
+  VirtioWrite32(common, kVirtioCommonQueueDevice, (uint32_t)queue->used);
+  VirtioWrite32(common, kVirtioCommonQueueDevice + 4, 0);
+  queue->notify_offset = VirtioRead16(common, kVirtioCommonQueueNotifyOffset);
+  VirtioWrite16(common, kVirtioCommonQueueEnable, 1);
+  return true;
+}
+
+void VirtioDriverOk(VirtioDevice *device) {
+  VirtioSetStatus(device, VirtioGetStatus(device) | kVirtioStatusDriverOk);
+}
+
+void VirtioFail(VirtioDevice *device) {
+  VirtioSetStatus(device, VirtioGetStatus(device) | kVirtioStatusFailed);
+}
+
+uint8_t VirtioReadISR(VirtioDevice *device) {
+  return device->modern ? VirtioRead8(device->isr, 0)
+                        : x86_inb(device->io_base + kVirtioLegacyISR);
+}
+
+uint32_t VirtioConfigRead32(VirtioDevice *device, uint32_t offset) {
+  return device->modern
+             ? VirtioRead32(device->device_config, offset)
+             : x86_inl(device->io_base + kVirtioLegacyConfig + offset);
+}
+
+void VirtqueuePush(Virtqueue *queue, uint16_t head) {
+  queue->avail->ring[queue->avail_index % queue->size] = head;
+  queue->avail_index++;
+}
+
+void VirtqueueKick(VirtioDevice *device, Virtqueue *queue) {
+  if (queue->avail->index == queue->avail_index) {
+    return;
+  }
+
+  // Ring entries before the index, and the index before reading the flags
+  CompilerBarrier();
+  queue->avail->index = queue->avail_index;
+  AtomicFence();
+
+  if (queue->used->flags & VIRTQ_USED_NO_NOTIFY) {
+    return;
+  }
+
+  if (device->modern) {
+    VirtioWrite16(device->notify,
+                  queue->notify_offset * device->notify_multiplier,
+                  queue->queue_index);
+  } else {
+    x86_outw(device->io_base + kVirtioLegacyQueueNotify, queue->queue_index);
+  }
+}
+
+bool VirtqueueHasUsed(const Virtqueue *queue) {
+  return queue->used->index != queue->used_index;
+}
+
+bool VirtqueuePop(Virtqueue *queue, uint32_t *id_out, uint32_t *length_out) {
+  if (!VirtqueueHasUsed(queue)) {
+    return false;
+  }
+
+  // x86 keeps the loads in order, the compiler must too
+  CompilerBarrier();
+  volatile VirtqUsedElement *element =
+      &queue->used->ring[queue->used_index % queue->size];
+  *id_out = element->id;
+  *length_out = element->length;
+  queue->used_index++;
+  return true;
+}
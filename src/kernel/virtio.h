@@ -0,0 +1,115 @@
+#pragma once
+#include "pci.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define VIRTIO_PCI_VENDOR 0x1AF4 // NOLINT
+
+// Largest queue the static ring memory has room for, legacy devices dictate
+// the size so bigger ones are refused
+#define VIRTQ_MAX_SIZE 256               // NOLINT
+#define VIRTQ_ALIGNMENT 4096             // NOLINT
+#define VIRTQ_MEMORY_SIZE (3 * 4096)     // NOLINT
+
+enum VirtioStatus {
+  kVirtioStatusAcknowledge = 0x01,
+  kVirtioStatusDriver = 0x02,
+  kVirtioStatusDriverOk = 0x04,
+  kVirtioStatusFeaturesOk = 0x08,
+  kVirtioStatusFailed = 0x80,
+};
+
+enum VirtioFeatures {
+  kVirtioFeatureIndirectDesc = 28,
+  kVirtioFeatureVersion1 = 32,
+};
+
+enum VirtqDescriptorFlags {
+  kVirtqDescriptorNext = 0x1,
+  kVirtqDescriptorWrite = 0x2,
+  kVirtqDescriptorIndirect = 0x4,
+};
+
+enum VirtioISRBits {
+  kVirtioISRQueue = 0x1,
+  kVirtioISRConfig = 0x2,
+};
+
+// Split virtqueue layout shared with the device
+typedef struct {
+  uint64_t address;
+  uint32_t length;
+  uint16_t flags;
+  uint16_t next;
+} VirtqDescriptor;
+
+typedef struct {
+  uint16_t flags;
+  uint16_t index;
+  uint16_t ring[];
+} VirtqAvail;
+
+typedef struct {
+  uint32_t id;
+  uint32_t length;
+} VirtqUsedElement;
+
+typedef struct {
+  uint16_t flags;
+  uint16_t index;
+  VirtqUsedElement ring[];
+} VirtqUsed;
+
+#define VIRTQ_USED_NO_NOTIFY 0x1 // NOLINT
+
+typedef struct {
+  uint8_t memory[VIRTQ_MEMORY_SIZE] __attribute__((aligned(VIRTQ_ALIGNMENT)));
+  volatile VirtqDescriptor *descriptors;
+  volatile VirtqAvail *avail;
+  volatile VirtqUsed *used;
+  uint16_t queue_index;
+  uint16_t size;
+  uint16_t avail_index; // Next free avail slot, published in batches
+  uint16_t used_index;  // Next used entry to reap
+  uint16_t notify_offset;
+} Virtqueue;
+
+// One virtio PCI function, through the legacy I/O port interface or the
+// virtio 1.0 capability structures in memory BARs
+typedef struct {
+  PCIDevice *pci;
+  bool modern;
+  uint16_t io_base;
+  volatile uint8_t *common;
+  volatile uint8_t *isr;
+  volatile uint8_t *device_config;
+  volatile uint8_t *notify;
+  uint32_t notify_multiplier;
+  uint64_t features;
+} VirtioDevice;
+
+// Resets the device and acknowledges it, preferring the modern interface
+bool VirtioInitialize(VirtioDevice *device, PCIDevice *pci);
+
+// Accepts the wanted features the device offers, stored in device->features.
+// Fails if a modern device rejects the set.
+bool VirtioNegotiate(VirtioDevice *device, uint64_t wanted);
+bool VirtioHasFeature(const VirtioDevice *device, int feature);
+
+bool VirtioSetupQueue(VirtioDevice *device, uint16_t index, Virtqueue *queue);
+void VirtioDriverOk(VirtioDevice *device);
+void VirtioFail(VirtioDevice *device);
+
+// Reading acknowledges the interrupt and lowers the line
+uint8_t VirtioReadISR(VirtioDevice *device);
+
+uint32_t VirtioConfigRead32(VirtioDevice *device, uint32_t offset);
+
+// Queue a descriptor chain, the device only sees it after the next kick.
+// Kicking publishes everything queued since the last one and notifies the
+// device once for the batch, unless it asked not to be.
+void VirtqueuePush(Virtqueue *queue, uint16_t head);
+void VirtqueueKick(VirtioDevice *device, Virtqueue *queue);
+
+bool VirtqueueHasUsed(const Virtqueue *queue);
+bool VirtqueuePop(Virtqueue *queue, uint32_t *id_out, uint32_t *length_out);
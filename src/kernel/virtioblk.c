@@ -0,0 +1,325 @@
+#include "virtioblk.h"
+#include "block.h"
+#include "irq.h"
+#include "pic.h"
+#include "softirq.h"
+#include "spinlock.h"
+#include "stdio.h"
+#include "virtio.h"
+#include <stddef.h>
+
+#define VIRTIO_BLK_MAX_DEVICES 4 // NOLINT
+
+// Larger transfers are split into several commands, which the device is free
+// to work on in parallel
+#define VIRTIO_BLK_MAX_TRANSFER 256 // NOLINT
+
+// Header, data and status
+#define VIRTIO_BLK_SEGMENTS 3 // NOLINT
+
+// Whoever waits on a request reaps it by polling as well, so interrupts only
+// need to run the bottom half once a few completions have gathered
+#define VIRTIO_BLK_SOFTIRQ_COALESCE 4 // NOLINT
+
+enum VirtioBlkDeviceIDs {
+  kVirtioBlkTransitional = 0x1001,
+  kVirtioBlkModern = 0x1042,
+};
+
+enum VirtioBlkFeatures {
+  kVirtioBlkFeatureReadOnly = 5,
+};
+
+enum VirtioBlkRequestTypes {
+  kVirtioBlkRequestIn = 0,
+  kVirtioBlkRequestOut = 1,
+};
+
+enum VirtioBlkStatus {
+  kVirtioBlkStatusOk = 0,
+  kVirtioBlkStatusPending = 0xFF, // Never written by the device
+};
+
+typedef struct {
+  uint32_t type;
+  uint32_t reserved;
+  uint64_t sector;
+} VirtioBlkHeader;
+
+// One command in flight. With indirect descriptors it takes a single ring
+// descriptor pointing at its own table, otherwise a chain of three.
+typedef struct {
+  VirtqDescriptor indirect[VIRTIO_BLK_SEGMENTS] __attribute__((aligned(16)));
+  VirtioBlkHeader header;
+  BlockRequest *request;
+  volatile uint8_t status;
+} VirtioBlkSlot;
+
+typedef struct {
+  BlockDevice block;
+  VirtioDevice virtio;
+  Virtqueue queue;
+  VirtioBlkSlot slots[VIRTQ_MAX_SIZE];
+  uint16_t free_slots[VIRTQ_MAX_SIZE];
+  int free_count;
+  bool indirect;
+  bool read_only;
+
+  // Requests with sectors not yet handed to the device, oldest first
+  BlockRequest *waiting;
+  BlockRequest **waiting_tail;
+
+  Spinlock lock;
+  IRQAction irq_action;
+  SoftIRQ softirq;
+  char name[4];
+} VirtioBlk;
+
+static VirtioBlk devices_[VIRTIO_BLK_MAX_DEVICES];
+static int device_count_ = 0;
+
+static void VirtioBlkSetDescriptor(volatile VirtqDescriptor *descriptor,
+                                   const volatile void *address,
+                                   uint32_t length, uint16_t flags,
+                                   uint16_t next) {
+  descriptor->address = (uint32_t)address;
+  descriptor->length = length;
+  descriptor->flags = flags;
+  descriptor->next = next;
+}
+
+// Fill the three segments starting at table, next links are relative to base
+static void VirtioBlkBuildChain(volatile VirtqDescriptor *table, uint16_t base,
+                                VirtioBlkSlot *slot, void *data,
+                                uint32_t count, bool write) {
+  VirtioBlkSetDescriptor(&table[0], &slot->header, sizeof(slot->header),
+                         kVirtqDescriptorNext, base + 1);
+  VirtioBlkSetDescriptor(
+      &table[1], data, count * BLOCK_SECTOR_SIZE,
+      kVirtqDescriptorNext | (write ? 0 : kVirtqDescriptorWrite), base + 2);
+  VirtioBlkSetDescriptor(&table[2], &slot->status, 1, kVirtqDescriptorWrite,
+                         0);
+}
+
+// Hand out free slots to waiting requests, then notify the device once.
+// Called with the lock held.
+static void VirtioBlkIssue(VirtioBlk *blk) {
+  while (blk->waiting != NULL && blk->free_count > 0) {
+    BlockRequest *request = blk->waiting;
+    uint32_t count = request->count - request->issued;
+    if (count > VIRTIO_BLK_MAX_TRANSFER) {
+      count = VIRTIO_BLK_MAX_TRANSFER;
+    }
+
+    uint16_t index = blk->free_slots[--blk->free_count];
+    VirtioBlkSlot *slot = &blk->slots[index];
+    slot->request = request;
+    slot->status = kVirtioBlkStatusPending;
+    slot->header.type =
+        request->write ? kVirtioBlkRequestOut : kVirtioBlkRequestIn;
+    slot->header.reserved = 0;
+    slot->header.sector = request->lba + request->issued;
+
+    uint8_t *data =
+        (uint8_t *)request->buffer + request->issued * BLOCK_SECTOR_SIZE;
+    if (blk->indirect) {
+      VirtioBlkBuildChain(slot->indirect, 0, slot, data, count,
+                          request->write);
+      VirtioBlkSetDescriptor(&blk->queue.descriptors[index], slot->indirect,
+                             sizeof(slot->indirect), kVirtqDescriptorIndirect,
+                             0);
+      VirtqueuePush(&blk->queue, index);
+    } else {
+      uint16_t head = index * VIRTIO_BLK_SEGMENTS;
+      VirtioBlkBuildChain(&blk->queue.descriptors[head], head, slot, data,
+                          count, request->write);
+      VirtqueuePush(&blk->queue, head);
+    }
+
+    request->issued += count;
+    request->pending++;
+    if (request->issued == request->count) {
+      blk->waiting = request->next;
+      if (blk->waiting == NULL) {
+        blk->waiting_tail = &blk->waiting;
+      }
+    }
+  }
+
+  VirtqueueKick(&blk->virtio, &blk->queue);
+}
+
+// Collect finished commands and refill the queue. Requests that are now
+// complete are returned as a list, to be completed once the lock is dropped.
+// Called with the lock held.
+static BlockRequest *VirtioBlkReap(VirtioBlk *blk) {
+  BlockRequest *completed = NULL;
+  uint32_t id;
+  uint32_t length;
+
+  while (VirtqueuePop(&blk->queue, &id, &length)) {
+    uint16_t index = blk->indirect ? id : id / VIRTIO_BLK_SEGMENTS;
+    VirtioBlkSlot *slot = &blk->slots[index];
+    BlockRequest *request = slot->request;
+
+    if (slot->status != kVirtioBlkStatusOk) {
+      request->success = false;
+    }
+
+    slot->request = NULL;
+    blk->free_slots[blk->free_count++] = index;
+
+    if (--request->pending == 0 && request->issued == request->count) {
+      request->next = completed;
+      completed = request;
+    }
+  }
+
+  VirtioBlkIssue(blk);
+  return completed;
+}
+
+static void VirtioBlkComplete(BlockRequest *completed) {
+  while (completed != NULL) {
+    // The request belongs to its owner once completed
+    BlockRequest *next = completed->next;
+    BlockCompleteRequest(completed, completed->success);
+    completed = next;
+  }
+}
+
+static void VirtioBlkSubmit(BlockDevice *device, BlockRequest *request) {
+  VirtioBlk *blk = device->context;
+  if (request->write && blk->read_only) {
+    BlockCompleteRequest(request, false);
+    return;
+  }
+
+  // Cleared by the first command that fails
+  request->success = true;
+
+  uint32_t flags = SpinlockAcquireIrqSave(&blk->lock);
+  *blk->waiting_tail = request;
+  blk->waiting_tail = &request->next;
+  VirtioBlkIssue(blk);
+  SpinlockReleaseIrqRestore(&blk->lock, flags);
+}
+
+static void VirtioBlkPoll(BlockDevice *device) {
+  VirtioBlk *blk = device->context;
+  if (!VirtqueueHasUsed(&blk->queue)) {
+    return;
+  }
+
+  uint32_t flags = SpinlockAcquireIrqSave(&blk->lock);
+  BlockRequest *completed = VirtioBlkReap(blk);
+  SpinlockReleaseIrqRestore(&blk->lock, flags);
+  VirtioBlkComplete(completed);
+}
+
+// The line may be shared, the ISR register says whether it was this device.
+// Reading it also lowers the line, the used ring is left to the bottom half.
+static void VirtioBlkInterrupt(ISRFrame *frame, void *context) {
+  VirtioBlk *blk = context;
+  if (VirtioReadISR(&blk->virtio) & kVirtioISRQueue) {
+    SoftIRQRaise(&blk->softirq, 0);
+  }
+}
+
+static void VirtioBlkSoftIRQ(void *context, const uint32_t *events,
+                             uint32_t count) {
+  VirtioBlk *blk = context;
+  VirtioBlkPoll(&blk->block);
+}
+
+static const BlockOperations kVirtioBlkOperations = {
+    .submit = VirtioBlkSubmit,
+    .poll = VirtioBlkPoll,
+};
+
+static bool VirtioBlkProbe(VirtioBlk *blk, PCIDevice *pci) {
+  VirtioDevice *virtio = &blk->virtio;
+  if (!VirtioInitialize(virtio, pci)) {
+    return false;
+  }
+
+  uint64_t wanted = (1ull << kVirtioFeatureIndirectDesc) |
+                    (1ull << kVirtioFeatureVersion1) |
+                    (1ull << kVirtioBlkFeatureReadOnly);
+  if (!VirtioNegotiate(virtio, wanted) ||
+      !VirtioSetupQueue(virtio, 0, &blk->queue)) {
+    VirtioFail(virtio);
+    return false;
+  }
+
+  blk->indirect = VirtioHasFeature(virtio, kVirtioFeatureIndirectDesc);
+  blk->read_only = VirtioHasFeature(virtio, kVirtioBlkFeatureReadOnly);
+
+  // Slots own fixed descriptors, so the free slot stack is all the ring
+  // bookkeeping there is
+  int slot_count = blk->indirect ? blk->queue.size
+                                 : blk->queue.size / VIRTIO_BLK_SEGMENTS;
+  blk->free_count = 0;
+  for (int i = slot_count - 1; i >= 0; i--) {
+    blk->free_slots[blk->free_count++] = i;
+  }
+
+  blk->waiting = NULL;
+  blk->waiting_tail = &blk->waiting;
+  SpinlockInitialize(&blk->lock);
+
+  // Capacity is always in 512 byte sectors
+  blk->block.sector_count = VirtioConfigRead32(virtio, 0) |
+                            (uint64_t)VirtioConfigRead32(virtio, 4) << 32;
+  blk->block.operations = &kVirtioBlkOperations;
+  blk->block.context = blk;
+
+  // Without an interrupt line BlockWait still reaps completions by polling
+  if (pci->irq_line < PIC_IRQ_COUNT) {
+    blk->softirq.handler = VirtioBlkSoftIRQ;
+    blk->softirq.context = blk;
+    blk->softirq.coalesce = VIRTIO_BLK_SOFTIRQ_COALESCE;
+    blk->irq_action.handler = VirtioBlkInterrupt;
+    blk->irq_action.context = blk;
+    IRQRegisterHandler(pci->irq_line, &blk->irq_action);
+  }
+
+  VirtioDriverOk(virtio);
+  return true;
+}
+
+int VirtioBlkInitialize() {
+  for (int i = 0; i < PCIDeviceCount(); i++) {
+    PCIDevice *pci = PCIGetDevice(i);
+    if (pci->vendor_id != VIRTIO_PCI_VENDOR ||
+        (pci->device_id != kVirtioBlkTransitional &&
+         pci->device_id != kVirtioBlkModern)) {
+      continue;
+    }
+    if (device_count_ == VIRTIO_BLK_MAX_DEVICES) {
+      break;
+    }
+
+    VirtioBlk *blk = &devices_[device_count_];
+    blk->name[0] = 'v';
+    blk->name[1] = 'd';
+    blk->name[2] = '0' + device_count_;
+    blk->name[3] = '\0';
+    blk->block.name = blk->name;
+
+    if (!VirtioBlkProbe(blk, pci)) {
+      printf("%s: cannot set up virtio device %x:%x.%d\n", blk->name, pci->bus,
+             pci->slot, pci->function);
+      continue;
+    }
+
+    device_count_++;
+    BlockRegister(&blk->block);
+    printf("%s: %llu MiB, %s, %d commands in flight%s\n", blk->name,
+           blk->block.sector_count / 2048,
+           blk->virtio.modern ? "modern" : "legacy", blk->free_count,
+           blk->read_only ? ", read-only" : "");
+  }
+
+  return device_count_;
+}
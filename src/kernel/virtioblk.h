@@ -0,0 +1,6 @@
+#pragma once
+
+// Registers every virtio block device on the PCI bus as "vd0", "vd1", ...
+// Commands complete through the device interrupt, up to a full virtqueue of
+// them in flight. Returns the number of devices found.
+int VirtioBlkInitialize();
@@ -14,3 +14,232 @@ x86_inb:
     xor eax, eax
     in al, dx
     ret
+
+global x86_outw
+x86_outw:
+    [bits 32]
+    mov dx, [esp + 4]
+    mov ax, [esp + 8]
+    out dx, ax
+    ret
+
+global x86_inw
+x86_inw:
+    [bits 32]
+    mov dx, [esp + 4]
+    xor eax, eax
+    in ax, dx
+    ret
+
+global x86_outl
+x86_outl:
+    [bits 32]
+    mov dx, [esp + 4]
+    mov eax, [esp + 8]
+    out dx, eax
+    ret
+
+global x86_inl
+x86_inl:
+    [bits 32]
+    mov dx, [esp + 4]
+    in eax, dx
+    ret
+
+global x86_ReadTSC
+x86_ReadTSC:
+    [bits 32]
+    rdtsc
+    ret
+
+global x86_CPUID
+x86_CPUID:
+    [bits 32]
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+
+    mov eax, [ebp + 8]
+    xor ecx, ecx
+    cpuid
+
+    mov esi, [ebp + 12]
+    mov [esi], eax
+    mov [esi + 4], ebx
+    mov [esi + 8], ecx
+    mov [esi + 12], edx
+
+    pop esi
+    pop ebx
+    mov esp, ebp
+    pop ebp
+    ret
+
+global x86_ReadMSR
+x86_ReadMSR:
+    [bits 32]
+    mov ecx, [esp + 4]
+    rdmsr
+    ret
+
+global x86_WriteMSR
+x86_WriteMSR:
+    [bits 32]
+    mov ecx, [esp + 4]
+    mov eax, [esp + 8]
+    mov edx, [esp + 12]
+    wrmsr
+    ret
+
+; Load a new GDT and reload every segment register
+; Args:
+;   1 - pointer to the GDT descriptor
+;   2 - code segment selector
+;   3 - data segment selector
+global x86_LoadGDT
+x86_LoadGDT:
+    [bits 32]
+    push ebp
+    mov ebp, esp
+
+    mov eax, [ebp + 8]
+    lgdt [eax]
+
+    ; Reload code segment with a far return
+    mov eax, [ebp + 12]
+    push eax
+    push .reload_cs
+    retf
+
+.reload_cs:
+    mov ax, [ebp + 16]
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov ss, ax
+
+    xor ax, ax
+    mov gs, ax
+
+    mov esp, ebp
+    pop ebp
+    ret
+
+global x86_LoadGS
+x86_LoadGS:
+    [bits 32]
+    mov ax, [esp + 4]
+    mov gs, ax
+    ret
+
+global x86_EnableInterrupts
+x86_EnableInterrupts:
+    [bits 32]
+    sti
+    ret
+
+global x86_DisableInterrupts
+x86_DisableInterrupts:
+    [bits 32]
+    cli
+    ret
+
+; Returns eflags as they were before disabling interrupts
+global x86_SaveFlagsAndDisableInterrupts
+x86_SaveFlagsAndDisableInterrupts:
+    [bits 32]
+    pushfd
+    pop eax
+    cli
+    ret
+
+global x86_RestoreFlags
+x86_RestoreFlags:
+    [bits 32]
+    push dword [esp + 4]
+    popfd
+    ret
+
+global x86_LoadIDT
+x86_LoadIDT:
+    [bits 32]
+    mov eax, [esp + 4]
+    lidt [eax]
+    ret
+
+global x86_Halt
+x86_Halt:
+    [bits 32]
+    hlt
+    ret
+
+; Sleep until the next interrupt and return with interrupts disabled again.
+; sti only takes effect after the following instruction, so an interrupt
+; cannot slip in between the caller's check and the hlt.
+global x86_WaitForInterrupt
+x86_WaitForInterrupt:
+    [bits 32]
+    sti
+    hlt
+    cli
+    ret
+
+; Drop to user mode, returning only when x86_LeaveUser unwinds back here
+; Args:
+;   1 - where to store the kernel stack pointer for x86_LeaveUser
+;   2 - user eip
+;   3 - user esp
+; Returns the result passed to x86_LeaveUser
+global x86_EnterUser
+x86_EnterUser:
+    [bits 32]
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    push edi
+
+    mov eax, [ebp + 8]
+    mov [eax], esp
+    mov ecx, [ebp + 12]
+    mov edx, [ebp + 16]
+
+    ; User data and code selectors from gdt.h with RPL 3, interrupts on
+    push dword 0x23
+    push edx
+    push dword 0x202
+    push dword 0x1B
+    push ecx
+
+    mov ax, 0x23
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    xor eax, eax
+    mov gs, ax
+
+    ; Nothing of the kernel's registers is left for user code to see
+    xor ebx, ebx
+    xor ecx, ecx
+    xor edx, edx
+    xor esi, esi
+    xor edi, edi
+    xor ebp, ebp
+    iret
+
+; Abandon the kernel stack of the current system call or fault and return
+; from x86_EnterUser
+; Args:
+;   1 - kernel stack pointer stored by x86_EnterUser
+;   2 - result
+global x86_LeaveUser
+x86_LeaveUser:
+    [bits 32]
+    mov eax, [esp + 8]
+    mov esp, [esp + 4]
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
@@ -2,5 +2,42 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+typedef struct {
+  uint32_t eax;
+  uint32_t ebx;
+  uint32_t ecx;
+  uint32_t edx;
+} x86_CPUIDResult; // NOLINT
+
 void __attribute__((cdecl)) x86_outb(uint16_t port, uint8_t value); // NOLINT
-uint8_t __attribute__((cdecl)) x86_inb(uint16_t port);              // NOLINT
\ No newline at end of file
+uint8_t __attribute__((cdecl)) x86_inb(uint16_t port);              // NOLINT
+void __attribute__((cdecl)) x86_outw(uint16_t port, uint16_t value); // NOLINT
+uint16_t __attribute__((cdecl)) x86_inw(uint16_t port);              // NOLINT
+void __attribute__((cdecl)) x86_outl(uint16_t port, uint32_t value); // NOLINT
+uint32_t __attribute__((cdecl)) x86_inl(uint16_t port);              // NOLINT
+
+uint64_t __attribute__((cdecl)) x86_ReadTSC();                     // NOLINT
+void __attribute__((cdecl)) x86_CPUID(uint32_t leaf,               // NOLINT
+                                      x86_CPUIDResult *result_out);
+uint64_t __attribute__((cdecl)) x86_ReadMSR(uint32_t msr);          // NOLINT
+void __attribute__((cdecl)) x86_WriteMSR(uint32_t msr, uint32_t low, // NOLINT
+                                         uint32_t high);
+
+void __attribute__((cdecl)) x86_LoadGDT(const void *descriptor, // NOLINT
+                                        uint16_t code_segment,
+                                        uint16_t data_segment);
+void __attribute__((cdecl)) x86_LoadGS(uint16_t selector); // NOLINT
+
+void __attribute__((cdecl)) x86_EnableInterrupts();                  // NOLINT
+void __attribute__((cdecl)) x86_DisableInterrupts();                 // NOLINT
+uint32_t __attribute__((cdecl)) x86_SaveFlagsAndDisableInterrupts(); // NOLINT
+void __attribute__((cdecl)) x86_RestoreFlags(uint32_t flags);        // NOLINT
+
+void __attribute__((cdecl)) x86_LoadIDT(const void *descriptor); // NOLINT
+void __attribute__((cdecl)) x86_Halt();                           // NOLINT
+void __attribute__((cdecl)) x86_WaitForInterrupt();               // NOLINT
+
+int __attribute__((cdecl)) x86_EnterUser(uint32_t *kernel_esp_out, // NOLINT
+                                         uint32_t eip, uint32_t esp);
+void __attribute__((cdecl, noreturn)) x86_LeaveUser( // NOLINT
+    uint32_t kernel_esp, int result);
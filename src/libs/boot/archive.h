@@ -0,0 +1,52 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Boot module archive built by build_scripts/mkarchive.c. A header and the
+// entry table come first, every module starts on an aligned offset so it can
+// be used in place:
+//
+//   BootArchiveHeader
+//   BootArchiveEntry[entry_count]
+//   padding, module 0, padding, module 1, ...
+
+#define BOOT_ARCHIVE_MAGIC 0x43524142 // NOLINT, "BARC"
+#define BOOT_ARCHIVE_VERSION 1        // NOLINT
+#define BOOT_ARCHIVE_ALIGNMENT 4096   // NOLINT
+#define BOOT_ARCHIVE_NAME_SIZE 32     // NOLINT
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entry_count;
+  uint32_t size; // Whole archive, header included
+} BootArchiveHeader;
+
+typedef struct {
+  char name[BOOT_ARCHIVE_NAME_SIZE]; // Zero padded, always terminated
+  uint32_t offset;                   // From the start of the archive
+  uint32_t size;
+} BootArchiveEntry;
+
+// Whether the header and every entry stay within size bytes
+static inline bool BootArchiveIsValid(const BootArchiveHeader *header,
+                                     uint32_t size) {
+  if (size < sizeof(BootArchiveHeader) ||
+      header->magic != BOOT_ARCHIVE_MAGIC ||
+      header->version != BOOT_ARCHIVE_VERSION || header->size > size ||
+      header->entry_count > (header->size - sizeof(BootArchiveHeader)) /
+                                sizeof(BootArchiveEntry)) {
+    return false;
+  }
+
+  const BootArchiveEntry *entries = (const BootArchiveEntry *)(header + 1);
+  for (uint32_t i = 0; i < header->entry_count; i++) {
+    if (entries[i].name[BOOT_ARCHIVE_NAME_SIZE - 1] != '\0' ||
+        entries[i].offset > header->size ||
+        entries[i].size > header->size - entries[i].offset) {
+      return false;
+    }
+  }
+
+  return true;
+}
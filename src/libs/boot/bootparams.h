@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+
+// Handed from stage2 to the kernel entry point. Only plain fixed-size fields,
+// both sides are built separately.
+
+#define BOOT_PARAMS_MAGIC 0x544F4F42 // NOLINT, "BOOT"
+
+// Time stamp counter readings taken along the boot path
+enum BootPhase {
+  kBootPhaseStage2Entry,
+  kBootPhaseStage2ImageLoaded,
+  kBootPhaseStage2DiskReady,
+  kBootPhaseKernelLoaded,
+  kBootPhaseKernelEntry,
+  kBootPhaseInterruptsReady,
+  kBootPhaseSMPReady,
+  kBootPhaseDevicesReady,
+  kBootPhaseDone,
+  kBootPhaseCount,
+};
+
+typedef struct {
+  uint32_t magic;
+  uint32_t boot_drive;
+
+  // Copy of the whole boot disk, size 0 when stage2 read it in place
+  uint32_t ramdisk_address;
+  uint32_t ramdisk_size;
+
+  // Boot module archive (boot/archive.h), size 0 without one
+  uint32_t modules_address;
+  uint32_t modules_size;
+
+  // 32-bit linear framebuffer set by stage2, address 0 in VGA text mode
+  uint32_t framebuffer_address;
+  uint32_t framebuffer_pitch;
+  uint32_t framebuffer_width;
+  uint32_t framebuffer_height;
+  uint32_t framebuffer_bpp;
+
+  // 8x16 VGA BIOS font, 256 glyphs of 16 bytes, 0 if unknown
+  uint32_t font_address;
+
+  uint64_t timestamps[kBootPhaseCount];
+} BootParams;
@@ -0,0 +1,13 @@
+#pragma once
+#include <stdint.h>
+
+// Trailer build_scripts/mkchecksum.c appends to the files stage2 loads. The
+// CRC32C covers everything before it, stage2 checks it while the file is
+// read and hands on the contents without the trailer.
+
+#define BOOT_CHECKSUM_MAGIC 0x43524333 // NOLINT, "3CRC"
+
+typedef struct {
+  uint32_t magic;
+  uint32_t crc32c;
+} BootChecksum;
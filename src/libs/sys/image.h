@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+
+// Address space layout of user processes and the header of their images.
+// Both the kernel and src/user are built against it; src/user/linker.ld
+// repeats the base address.
+//
+//   USER_BASE          image: header, code, data, bss
+//   ...                unmapped
+//   USER_MAP_BASE      file mappings and received messages, growing up
+//   ...                unmapped
+//   USER_STACK_TOP     initial stack, growing down USER_STACK_SIZE bytes
+//   USER_SHARED_PAGE   read-only system call entry and time page
+//   USER_END
+
+#define USER_BASE 0x40000000        // NOLINT
+#define USER_END 0x80000000         // NOLINT
+#define USER_MAP_BASE 0x60000000    // NOLINT
+#define USER_SHARED_PAGE 0x7FFFF000 // NOLINT
+#define USER_STACK_TOP 0x7FFF0000   // NOLINT
+#define USER_STACK_SIZE 0x10000     // NOLINT
+
+#define USER_IMAGE_MAGIC 0x52455355 // NOLINT, "USER"
+
+// First bytes of a flat image, which is loaded at USER_BASE. The image file
+// ends with the initialized data, end also covers the bss.
+typedef struct {
+  uint32_t magic;
+  uint32_t entry;
+  uint32_t end;
+} UserImageHeader;
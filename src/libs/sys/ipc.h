@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+
+// Messages of the channel system calls. Sending takes whole pages out of the
+// sender's address space, receiving maps the same frames into the
+// receiver's, so the data itself is never copied. A received message is a
+// mapping of its own until it is unmapped or sent on, and a process holds at
+// most 32 mappings at a time.
+
+#define IPC_MESSAGE_PAGES 16 // NOLINT, 64 KiB per message
+#define IPC_BATCH_MAX 16     // NOLINT, messages per call
+
+typedef struct {
+  // Page aligned. The pages must be writable memory of the sender's own,
+  // not file mappings, and are gone from its address space once sent.
+  uint32_t address;
+  uint32_t size; // Bytes, every page it touches is moved
+  uint32_t tag;  // Handed to the receiver as it is
+} IPCMessage;
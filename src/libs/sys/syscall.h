@@ -0,0 +1,48 @@
+#pragma once
+
+// System calls take the number in eax and up to five arguments in ebx, ecx,
+// edx, esi and edi, and return a result in eax. User code calls the entry
+// at the start of the shared page (TimePage.syscall_entry), which uses
+// sysenter when the CPU has it and int SYSCALL_VECTOR otherwise, preserving
+// every register but eax.
+//
+// The sysenter convention behind the entry: ebp holds the user stack
+// pointer, sysexit returns to the instruction after sysenter in the entry.
+
+#define SYSCALL_VECTOR 0x80 // NOLINT
+
+enum SyscallNumber {
+  kSyscallNull,    // Does nothing, for measuring the entry cost
+  kSyscallExit,    // (int status), does not return
+  kSyscallWrite,   // (const char *buffer, uint32_t size), to the console
+  kSyscallGetCpu,  // Index of the calling CPU
+  kSyscallClock,   // (uint64_t *microseconds_out), since boot
+
+  // (const char *path, uint32_t offset, uint32_t *length_inout), maps a file
+  // read-only and returns the address. offset must be page aligned, a
+  // length of 0 maps the rest of the file, the mapped length comes back.
+  kSyscallMap,
+  kSyscallUnmap,   // (uint32_t address), of a whole mapping
+
+  // Pipes and channels, see sys/ipc.h. Create returns an id, reads, writes,
+  // sends and receives never wait and return how much they moved. Send and
+  // receive take up to IPC_BATCH_MAX messages.
+  kSyscallPipeCreate,
+  kSyscallPipeClose,          // (int pipe)
+  kSyscallPipeWrite,          // (int pipe, const void *buffer, uint32_t size)
+  kSyscallPipeRead,           // (int pipe, void *buffer, uint32_t size)
+  kSyscallChannelCreate,
+  kSyscallChannelClose,       // (int channel)
+  kSyscallChannelSend,        // (int channel, const IPCMessage *, count)
+  kSyscallChannelReceive,     // (int channel, IPCMessage *messages_out, count)
+  kSyscallCount,
+};
+
+// Negative results report errors
+enum SyscallError {
+  kSyscallErrorNoSys = -1,
+  kSyscallErrorFault = -2,
+  kSyscallErrorInvalid = -3,
+  kSyscallErrorNotFound = -4,
+  kSyscallErrorNoMemory = -5,
+};
@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+
+// The page mapped read-only at USER_SHARED_PAGE in every process. The kernel
+// copies the system call entry to its start and sets the clock fields at
+// boot through its identity mapping, so reading the time or the CPU index
+// never enters the kernel.
+
+#define TIMEPAGE_ENTRY_SIZE 64 // NOLINT
+
+enum TimePageFlags {
+  kTimePageSysenter = 1 << 0, // The entry uses sysenter, not int
+};
+
+typedef struct {
+  uint8_t syscall_entry[TIMEPAGE_ENTRY_SIZE];
+
+  // Odd while the kernel writes the clock, readers retry if it is odd or
+  // changed across their reads
+  volatile uint32_t sequence;
+  uint32_t flags;
+
+  // Microseconds since boot are us_base + (rdtsc - tsc_base) / tsc_per_us
+  uint64_t tsc_base;
+  uint64_t us_base;
+  uint32_t tsc_per_us;
+
+  // Every CPU loads its own task state segment, so the selector the
+  // unprivileged str instruction returns identifies the CPU:
+  // index = (str - tss_selector_base) / 8
+  uint32_t tss_selector_base;
+  uint32_t cpu_count;
+} TimePage;
@@ -0,0 +1,23 @@
+; Start of every user image: the UserImageHeader from sys/image.h, then the
+; entry point, which runs main and exits with its result
+
+section .header
+
+extern __end
+
+    dd 0x52455355       ; USER_IMAGE_MAGIC
+    dd _start
+    dd __end
+
+section .text
+
+extern main
+extern UserExit
+
+global _start
+_start:
+    [bits 32]
+    xor ebp, ebp
+    call main
+    push eax
+    call UserExit
@@ -0,0 +1,181 @@
+#include "user.h"
+
+// The first process: reports how it was started and what the ways into the
+// kernel cost, as "user:" lines on the console
+
+#define INIT_SAMPLES 1000 // NOLINT
+#define INIT_MAP_PATH "/disk/kernel.bin" // NOLINT
+#define INIT_PAGE_SIZE 4096               // NOLINT
+#define INIT_MESSAGE_SIZE (IPC_MESSAGE_PAGES * INIT_PAGE_SIZE)
+#define INIT_PIPE_CHUNK 1024              // NOLINT
+#define INIT_HOPS 64                      // NOLINT
+
+// Sent away by InitChannel, never touched again after that
+static uint8_t init_message_[INIT_MESSAGE_SIZE]
+    __attribute__((aligned(INIT_PAGE_SIZE)));
+static uint8_t init_copy_[INIT_MESSAGE_SIZE];
+
+typedef void (*InitFunction)();
+
+static uint32_t InitMinimum(InitFunction function) {
+  uint32_t best = UINT32_MAX;
+  for (int i = 0; i < INIT_SAMPLES; i++) {
+    uint64_t start = UserReadTSC();
+    function();
+    uint64_t cycles = UserReadTSC() - start;
+    if (cycles < best) {
+      best = (uint32_t)cycles;
+    }
+  }
+  return best;
+}
+
+static void InitEmpty() {}
+static void InitEntry() { UserSyscall(kSyscallNull, 0, 0, 0); }
+static void InitInt() { UserSyscallInt(kSyscallNull, 0); }
+
+static void InitClockSyscall() {
+  uint64_t us;
+  UserSyscall(kSyscallClock, (uint32_t)&us, 0, 0);
+}
+
+static void InitClockPage() { UserMicroseconds(); }
+static void InitCpuSyscall() { UserSyscall(kSyscallGetCpu, 0, 0, 0); }
+static void InitCpuPage() { UserGetCpu(); }
+
+static void InitReport(const char *name, InitFunction function,
+                       uint32_t overhead) {
+  uint32_t cycles = InitMinimum(function);
+  UserPrintf("user: %s %u cycles\n", name,
+             cycles > overhead ? cycles - overhead : 0);
+}
+
+static uint32_t InitSum(const uint8_t *data, uint32_t size) {
+  uint32_t sum = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    sum += data[i];
+  }
+  return sum;
+}
+
+// The first pass faults every page in through the page cache, the second
+// one only reads memory
+static void InitMapFile(uint32_t tsc_per_us) {
+  uint32_t length = 0;
+  const uint8_t *data = UserMap(INIT_MAP_PATH, 0, &length);
+  if (data == NULL) {
+    UserPrintf("user: mmap %s unavailable\n", INIT_MAP_PATH);
+    return;
+  }
+
+  uint64_t start = UserReadTSC();
+  uint32_t sum = InitSum(data, length);
+  uint64_t faulted = UserReadTSC();
+  uint32_t again = InitSum(data, length);
+  uint64_t end = UserReadTSC();
+  UserUnmap(data);
+
+  UserPrintf("user: mmap %s %u KiB, first pass %u us, second pass %u us%s\n",
+             INIT_MAP_PATH, length / 1024,
+             (uint32_t)((faulted - start) / tsc_per_us),
+             (uint32_t)((end - faulted) / tsc_per_us),
+             sum == again ? "" : ", contents changed");
+}
+
+// Bytes through a pipe and back, checked on the way out
+static void InitPipe() {
+  int pipe = UserPipeCreate();
+  if (pipe < 0) {
+    UserPrintf("user: pipe unavailable\n");
+    return;
+  }
+
+  uint8_t out[INIT_PIPE_CHUNK];
+  uint8_t in[INIT_PIPE_CHUNK];
+  uint32_t moved = 0;
+  bool same = true;
+  uint64_t start = UserReadTSC();
+  for (int round = 0; round < 64; round++) {
+    for (int i = 0; i < INIT_PIPE_CHUNK; i++) {
+      out[i] = (uint8_t)(round + i);
+    }
+    int32_t written = UserPipeWrite(pipe, out, INIT_PIPE_CHUNK);
+    int32_t read = UserPipeRead(pipe, in, INIT_PIPE_CHUNK);
+    same = same && written == INIT_PIPE_CHUNK && read == written &&
+           InitSum(in, INIT_PIPE_CHUNK) == InitSum(out, INIT_PIPE_CHUNK);
+    moved += read > 0 ? (uint32_t)read : 0;
+  }
+  uint64_t cycles = UserReadTSC() - start;
+  UserPipeClose(pipe);
+
+  UserPrintf("user: pipe %u KiB in %u byte writes, %u cycles per KiB%s\n",
+             moved / 1024, INIT_PIPE_CHUNK,
+             moved > 0 ? (uint32_t)(cycles * 1024 / moved) : 0,
+             same ? "" : ", data lost");
+}
+
+// A 64 KiB message sent around a channel again and again, each hop remaps
+// the pages to a new address, against copying the same bytes once
+static void InitChannel() {
+  int channel = UserChannelCreate();
+  if (channel < 0) {
+    UserPrintf("user: channel unavailable\n");
+    return;
+  }
+
+  for (uint32_t i = 0; i < INIT_MESSAGE_SIZE; i++) {
+    init_message_[i] = (uint8_t)(i * 7);
+  }
+  uint32_t sum = InitSum(init_message_, INIT_MESSAGE_SIZE);
+
+  IPCMessage message = {(uint32_t)init_message_, INIT_MESSAGE_SIZE, 0};
+  uint32_t best = UINT32_MAX;
+  bool ok = true;
+  for (int hop = 0; hop < INIT_HOPS && ok; hop++) {
+    uint64_t start = UserReadTSC();
+    ok = UserChannelSend(channel, &message, 1) == 1 &&
+         UserChannelReceive(channel, &message, 1) == 1;
+    uint64_t cycles = UserReadTSC() - start;
+    if (cycles < best) {
+      best = (uint32_t)cycles;
+    }
+  }
+  UserChannelClose(channel);
+  if (!ok) {
+    UserPrintf("user: channel hop failed\n");
+    return;
+  }
+
+  bool same = InitSum((const uint8_t *)message.address, message.size) == sum;
+  uint64_t start = UserReadTSC();
+  const uint8_t *source = (const uint8_t *)message.address;
+  for (uint32_t i = 0; i < INIT_MESSAGE_SIZE; i++) {
+    init_copy_[i] = source[i];
+  }
+  uint32_t copy = (uint32_t)(UserReadTSC() - start);
+  UserUnmap(source);
+
+  UserPrintf("user: channel %u KiB hop %u cycles, copying it %u cycles%s\n",
+             INIT_MESSAGE_SIZE / 1024, best, copy,
+             same ? "" : ", contents changed");
+}
+
+int main() {
+  const TimePage *page = UserTimePage();
+  UserPrintf("user: init on cpu %d of %u, %u us since boot\n", UserGetCpu(),
+             page->cpu_count, (uint32_t)UserMicroseconds());
+
+  uint32_t overhead = InitMinimum(InitEmpty);
+  InitReport((page->flags & kTimePageSysenter) ? "syscall sysenter"
+                                                : "syscall int (no sysenter)",
+             InitEntry, overhead);
+  InitReport("syscall int", InitInt, overhead);
+  InitReport("clock syscall", InitClockSyscall, overhead);
+  InitReport("clock page", InitClockPage, overhead);
+  InitReport("getcpu syscall", InitCpuSyscall, overhead);
+  InitReport("getcpu page", InitCpuPage, overhead);
+  InitMapFile(page->tsc_per_us);
+  InitPipe();
+  InitChannel();
+  return 0;
+}
@@ -0,0 +1,147 @@
+#include "user.h"
+#include <stdarg.h>
+
+#define USER_PRINTF_BUFFER 256 // NOLINT
+
+void UserExit(int status) {
+  UserSyscall(kSyscallExit, (uint32_t)status, 0, 0);
+  for (;;)
+    ;
+}
+
+int32_t UserWrite(const char *buffer, uint32_t size) {
+  return UserSyscall(kSyscallWrite, (uint32_t)buffer, size, 0);
+}
+
+const void *UserMap(const char *path, uint32_t offset,
+                    uint32_t *length_inout) {
+  int32_t result = UserSyscall(kSyscallMap, (uint32_t)path, offset,
+                               (uint32_t)length_inout);
+  return result < 0 ? NULL : (const void *)result;
+}
+
+int32_t UserUnmap(const void *address) {
+  return UserSyscall(kSyscallUnmap, (uint32_t)address, 0, 0);
+}
+
+int32_t UserPipeCreate() { return UserSyscall(kSyscallPipeCreate, 0, 0, 0); }
+
+int32_t UserPipeClose(int pipe) {
+  return UserSyscall(kSyscallPipeClose, (uint32_t)pipe, 0, 0);
+}
+
+int32_t UserPipeWrite(int pipe, const void *buffer, uint32_t size) {
+  return UserSyscall(kSyscallPipeWrite, (uint32_t)pipe, (uint32_t)buffer,
+                     size);
+}
+
+int32_t UserPipeRead(int pipe, void *buffer, uint32_t size) {
+  return UserSyscall(kSyscallPipeRead, (uint32_t)pipe, (uint32_t)buffer, size);
+}
+
+int32_t UserChannelCreate() {
+  return UserSyscall(kSyscallChannelCreate, 0, 0, 0);
+}
+
+int32_t UserChannelClose(int channel) {
+  return UserSyscall(kSyscallChannelClose, (uint32_t)channel, 0, 0);
+}
+
+int32_t UserChannelSend(int channel, const IPCMessage *messages,
+                        uint32_t count) {
+  return UserSyscall(kSyscallChannelSend, (uint32_t)channel,
+                     (uint32_t)messages, count);
+}
+
+int32_t UserChannelReceive(int channel, IPCMessage *messages_out,
+                           uint32_t count) {
+  return UserSyscall(kSyscallChannelReceive, (uint32_t)channel,
+                     (uint32_t)messages_out, count);
+}
+
+static int UserAppendNumber(char *buffer, int length, uint32_t value,
+                            uint32_t base) {
+  char digits[11];
+  int pos = sizeof(digits);
+  do {
+    digits[--pos] = "0123456789abcdef"[value % base];
+    value /= base;
+  } while (value != 0);
+
+  while (pos < (int)sizeof(digits) && length < USER_PRINTF_BUFFER) {
+    buffer[length++] = digits[pos++];
+  }
+  return length;
+}
+
+// %s %c %d %u %x, collected into one write
+void UserPrintf(const char *fmt, ...) {
+  char buffer[USER_PRINTF_BUFFER];
+  int length = 0;
+  va_list args;
+  va_start(args, fmt);
+
+  for (; *fmt && length < USER_PRINTF_BUFFER; fmt++) {
+    if (*fmt != '%' || fmt[1] == '\0') {
+      buffer[length++] = *fmt;
+      continue;
+    }
+
+    fmt++;
+    switch (*fmt) {
+    case 's': {
+      const char *str = va_arg(args, const char *);
+      while (*str && length < USER_PRINTF_BUFFER) {
+        buffer[length++] = *str++;
+      }
+      break;
+    }
+    case 'c':
+      buffer[length++] = (char)va_arg(args, int);
+      break;
+    case 'd': {
+      int value = va_arg(args, int);
+      if (value < 0) {
+        buffer[length++] = '-';
+        value = -value;
+      }
+      length = UserAppendNumber(buffer, length, (uint32_t)value, 10);
+      break;
+    }
+    case 'u':
+      length = UserAppendNumber(buffer, length, va_arg(args, uint32_t), 10);
+      break;
+    case 'x':
+      length = UserAppendNumber(buffer, length, va_arg(args, uint32_t), 16);
+      break;
+    default:
+      buffer[length++] = *fmt;
+      break;
+    }
+  }
+
+  va_end(args);
+  UserWrite(buffer, length);
+}
+
+// Retry while the kernel is rewriting the clock, the same as a seqlock
+// reader
+uint64_t UserMicroseconds() {
+  const TimePage *page = UserTimePage();
+  uint32_t sequence;
+  uint64_t us;
+  do {
+    while ((sequence = page->sequence) & 1) {
+      __asm__ volatile("pause");
+    }
+    us = page->us_base + (UserReadTSC() - page->tsc_base) / page->tsc_per_us;
+    __asm__ volatile("" : : : "memory");
+  } while (page->sequence != sequence);
+  return us;
+}
+
+int UserGetCpu() {
+  uint16_t selector;
+  __asm__ volatile("str %0" : "=r"(selector));
+  return (selector - UserTimePage()->tss_selector_base) / 8;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/image.h>
+#include <sys/ipc.h>
+#include <sys/syscall.h>
+#include <sys/timepage.h>
+
+// The few things a user program needs, on top of the shared page
+
+static inline const TimePage *UserTimePage() {
+  return (const TimePage *)USER_SHARED_PAGE;
+}
+
+// Through the shared page entry, sysenter when the kernel picked it
+static inline int32_t UserSyscall(uint32_t number, uint32_t arg1,
+                                  uint32_t arg2, uint32_t arg3) {
+  int32_t result;
+  __asm__ volatile("call %P[entry]"
+                   : "=a"(result)
+                   : [entry] "i"(USER_SHARED_PAGE), "a"(number), "b"(arg1),
+                     "c"(arg2), "d"(arg3)
+                   : "memory");
+  return result;
+}
+
+// Always int SYSCALL_VECTOR, to compare against the shared page entry
+static inline int32_t UserSyscallInt(uint32_t number, uint32_t arg1) {
+  int32_t result;
+  __asm__ volatile("int %[vector]"
+                   : "=a"(result)
+                   : [vector] "i"(SYSCALL_VECTOR), "a"(number), "b"(arg1)
+                   : "memory");
+  return result;
+}
+
+static inline uint64_t UserReadTSC() {
+  uint64_t value;
+  __asm__ volatile("rdtsc" : "=A"(value));
+  return value;
+}
+
+void __attribute__((noreturn)) UserExit(int status);
+int32_t UserWrite(const char *buffer, uint32_t size);
+void UserPrintf(const char *fmt, ...);
+
+// Map a file read-only, see kSyscallMap. Returns NULL on errors.
+const void *UserMap(const char *path, uint32_t offset, uint32_t *length_inout);
+int32_t UserUnmap(const void *address);
+
+// Pipes and channels, see kSyscallPipeCreate. Negative results are errors.
+int32_t UserPipeCreate();
+int32_t UserPipeClose(int pipe);
+int32_t UserPipeWrite(int pipe, const void *buffer, uint32_t size);
+int32_t UserPipeRead(int pipe, void *buffer, uint32_t size);
+int32_t UserChannelCreate();
+int32_t UserChannelClose(int channel);
+int32_t UserChannelSend(int channel, const IPCMessage *messages,
+                        uint32_t count);
+int32_t UserChannelReceive(int channel, IPCMessage *messages_out,
+                           uint32_t count);
+
+// Read from the shared page without entering the kernel
+uint64_t UserMicroseconds();
+int UserGetCpu();
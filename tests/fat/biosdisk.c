@@ -0,0 +1,508 @@
+// Stands in for the real mode trampoline in stage2/x86.asm and the int 13h
+// services behind it, and for the floppy controller and DMA ports behind
+// x86_inb/x86_outb. The image is held
+// in memory so timings measure the driver rather than the host file system.
+#define _GNU_SOURCE
+#include "biosdisk.h"
+#include "bios.h"
+#include "x86.h"
+
+#include <cpuid.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Older headers, the kernel then treats the address as a hint
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0
+#endif
+
+#define SECTOR_SIZE 512                // NOLINT
+#define LOW_MEMORY_START 0x00010000    // NOLINT
+#define LOW_MEMORY_END 0x00080000      // NOLINT
+#define REAL_MODE_LIMIT 0x00100000     // NOLINT
+#define DMA_BOUNDARY 0x00010000        // NOLINT
+#define FDC_RESET_SENSES 4             // NOLINT
+
+typedef struct {
+  uint32_t image_size;
+  uint8_t drive_type;
+  uint16_t cylinders;
+  uint16_t heads;
+  uint16_t sectors;
+} FloppyFormat;
+
+static const FloppyFormat kFloppyFormats[] = {
+    {368640, 1, 40, 2, 9},   // 360 KiB
+    {737280, 3, 80, 2, 9},   // 720 KiB
+    {1228800, 2, 80, 2, 15}, // 1.2 MiB
+    {1474560, 4, 80, 2, 18}, // 1.44 MiB
+    {2949120, 5, 80, 2, 36}, // 2.88 MiB
+};
+
+static uint8_t *image_ = NULL;
+static const FloppyFormat *format_ = NULL;
+static BIOSDiskStats stats_;
+static bool controller_present_ = true;
+
+static void BIOSDiskResetController();
+
+bool BIOSDiskOpen(const char *image_path) {
+  FILE *file = fopen(image_path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "biosdisk: cannot open %s\n", image_path);
+    return false;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  format_ = NULL;
+  for (size_t i = 0; i < sizeof(kFloppyFormats) / sizeof(*kFloppyFormats);
+       i++) {
+    if (kFloppyFormats[i].image_size == size) {
+      format_ = &kFloppyFormats[i];
+    }
+  }
+
+  if (format_ == NULL) {
+    fprintf(stderr, "biosdisk: %s is not a standard floppy size (%ld)\n",
+            image_path, size);
+    fclose(file);
+    return false;
+  }
+
+  image_ = malloc(size);
+  bool ok = image_ != NULL && fread(image_, 1, size, file) == (size_t)size;
+  fclose(file);
+  if (!ok) {
+    fprintf(stderr, "biosdisk: cannot read %s\n", image_path);
+    BIOSDiskClose();
+    return false;
+  }
+
+  BIOSDiskResetStats();
+  BIOSDiskResetController();
+  return true;
+}
+
+void BIOSDiskClose() {
+  free(image_);
+  image_ = NULL;
+  format_ = NULL;
+}
+
+void BIOSDiskGeometry(uint16_t *cylinders_out, uint16_t *heads_out,
+                      uint16_t *sectors_out) {
+  *cylinders_out = format_->cylinders;
+  *heads_out = format_->heads;
+  *sectors_out = format_->sectors;
+}
+
+BIOSDiskStats BIOSDiskGetStats() { return stats_; }
+
+void BIOSDiskResetStats() { memset(&stats_, 0, sizeof(stats_)); }
+
+void BIOSDiskSetController(bool present) { controller_present_ = present; }
+
+bool BIOSMapLowMemory() {
+  void *wanted = (void *)LOW_MEMORY_START;
+  void *memory = mmap(wanted, LOW_MEMORY_END - LOW_MEMORY_START,
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  if (memory != wanted) {
+    perror("biosdisk: cannot map conventional memory (check "
+           "vm.mmap_min_addr)");
+    return false;
+  }
+
+  return true;
+}
+
+static bool BIOSDiskGetParameters(BIOSRegisters *registers) {
+  stats_.get_params_calls++;
+  if ((registers->edx & 0xFF) != 0 || format_ == NULL) {
+    return false;
+  }
+
+  // Highest cylinder and head numbers, with cylinder bits 8-9 in cl 6-7
+  uint16_t cylinder = format_->cylinders - 1;
+  registers->ebx = format_->drive_type;
+  registers->ecx = ((cylinder & 0xFF) << 8) | ((cylinder >> 2) & 0xC0) |
+                   format_->sectors;
+  registers->edx = ((format_->heads - 1) << 8) | 1;
+  registers->eax = 0;
+  return true;
+}
+
+static bool BIOSDiskReset(BIOSRegisters *registers) {
+  stats_.reset_calls++;
+  return (registers->edx & 0xFF) == 0 && format_ != NULL;
+}
+
+// Int 13h/02h with the restrictions of a conservative floppy BIOS: no reads
+// across a track, buffers below 1 MiB and no DMA across a 64 KiB boundary
+static bool BIOSDiskRead(BIOSRegisters *registers) {
+  stats_.read_calls++;
+
+  uint8_t drive = registers->edx & 0xFF;
+  uint8_t head = (registers->edx >> 8) & 0xFF;
+  uint8_t count = registers->eax & 0xFF;
+  uint16_t sector = registers->ecx & 0x3F;
+  uint16_t cylinder =
+      ((registers->ecx >> 8) & 0xFF) | ((registers->ecx & 0xC0) << 2);
+  uintptr_t address = registers->es * 16 + (registers->ebx & 0xFFFF);
+  uint32_t bytes = count * SECTOR_SIZE;
+
+  if (drive != 0 || format_ == NULL || count == 0 ||
+      cylinder >= format_->cylinders || head >= format_->heads ||
+      sector == 0 || sector + count - 1 > format_->sectors ||
+      address + bytes > REAL_MODE_LIMIT ||
+      (address & (DMA_BOUNDARY - 1)) + bytes > DMA_BOUNDARY) {
+    stats_.failed_reads++;
+    return false;
+  }
+
+  uint32_t lba = (cylinder * format_->heads + head) * format_->sectors +
+                 (sector - 1);
+  memcpy((void *)address, image_ + lba * SECTOR_SIZE, bytes);
+  stats_.sectors_read += count;
+  registers->eax = count;
+  return true;
+}
+
+void x86_BIOSCallBatch(void *requests, uint32_t count) {
+  stats_.batches++;
+
+  BIOSRequest *request = (BIOSRequest *)requests;
+  for (uint32_t i = 0; i < count; i++, request++) {
+    request->out = request->in;
+
+    bool ok = false;
+    if (request->interrupt == 0x13) {
+      switch ((request->in.eax >> 8) & 0xFF) {
+      case 0x00:
+        ok = BIOSDiskReset(&request->out);
+        break;
+      case 0x02:
+        ok = BIOSDiskRead(&request->out);
+        break;
+      case 0x08:
+        ok = BIOSDiskGetParameters(&request->out);
+        break;
+      }
+    }
+
+    request->out.eflags = ok ? 0 : kBIOSFlagCarry;
+  }
+}
+
+// 82077AA floppy controller on drive 0 with ISA DMA channel 2. Commands
+// complete as soon as they are written, completion is reported the way the
+// controller does when polled: result phase in the main status register, and
+// an interrupt to collect with sense interrupt after seeks and resets.
+typedef struct {
+  uint8_t digital_output;
+  uint8_t data_rate;
+  uint8_t command[9];
+  int command_size;
+  int command_length;
+  uint8_t result[7];
+  int result_size;
+  int result_position;
+  int reset_senses;
+  bool interrupt;
+  uint8_t status0;
+  uint8_t cylinder;
+} Controller;
+
+typedef struct {
+  bool flip_flop;
+  bool masked;
+  uint8_t mode;
+  uint8_t page;
+  uint16_t address;
+  uint16_t count;
+} DMAChannel;
+
+static Controller controller_;
+static DMAChannel dma_;
+
+static void BIOSDiskResetController() {
+  memset(&controller_, 0, sizeof(controller_));
+  memset(&dma_, 0, sizeof(dma_));
+  dma_.masked = true;
+}
+
+static int BIOSDiskCommandLength(uint8_t command) {
+  switch (command & 0x1F) {
+  case 0x03:
+    return 3;
+  case 0x06:
+    return 9;
+  case 0x07:
+    return 2;
+  case 0x0F:
+    return 3;
+  case 0x13:
+    return 4;
+  default:
+    return 1;
+  }
+}
+
+static void BIOSDiskSetResult(const uint8_t *result, int size) {
+  memcpy(controller_.result, result, size);
+  controller_.result_size = size;
+  controller_.result_position = 0;
+}
+
+static uint8_t BIOSDiskExpectedDataRate() {
+  if (format_->sectors >= 36) {
+    return 3;
+  }
+  if (format_->sectors >= 15) {
+    return 0;
+  }
+  return format_->cylinders > 40 ? 2 : 1;
+}
+
+static void BIOSDiskSeek(uint8_t drive, uint16_t cylinder) {
+  stats_.seeks++;
+  controller_.interrupt = true;
+  if (drive != 0 || cylinder >= format_->cylinders) {
+    controller_.status0 = 0x70 | drive; // Abnormal, seek end, equipment check
+    return;
+  }
+
+  controller_.status0 = 0x20;
+  controller_.cylinder = cylinder;
+}
+
+// Read data, sector by sector until the DMA count runs out (terminal count
+// ends the command normally) or the track, or with MT the cylinder, ends
+static void BIOSDiskControllerRead() {
+  const uint8_t *command = controller_.command;
+  bool multi_track = (command[0] & 0x80) != 0;
+  uint8_t drive = command[1] & 0x03;
+  uint8_t head = command[3];
+  uint8_t sector = command[4];
+  uint8_t end_of_track = command[6];
+  uint8_t status[7] = {0x40 | (head << 2) | drive, 0, 0, command[2], head,
+                       sector, command[5]};
+
+  stats_.read_calls++;
+  uintptr_t address = (dma_.page << 16) | dma_.address;
+  uint32_t remaining = dma_.count + 1;
+  bool ready = drive == 0 &&
+               (controller_.digital_output & 0x1C) == 0x1C &&
+               controller_.data_rate == BIOSDiskExpectedDataRate() &&
+               !dma_.masked && (dma_.mode & 0xCF) == 0x46 &&
+               dma_.address + remaining <= DMA_BOUNDARY &&
+               address >= LOW_MEMORY_START &&
+               address + remaining <= LOW_MEMORY_END;
+  bool on_cylinder = command[2] == controller_.cylinder &&
+                     (command[1] >> 2 & 1) == head;
+
+  if (!ready || !on_cylinder || command[5] != 2 || sector == 0 ||
+      end_of_track != format_->sectors || head >= format_->heads) {
+    stats_.failed_reads++;
+    status[1] = 0x04; // No data
+    BIOSDiskSetResult(status, sizeof(status));
+    return;
+  }
+
+  while (remaining >= SECTOR_SIZE) {
+    uint32_t lba =
+        (controller_.cylinder * format_->heads + head) * format_->sectors +
+        (sector - 1);
+    memcpy((void *)address, image_ + lba * SECTOR_SIZE, SECTOR_SIZE);
+    stats_.sectors_read++;
+    address += SECTOR_SIZE;
+    remaining -= SECTOR_SIZE;
+
+    if (sector++ == end_of_track) {
+      sector = 1;
+      if (!multi_track || head == format_->heads - 1) {
+        break;
+      }
+      head++;
+    }
+  }
+
+  if (remaining == 0) {
+    status[0] &= ~0xC0;
+  } else {
+    stats_.failed_reads++;
+    status[1] = 0x80; // End of cylinder before terminal count
+  }
+  status[4] = head;
+  status[5] = sector;
+  BIOSDiskSetResult(status, sizeof(status));
+}
+
+static void BIOSDiskExecute() {
+  const uint8_t *command = controller_.command;
+  static const uint8_t kInvalid[] = {0x80};
+
+  switch (command[0] & 0x1F) {
+  case 0x03: // Specify
+  case 0x13: // Configure
+    break;
+  case 0x06:
+    BIOSDiskControllerRead();
+    break;
+  case 0x07: // Recalibrate
+    BIOSDiskSeek(command[1] & 0x03, 0);
+    break;
+  case 0x08: // Sense interrupt
+    if (controller_.reset_senses > 0) {
+      uint8_t drive = FDC_RESET_SENSES - controller_.reset_senses--;
+      uint8_t status[] = {0xC0 | drive, controller_.cylinder};
+      BIOSDiskSetResult(status, sizeof(status));
+    } else if (controller_.interrupt) {
+      uint8_t status[] = {controller_.status0, controller_.cylinder};
+      controller_.interrupt = false;
+      BIOSDiskSetResult(status, sizeof(status));
+    } else {
+      BIOSDiskSetResult(kInvalid, sizeof(kInvalid));
+    }
+    break;
+  case 0x0F:
+    BIOSDiskSeek(command[1] & 0x03, command[2]);
+    break;
+  case 0x10: { // Version
+    static const uint8_t kVersion[] = {0x90};
+    BIOSDiskSetResult(kVersion, sizeof(kVersion));
+    break;
+  }
+  default:
+    BIOSDiskSetResult(kInvalid, sizeof(kInvalid));
+    break;
+  }
+}
+
+static void BIOSDiskWriteFIFO(uint8_t value) {
+  if (controller_.result_position < controller_.result_size) {
+    return;
+  }
+
+  if (controller_.command_size == 0) {
+    controller_.command_length = BIOSDiskCommandLength(value);
+  }
+  controller_.command[controller_.command_size++] = value;
+
+  if (controller_.command_size == controller_.command_length) {
+    controller_.command_size = 0;
+    controller_.result_size = 0;
+    controller_.result_position = 0;
+    BIOSDiskExecute();
+  }
+}
+
+static void BIOSDiskWriteDigitalOutput(uint8_t value) {
+  // Leaving reset raises the interrupt for every drive
+  if (!(controller_.digital_output & 0x04) && (value & 0x04)) {
+    controller_.reset_senses = FDC_RESET_SENSES;
+    controller_.command_size = 0;
+    controller_.result_size = 0;
+    controller_.result_position = 0;
+  }
+  controller_.digital_output = value;
+}
+
+// 16-bit DMA registers are written low byte first through the flip-flop
+static void BIOSDiskWriteDMA(uint16_t *value, uint8_t byte) {
+  if (dma_.flip_flop) {
+    *value = (*value & 0x00FF) | (byte << 8);
+  } else {
+    *value = (*value & 0xFF00) | byte;
+  }
+  dma_.flip_flop = !dma_.flip_flop;
+}
+
+void x86_outb(uint16_t port, uint8_t value) {
+  switch (port) {
+  case 0x04:
+    BIOSDiskWriteDMA(&dma_.address, value);
+    break;
+  case 0x05:
+    BIOSDiskWriteDMA(&dma_.count, value);
+    break;
+  case 0x0A:
+    if ((value & 0x03) == 2) {
+      dma_.masked = (value & 0x04) != 0;
+    }
+    break;
+  case 0x0B:
+    if ((value & 0x03) == 2) {
+      dma_.mode = value;
+    }
+    break;
+  case 0x0C:
+    dma_.flip_flop = false;
+    break;
+  case 0x81:
+    dma_.page = value;
+    break;
+  }
+
+  if (!controller_present_) {
+    return;
+  }
+
+  switch (port) {
+  case 0x3F2:
+    BIOSDiskWriteDigitalOutput(value);
+    break;
+  case 0x3F5:
+    BIOSDiskWriteFIFO(value);
+    break;
+  case 0x3F7:
+    controller_.data_rate = value & 0x03;
+    break;
+  }
+}
+
+uint8_t x86_inb(uint16_t port) {
+  if (!controller_present_) {
+    return 0xFF;
+  }
+
+  switch (port) {
+  case 0x3F2:
+    return controller_.digital_output;
+  case 0x3F4:
+    // Ready, plus data in and busy while there are result bytes to read
+    return controller_.result_position < controller_.result_size ? 0xD0
+                                                                 : 0x80;
+  case 0x3F5:
+    if (controller_.result_position < controller_.result_size) {
+      return controller_.result[controller_.result_position++];
+    }
+    return 0xFF;
+  default:
+    return 0xFF;
+  }
+}
+
+// The host CPU answers for the one stage2 runs on
+void x86_CPUID(uint32_t leaf, x86_CPUIDResult *result_out) {
+  __cpuid_count(leaf, 0, result_out->eax, result_out->ebx, result_out->ecx,
+                result_out->edx);
+}
+
+// Console output of the driver, normally written to VGA memory
+void stage2_putc(char c) { putchar(c); }
+
+void stage2_puts(const char *str) { fputs(str, stdout); }
+
+void stage2_printf(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+}
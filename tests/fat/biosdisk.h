@@ -0,0 +1,28 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Counters for the int 13h calls made by stage2
+typedef struct {
+  uint32_t batches; // Round trips to real mode
+  uint32_t get_params_calls;
+  uint32_t reset_calls;
+  uint32_t read_calls; // Int 13h reads and controller read commands
+  uint32_t failed_reads;
+  uint32_t sectors_read;
+  uint32_t seeks; // Controller seeks and recalibrates
+} BIOSDiskStats;
+
+bool BIOSDiskOpen(const char *image_path);
+void BIOSDiskClose();
+void BIOSDiskGeometry(uint16_t *cylinders_out, uint16_t *heads_out,
+                      uint16_t *sectors_out);
+BIOSDiskStats BIOSDiskGetStats();
+void BIOSDiskResetStats();
+
+// Whether the floppy controller answers on its ports, stage2 falls back to
+// int 13h without one
+void BIOSDiskSetController(bool present);
+
+// Map the conventional memory stage2 keeps its buffers in at its real address
+bool BIOSMapLowMemory();
@@ -0,0 +1,342 @@
+// Correctness tests and read benchmark for the stage2 FAT driver.
+//
+//   fat_test [-b] [-r] [-n iterations] IMAGE HOST_DIR PATH...
+//
+// Every PATH is opened in IMAGE and compared against HOST_DIR/PATH. Reads go
+// through the floppy controller driver, or through int 13h only with -b. With
+// -r the whole image is loaded first and read from memory. The directory of
+// every PATH is listed as well, and has to show it under its own name. The
+// CRC32C stage2 checks loaded files with is compared against a plain one.
+#define _GNU_SOURCE
+#include "biosdisk.h"
+#include "crc32c.h"
+#include "disk.h"
+#include "fat.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOAD_CHUNK_SIZE 0x10000 // NOLINT, same as MEMORY_LOAD_SIZE
+#define MAX_FILE_HANDLES 10     // NOLINT, same as fat.c
+#define LIST_BATCH_SIZE 3       // NOLINT, small so listings span many calls
+
+static const uint32_t kChunkSizes[] = {1, 7, 32, 511, 512, 513, 4096,
+                                       LOAD_CHUNK_SIZE};
+
+static DISK disk_;
+static int failures_ = 0;
+
+static void Check(bool ok, const char *what, const char *path) {
+  printf("%s %s %s\n", ok ? "PASS" : "FAIL", what, path);
+  if (!ok) {
+    failures_++;
+  }
+}
+
+static uint8_t *ReadHostFile(const char *path, uint32_t *size_out) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  // One spare byte so empty files still get a buffer
+  uint8_t *data = malloc(size + 1);
+  if (data != NULL && fread(data, 1, size, file) != (size_t)size) {
+    free(data);
+    data = NULL;
+  }
+
+  fclose(file);
+  *size_out = size;
+  return data;
+}
+
+// Bit at a time, the way build_scripts/mkchecksum.c does it
+static uint32_t ReferenceCRC32C(const uint8_t *data, uint32_t size) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (uint32_t i = 0; i < size; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
+    }
+  }
+  return ~crc;
+}
+
+static double Now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+// Read the whole file in chunks of chunk_size, the way stage2 loads the kernel
+static bool ReadFile(const char *path, uint32_t chunk_size, uint8_t *data_out,
+                     uint32_t capacity, uint32_t *size_out) {
+  FATFile *file = FATOpen(&disk_, path);
+  if (file == NULL) {
+    return false;
+  }
+
+  uint8_t *chunk = malloc(chunk_size);
+  uint32_t total = 0;
+  uint32_t read;
+  while ((read = FATRead(&disk_, file, chunk_size, chunk)) > 0) {
+    if (total + read > capacity) {
+      break;
+    }
+    memcpy(data_out + total, chunk, read);
+    total += read;
+  }
+
+  free(chunk);
+  FATClose(file);
+  *size_out = total;
+  return true;
+}
+
+static void TestFile(const char *host_dir, const char *path) {
+  char host_path[1024];
+  snprintf(host_path, sizeof(host_path), "%s/%s", host_dir, path);
+
+  uint32_t expected_size;
+  uint8_t *expected = ReadHostFile(host_path, &expected_size);
+  if (expected == NULL) {
+    Check(false, "reference", host_path);
+    return;
+  }
+
+  // Both CRC32C paths, fed in the uneven pieces a chunked load produces
+  uint32_t reference = ReferenceCRC32C(expected, expected_size);
+  for (size_t i = 0; i < sizeof(kChunkSizes) / sizeof(*kChunkSizes); i++) {
+    uint32_t crc = 0;
+    uint32_t table_crc = 0;
+    for (uint32_t done = 0; done < expected_size; done += kChunkSizes[i]) {
+      uint32_t take = expected_size - done < kChunkSizes[i]
+                          ? expected_size - done
+                          : kChunkSizes[i];
+      crc = CRC32CUpdate(crc, expected + done, take);
+      table_crc = CRC32CUpdateTable(table_crc, expected + done, take);
+    }
+
+    char what[64];
+    snprintf(what, sizeof(what), "crc32c/%u", kChunkSizes[i]);
+    Check(crc == reference && table_crc == reference, what, path);
+  }
+
+  uint8_t *actual = malloc(expected_size + 1);
+  for (size_t i = 0; i < sizeof(kChunkSizes) / sizeof(*kChunkSizes); i++) {
+    char what[64];
+    snprintf(what, sizeof(what), "read/%u", kChunkSizes[i]);
+
+    uint32_t size;
+    memset(actual, 0, expected_size + 1);
+    bool ok = ReadFile(path, kChunkSizes[i], actual, expected_size + 1, &size);
+    Check(ok && size == expected_size &&
+              memcmp(actual, expected, expected_size) == 0,
+          what, path);
+  }
+
+  free(actual);
+  free(expected);
+
+  // A regular file cannot be used as a directory
+  char child[1024];
+  snprintf(child, sizeof(child), "%s/child.txt", path);
+  FATFile *file = FATOpen(&disk_, child);
+  Check(file == NULL, "not-a-directory", path);
+  if (file != NULL) {
+    FATClose(file);
+  }
+}
+
+static void TestListing(const char *host_dir, const char *path) {
+  char host_path[1024];
+  snprintf(host_path, sizeof(host_path), "%s/%s", host_dir, path);
+  uint32_t expected_size = 0;
+  free(ReadHostFile(host_path, &expected_size));
+
+  // Everything up to the last slash is the directory, the root otherwise
+  const char *slash = strrchr(path, '/');
+  const char *name = slash != NULL ? slash + 1 : path;
+  char directory[1024] = "/";
+  snprintf(directory + 1, sizeof(directory) - 1, "%.*s", (int)(name - path),
+           path);
+
+  FATFile *file = FATOpen(&disk_, directory);
+  if (file == NULL) {
+    Check(false, "list", path);
+    return;
+  }
+
+  FATEntry entries[LIST_BATCH_SIZE];
+  int found = 0;
+  int count;
+  while ((count = FATReadDir(&disk_, file, entries, LIST_BATCH_SIZE)) > 0) {
+    for (int i = 0; i < count; i++) {
+      if (strcasecmp(entries[i].name, name) == 0 &&
+          (entries[i].attributes & kFatAttributeDirectory) == 0 &&
+          entries[i].size == expected_size) {
+        found++;
+      }
+    }
+  }
+  FATClose(file);
+
+  // Names are found case-insensitively, but listed as they were written
+  Check(count == 0 && found == 1, "list", path);
+  char *upper = strdup(path);
+  for (char *c = upper; *c != '\0'; c++) {
+    *c = toupper(*c);
+  }
+  file = FATOpen(&disk_, upper);
+  Check(file != NULL, "open-case", path);
+  if (file != NULL) {
+    FATClose(file);
+  }
+  free(upper);
+}
+
+static void TestMissing() {
+  static const char *const kMissing[] = {"/missing.txt", "/missing",
+                                         "/missing/file.txt"};
+  for (size_t i = 0; i < sizeof(kMissing) / sizeof(*kMissing); i++) {
+    FATFile *file = FATOpen(&disk_, kMissing[i]);
+    Check(file == NULL, "missing", kMissing[i]);
+    if (file != NULL) {
+      FATClose(file);
+    }
+  }
+}
+
+static void TestHandles(const char *path) {
+  // Handles have to be given back by FATClose
+  bool ok = true;
+  for (int i = 0; i < MAX_FILE_HANDLES * 2 && ok; i++) {
+    FATFile *file = FATOpen(&disk_, path);
+    ok = file != NULL;
+    if (ok) {
+      FATClose(file);
+    }
+  }
+  Check(ok, "handles", path);
+}
+
+static void PrintStats(const char *what, BIOSDiskStats stats, uint32_t bytes,
+                       double seconds, int iterations) {
+  printf("%-24s %8u bytes %6u sectors %5u reads %4u seeks %3u resets %5u "
+         "batches",
+         what, bytes, stats.sectors_read / iterations,
+         stats.read_calls / iterations, stats.seeks / iterations,
+         stats.reset_calls / iterations, stats.batches / iterations);
+  if (seconds > 0) {
+    printf(" %9.1f us %8.1f MiB/s", seconds * 1e6 / iterations,
+           (double)bytes * iterations / seconds / (1024 * 1024));
+  }
+  if (stats.failed_reads > 0) {
+    printf(" %u failed reads", stats.failed_reads);
+  }
+  printf("\n");
+}
+
+static void Benchmark(const char *path, uint32_t size, int iterations) {
+  uint8_t *data = malloc(size + 1);
+  uint32_t read = 0;
+
+  BIOSDiskResetStats();
+  double start = Now();
+  for (int i = 0; i < iterations; i++) {
+    ReadFile(path, LOAD_CHUNK_SIZE, data, size + 1, &read);
+  }
+  double seconds = Now() - start;
+
+  PrintStats(path, BIOSDiskGetStats(), read, seconds, iterations);
+  free(data);
+}
+
+int main(int argc, char **argv) {
+  int iterations = 100;
+  bool ramdisk = false;
+  int option;
+  while ((option = getopt(argc, argv, "brn:")) != -1) {
+    if (option == 'b') {
+      BIOSDiskSetController(false);
+    } else if (option == 'r') {
+      ramdisk = true;
+    } else if (option == 'n') {
+      iterations = atoi(optarg) > 0 ? atoi(optarg) : 1;
+    } else {
+      return 2;
+    }
+  }
+
+  if (argc - optind < 2) {
+    fprintf(stderr,
+            "usage: %s [-b] [-r] [-n iterations] IMAGE HOST_DIR PATH...\n",
+            argv[0]);
+    return 2;
+  }
+
+  CRC32CInitialize();
+  const char *image = argv[optind];
+  const char *host_dir = argv[optind + 1];
+  if (!BIOSMapLowMemory() || !BIOSDiskOpen(image)) {
+    return 2;
+  }
+
+  uint16_t cylinders, heads, sectors;
+  BIOSDiskGeometry(&cylinders, &heads, &sectors);
+  printf("image %s (C/H/S %u/%u/%u)\n", image, cylinders, heads, sectors);
+
+  bool initialized = DISKInitialize(&disk_, 0);
+  uint8_t *image_copy = NULL;
+  if (initialized && ramdisk) {
+    uint32_t size = DISKSize(&disk_);
+    image_copy = malloc(size);
+    initialized = DISKLoadImage(&disk_, image_copy, size);
+    PrintStats("load image", BIOSDiskGetStats(), size, 0, 1);
+    BIOSDiskResetStats();
+  }
+  initialized = initialized && FATInitialize(&disk_);
+  Check(initialized, "initialize", image);
+  if (!initialized) {
+    return 1;
+  }
+  printf("reads through %s\n", disk_.image != NULL ? "memory"
+                                : disk_.fdc      ? "floppy controller"
+                                                 : "int 13h");
+  PrintStats("initialize", BIOSDiskGetStats(), 0, 0, 1);
+
+  // Correctness
+  for (int i = optind + 2; i < argc; i++) {
+    TestFile(host_dir, argv[i]);
+    TestListing(host_dir, argv[i]);
+  }
+  TestMissing();
+  if (optind + 2 < argc) {
+    TestHandles(argv[optind + 2]);
+  }
+
+  // Benchmark, numbers are per open and full read
+  printf("benchmark (%d iterations, %u byte chunks)\n", iterations,
+         LOAD_CHUNK_SIZE);
+  for (int i = optind + 2; i < argc; i++) {
+    char host_path[1024];
+    uint32_t size = 0;
+    snprintf(host_path, sizeof(host_path), "%s/%s", host_dir, argv[i]);
+    free(ReadHostFile(host_path, &size));
+    Benchmark(argv[i], size, iterations);
+  }
+
+  BIOSDiskClose();
+  free(image_copy);
+  printf("%s: %d failure(s)\n", image, failures_);
+  return failures_ == 0 ? 0 : 1;
+}
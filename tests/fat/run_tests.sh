@@ -0,0 +1,92 @@
+#!/bin/sh
+# Build FAT12 images with mkfs.fat/mtools and run fat_test against them.
+# Usage: run_tests.sh BUILD_DIR [fat_test options]
+set -e
+
+BUILD_DIR=$1
+shift
+WORK_DIR=$BUILD_DIR/tests/fat/images
+FILES_DIR=$WORK_DIR/files
+FAT_TEST=$BUILD_DIR/tests/fat_test
+ROOT_DIR=$(dirname "$0")/../..
+
+rm -rf "$WORK_DIR"
+mkdir -p "$FILES_DIR/mydir/sub" "$FILES_DIR/Long-Directory-Name"
+
+# Reference files, sized around sector and cluster boundaries
+cp "$ROOT_DIR/test.txt" "$FILES_DIR/test.txt"
+: > "$FILES_DIR/empty.txt"
+head -c 512 /dev/urandom > "$FILES_DIR/sector.bin"
+head -c 1000 /dev/urandom > "$FILES_DIR/odd.bin"
+head -c 2048 /dev/urandom > "$FILES_DIR/cluster.bin"
+head -c 4000 /dev/urandom > "$FILES_DIR/gap.bin"
+head -c 96000 /dev/urandom > "$FILES_DIR/frag.bin"
+head -c 307200 /dev/urandom > "$FILES_DIR/kernel.bin"
+head -c 700 /dev/urandom > "$FILES_DIR/README"
+cp "$ROOT_DIR/test.txt" "$FILES_DIR/mydir/test.txt"
+head -c 5000 /dev/urandom > "$FILES_DIR/mydir/sub/deep.bin"
+
+# Long names, some spread over several LFN entries
+head -c 1500 /dev/urandom > "$FILES_DIR/a-long-file-name-in-three-entries.data"
+cp "$ROOT_DIR/test.txt" "$FILES_DIR/MixedCase.Txt"
+head -c 800 /dev/urandom > "$FILES_DIR/Long-Directory-Name/inner-file.bin"
+
+FILES="test.txt empty.txt sector.bin odd.bin cluster.bin frag.bin kernel.bin
+       README mydir/test.txt mydir/sub/deep.bin
+       a-long-file-name-in-three-entries.data MixedCase.Txt
+       Long-Directory-Name/inner-file.bin"
+
+# Enough entries to spill the root directory over several sectors
+i=0
+while [ $i -lt 40 ]; do
+    echo "file $i" > "$FILES_DIR/f$i.txt"
+    i=$((i + 1))
+done
+FILES="$FILES f39.txt"
+
+make_image() {
+    image=$1
+    sectors=$2
+    shift 2
+
+    dd if=/dev/zero of="$image" bs=512 count="$sectors" 2> /dev/null
+    mkfs.fat -F 12 -n "PICO" "$@" "$image" > /dev/null
+    for file in test.txt empty.txt sector.bin odd.bin cluster.bin; do
+        mcopy -i "$image" "$FILES_DIR/$file" "::$file"
+    done
+
+    # Free a hole in the middle of the data area so frag.bin is split
+    mcopy -i "$image" "$FILES_DIR/gap.bin" "::gap.bin"
+    mcopy -i "$image" "$FILES_DIR/kernel.bin" "::kernel.bin"
+    mdel -i "$image" "::gap.bin"
+    mcopy -i "$image" "$FILES_DIR/frag.bin" "::frag.bin"
+
+    mcopy -i "$image" "$FILES_DIR/README" "::README"
+    mmd -i "$image" "::mydir"
+    mmd -i "$image" "::mydir/sub"
+    mcopy -i "$image" "$FILES_DIR/mydir/test.txt" "::mydir/test.txt"
+    mcopy -i "$image" "$FILES_DIR/mydir/sub/deep.bin" "::mydir/sub/deep.bin"
+    mcopy -i "$image" \
+        "$FILES_DIR/a-long-file-name-in-three-entries.data" \
+        "$FILES_DIR/MixedCase.Txt" ::
+    mmd -i "$image" "::Long-Directory-Name"
+    mcopy -i "$image" "$FILES_DIR/Long-Directory-Name/inner-file.bin" \
+        "::Long-Directory-Name/inner-file.bin"
+    for file in "$FILES_DIR"/f*.txt; do
+        mcopy -i "$image" "$file" "::$(basename "$file")"
+    done
+}
+
+make_image "$WORK_DIR/floppy144.img" 2880
+make_image "$WORK_DIR/floppy288.img" 5760 -s 4
+
+status=0
+for image in "$WORK_DIR/floppy144.img" "$WORK_DIR/floppy288.img"; do
+    # Floppy controller driver, the int 13h fallback and the RAM disk
+    for mode in "" -b -r; do
+        # shellcheck disable=SC2086
+        "$FAT_TEST" $mode "$@" "$image" "$FILES_DIR" $FILES || status=1
+    done
+done
+
+exit $status